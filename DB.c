@@ -18,7 +18,10 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <limits.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #include "DB.h"
 
@@ -1183,7 +1186,9 @@ void Print_Read(char *s, int width)
 //   supplied it and so should free it).
 
 void Close_DB(DAZZ_DB *db)
-{ if (db->loaded)
+{ if (db->loaded == 2)
+    munmap(((char *) (db->bases)) - 1,db->reads[db->nreads].boff + 4);
+  else if (db->loaded)
     free(((char *) (db->bases)) - 1);
   else if (db->bases != NULL)
     fclose((FILE *) db->bases);
@@ -1435,6 +1440,397 @@ int Load_All_Reads(DAZZ_DB *db, int ascii)
   return (0);
 }
 
+//  A .ubs sidecar holds the block of reads exactly as laid out by Load_All_Reads with ascii
+//    = 0 (a leading 4, each read followed by a 4, and then 3 bytes of slack), followed by a
+//    trailer that identifies the reads it holds.
+
+typedef struct
+  { char   magic[8];   //  "DAZZUBS1"
+    int64  nreads;     //  # of reads in the block
+    int64  size;       //  # of bytes in the block
+    int64  bsize;      //  Size and modification time of the .bps file
+    int64  btime;
+    uint64 sig;        //  Hash of the .bps offset and length of each read
+  } Ubs_Trailer;
+
+int Map_All_Reads(DAZZ_DB *db)
+{ DAZZ_READ  *reads  = db->reads;
+  int         nreads = db->nreads;
+  Ubs_Trailer trail, ftrail;
+  struct stat info;
+  char       *name, *temp, *seq;
+  char        host[256];
+  int64       o;
+  int         i, fd, ok;
+  FILE       *out;
+
+  if (db->loaded)
+    return (0);
+
+  //  The trailer the sidecar must have
+
+  memcpy(trail.magic,"DAZZUBS1",8);
+  trail.nreads = nreads;
+  trail.sig    = 0xcbf29ce484222325ull;
+  o = 0;
+  for (i = 0; i < nreads; i++)
+    { trail.sig = (trail.sig ^ (uint64) reads[i].boff) * 0x100000001b3ull;
+      trail.sig = (trail.sig ^ (uint64) reads[i].rlen) * 0x100000001b3ull;
+      o += reads[i].rlen + 1;
+    }
+  trail.size = o + 4;
+  if (fstat(fileno((FILE *) db->bases),&info) < 0)
+    return (Load_All_Reads(db,0));
+  trail.bsize = info.st_size;
+  trail.btime = info.st_mtime;
+
+  if (db->part > 0)
+    name = Numbered_Suffix(Catenate(db->path,".","",""),db->part,".ubs");
+  else
+    name = Catenate(db->path,"","",".ubs");
+  name = Strdup(name,"Allocating sidecar name");
+  if (name == NULL)
+    EXIT(1);
+
+  //  If the sidecar is for these reads then map it
+
+  fd = open(name,O_RDONLY);
+  if (fd >= 0)
+    { seq = NULL;
+      if (fstat(fd,&info) == 0 && info.st_size == trail.size + (int64) sizeof(Ubs_Trailer)
+                               && pread(fd,&ftrail,sizeof(Ubs_Trailer),trail.size)
+                                       == sizeof(Ubs_Trailer)
+                               && memcmp(&ftrail,&trail,sizeof(Ubs_Trailer)) == 0)
+        { seq = (char *) mmap(NULL,trail.size,PROT_READ,MAP_SHARED,fd,0);
+          if (seq == MAP_FAILED)
+            seq = NULL;
+        }
+      close(fd);
+
+      if (seq != NULL)
+        { o = 0;
+          for (i = 0; i < nreads; i++)
+            { reads[i].boff = o;
+              o += reads[i].rlen + 1;
+            }
+          reads[nreads].boff = o;
+
+          fclose((FILE *) db->bases);
+
+          db->bases  = (void *) (seq+1);
+          db->loaded = 2;
+
+          free(name);
+          return (0);
+        }
+    }
+
+  //  Otherwise load the reads and write them to a temporary file that is then renamed to
+  //    the sidecar, so that a concurrent job never maps a partial one
+
+  if (Load_All_Reads(db,0))
+    { free(name);
+      return (1);
+    }
+
+  if (gethostname(host,sizeof(host)) != 0)
+    strcpy(host,"host");
+  host[sizeof(host)-1] = '\0';
+  temp = Strdup(Numbered_Suffix(Catenate(name,".",host,"."),getpid(),""),
+                "Allocating sidecar name");
+  if (temp == NULL)
+    { free(name);
+      return (0);
+    }
+
+  out = fopen(temp,"w");
+  if (out != NULL)
+    { seq = ((char *) db->bases) - 1;
+      memset(seq+(o+1),0,3);
+      ok = (fwrite(seq,trail.size,1,out) == 1);
+      ok = (fwrite(&trail,sizeof(Ubs_Trailer),1,out) == 1 && ok);
+      ok = (fclose(out) == 0 && ok);
+      if ( ! ok || rename(temp,name) != 0)
+        unlink(temp);
+    }
+
+  free(temp);
+  free(name);
+  return (0);
+}
+
+
+/*******************************************************************************************
+ *
+ *  READ CACHE NEW, LOAD, STATS, & FREE
+ *
+ ********************************************************************************************/
+
+  //  Each cached read is an entry followed by the rlen bytes of the read (without delimiters).
+  //    The entries are in a hash table of chains, and in a list from most to least recently
+  //    used.  All access is under the cache's lock, save that a read that is not in the
+  //    cache is loaded from its DB outside of it.
+
+typedef struct _Cache_Entry
+  { struct _Cache_Entry *link;          //  Next entry in the same hash chain
+    struct _Cache_Entry *prev, *next;   //  Neighbors in the LRU list
+    DAZZ_READ           *reads;         //  Key: DB (as its reads array), read index, ascii mode
+    int                  read;
+    int                  ascii;
+    int                  rlen;
+  } Cache_Entry;
+
+#define CACHE_SEQ(e)  ((char *) ((e)+1))
+
+#define CACHE_BUCKETS  1024   //  Initial # of hash chains (doubled whenever there are as
+                              //    many entries)
+typedef struct
+  { pthread_mutex_t lock;
+    int64           max;              //  Capacity in bytes
+    int64           bytes;            //  Bytes held by the entries
+    int64           nreads;           //  # of entries
+    int64           nbuck;            //  # of hash chains (a power of 2)
+    Cache_Entry   **table;
+    Cache_Entry    *first, *last;     //  Most and least recently used entries
+    int64           hits, misses, evicted;
+  } _Read_Cache;
+
+static inline int64 cache_hash(DAZZ_READ *reads, int i, int ascii, int64 nbuck)
+{ uint64 h;
+
+  h = ((((uint64) i) << 2) | ascii) ^ (((uint64) (size_t) reads) >> 4) * 0xff51afd7ed558ccdull;
+  h *= 0x9e3779b97f4a7c15ull;
+  return ((h >> 24) & (nbuck-1));
+}
+
+static Cache_Entry *cache_find(_Read_Cache *cache, DAZZ_READ *reads, int i, int ascii)
+{ Cache_Entry *e;
+
+  e = cache->table[cache_hash(reads,i,ascii,cache->nbuck)];
+  while (e != NULL && (e->read != i || e->reads != reads || e->ascii != ascii))
+    e = e->link;
+  return (e);
+}
+
+static void cache_unlist(_Read_Cache *cache, Cache_Entry *e)
+{ if (e->prev == NULL)
+    cache->first = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next == NULL)
+    cache->last = e->prev;
+  else
+    e->next->prev = e->prev;
+}
+
+static void cache_list(_Read_Cache *cache, Cache_Entry *e)
+{ e->prev = NULL;
+  e->next = cache->first;
+  if (cache->first == NULL)
+    cache->last = e;
+  else
+    cache->first->prev = e;
+  cache->first = e;
+}
+
+  //  Remove the least recently used entry
+
+static void cache_evict(_Read_Cache *cache)
+{ Cache_Entry *e, **p;
+
+  e = cache->last;
+  p = cache->table + cache_hash(e->reads,e->read,e->ascii,cache->nbuck);
+  while (*p != e)
+    p = &((*p)->link);
+  *p = e->link;
+  cache_unlist(cache,e);
+
+  cache->bytes   -= sizeof(Cache_Entry) + e->rlen;
+  cache->nreads  -= 1;
+  cache->evicted += 1;
+  free(e);
+}
+
+  //  Double the number of hash chains (or leave the table as is if out of memory)
+
+static void cache_grow(_Read_Cache *cache)
+{ Cache_Entry **table, *e;
+  int64         nbuck, h;
+
+  nbuck = 2*cache->nbuck;
+  table = (Cache_Entry **) calloc(nbuck,sizeof(Cache_Entry *));
+  if (table == NULL)
+    return;
+  for (e = cache->first; e != NULL; e = e->next)
+    { h = cache_hash(e->reads,e->read,e->ascii,nbuck);
+      e->link  = table[h];
+      table[h] = e;
+    }
+  free(cache->table);
+  cache->table = table;
+  cache->nbuck = nbuck;
+}
+
+  //  If read i of db is in the cache, then copy its interval [beg,end] into read, delimited
+  //    as per its ascii mode, and return 1.  Otherwise return 0.
+
+static int cache_fetch(_Read_Cache *cache, DAZZ_DB *db, int i, int beg, int end,
+                       char *read, int ascii)
+{ Cache_Entry *e;
+
+  pthread_mutex_lock(&(cache->lock));
+  e = cache_find(cache,db->reads,i,ascii);
+  if (e == NULL)
+    { cache->misses += 1;
+      pthread_mutex_unlock(&(cache->lock));
+      return (0);
+    }
+  if (e != cache->first)
+    { cache_unlist(cache,e);
+      cache_list(cache,e);
+    }
+  memcpy(read,CACHE_SEQ(e)+beg,end-beg);
+  cache->hits += 1;
+  pthread_mutex_unlock(&(cache->lock));
+
+  if (ascii == 0)
+    read[-1] = read[end-beg] = 4;
+  else
+    read[-1] = read[end-beg] = '\0';
+  return (1);
+}
+
+  //  Add the whole read i of db just loaded into read to the cache, unless it is larger
+  //    than the cache, it is already there (put there by another thread), or there is no
+  //    memory for it.
+
+static void cache_add(_Read_Cache *cache, DAZZ_DB *db, int i, char *read, int ascii)
+{ Cache_Entry *e;
+  int64        size, h;
+  int          rlen;
+
+  rlen = db->reads[i].rlen;
+  size = sizeof(Cache_Entry) + rlen;
+  if (size > cache->max)
+    return;
+
+  e = (Cache_Entry *) malloc(size);
+  if (e == NULL)
+    return;
+  e->reads = db->reads;
+  e->read  = i;
+  e->ascii = ascii;
+  e->rlen  = rlen;
+  memcpy(CACHE_SEQ(e),read,rlen);
+
+  pthread_mutex_lock(&(cache->lock));
+  if (cache_find(cache,db->reads,i,ascii) != NULL)
+    { pthread_mutex_unlock(&(cache->lock));
+      free(e);
+      return;
+    }
+  while (cache->bytes + size > cache->max)
+    cache_evict(cache);
+  if (cache->nreads >= cache->nbuck)
+    cache_grow(cache);
+
+  h = cache_hash(e->reads,i,ascii,cache->nbuck);
+  e->link = cache->table[h];
+  cache->table[h] = e;
+  cache_list(cache,e);
+  cache->bytes  += size;
+  cache->nreads += 1;
+  pthread_mutex_unlock(&(cache->lock));
+}
+
+DAZZ_CACHE *New_Read_Cache(int64 mbytes)
+{ _Read_Cache *cache;
+
+  cache = (_Read_Cache *) Malloc(sizeof(_Read_Cache),"Allocating read cache");
+  if (cache == NULL)
+    EXIT(NULL);
+  cache->table = (Cache_Entry **) Malloc(CACHE_BUCKETS*sizeof(Cache_Entry *),
+                                         "Allocating read cache");
+  if (cache->table == NULL)
+    { free(cache);
+      EXIT(NULL);
+    }
+  memset(cache->table,0,CACHE_BUCKETS*sizeof(Cache_Entry *));
+  pthread_mutex_init(&(cache->lock),NULL);
+
+  cache->max     = mbytes * 0x100000ll;
+  cache->bytes   = 0;
+  cache->nreads  = 0;
+  cache->nbuck   = CACHE_BUCKETS;
+  cache->first   = NULL;
+  cache->last    = NULL;
+  cache->hits    = 0;
+  cache->misses  = 0;
+  cache->evicted = 0;
+  return ((DAZZ_CACHE *) cache);
+}
+
+int Cache_Read(DAZZ_CACHE *ecache, DAZZ_DB *db, int i, char *read, int ascii)
+{ _Read_Cache *cache = (_Read_Cache *) ecache;
+
+  if (cache == NULL || db->loaded || i < 0 || i >= db->nreads)
+    return (Load_Read(db,i,read,ascii));
+
+  if (ascii != 1 && ascii != 2)
+    ascii = 0;
+  if (cache_fetch(cache,db,i,0,db->reads[i].rlen,read,ascii))
+    return (0);
+  if (Load_Read(db,i,read,ascii))
+    return (1);
+  cache_add(cache,db,i,read,ascii);
+  return (0);
+}
+
+char *Cache_Subread(DAZZ_CACHE *ecache, DAZZ_DB *db, int i, int beg, int end, char *read,
+                    int ascii)
+{ _Read_Cache *cache = (_Read_Cache *) ecache;
+
+  if (cache == NULL || db->loaded || i < 0 || i >= db->nreads)
+    return (Load_Subread(db,i,beg,end,read,ascii));
+
+  if (ascii != 1 && ascii != 2)
+    ascii = 0;
+  if (cache_fetch(cache,db,i,beg,end,read,ascii))
+    return (read);
+  if (Load_Read(db,i,read,ascii))
+    return (NULL);
+  cache_add(cache,db,i,read,ascii);
+  if (beg > 0)
+    memmove(read,read+beg,end-beg);
+  read[end-beg] = read[-1];
+  return (read);
+}
+
+void Read_Cache_Stats(DAZZ_CACHE *ecache, DAZZ_CACHE_STATS *stats)
+{ _Read_Cache *cache = (_Read_Cache *) ecache;
+
+  pthread_mutex_lock(&(cache->lock));
+  stats->hits    = cache->hits;
+  stats->misses  = cache->misses;
+  stats->evicted = cache->evicted;
+  stats->nreads  = cache->nreads;
+  stats->bytes   = cache->bytes;
+  pthread_mutex_unlock(&(cache->lock));
+}
+
+void Free_Read_Cache(DAZZ_CACHE *ecache)
+{ _Read_Cache *cache = (_Read_Cache *) ecache;
+  Cache_Entry *e, *n;
+
+  for (e = cache->first; e != NULL; e = n)
+    { n = e->next;
+      free(e);
+    }
+  free(cache->table);
+  pthread_mutex_destroy(&(cache->lock));
+  free(cache);
+}
+
 
 /*******************************************************************************************
  *
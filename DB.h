@@ -553,6 +553,62 @@ char *Load_Subread(DAZZ_DB *db, int i, int beg, int end, char *read, int ascii);
 
 int Load_All_Reads(DAZZ_DB *db, int ascii);
 
+  // Exactly the same as Load_All_Reads with ascii = 0, save that the block of uncompressed
+  //   reads is mapped read-only from a sidecar file, .<db>[.<part>].ubs, beside the .bps file.
+  //   If the sidecar does not exist or is not for the current reads (say the DB has been
+  //   split again), then the reads are loaded with Load_All_Reads and the sidecar is
+  //   (re)made for the next call, a failure to write it being silently ignored.  Concurrent
+  //   jobs on a node thus share one copy of the block in the page cache.  Close_DB unmaps it.
+
+int Map_All_Reads(DAZZ_DB *db);
+
+
+/*******************************************************************************************
+ *
+ *  READ CACHE ROUTINES
+ *
+ ********************************************************************************************/
+
+  // A read cache keeps up to a given number of megabytes of the most recently loaded reads,
+  //   uncompressed, so that a read that is loaded again is simply copied out of memory.  A
+  //   read is keyed by its DB, its index, and the ascii mode in which it was loaded.  Copies
+  //   of a DB, say one per thread each with its own open .bps file, are the same DB for the
+  //   cache so long as they share the same reads array.  A cache can be used by any number
+  //   of threads at once, and when full, the least recently used reads are evicted.
+
+typedef void DAZZ_CACHE;
+
+typedef struct
+  { int64 hits;       //  # of loads satisfied by the cache
+    int64 misses;     //  # of loads that went to the DB
+    int64 evicted;    //  # of reads evicted to make room
+    int64 nreads;     //  # of reads currently in the cache
+    int64 bytes;      //  Bytes currently held by the reads in the cache
+  } DAZZ_CACHE_STATS;
+
+  // Allocate a cache of 'mbytes' megabytes.  If cannot allocate memory then return NULL
+  //   if INTERACTIVE is defined, or print error to stderr and exit otherwise.
+
+DAZZ_CACHE *New_Read_Cache(int64 mbytes);
+
+  // Exactly the same as Load_Read and Load_Subread, save that the read is taken from 'cache'
+  //   if it is there, and is added to it otherwise.  Cache_Subread always returns 'read',
+  //   which must be big enough for the entire read (e.g. a buffer from New_Read_Buffer).
+  //   If 'cache' is NULL or the reads of 'db' have been loaded with Load_All_Reads then
+  //   these simply call Load_Read and Load_Subread, respectively.
+
+int   Cache_Read(DAZZ_CACHE *cache, DAZZ_DB *db, int i, char *read, int ascii);
+char *Cache_Subread(DAZZ_CACHE *cache, DAZZ_DB *db, int i, int beg, int end, char *read,
+                    int ascii);
+
+  // Return the hit and miss counts and the current contents of 'cache' in 'stats'.
+
+void Read_Cache_Stats(DAZZ_CACHE *cache, DAZZ_CACHE_STATS *stats);
+
+  // Free all the space associated with 'cache'.
+
+void Free_Read_Cache(DAZZ_CACHE *cache);
+
 
 /*******************************************************************************************
  *
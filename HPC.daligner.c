@@ -24,7 +24,7 @@
 #undef  SLURM  //  define if want a directly executable SLURM script
 
 static char *Usage[] =
-  { "[-vad] [-l<int(1500)>] [-s<int(100)] [-w<int(6)>] [-t<int>] [-M<int>]",
+  { "[-vadu] [-l<int(1500)>] [-s<int(100)] [-w<int(6)>] [-t<int>] [-M<int>] [-b<int>]",
     "       [-P<dir(/tmp)>] [-B<int(4)>] [-T<int(4)>] [-f<name>]",
     "     ( [-k<int(16)>] [-%<int(28)>] [-h<int(50)>] [-e<double(.75)>] [-H<int>]",
     "       [-k<int(20)>] [-%<int(50)>] [-h<int(70)>] [-e<double(.85)>] <ref:db|dam> )",
@@ -34,8 +34,8 @@ static char *Usage[] =
   //  Command Options
 
 static int    BUNIT;
-static int    VON, CON, DON;
-static int    WINT, TINT, HGAP, HINT, KINT, SINT, PINT, LINT, MINT;
+static int    VON, CON, DON, UON;
+static int    WINT, TINT, HGAP, HINT, KINT, SINT, PINT, LINT, MINT, BINT;
 static int    NTHREADS;
 static double EREL;
 static int    MMAX, MTOP;
@@ -249,6 +249,8 @@ void daligner_script(int argc, char *argv[])
               fprintf(out," -v");
             if (CON)
               fprintf(out," -a");
+            if (UON)
+              fprintf(out," -u");
             if (KINT != 16)
               fprintf(out," -k%d",KINT);
             if (PINT != 28)
@@ -269,6 +271,8 @@ void daligner_script(int argc, char *argv[])
               fprintf(out," -s%d",SINT);
             if (MINT >= 0)
               fprintf(out," -M%d",MINT);
+            if (BINT > 0)
+              fprintf(out," -b%d",BINT);
             if (PDIR != NULL)
               fprintf(out," -P%s",PDIR);
             if (NTHREADS != 4)
@@ -768,6 +772,8 @@ void mapper_script(int argc, char *argv[])
               fprintf(out," -v");
             if (CON)
               fprintf(out," -a");
+            if (UON)
+              fprintf(out," -u");
             if (KINT != 20)
               fprintf(out," -k%d",KINT);
             if (PINT != 50)
@@ -790,6 +796,8 @@ void mapper_script(int argc, char *argv[])
               fprintf(out," -T%d",NTHREADS);
             if (MINT >= 0)
               fprintf(out," -M%d",MINT);
+            if (BINT > 0)
+              fprintf(out," -b%d",BINT);
             if (PDIR != NULL)
               fprintf(out," -P%s",PDIR);
             for (k = 0; k < MTOP; k++)
@@ -994,6 +1002,7 @@ int main(int argc, char *argv[])
   LINT  = 1500;
   SINT  = 100;
   MINT  = -1;
+  BINT  = 0;
   PINT  = -1;
   PDIR  = NULL;
 
@@ -1011,7 +1020,7 @@ int main(int argc, char *argv[])
     if (argv[i][0] == '-')
       switch (argv[i][1])
       { default:
-          ARG_FLAGS("vadAI");
+          ARG_FLAGS("vadAIu");
           break;
         case 'e':
           ARG_REAL(EREL)
@@ -1033,6 +1042,9 @@ int main(int argc, char *argv[])
               exit (1);
             }
           break;
+        case 'b':
+          ARG_POSITIVE(BINT,"Alignment work budget (in millions of cells)")
+          break;
         case 'l':
           ARG_POSITIVE(LINT,"Minimum ovlerap length")
           break;
@@ -1080,6 +1092,7 @@ int main(int argc, char *argv[])
   VON = flags['v'];
   CON = flags['a'];
   DON = flags['d'];
+  UON = flags['u'];
 
   if (argc < 2 || argc > 4)
     { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
@@ -1101,6 +1114,7 @@ int main(int argc, char *argv[])
       fprintf(stderr,"      -l: Look for alignments of length >= -l.\n");
       fprintf(stderr,"      -s: Use -s as the trace point spacing for encoding alignments.\n");
       fprintf(stderr,"      -H: HGAP option: align only target reads of length >= -H.\n");
+      fprintf(stderr,"      -b: Cut short any one alignment search after -b million d.p. cells.\n");
       fprintf(stderr,"\n");
       fprintf(stderr,"      -T: Use -T threads.\n");
       fprintf(stderr,"      -P: Do first level sort and merge in directory -P.\n");
@@ -1110,6 +1124,7 @@ int main(int argc, char *argv[])
       fprintf(stderr,"      -v: Run all commands in script in verbose mode.\n");
       fprintf(stderr,"      -a: Instruct LAsort & LAmerge to sort only on (a,ab).\n");
       fprintf(stderr,"      -d: Put .las files for each target block in a sub-directory\n");
+      fprintf(stderr,"      -u: Instruct daligner to map blocks from uncompressed sidecars.\n");
       fprintf(stderr,"      -B: # of block compares per daligner job\n");
       fprintf(stderr,"      -f: Place script bundles in separate files with prefix <name>\n");
       exit (1);
@@ -1,104 +1,204 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "DB.h"
 #include "align.h"
+#include "dump.h"
 
-int main(int argc, char *argv[])
-{ char    code, which;
-  int64   total;
-  int     aread, bread;
-  char    orient, chain;
-  int     alen, blen;
-  int     ab, ae, bb, be;
-  int     diffs;
-  int     len;
-  int     tspace, small;
-  uint8  *tbuffer = NULL;
-  uint16 *sbuffer = NULL;
-
-  (void) argv;
+#define HEAD_SIZE 0x100000   //  Bytes read to parse the header lines from
 
-  //  Process arguments
+static int HasTrace;   //  There is an @ T-line
+static int Small;      //  Trace values are bytes
 
-  if (argc > 1)
-    { fprintf(stderr,"Usage: LAa2b <(ascii) >(binary)\n");
-      exit (1);
-    }
+typedef struct
+  { int error;         //  A T-line was met without an @ T-line
+  } A2B_Info;
 
-  while (scanf(" %c",&code) == 1)       //  Header lines
-    if (code == '@' || code == '+' || code == '%')
-      { scanf(" %c %lld",&which,&total);
-        fwrite(&code,sizeof(char),1,stdout);
-        fwrite(&which,sizeof(char),1,stdout);
-        fwrite(&total,sizeof(int64),1,stdout);
-        if (code == '@')
-          { tbuffer = (uint8 *) malloc(2*total*sizeof(uint16));
-            sbuffer = (uint16 *) tbuffer;
-          }
-      }
-    else
-      { ungetc(code,stdin);
-        break;
-      }
-  small = 0;
-  if (tbuffer != NULL)
-    { if (code != 'X')
-        { fprintf(stderr,"LAa2b: .las dump has traces but no X-line\n");
-          exit (1);
-        }
-      scanf(" X %d",&tspace);
-      small = (tspace <= TRACE_XOVR && tspace != 0);
-      fwrite(&code,sizeof(char),1,stdout);
-      fwrite(&tspace,sizeof(int),1,stdout);
-    }
+#define PUT(o,v)  { memcpy(o,&(v),sizeof(v)); o += sizeof(v); }
+
+  //  Convert the lines of block b, stopping at a T-line should there be no @ T-line
+
+static void a2b_task(Dump_Block *b, void *arg)
+{ A2B_Info *info = (A2B_Info *) b->info;
+  char     *p, *end, *o;
+  int       code, i;
+  int64     x;
+  int       v[4];
+  char      c[2];
 
-  while (scanf(" %c",&code) == 1)       //  For each data line do
-    { fwrite(&code,sizeof(char),1,stdout);
+  (void) arg;
+
+  p   = b->text;
+  end = b->text + b->tlen;
+  v[0] = v[1] = v[2] = v[3] = 0;
+  c[0] = c[1] = 0;
+  while ((code = Dump_Char(&p,end)) >= 0)       //  For each data line do
+    { o = Dump_Room(b,1+4*sizeof(int));
+      *o++ = code;
       switch (code)
       { case 'P':                         //  Alignment pair
-          scanf(" %d %d %c %c",&aread,&bread,&orient,&chain);
-          fwrite(&aread,sizeof(int),1,stdout);
-          fwrite(&bread,sizeof(int),1,stdout);
-          fwrite(&orient,sizeof(char),1,stdout);
-          fwrite(&chain,sizeof(char),1,stdout);
+          for (i = 0; i < 2; i++)
+            if (Dump_Int(&p,end,&x))
+              v[i] = x;
+          for (i = 0; i < 2; i++)
+            if ((x = Dump_Char(&p,end)) >= 0)
+              c[i] = x;
+          PUT(o,v[0])
+          PUT(o,v[1])
+          PUT(o,c[0])
+          PUT(o,c[1])
           break;
         case 'L':                         //  Read lengths
-          scanf(" %d %d",&alen,&blen);
-          fwrite(&len,sizeof(int),1,stdout);
-          fwrite(&blen,sizeof(int),1,stdout);
+          for (i = 0; i < 2; i++)
+            if (Dump_Int(&p,end,&x))
+              v[i] = x;
+          PUT(o,v[0])
+          PUT(o,v[1])
           break;
         case 'C':                         //  Coordinate intervals
-          scanf(" %d %d %d %d",&ab,&ae,&bb,&be);
-          fwrite(&ab,sizeof(int),1,stdout);
-          fwrite(&ae,sizeof(int),1,stdout);
-          fwrite(&bb,sizeof(int),1,stdout);
-          fwrite(&be,sizeof(int),1,stdout);
+          for (i = 0; i < 4; i++)
+            { if (Dump_Int(&p,end,&x))
+                v[i] = x;
+              PUT(o,v[i])
+            }
           break;
         case 'D':                         //  Differences
-          scanf(" %d",&diffs);
-          fwrite(&diffs,sizeof(int),1,stdout);
+          if (Dump_Int(&p,end,&x))
+            v[0] = x;
+          PUT(o,v[0])
           break;
         case 'T':                         //  Mask
-          if (tbuffer == NULL)
-            { fprintf(stderr,"LAa2b: .las dump has traces but no @ T-line\n");
-              exit (1);
+          if ( ! HasTrace)
+            { b->olen   = o - b->out;
+              info->error = 1;
+              return;
             }
-          scanf(" %d",&len);
-          fwrite(&len,sizeof(int),1,stdout);
-          len *= 2;
-          if (small)
-            { for (int i = 0; i < len; i += 2)
-                scanf(" %hhd %hhd",tbuffer+i,tbuffer+(i+1));
-              fwrite(tbuffer,sizeof(uint8),len,stdout);
+          if (Dump_Int(&p,end,&x))
+            v[0] = x;
+          PUT(o,v[0])
+          b->olen = o - b->out;
+          if (v[0] <= 0)
+            continue;
+          if (Small)
+            { uint8 *t8 = (uint8 *) Dump_Room(b,2*v[0]*sizeof(uint8));
+
+              for (i = 0; i < 2*v[0]; i++)
+                if (Dump_Int(&p,end,&x))
+                  t8[i] = x;
+              b->olen += 2*v[0]*sizeof(uint8);
             }
           else
-            { for (int i = 0; i < len; i += 2)
-                scanf(" %hd %hd",sbuffer+i,sbuffer+(i+1));
-              fwrite(sbuffer,sizeof(uint16),len,stdout);
+            { uint16  t16 = 0;
+
+              o = Dump_Room(b,2*v[0]*sizeof(uint16));
+              for (i = 0; i < 2*v[0]; i++)
+                { if (Dump_Int(&p,end,&x))
+                    t16 = x;
+                  PUT(o,t16)
+                }
+              b->olen = o - b->out;
             }
+          continue;
       }
+      b->olen = o - b->out;
     }
+}
+
+static void a2b_output(Dump_Block *b, void *arg)
+{ A2B_Info *info = (A2B_Info *) b->info;
+
+  (void) arg;
+
+  fwrite(b->out,1,b->olen,stdout);
+  if (info->error)
+    { fprintf(stderr,"LAa2b: .las dump has traces but no @ T-line\n");
+      exit (1);
+    }
+}
+
+int main(int argc, char *argv[])
+{ char   *head, *p, *end;
+  int64   hlen, total;
+  int     code;
+  char    c, which;
+  int     tspace;
+  int     NTHREADS;
+
+  //  Process arguments
+
+  { int   i, j;
+    char *eptr;
+
+    Prog_Name = Strdup("LAa2b","");
+
+    NTHREADS = 4;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            fprintf(stderr,"%s: -%c is an illegal option\n",Prog_Name,argv[i][1]);
+            exit (1);
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    if (argc > 1)
+      { fprintf(stderr,"Usage: LAa2b [-T<int(4)>] <(ascii) >(binary)\n");
+        exit (1);
+      }
+  }
+
+  head = Dump_Head(stdin,HEAD_SIZE,&hlen);
+  p    = head;
+  end  = head + hlen;
+
+  HasTrace = 0;
+  while ((code = Dump_Char(&p,end)) >= 0)       //  Header lines
+    if (code == '@' || code == '+' || code == '%')
+      { which = Dump_Char(&p,end);
+        Dump_Int(&p,end,&total);
+        c = code;
+        fwrite(&c,sizeof(char),1,stdout);
+        fwrite(&which,sizeof(char),1,stdout);
+        fwrite(&total,sizeof(int64),1,stdout);
+        if (code == '@')
+          HasTrace = 1;
+      }
+    else
+      { p -= 1;
+        break;
+      }
+  Small = 0;
+  if (HasTrace)
+    { if (code != 'X')
+        { fprintf(stderr,"LAa2b: .las dump has traces but no X-line\n");
+          exit (1);
+        }
+      p += 1;
+      tspace = 0;
+      { int64 x;
+
+        if (Dump_Int(&p,end,&x))
+          tspace = x;
+      }
+      Small = (tspace <= TRACE_XOVR && tspace != 0);
+      c = code;
+      fwrite(&c,sizeof(char),1,stdout);
+      fwrite(&tspace,sizeof(int),1,stdout);
+    }
+
+  //  Convert the data lines, a block of whole LAs at a time
+
+  Dump_Pipe(stdin,p,end-p,NTHREADS,Dump_Cut_P,a2b_task,a2b_output,sizeof(A2B_Info),NULL);
+
+  free(head);
 
   exit (0);
 }
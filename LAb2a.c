@@ -1,107 +1,267 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "DB.h"
 #include "align.h"
+#include "dump.h"
 
-int main(int argc, char *argv[])
-{ char    code, which;
-  int64   total;
-  int     aread, bread;
-  char    orient, chain;
-  int     alen, blen;
-  int     ab, ae, bb, be;
-  int     diffs;
-  int     len;
-  int     tspace, small;
-  uint8  *tbuffer = NULL;
-  uint16 *sbuffer = NULL;
-
-  (void) argv;
+#define HEAD_SIZE 0x100000   //  Bytes read to parse the header items from
 
-  //  Process arguments
+static int HasTrace;   //  There is an @ T-item
+static int Tbytes;     //  Bytes per trace value
+static int Stopped;    //  A 0 code ended the data
 
-  if (argc > 1)
-    { fprintf(stderr,"Usage: LAa2b <(ascii) >(binary)\n");
-      exit (1);
-    }
+typedef struct
+  { int error;         //  A T-item was met without an @ T-item
+    int stop;          //  A 0 code was met
+  } B2A_Info;
 
-  if (fread(&code,sizeof(char),1,stdin) == 0)
-    code = 0;
+#define GET(v,p)  { memcpy(&(v),p,sizeof(v)); p += sizeof(v); }
 
-  while (code == '@' || code == '+' || code == '%')
-    { fread(&which,sizeof(char),1,stdin);
-      fread(&total,sizeof(int64),1,stdin);
-      printf("%c %c %lld\n",code,which,total);
-      if (code == '@')
-        { tbuffer = (uint8 *) malloc(2*total*sizeof(uint16));
-          sbuffer = (uint16 *) tbuffer;
+  //  The number of bytes of the data item at p, or -1 if it does not end before 'end'
+
+static int64 item_size(char *p, char *end)
+{ int64 n;
+  int   len;
+
+  switch (*p)
+  { case 'P':
+      n = 1 + 2*sizeof(int) + 2*sizeof(char);
+      break;
+    case 'L':
+      n = 1 + 2*sizeof(int);
+      break;
+    case 'C':
+      n = 1 + 4*sizeof(int);
+      break;
+    case 'D':
+      n = 1 + sizeof(int);
+      break;
+    case 'T':
+      n = 1 + sizeof(int);
+      if (HasTrace && end-p >= n)
+        { memcpy(&len,p+1,sizeof(int));
+          if (len > 0)
+            n += 2*((int64) len)*Tbytes;
         }
+      break;
+    default:
+      n = 1;
+      break;
+  }
+  if (end-p < n)
+    return (-1);
+  return (n);
+}
 
-      if (fread(&code,sizeof(char),1,stdin) == 0)
-       code = 0;
-    }
+  //  Cut the data after the last whole item
 
-  small = 0;
-  if (tbuffer != NULL && code != 0)
-    { if (code != 'X')
-        { fprintf(stderr,"LAb2a: .las dump has traces but no X-info\n");
-          exit (1);
+static int64 b2a_cut(char *buf, int64 len, int eof, void *arg)
+{ char *p, *end;
+  int64 n;
+
+  (void) arg;
+
+  if (eof)
+    return (len);
+  p   = buf;
+  end = buf+len;
+  while (p < end && (n = item_size(p,end)) > 0)
+    p += n;
+  return (p-buf);
+}
+
+  //  Convert the items of block b, stopping at a T-item should there be no @ T-item, or at a
+  //    0 code
+
+static void b2a_task(Dump_Block *b, void *arg)
+{ B2A_Info *info = (B2A_Info *) b->info;
+  char     *p, *end, *o;
+  int64     n;
+  int       code, i;
+  int       v[4];
+  char      c[2];
+
+  (void) arg;
+
+  p   = b->text;
+  end = b->text + b->tlen;
+  while (p < end)                     //  For each data item do
+    { code = *p;
+      if (code == 0)
+        { info->stop = 1;
+          break;
         }
-      fread(&tspace,sizeof(int),1,stdin);
-      small = (tspace <= TRACE_XOVR && tspace != 0);
-      printf("X %d\n",tspace);
-    }
+      if (code == 'T' && ! HasTrace)
+        { info->error = 1;
+          return;
+        }
+      n = item_size(p,end);
+      if (n < 0)
+        break;
+      p += 1;
 
-  while (code != 0)                        //  For each data item do
-    { switch (code)
+      o = Dump_Room(b,64);
+      switch (code)
       { case 'P':                         //  Alignment pair
-          fread(&aread,sizeof(int),1,stdin);
-          fread(&bread,sizeof(int),1,stdin);
-          fread(&orient,sizeof(char),1,stdin);
-          fread(&chain,sizeof(char),1,stdin);
-          printf("%c %d %d %c %c\n",code,aread,bread,orient,chain);
+          GET(v[0],p)
+          GET(v[1],p)
+          GET(c[0],p)
+          GET(c[1],p)
+          *o++ = code;
+          *o++ = ' ';
+          o = Dump_Put_Int(o,v[0]);
+          *o++ = ' ';
+          o = Dump_Put_Int(o,v[1]);
+          *o++ = ' ';
+          *o++ = c[0];
+          *o++ = ' ';
+          *o++ = c[1];
+          *o++ = '\n';
           break;
         case 'L':                         //  Read lengths
-          scanf(" %d %d",&alen,&blen);
-          fread(&len,sizeof(int),1,stdin);
-          fread(&blen,sizeof(int),1,stdin);
-          printf("%c %d %d\n",code,alen,blen);
-          break;
         case 'C':                         //  Coordinate intervals
-          fread(&ab,sizeof(int),1,stdin);
-          fread(&ae,sizeof(int),1,stdin);
-          fread(&bb,sizeof(int),1,stdin);
-          fread(&be,sizeof(int),1,stdin);
-          printf("%c %d %d %d %d\n",code,ab,ae,bb,be);
-          break;
         case 'D':                         //  Differences
-          fread(&diffs,sizeof(int),1,stdin);
-          printf("%c %d\n",code,diffs);
+          *o++ = code;
+          for (i = 0; i < (n-1)/((int) sizeof(int)); i++)
+            { GET(v[0],p)
+              *o++ = ' ';
+              o = Dump_Put_Int(o,v[0]);
+            }
+          *o++ = '\n';
           break;
         case 'T':                         //  Mask
-          if (tbuffer == NULL)
-            { fprintf(stderr,"LAb2a: .las dump has traces but no @ T-info\n");
-              exit (1);
-            }
-          fread(&len,sizeof(int),1,stdin);
-          printf("%c %d\n",code,len);
-          len *= 2;
-          if (small)
-            { fread(tbuffer,sizeof(uint8),len,stdin);
-              for (int i = 0; i < len; i += 2)
-                printf(" %d %d\n",tbuffer[i],tbuffer[i+1]);
+          GET(v[0],p)
+          *o++ = code;
+          *o++ = ' ';
+          o = Dump_Put_Int(o,v[0]);
+          *o++ = '\n';
+          b->olen = o - b->out;
+          if (v[0] <= 0)
+            continue;
+          o = Dump_Room(b,26*((int64) v[0]));
+          if (Tbytes == sizeof(uint8))
+            { uint8 *t8 = (uint8 *) p;
+
+              for (i = 0; i < 2*v[0]; i += 2)
+                { *o++ = ' ';
+                  o = Dump_Put_Int(o,t8[i]);
+                  *o++ = ' ';
+                  o = Dump_Put_Int(o,t8[i+1]);
+                  *o++ = '\n';
+                }
             }
           else
-            { fread(sbuffer,sizeof(uint16),len,stdin);
-              for (int i = 0; i < len; i += 2)
-                printf(" %d %d\n",sbuffer[i],sbuffer[i+1]);
+            { uint16 t16[2];
+
+              for (i = 0; i < 2*v[0]; i += 2)
+                { memcpy(t16,p+i*sizeof(uint16),2*sizeof(uint16));
+                  *o++ = ' ';
+                  o = Dump_Put_Int(o,t16[0]);
+                  *o++ = ' ';
+                  o = Dump_Put_Int(o,t16[1]);
+                  *o++ = '\n';
+                }
             }
+          p += 2*((int64) v[0])*Tbytes;
+          break;
+      }
+      b->olen = o - b->out;
+    }
+}
+
+static void b2a_output(Dump_Block *b, void *arg)
+{ B2A_Info *info = (B2A_Info *) b->info;
+
+  (void) arg;
+
+  if (Stopped)
+    return;
+  fwrite(b->out,1,b->olen,stdout);
+  if (info->error)
+    { fprintf(stderr,"LAb2a: .las dump has traces but no @ T-info\n");
+      exit (1);
+    }
+  Stopped = info->stop;
+}
+
+int main(int argc, char *argv[])
+{ char   *head, *p, *end;
+  int64   hlen, total;
+  char    code, which;
+  int     tspace;
+  int     NTHREADS;
+
+  //  Process arguments
+
+  { int   i, j;
+    char *eptr;
+
+    Prog_Name = Strdup("LAb2a","");
+
+    NTHREADS = 4;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            fprintf(stderr,"%s: -%c is an illegal option\n",Prog_Name,argv[i][1]);
+            exit (1);
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    if (argc > 1)
+      { fprintf(stderr,"Usage: LAb2a [-T<int(4)>] <(binary) >(ascii)\n");
+        exit (1);
       }
+  }
+
+  head = Dump_Head(stdin,HEAD_SIZE,&hlen);
+  p    = head;
+  end  = head + hlen;
+
+#define NEXT_CODE  code = (p < end ? *p++ : 0);
+
+  NEXT_CODE
+  HasTrace = 0;
+  while ((code == '@' || code == '+' || code == '%') && end-p >= 1+(int64) sizeof(int64))
+    { which = *p++;
+      GET(total,p)
+      printf("%c %c %lld\n",code,which,total);
+      if (code == '@')
+        HasTrace = 1;
+      NEXT_CODE
+    }
 
-      if (fread(&code,sizeof(char),1,stdin) == 0)
-       code = 0;
+  Tbytes = sizeof(uint16);
+  if (HasTrace && code != 0)
+    { if (code != 'X')
+        { fprintf(stderr,"LAb2a: .las dump has traces but no X-info\n");
+          exit (1);
+        }
+      tspace = 0;
+      if (end-p >= (int64) sizeof(int))
+        GET(tspace,p)
+      if (tspace <= TRACE_XOVR && tspace != 0)
+        Tbytes = sizeof(uint8);
+      printf("X %d\n",tspace);
+      NEXT_CODE
     }
 
+  //  Convert the data items, a block of whole items at a time
+
+  Stopped = 0;
+  if (code != 0)
+    Dump_Pipe(stdin,p-1,end-(p-1),NTHREADS,b2a_cut,b2a_task,b2a_output,sizeof(B2A_Info),NULL);
+
+  free(head);
+
   exit (0);
 }
@@ -0,0 +1,373 @@
+/*******************************************************************************************
+ *
+ *  Time the trace engines of align.c (Compute_Trace_PTS/MID/WFA and optionally the
+ *    DIFF_ALIGN and WFA_ALIGN tasks of Compute_Alignment) over the LAs of a .las file,
+ *    checking that each produces a trace consistent with the reads and that the
+ *    exact engines agree on the number of differences.
+ *
+ *  Date  :  October 2026
+ *
+ *******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "DB.h"
+#include "align.h"
+#include "las.h"
+
+static char *Usage[] =
+    { "[-vx] [-r<int(1)>]",
+      "    <src1:db|dam> [ <src2:db|dam> ] <align:las>"
+    };
+
+#define PTS_ENGINE   0
+#define MID_ENGINE   1
+#define WFA_ENGINE   2
+#define DND_ENGINE   3
+#define WND_ENGINE   4
+
+#define NUM_ENGINES  5
+
+#define IO_BLOCK 10000000   //  Buffer size of the reader of a .las that cannot be mapped
+
+static char *Engine_Name[NUM_ENGINES] =
+    { "Compute_Trace_PTS", "Compute_Trace_MID", "Compute_Trace_WFA",
+      "Compute_Alignment(DIFF_ALIGN)", "Compute_Alignment(WFA_ALIGN)" };
+
+  //  Walk the exact trace of 'aln' and return the number of differences it implies
+  //    or -1 if it does not exactly span the LA's intervals
+
+static int trace_diffs(Alignment *aln)
+{ Path *path = aln->path;
+  int  *trace = (int *) path->trace;
+  char *a = aln->aseq - 1;
+  char *b = aln->bseq - 1;
+  int   i, j, k, p;
+  int   diffs;
+
+  diffs = 0;
+  i = path->abpos+1;
+  j = path->bbpos+1;
+  for (k = 0; k < path->tlen; k++)
+    { p = trace[k];
+      if (p < 0)
+        { p = -p;
+          if (p < i || p > path->aepos+1)
+            return (-1);
+          while (i < p)
+            { if (a[i] != b[j])
+                diffs += 1;
+              i += 1;
+              j += 1;
+            }
+          j += 1;
+        }
+      else
+        { if (p < j || p > path->bepos+1)
+            return (-1);
+          while (j < p)
+            { if (a[i] != b[j])
+                diffs += 1;
+              i += 1;
+              j += 1;
+            }
+          i += 1;
+        }
+      diffs += 1;
+    }
+  while (i <= path->aepos)
+    { if (a[i] != b[j])
+        diffs += 1;
+      i += 1;
+      j += 1;
+    }
+  if (i != path->aepos+1 || j != path->bepos+1)
+    return (-1);
+  return (diffs);
+}
+
+static double wall_clock()
+{ struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (t.tv_sec + t.tv_nsec*1e-9);
+}
+
+int main(int argc, char *argv[])
+{ DAZZ_DB   _db1, *db1 = &_db1;
+  DAZZ_DB   _db2, *db2 = &_db2;
+  Overlap   _ovl, *ovl = &_ovl;
+  Alignment _aln, *aln = &_aln;
+
+  FILE   *input;
+  Las_Reader *reader;
+  int     sameDB;
+  int64   novl;
+  int     tspace, small;
+
+  int     VERBOSE;
+  int     WHOLE;
+  int     REPEATS;
+
+  //  Process options
+
+  { int    i, j, k;
+    int    flags[128];
+    char  *eptr;
+
+    ARG_INIT("LAbench")
+
+    REPEATS = 1;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("vx")
+            break;
+          case 'r':
+            ARG_POSITIVE(REPEATS,"Repetitions")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    VERBOSE = flags['v'];
+    WHOLE   = flags['x'];
+
+    if (argc <= 2 || argc > 4)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
+        fprintf(stderr,"       %*s %s\n",(int) strlen(Prog_Name),"",Usage[1]);
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -v: Verbose mode, report each LA on which the engines disagree.\n");
+        fprintf(stderr,"      -x: Also time whole-LA alignment with Compute_Alignment.\n");
+        fprintf(stderr,"      -r: Repeat each trace computation -r times.\n");
+        exit (1);
+      }
+  }
+
+  //  Open trimmed DB or DB pair
+
+  { int status;
+
+    status = Open_DB(argv[1],db1);
+    if (status < 0)
+      exit (1);
+    if (db1->part > 0)
+      { fprintf(stderr,"%s: Cannot be called on a block: %s\n",Prog_Name,argv[1]);
+        exit (1);
+      }
+
+    sameDB = (argc == 3);
+    if (sameDB)
+      db2 = db1;
+    else
+      { status = Open_DB(argv[2],db2);
+        if (status < 0)
+          exit (1);
+        if (db2->part > 0)
+          { fprintf(stderr,"%s: Cannot be called on a block: %s\n",Prog_Name,argv[2]);
+            exit (1);
+          }
+        Trim_DB(db2);
+      }
+    Trim_DB(db1);
+  }
+
+  //  Open .las and get header
+
+  { char *over, *pwd, *root;
+
+    pwd   = PathTo(argv[argc-1]);
+    root  = Root(argv[argc-1],".las");
+    over  = Catenate(pwd,"/",root,".las");
+    input = Fopen(over,"r");
+    if (input == NULL)
+      exit (1);
+
+    reader = Open_Las_Map(input,0);
+    if (reader == NULL)
+      reader = Open_Las_Reader(input,IO_BLOCK);
+    novl   = reader->novl;
+    tspace = reader->tspace;
+    small  = (reader->tbytes == sizeof(uint8));
+
+    free(pwd);
+    free(root);
+  }
+
+  //  For each LA time each engine in turn, checking the traces as one goes
+
+  { Work_Data *work;
+    uint16    *trace;
+    int        tmax;
+    Overlap   *view;
+    char      *abuffer, *bbuffer;
+    int        nengine;
+    double     etime[NUM_ENGINES];
+    int64      ediff[NUM_ENGINES];
+    int64      eindl[NUM_ENGINES];
+    int64      ebad[NUM_ENGINES];
+    int64      disagree;
+    int64      j;
+    int        e, r;
+
+    work    = New_Work_Data();
+    abuffer = New_Read_Buffer(db1);
+    bbuffer = New_Read_Buffer(db2);
+
+    tmax  = 1000;
+    trace = (uint16 *) Malloc(sizeof(uint16)*tmax,"Allocating trace vector");
+    if (work == NULL || abuffer == NULL || bbuffer == NULL || trace == NULL)
+      exit (1);
+
+    if (WHOLE)
+      nengine = NUM_ENGINES;
+    else
+      nengine = WFA_ENGINE+1;
+    for (e = 0; e < NUM_ENGINES; e++)
+      { etime[e] = 0.;
+        ediff[e] = eindl[e] = ebad[e] = 0;
+      }
+    disagree = 0;
+
+    aln->path = &(ovl->path);
+    for (j = 0; j < novl; j++)
+      { Path  save;
+        int   d[NUM_ENGINES];
+
+        view = Las_Next(reader);
+        *ovl = *view;
+        if (small)
+          { uint8 *t8 = (uint8 *) LAS_TRACE(view);
+            int    k;
+
+            if (ovl->path.tlen > tmax)
+              { tmax = ((int) 1.2*ovl->path.tlen) + 100;
+                trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
+                if (trace == NULL)
+                  exit (1);
+              }
+            for (k = 0; k < ovl->path.tlen; k++)
+              trace[k] = t8[k];
+            ovl->path.trace = (void *) trace;
+          }
+        else
+          ovl->path.trace = LAS_TRACE(view);
+
+        if (ovl->aread >= db1->nreads || ovl->bread >= db2->nreads)
+          { fprintf(stderr,"%s: LA read index is out-of-range of DB\n",Prog_Name);
+            exit (1);
+          }
+
+        aln->alen  = db1->reads[ovl->aread].rlen;
+        aln->blen  = db2->reads[ovl->bread].rlen;
+        aln->flags = ovl->flags;
+
+        Load_Read(db1,ovl->aread,abuffer,0);
+        aln->aseq = abuffer;
+        if (sameDB && ovl->aread == ovl->bread && !COMP(ovl->flags))
+          aln->bseq = abuffer;
+        else
+          { Load_Read(db2,ovl->bread,bbuffer,0);
+            if (COMP(ovl->flags))
+              Complement_Seq(bbuffer,aln->blen);
+            aln->bseq = bbuffer;
+          }
+
+        save = ovl->path;
+        for (e = 0; e < nengine; e++)
+          { double start;
+
+            if (e == MID_ENGINE && tspace == 0)
+              continue;
+
+            start = wall_clock();
+            for (r = 0; r < REPEATS; r++)
+              { ovl->path = save;
+                switch (e)
+                { case PTS_ENGINE:
+                    if (tspace == 0)
+                      Compute_Trace_IRR(aln,work,GREEDIEST);
+                    else
+                      Compute_Trace_PTS(aln,work,tspace,GREEDIEST);
+                    break;
+                  case MID_ENGINE:
+                    Compute_Trace_MID(aln,work,tspace,GREEDIEST);
+                    break;
+                  case WFA_ENGINE:
+                    Compute_Trace_WFA(aln,work,tspace,GREEDIEST);
+                    break;
+                  case DND_ENGINE:
+                    Compute_Alignment(aln,work,DIFF_ALIGN,0);
+                    break;
+                  case WND_ENGINE:
+                    Compute_Alignment(aln,work,WFA_ALIGN,0);
+                    break;
+                }
+              }
+            etime[e] += wall_clock() - start;
+
+            d[e] = trace_diffs(aln);         //  MID's diffs field is only an estimate, so
+            eindl[e] += ovl->path.tlen;      //    tally what the trace actually implies
+            if (d[e] >= 0)
+              ediff[e] += d[e];
+            if (d[e] < 0 || (e != MID_ENGINE && d[e] != ovl->path.diffs))
+              { ebad[e] += 1;
+                if (VERBOSE)
+                  fprintf(stderr,"  %s: trace of LA %lld (%d vs %d) is inconsistent\n",
+                                 Engine_Name[e],j+1,ovl->aread+1,ovl->bread+1);
+              }
+          }
+        ovl->path = save;
+
+        if (d[WFA_ENGINE] != d[PTS_ENGINE] || (WHOLE && d[WND_ENGINE] != d[DND_ENGINE]))
+          { disagree += 1;
+            if (VERBOSE)
+              fprintf(stderr,"  LA %lld (%d vs %d): engines disagree on the number of diffs\n",
+                             j+1,ovl->aread+1,ovl->bread+1);
+          }
+      }
+
+    //  Report
+
+    printf("\n  ");
+    Print_Number(novl,0,stdout);
+    printf(" LAs, each traced %d time%s\n\n",REPEATS,REPEATS == 1 ? "" : "s");
+    printf("    %-29s %10s %12s %12s %8s\n","Engine","Seconds","Diffs","Indels","Bad");
+    for (e = 0; e < nengine; e++)
+      { if (e == MID_ENGINE && tspace == 0)
+          continue;
+        printf("    %-29s %10.3f ",Engine_Name[e],etime[e]);
+        Print_Number(ediff[e],12,stdout);
+        printf(" ");
+        Print_Number(eindl[e],12,stdout);
+        printf(" ");
+        Print_Number(ebad[e],8,stdout);
+        printf("\n");
+      }
+    if (disagree > 0)
+      { printf("\n  ");
+        Print_Number(disagree,0,stdout);
+        printf(" LAs on which the exact engines disagree\n");
+      }
+
+    free(trace);
+    free(bbuffer-1);
+    free(abuffer-1);
+    Free_Work_Data(work);
+  }
+
+  Close_Las_Reader(reader);
+  fclose(input);
+  Close_DB(db1);
+  if (!sameDB)
+    Close_DB(db2);
+
+  exit (0);
+}
@@ -1,48 +1,155 @@
 /*******************************************************************************************
  *
  *  Merge together in index order, overlap files <XXX>.1.las, <XXX>.2.las, ... into a
- *    single overlap file and output to the standard output
+ *    single overlap file and output to the standard output.  After a header giving the
+ *    total number of LAs, the body of each file is copied as is, by the kernel if possible,
+ *    save that a packed file is unpacked.
  *
  *  Author:  Gene Myers
  *  Date  :  July 2013
  *
  *******************************************************************************************/
 
+#ifdef __linux__
+#define _GNU_SOURCE          //  For copy_file_range
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 #include "DB.h"
 #include "align.h"
+#include "las.h"
+
+static char *Usage = "[-v] [-M<int(1)>] <source:las> ... > <target>.las";
+
+  //  Can a failed copy_file_range or sendfile be retried with a plainer method?
+
+#define RETRY_OTHERWISE(e)  \
+  ((e) == EXDEV || (e) == EINVAL || (e) == ENOSYS || (e) == EOPNOTSUPP || (e) == EBADF)
+
+  //  Copy 'len' bytes of 'input' from offset 'off' to the end of output file ofd, in the kernel
+  //    with copy_file_range or sendfile if possible, and otherwise through a buffer of bsize
+  //    bytes.  If len < 0 then 'input' is not a regular file, and all that remains of it
+  //    from its current position is copied.  Returns the number of bytes copied, or -1 on
+  //    an error.
+
+static int64 copy_body(FILE *input, int64 off, int64 len, int ofd, int64 bsize)
+{ static char *buf = NULL;
+
+  int64 done, n, m, w;
+  int   ifd = fileno(input);
+
+  done = 0;
+
+#ifdef __linux__
+  if (len > 0)
+    { loff_t o = off;
+
+      while (done < len)
+        { n = copy_file_range(ifd,&o,ofd,NULL,len-done,0);
+          if (n <= 0)
+            break;
+          done += n;
+        }
+      if (done < len && n < 0 && ! RETRY_OTHERWISE(errno))
+        return (-1);
+
+      if (done < len && n < 0)
+        { off_t p = off+done;
 
-static char *Usage = "[-v] <source:las> ... > <target>.las";
+          while (done < len)
+            { n = sendfile(ofd,ifd,&p,len-done);
+              if (n <= 0)
+                break;
+              done += n;
+            }
+          if (done < len && n < 0 && ! RETRY_OTHERWISE(errno))
+            return (-1);
+        }
+      if (done >= len || n == 0)
+        return (done);
+    }
+#endif
 
-#define MEMORY   1000         //  How many megabytes for output buffer
+  if (buf == NULL)
+    { buf = (char *) Malloc(bsize,"Allocating copy buffer");
+      if (buf == NULL)
+        exit (1);
+    }
+  while (len < 0 || done < len)
+    { m = bsize;
+      if (len >= 0 && len-done < m)
+        m = len-done;
+      if (len < 0)
+        { n = fread(buf,1,m,input);
+          if (n == 0 && ferror(input))
+            return (-1);
+        }
+      else
+        { n = pread(ifd,buf,m,off+done);
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n < 0)
+            return (-1);
+        }
+      if (n == 0)
+        break;
+      for (m = 0; m < n; m += w)
+        { w = write(ofd,buf+m,n-m);
+          if (w < 0 && errno == EINTR)
+            w = 0;
+          else if (w < 0)
+            return (-1);
+        }
+      done += n;
+    }
+  return (done);
+}
 
 int main(int argc, char *argv[])
-{ char     *iblock, *oblock;
-  FILE     *input;
-  int64     novl, bsize, ovlsize, ptrsize;
-  int       tspace, tbytes;
-  int       c;
+{ int64       novl;
+  int         tspace;
+  int         c;
 
-  int       VERBOSE;
+  int         VERBOSE;
+  int64       MEMORY;
 
   //  Process options
 
-  { int i, j, k;
-    int flags[128];
+  { int   i, j, k;
+    int   flags[128];
+    char *eptr;
 
     ARG_INIT("LAcat")
 
+    MEMORY = 0x40000000ll;
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
-        { ARG_FLAGS("v") }
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("v")
+            break;
+          case 'M':
+            { int limit;
+
+              ARG_POSITIVE(limit,"Memory for copy buffer (in Gb)")
+              MEMORY = limit * 0x40000000ll;
+              break;
+            }
+        }
       else
         argv[j++] = argv[i];
     argc = j;
@@ -55,19 +162,13 @@ int main(int argc, char *argv[])
         fprintf(stderr,"    <source>'s may contain a template that is %c-sign optionally\n",
                         BLOCK_SYMBOL);
         fprintf(stderr,"      followed by an integer or integer range\n");
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
+        fprintf(stderr,"      -M: Use -M GB of memory should a copy need a buffer.\n");
         exit (1);
       }
   }
 
-  ptrsize = sizeof(void *);
-  ovlsize = sizeof(Overlap) - ptrsize;
-  bsize   = MEMORY * 1000000ll;
-  oblock  = (char *) Malloc(bsize,"Allocating output block");
-  iblock  = (char *) Malloc(bsize + ptrsize,"Allocating input block");
-  if (oblock == NULL || iblock == NULL)
-    exit (1);
-  iblock += ptrsize;
-
   novl   = 0;
   tspace = -1;
   for (c = 1; c < argc; c++)
@@ -80,11 +181,9 @@ int main(int argc, char *argv[])
         { int64 povl;
           int   mspace;
 
-          if (fread(&povl,sizeof(int64),1,input) != 1)
-            SYSTEM_READ_ERROR
+          if (Las_Header(input,&povl,&mspace) < 0)
+            exit (1);
           novl += povl;
-          if (fread(&mspace,sizeof(int),1,input) != 1)
-            SYSTEM_READ_ERROR
           if (tspace < 0)
             tspace = mspace;
           else if (tspace != mspace)
@@ -100,100 +199,74 @@ int main(int argc, char *argv[])
       Free_Block_Arg(parse);
     }
 
-  if (tspace <= TRACE_XOVR && tspace != 0)
-    tbytes = sizeof(uint8);
-  else
-    tbytes = sizeof(uint16);
+  //  Write the combined header and then append the body of each file
+
   if (fwrite(&novl,sizeof(int64),1,stdout) != 1)
-    SYSTEM_READ_ERROR
+    SYSTEM_WRITE_ERROR
   if (fwrite(&tspace,sizeof(int),1,stdout) != 1)
-    SYSTEM_READ_ERROR
-
-  { Block_Looper *parse;
-    int      c, j;
-    Overlap *w;
-    int64    tsize, povl;
-    int      mspace;
-    char    *iptr, *itop;
-    char    *optr, *otop;
-
-    optr = oblock;
-    otop = oblock + bsize;
-
-    for (c = 1; c < argc; c++)
-      { parse = Parse_Block_LAS_Arg(argv[c]);
-
-        while ((input = Next_Block_Arg(parse)) != NULL)
-          { if (fread(&povl,sizeof(int64),1,input) != 1)
-              SYSTEM_READ_ERROR
-            if (fread(&mspace,sizeof(int),1,input) != 1)
-              SYSTEM_READ_ERROR
-
-            if (VERBOSE)
-              { fprintf(stderr,
-                    "  Concatenating %s: %lld la\'s\n",Block_Arg_Root(parse),povl);
-                fflush(stderr);
-              }
-
-            iptr = iblock;
-            itop = iblock + fread(iblock,1,bsize,input);
-
-            for (j = 0; j < povl; j++)
-              { if (iptr + ovlsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
-                  }
-
-                w = (Overlap *) (iptr - ptrsize);
-                tsize = w->path.tlen*tbytes;
-
-                if (optr + ovlsize + tsize > otop)
-                  { if (fwrite(oblock,1,optr-oblock,stdout) != (size_t) (optr-oblock))
-                      SYSTEM_READ_ERROR
-                    optr = oblock;
-                  }
-
-                memmove(optr,iptr,ovlsize);
-                optr += ovlsize;
-                iptr += ovlsize;
-
-                if (iptr + tsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
-                  }
-
-                memmove(optr,iptr,tsize);
-                optr += tsize;
-                iptr += tsize;
-              }
-
-            fclose(input);
-          }
-
-        Free_Block_Arg(parse);
-      }
+    SYSTEM_WRITE_ERROR
+  if (fflush(stdout) != 0)
+    SYSTEM_WRITE_ERROR
 
-    if (optr > oblock)
-      { if (fwrite(oblock,1,optr-oblock,stdout) != (size_t) (optr-oblock))
-          SYSTEM_READ_ERROR
-      }
-  }
+  for (c = 1; c < argc; c++)
+    { Block_Looper *parse;
+      FILE         *input;
+      struct stat   info;
+      int64         povl, hsize, len;
+      int           mspace, version;
+
+      parse = Parse_Block_LAS_Arg(argv[c]);
+
+      while ((input = Next_Block_Arg(parse)) != NULL)
+        { version = Las_Header(input,&povl,&mspace);
+          if (version < 0)
+            exit (1);
+
+          if (VERBOSE)
+            { fprintf(stderr,
+                  "  Concatenating %s: %lld la\'s\n",Block_Arg_Root(parse),povl);
+              fflush(stderr);
+            }
+
+          //  A packed file has no body that can be copied, its LAs are unpacked and written
+
+          if (version == 2)
+            { Las_Reader *in;
+              Las_Writer *out;
+
+              rewind(input);
+              in  = Open_Las_Reader(input,0);
+              out = Open_Las_Segment_Writer(stdout,tspace,MEMORY < 10000000 ? MEMORY : 10000000);
+              Cat_Las(in,out);
+              Close_Las_Writer(out);
+              Close_Las_Reader(in);
+              if (fflush(stdout) != 0)
+                SYSTEM_WRITE_ERROR
+              fclose(input);
+              continue;
+            }
+
+          hsize = sizeof(int64) + sizeof(int);
+          if (fstat(fileno(input),&info) == 0 && S_ISREG(info.st_mode))
+            { len = info.st_size - hsize;
+              if (copy_body(input,hsize,len,fileno(stdout),MEMORY) != len)
+                SYSTEM_WRITE_ERROR
+            }
+          else
+            { if (copy_body(input,hsize,-1,fileno(stdout),MEMORY) < 0)
+                SYSTEM_WRITE_ERROR
+            }
+
+          fclose(input);
+        }
+
+      Free_Block_Arg(parse);
+    }
 
   if (VERBOSE)
     { fprintf(stderr,"  Totalling %lld la\'s\n",novl);
       fflush(stderr);
     }
 
-  free(oblock);
-  free(iblock-ptrsize);
-
   exit (0);
 }
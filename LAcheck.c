@@ -12,38 +12,753 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
+
+static char *Usage[] =
+    { "[-vaSt] [-T<int(4)>] [-C<int(64)>]",
+      "    <src1:db|dam> [ <src2:db|dam> ] <align:las> ..."
+    };
+
+#define CHUNK_SIZE  0x4000000ll   //  A large .las is checked in chunks of about this many bytes
+#define RESYNC      16            //  # of consecutive LAs that must parse at a chunk boundary
+
+static int VERBOSE;
+static int MAP_ORDER;
+static int SORTED;
+static int TRACES;
+static int ISTWO;
+
+static DAZZ_READ *Reads1, *Reads2;
+static int        Nreads1, Nreads2;
+
+static DAZZ_CACHE *Cache;   //  Reads recently loaded for -t (if -C > 0)
+
+  //  The outcome of checking an LA, or a run of them
+
+#define CHECK_OK     0
+#define CHECK_ERROR  1   //  An error, as described by a message
+#define CHECK_TRACE  2   //  Check_Trace_Points failed on an LA (and describes the error itself)
+#define CHECK_SHORT  3   //  The file ends part way through an LA
+#define CHECK_MORE   4   //  There is more data after the LAs of the header
+
+  //  The reads, buffers, and work data of a thread for the -t check
+
+typedef struct
+  { DAZZ_DB    _db1, _db2;
+    DAZZ_DB   *db1, *db2;
+    Work_Data *work;
+    char      *abuffer, *bbuffer;
+    uint16    *tbuffer;
+    int        tmax;
+  } Check_Work;
+
+  //  A large mapped .las is split into chunks that are checked in parallel.  The LAs of a chunk
+  //    are those that start in [beg,end), unless one ends beyond end, in which case the chunk
+  //    was not entered at an LA and the LAs are checked to the end of the file.  An LA whose
+  //    order (or duplicate) check needs the LA or chain start that precedes the chunk is
+  //    deferred, and checked once the chunks before it have been.
+
+typedef struct
+  { int64    idx;     //  The LA is the idx'th of its chunk
+    int      local;   //  last is the LA before it (otherwise it is the first of the chunk)
+    Overlap  ovl;
+    Overlap  last;
+  } Deferred;
+
+typedef struct
+  { char     *beg, *end;
+    int64     nrec;         //  # of LAs that passed the checks ...
+    int       kind;         //    and the outcome of the one that follows them (if any)
+    char      mesg[100];    //  Message of a CHECK_ERROR
+    Overlap   bad;          //  LA of a CHECK_TRACE
+    int       over;         //  LAs were checked to the end of the file
+    Overlap   last, prev;   //  The last LA and the last chain start checked
+    int       klast, kprev; //  last and prev are known
+    int       sawstart;     //  prev is a chain start of this chunk
+    int64     ndefer, dmax;
+    Deferred *defer;
+  } Chunk;
+
+typedef struct
+  { char       *disp;        //  Name of the file in messages
+    FILE       *input;
+    Las_Reader *in;
+    int         fail;        //  The file has a bad header (described by mesg)
+    char        mesg[100];
+    int64       novl;
+    int         tspace;
+    int         tbytes;
+    int         has_chains;
+    char       *top;         //  End of the mapping
+    int         nchunk;      //  # of chunks, and how many have been taken and checked
+    int         ntaken;
+    int         ndone;
+    Chunk      *chunk;
+  } File_Check;
+
+  //  The checks of ovl that involve it alone
+
+static int check_record(Check_Work *w, File_Check *f, Overlap *ovl, char *mesg)
+{ if (ovl->aread < 0 || ovl->bread < 0)
+    { sprintf(mesg,"Read indices < 0");
+      return (CHECK_ERROR);
+    }
+  if (ovl->aread >= Nreads1 || ovl->bread >= Nreads2)
+    { sprintf(mesg,"Read indices out of range");
+      return (CHECK_ERROR);
+    }
+
+  if (ovl->path.abpos >= ovl->path.aepos || ovl->path.aepos > Reads1[ovl->aread].rlen ||
+      ovl->path.bbpos >= ovl->path.bepos || ovl->path.bepos > Reads2[ovl->bread].rlen ||
+      ovl->path.abpos < 0                || ovl->path.bbpos < 0                        )
+    { sprintf(mesg,"Non-sense alignment intervals");
+      return (CHECK_ERROR);
+    }
+
+  if (ovl->path.diffs < 0 || ovl->path.diffs > Reads1[ovl->aread].rlen ||
+                             ovl->path.diffs > Reads2[ovl->bread].rlen)
+    { sprintf(mesg,"Non-sense number of differences");
+      return (CHECK_ERROR);
+    }
+
+  if (Check_Trace_Points(ovl,f->tspace,0,NULL))
+    return (CHECK_TRACE);
+  if (ovl->path.tlen < 0)
+    { sprintf(mesg,"Trace length < 0");
+      return (CHECK_ERROR);
+    }
+
+  //  If -t, then the differences of an optimal alignment through the trace
+  //    points cannot exceed those claimed for the LA
+
+  if (TRACES)
+    { Alignment _aln, *aln = &_aln;
+      Path       path;
+      int        k;
+
+      if (ovl->path.tlen > w->tmax)
+        { w->tmax    = 1.2*ovl->path.tlen + 1000;
+          w->tbuffer = (uint16 *) Realloc(w->tbuffer,w->tmax*sizeof(uint16),
+                                          "Allocating trace vector");
+          if (w->tbuffer == NULL)
+            exit (1);
+        }
+      if (f->tbytes == sizeof(uint8))
+        for (k = 0; k < ovl->path.tlen; k++)
+          w->tbuffer[k] = ((uint8 *) ovl->path.trace)[k];
+      else
+        memcpy(w->tbuffer,ovl->path.trace,ovl->path.tlen*sizeof(uint16));
+
+      path       = ovl->path;
+      path.trace = w->tbuffer;
+      aln->path  = &path;
+      aln->flags = ovl->flags;
+      aln->alen  = Reads1[ovl->aread].rlen;
+      aln->blen  = Reads2[ovl->bread].rlen;
+
+      Cache_Read(Cache,w->db1,ovl->aread,w->abuffer,0);
+      aln->aseq = w->abuffer;
+      if (!ISTWO && ovl->aread == ovl->bread && !COMP(ovl->flags))
+        aln->bseq = w->abuffer;
+      else
+        { Cache_Read(Cache,w->db2,ovl->bread,w->bbuffer,0);
+          if (COMP(ovl->flags))
+            Complement_Seq(w->bbuffer,aln->blen);
+          aln->bseq = w->bbuffer;
+        }
+
+      Compute_Trace_WFA(aln,w->work,f->tspace,GREEDIEST);
+      if (path.diffs > ovl->path.diffs)
+        { sprintf(mesg,"Trace is inconsistent with reads (%d vs %d)",
+                       ovl->aread+1,ovl->bread+1);
+          return (CHECK_ERROR);
+        }
+    }
+
+  if (f->has_chains)
+    { if (CHAIN_START(ovl->flags) && CHAIN_NEXT(ovl->flags))
+        { sprintf(mesg,"LA has both start & next flag set");
+          return (CHECK_ERROR);
+        }
+      if (BEST_CHAIN(ovl->flags) && CHAIN_NEXT(ovl->flags))
+        { sprintf(mesg,"LA has both best & next flag set");
+          return (CHECK_ERROR);
+        }
+    }
+  else
+    { if ((ovl->flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0)
+        { sprintf(mesg,"LAs should not have chain flags");
+          return (CHECK_ERROR);
+        }
+    }
+
+  return (CHECK_OK);
+}
+
+  //  Duplicate check, and sort check if -S set, of ovl given the LA, last, and the chain
+  //    start, prev, before it
+
+static int check_order(Overlap *ovl, Overlap *last, Overlap *prev, int has_chains, char *mesg)
+{ int equal;
+
+  equal = 0;
+  if (SORTED)
+    { if (CHAIN_NEXT(ovl->flags))
+        { if (ovl->aread == last->aread && ovl->bread != last->bread &&
+              COMP(ovl->flags) != COMP(last->flags) &&
+              ovl->path.abpos >= last->path.abpos &&
+              ovl->path.bbpos >= last->path.bbpos)
+            goto dupcheck;
+          sprintf(mesg,"Chain is not valid (%d vs %d)",ovl->aread+1,ovl->bread+1);
+          return (CHECK_ERROR);
+        }
+      else if (!has_chains)
+        { if (ovl->aread > last->aread) goto inorder;
+          if (ovl->aread == last->aread)
+            { if (MAP_ORDER)
+                { if (ovl->path.abpos > prev->path.abpos) goto inorder;
+                  if (ovl->path.abpos == prev->path.abpos)
+                    goto dupcheck;
+                }
+              else
+                { if (ovl->bread > last->bread) goto inorder;
+                  if (ovl->bread == last->bread)
+                    { if (COMP(ovl->flags) > COMP(last->flags)) goto inorder;
+                      if (COMP(ovl->flags) == COMP(last->flags))
+                        { if (ovl->path.abpos > last->path.abpos) goto inorder;
+                          if (ovl->path.abpos == last->path.abpos)
+                            { equal = 1;
+                              goto inorder;
+                            }
+                        }
+                    }
+                }
+            }
+          sprintf(mesg,"LAs are not sorted (%d vs %d)",ovl->aread+1,ovl->bread+1);
+          return (CHECK_ERROR);
+        }
+      else //  First element of a chain
+        { if (ovl->aread > prev->aread) goto inorder;
+          if (ovl->aread == prev->aread)
+            { if (MAP_ORDER)
+                { if (ovl->path.abpos > prev->path.abpos) goto inorder;
+                  if (ovl->path.abpos == prev->path.abpos)
+                    goto dupcheck;
+                }
+              else
+                { if (ovl->bread > prev->bread) goto inorder;
+                  if (ovl->bread == prev->bread)
+                    { if (COMP(ovl->flags) > COMP(prev->flags)) goto inorder;
+                      if (COMP(ovl->flags) == COMP(prev->flags))
+                        { if (ovl->path.abpos > prev->path.abpos) goto inorder;
+                          if (ovl->path.abpos == prev->path.abpos)
+                            { equal = 1;
+                              goto dupcheck;
+                            }
+                        }
+                    }
+                }
+            }
+          sprintf(mesg,"Chains are not sorted (%d vs %d)",ovl->aread+1,ovl->bread+1);
+          return (CHECK_ERROR);
+        }
+    }
+dupcheck:
+  if (ovl->aread == last->aread && ovl->bread == last->bread &&
+      COMP(ovl->flags) == COMP(last->flags) && ovl->path.abpos == last->path.abpos)
+    equal = 1;
+inorder:
+  if (equal)
+    { if (ovl->path.aepos == last->path.aepos &&
+          ovl->path.bbpos == last->path.bbpos &&
+          ovl->path.bepos == last->path.bepos)
+        { sprintf(mesg,"Duplicate LAs (%d vs %d)",ovl->aread+1,ovl->bread+1);
+          return (CHECK_ERROR);
+        }
+    }
+  return (CHECK_OK);
+}
+
+  //  The state before the first LA of a file
+
+static void first_state(Overlap *last, Overlap *prev)
+{ last->aread = -1;
+  last->bread = -1;
+  last->flags =  0;
+  last->path.bbpos = last->path.abpos = 0;
+  last->path.bepos = last->path.aepos = 0;
+  *prev = *last;
+}
+
+  //  Check ovl, the n'th LA of chunk c
+
+static int check_la(Check_Work *w, File_Check *f, Chunk *c, Overlap *ovl, int64 n)
+{ int kind;
+
+  kind = check_record(w,f,ovl,c->mesg);
+  if (kind != CHECK_OK)
+    { if (kind == CHECK_TRACE)
+        c->bad = *ovl;
+      return (kind);
+    }
+
+  if ( ! c->klast || ( ! c->kprev && ! CHAIN_NEXT(ovl->flags)))
+    { Deferred *d;
+
+      if (c->ndefer >= c->dmax)
+        { c->dmax  = 1.2*c->ndefer + 10;
+          c->defer = (Deferred *) Realloc(c->defer,c->dmax*sizeof(Deferred),
+                                          "Allocating deferred checks");
+          if (c->defer == NULL)
+            exit (1);
+        }
+      d = c->defer + c->ndefer++;
+      d->idx   = n;
+      d->local = c->klast;
+      d->ovl   = *ovl;
+      d->last  = c->last;
+    }
+  else if (check_order(ovl,&c->last,&c->prev,f->has_chains,c->mesg))
+    return (CHECK_ERROR);
+
+  c->last  = *ovl;
+  c->klast = 1;
+  if (CHAIN_START(ovl->flags))
+    { c->prev     = *ovl;
+      c->kprev    = 1;
+      c->sawstart = 1;
+    }
+  return (CHECK_OK);
+}
+
+  //  Check the LAs of chunk c of file f
+
+static void check_chunk(Check_Work *w, File_Check *f, Chunk *c)
+{ Overlap ovl;
+  int64   n, tsize;
+  int     kind;
+
+  kind = CHECK_OK;
+  if (f->in->pack != NULL)     //  A packed .las is a single chunk read through its reader
+    { Las_Reader *in = f->in;
+
+      for (n = 0; n < f->novl; n++)
+        { if (Las_Available(in,LAS_OVL) < LAS_OVL)
+            { kind = CHECK_SHORT;
+              break;
+            }
+          ovl   = *((Overlap *) (in->ptr - LAS_PTR));
+          tsize = ovl.path.tlen*f->tbytes;
+          if (Las_Available(in,LAS_OVL+tsize) < LAS_OVL+tsize)
+            { kind = CHECK_SHORT;
+              break;
+            }
+          ovl.path.trace = in->ptr + LAS_OVL;
+          in->ptr   += LAS_OVL + tsize;
+          in->nread += 1;
+
+          if (n == 0)
+            f->has_chains = ((ovl.flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0);
+          kind = check_la(w,f,c,&ovl,n);
+          if (kind != CHECK_OK)
+            break;
+        }
+      if (kind == CHECK_OK && Las_Available(in,1) > 0)
+        kind = CHECK_MORE;
+    }
+
+  else
+    { char *p, *end;
+
+      p   = c->beg;
+      end = c->end;
+      for (n = 0; p < end; n++)
+        { if (f->top - p < LAS_OVL)
+            { kind = CHECK_SHORT;
+              break;
+            }
+          ovl   = *((Overlap *) (p - LAS_PTR));
+          tsize = ovl.path.tlen*f->tbytes;
+          if (f->top - p < LAS_OVL+tsize)
+            { kind = CHECK_SHORT;
+              break;
+            }
+          ovl.path.trace = p + LAS_OVL;
+          p += LAS_OVL + tsize;
+
+          kind = check_la(w,f,c,&ovl,n);
+          if (kind != CHECK_OK)
+            break;
+
+          if (p > end && ! c->over)     //  Not entered at an LA, check on to the end
+            { c->over = 1;
+              end     = f->top;
+            }
+        }
+    }
+
+  c->nrec = n;
+  c->kind = kind;
+}
+
+  //  Could a run of RESYNC LAs (or all those to the end of the file) start at p?
+
+static int plausible(File_Check *f, char *p)
+{ Overlap ovl;
+  int64   tsize;
+  int     k;
+
+  for (k = 0; k < RESYNC; k++)
+    { if (p == f->top)
+        return (k > 0);
+      if (f->top - p < LAS_OVL)
+        return (0);
+      ovl = *((Overlap *) (p - LAS_PTR));
+      if (ovl.path.tlen < 0)
+        return (0);
+      tsize = ovl.path.tlen*f->tbytes;
+      if (f->top - p < LAS_OVL+tsize)
+        return (0);
+      ovl.path.trace = p + LAS_OVL;
+      if (ovl.aread < 0 || ovl.bread < 0 || ovl.aread >= Nreads1 || ovl.bread >= Nreads2)
+        return (0);
+      if (ovl.path.abpos >= ovl.path.aepos || ovl.path.aepos > Reads1[ovl.aread].rlen ||
+          ovl.path.bbpos >= ovl.path.bepos || ovl.path.bepos > Reads2[ovl.bread].rlen ||
+          ovl.path.abpos < 0               || ovl.path.bbpos < 0                       )
+        return (0);
+      if (ovl.path.diffs < 0 || ovl.path.diffs > Reads1[ovl.aread].rlen ||
+                                ovl.path.diffs > Reads2[ovl.bread].rlen)
+        return (0);
+      if (Check_Trace_Points(&ovl,f->tspace,0,NULL))
+        return (0);
+      p += LAS_OVL + tsize;
+    }
+  return (1);
+}
+
+  //  Split the LAs of mapped file f into chunks at LAs found from its index, idx, if it has
+  //    one, or by scanning forward for a run of LAs that are plausible
+
+static void split_file(File_Check *f, Las_Index *idx)
+{ char  *beg, *map, *b;
+  int64  size, e;
+  int    n, k;
+
+  beg  = f->in->ptr;
+  map  = f->in->block - LAS_HEADER;
+  size = f->top - beg;
+
+  if (f->in->pack != NULL || size <= CHUNK_SIZE)
+    n = 1;
+  else
+    n = (size + CHUNK_SIZE-1) / CHUNK_SIZE;
+
+  f->chunk = (Chunk *) Malloc(n*sizeof(Chunk),"Allocating chunks");
+  if (f->chunk == NULL)
+    exit (1);
+
+  f->chunk[0].beg = beg;
+  f->nchunk = 1;
+  e = 0;
+  for (k = 1; k < n; k++)
+    { char *t, *lim;
+
+      t   = beg + (size*k)/n;
+      lim = beg + (size*(k+1))/n;
+      b   = NULL;
+      if (idx != NULL)
+        { while (e < idx->nent && map + idx->offset[e] < t)
+            e += 1;
+          if (e < idx->nent && map + idx->offset[e] < lim)
+            b = map + idx->offset[e];
+        }
+      else
+        { for (b = t; b < lim; b++)
+            if (plausible(f,b))
+              break;
+          if (b >= lim)
+            b = NULL;
+        }
+      if (b != NULL && b > f->chunk[f->nchunk-1].beg)
+        { f->chunk[f->nchunk-1].end = b;
+          f->chunk[f->nchunk++].beg = b;
+        }
+    }
+  f->chunk[f->nchunk-1].end = f->top;
+
+  for (k = 0; k < f->nchunk; k++)
+    { Chunk *c = f->chunk + k;
+
+      c->nrec     = 0;
+      c->kind     = CHECK_OK;
+      c->over     = 0;
+      c->sawstart = 0;
+      c->ndefer   = 0;
+      c->dmax     = 0;
+      c->defer    = NULL;
+      first_state(&c->last,&c->prev);
+      c->klast    = (k == 0);
+      c->kprev    = (k == 0 || ! (SORTED && f->has_chains));
+    }
+}
+
+  //  Files are checked by a pool of threads, a window of up to NFILE of them at a time: each
+  //    thread takes the next chunk of the oldest file with one left to check, while the main
+  //    thread opens the files and reports on them, in order, as they are done.  Unpacking a
+  //    corrupt block is fatal, so a packed file is not checked until those before it have
+  //    been reported.
+
+static pthread_mutex_t Check_Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  Check_Cond = PTHREAD_COND_INITIALIZER;
+
+static File_Check *Files;
+static int         NFILE;
+static int64       Fhead, Ftail;   //  Files[Fhead..Ftail-1 % NFILE] are in the window
+static int         Nomore;         //  No more files will enter the window
+
+static void *check_thread(void *arg)
+{ Check_Work *w = (Check_Work *) arg;
+  File_Check *f;
+  Chunk      *c;
+  int64       s;
+
+  while (1)
+    { pthread_mutex_lock(&Check_Lock);
+      while (1)
+        { f = NULL;
+          for (s = Fhead; s < Ftail; s++)
+            { f = Files + (s % NFILE);
+              if (f->ntaken < f->nchunk && (s == Fhead || f->in->pack == NULL))
+                break;
+            }
+          if (s < Ftail || Nomore)
+            break;
+          pthread_cond_wait(&Check_Cond,&Check_Lock);
+        }
+      if (s >= Ftail)
+        { pthread_mutex_unlock(&Check_Lock);
+          break;
+        }
+      c = f->chunk + f->ntaken++;
+      pthread_mutex_unlock(&Check_Lock);
+
+      check_chunk(w,f,c);
+
+      pthread_mutex_lock(&Check_Lock);
+      f->ndone += 1;
+      pthread_cond_broadcast(&Check_Cond);
+      pthread_mutex_unlock(&Check_Lock);
+    }
+  return (NULL);
+}
+
+  //  Once its chunks are checked, complete the checks of the deferred LAs and across the seams
+  //    of the chunks of file f, and report the first error in it if any, returning 1 if there
+  //    is one and 0 otherwise
+
+static int report_file(File_Check *f)
+{ Overlap last, prev;
+  Overlap *bad;
+  char    *mesg, buf[100];
+  int64    base, d;
+  int      k, kind;
+
+  pthread_mutex_lock(&Check_Lock);
+  while (f->ndone < f->nchunk)
+    pthread_cond_wait(&Check_Cond,&Check_Lock);
+  pthread_mutex_unlock(&Check_Lock);
+
+  mesg = buf;
+  bad  = NULL;
+  if (f->fail)
+    { kind = CHECK_ERROR;
+      mesg = f->mesg;
+    }
+  else
+    { first_state(&last,&prev);
+      kind = CHECK_OK;
+      base = 0;
+      for (k = 0; k < f->nchunk; k++)
+        { Chunk *c = f->chunk + k;
+
+          for (d = 0; d < c->ndefer; d++)
+            { Deferred *x = c->defer + d;
+
+              if (base + x->idx >= f->novl)
+                { kind = CHECK_MORE;
+                  break;
+                }
+              if (check_order(&x->ovl,x->local ? &x->last : &last,&prev,f->has_chains,mesg))
+                { kind = CHECK_ERROR;
+                  break;
+                }
+              if (CHAIN_START(x->ovl.flags))
+                prev = x->ovl;
+            }
+          if (kind != CHECK_OK)
+            break;
 
-static char *Usage = "[-vaS] <src1:db|dam> [ <src2:db|dam> ] <align:las> ...";
+          if (c->kind != CHECK_OK)
+            { if (c->kind == CHECK_MORE || base + c->nrec >= f->novl)
+                kind = CHECK_MORE;
+              else
+                { kind = c->kind;
+                  mesg = c->mesg;
+                  bad  = &(c->bad);
+                }
+              break;
+            }
+
+          base += c->nrec;
+          if (c->nrec > 0)
+            last = c->last;
+          if (c->sawstart)
+            prev = c->prev;
+          if (c->over)
+            break;
+        }
+      if (kind == CHECK_OK)
+        { if (base < f->novl)
+            kind = CHECK_SHORT;
+          else if (base > f->novl)
+            kind = CHECK_MORE;
+        }
+    }
+
+  if (VERBOSE)
+    { switch (kind)
+      { case CHECK_OK:
+          printf("  %s: ",f->disp);
+          Print_Number(f->novl,0,stdout);
+          printf(" all OK\n");
+          break;
+        case CHECK_ERROR:
+          fprintf(stderr,"  %s: %s\n",f->disp,mesg);
+          break;
+        case CHECK_TRACE:
+          Check_Trace_Points(bad,f->tspace,1,f->disp);
+          break;
+        case CHECK_SHORT:
+          fprintf(stderr,"  %s: Too few alignment records\n",f->disp);
+          break;
+        case CHECK_MORE:
+          fprintf(stderr,"  %s: Too many alignment records\n",f->disp);
+          break;
+      }
+      if (kind != CHECK_OK)
+        printf("  %s: Not OK, see stderr\n",f->disp);
+      fflush(stdout);
+    }
+
+  for (k = 0; k < f->nchunk; k++)
+    free(f->chunk[k].defer);
+  free(f->chunk);
+  if (f->in != NULL)
+    Close_Las_Reader(f->in);
+  if (f->input != NULL)
+    fclose(f->input);
+  free(f->disp);
+
+  return (kind != CHECK_OK);
+}
 
-#define MEMORY   1000   //  How many megabytes for output buffer
+  //  Map the file open on input, named disp at path, into f and split it into chunks
+
+static void open_file(File_Check *f, FILE *input, char *path, char *disp)
+{ Las_Reader *in;
+
+  f->disp   = disp;
+  f->input  = input;
+  f->fail   = 0;
+  f->nchunk = 0;
+  f->ntaken = 0;
+  f->ndone  = 0;
+  f->chunk  = NULL;
+
+  //  Map the file, so that every record and its trace is checked in place (those of
+  //    a packed file as each block is unpacked)
+
+  in = f->in = Open_Las_Map(input,0);
+  if (in == NULL)
+    { sprintf(f->mesg,"Too short to have a header, or cannot be mapped");
+      f->fail = 1;
+      return;
+    }
+  f->novl   = in->novl;
+  f->tspace = in->tspace;
+  f->top    = in->top;
+  if (f->novl < 0)
+    { sprintf(f->mesg,"Number of alignments < 0");
+      f->fail = 1;
+      return;
+    }
+  if (f->tspace < 0)
+    { sprintf(f->mesg,"Trace spacing < 0");
+      f->fail = 1;
+      return;
+    }
+
+  if (f->tspace <= TRACE_XOVR && f->tspace != 0)
+    f->tbytes = sizeof(uint8);
+  else
+    f->tbytes = sizeof(uint16);
+
+  f->has_chains = 0;
+  if (in->pack == NULL && f->novl > 0 && in->top - in->ptr >= LAS_OVL)
+    f->has_chains = ((((Overlap *) (in->ptr - LAS_PTR))->flags
+                                    & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0);
+
+  { Las_Index  *idx;
+    struct stat info;
+
+    idx = NULL;
+    if (in->pack == NULL && in->top - in->ptr > CHUNK_SIZE
+                         && fstat(fileno(input),&info) == 0)
+      idx = Read_Las_Index(Las_Index_Name(path,disp),f->novl,&info);
+    split_file(f,idx);
+    if (idx != NULL)
+      Free_Las_Index(idx);
+  }
+}
 
 int main(int argc, char *argv[])
 { DAZZ_DB   _db1,  *db1  = &_db1;
   DAZZ_DB   _db2,  *db2  = &_db2;
-  int        VERBOSE;
-  int        MAP_ORDER;
-  int        SORTED;
-  int        ISTWO;
+  int        NTHREADS;
+  int        CACHE_MB, CACHE_STATS;
   int        status;
 
   //  Process options
 
-  { int i, j, k;
-    int flags[128];
+  { int   i, j, k;
+    int   flags[128];
+    char *eptr;
 
     ARG_INIT("LAcheck")
 
+    NTHREADS    = 4;
+    CACHE_MB    = 64;
+    CACHE_STATS = 0;
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("vaS")
+            ARG_FLAGS("vaSt")
+            break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+          case 'C':
+            ARG_NON_NEGATIVE(CACHE_MB,"Read cache size")
+            CACHE_STATS = 1;
             break;
         }
       else
@@ -53,14 +768,20 @@ int main(int argc, char *argv[])
     VERBOSE   = flags['v'];
     MAP_ORDER = flags['a'];
     SORTED    = flags['S'];
+    TRACES    = flags['t'];
 
     if (argc <= 2)
-      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
+        fprintf(stderr,"       %*s %s\n",(int) strlen(Prog_Name),"",Usage[1]);
         fprintf(stderr,"\n");
         fprintf(stderr,"      -v: Verbose mode, output error messages.\n");
         fprintf(stderr,"      -S: Check that .las is in sorted order.\n");
         fprintf(stderr,"      -a: If -S, then check sorted by A-read, A-position pairs\n");
         fprintf(stderr,"          off => check sorted by A,B-read pairs (LA-piles)\n");
+        fprintf(stderr,"      -t: Check that the trace of each LA is consistent with the reads\n");
+        fprintf(stderr,"      -T: Check with -T threads.\n");
+        fprintf(stderr,"      -C: If -t, then cache up to -C MB of the reads (0 = none).\n");
+        fprintf(stderr,"          If given, report the hit rate of the cache on stderr.\n");
         exit (1);
       }
   }
@@ -101,292 +822,144 @@ int main(int argc, char *argv[])
     Trim_DB(db1);
   }
 
-  { char      *iblock;
-    int64      bsize, ovlsize, ptrsize;
-    int        i, j;
-    DAZZ_READ *reads1  = db1->reads;
-    int        nreads1 = db1->nreads;
-    DAZZ_READ *reads2  = db2->reads;
-    int        nreads2 = db2->nreads;
-
-    //  Setup IO buffers
-
-    ptrsize = sizeof(void *);
-    ovlsize = sizeof(Overlap) - ptrsize;
-    bsize   = MEMORY * 1000000ll;
-    iblock  = (char *) Malloc(bsize+ptrsize,"Allocating input block");
-    if (iblock == NULL)
+  Reads1  = db1->reads;
+  Nreads1 = db1->nreads;
+  Reads2  = db2->reads;
+  Nreads2 = db2->nreads;
+
+  { int         i, t;
+    Check_Work *work;
+    pthread_t  *threads;
+
+    //  Start the threads, each with its own reads and work data if -t, sharing a cache of
+    //    the reads
+
+    work    = (Check_Work *) Malloc(NTHREADS*sizeof(Check_Work),"Allocating thread data");
+    threads = (pthread_t *) Malloc(NTHREADS*sizeof(pthread_t),"Allocating threads");
+    NFILE   = 2*NTHREADS;
+    Files   = (File_Check *) Malloc(NFILE*sizeof(File_Check),"Allocating file window");
+    if (work == NULL || threads == NULL || Files == NULL)
       exit (1);
-    iblock += ptrsize;
+
+    for (t = 0; t < NTHREADS; t++)
+      { Check_Work *w = work+t;
+
+        if (TRACES)
+          { w->_db1 = *db1;
+            w->_db1.bases = Fopen(Catenate(db1->path,"","",".bps"),"r");
+            if (w->_db1.bases == NULL)
+              exit (1);
+            w->db1 = &(w->_db1);
+            if (ISTWO)
+              { w->_db2 = *db2;
+                w->_db2.bases = Fopen(Catenate(db2->path,"","",".bps"),"r");
+                if (w->_db2.bases == NULL)
+                  exit (1);
+                w->db2 = &(w->_db2);
+              }
+            else
+              w->db2 = w->db1;
+            w->work    = New_Work_Data();
+            w->abuffer = New_Read_Buffer(w->db1);
+            w->bbuffer = New_Read_Buffer(w->db2);
+            w->tmax    = 1000;
+            w->tbuffer = (uint16 *) Malloc(w->tmax*sizeof(uint16),"Allocating trace vector");
+            if (w->work == NULL || w->abuffer == NULL || w->bbuffer == NULL || w->tbuffer == NULL)
+              exit (1);
+          }
+        else
+          { w->work    = NULL;
+            w->abuffer = w->bbuffer = NULL;
+            w->tbuffer = NULL;
+            w->tmax    = 0;
+          }
+      }
+
+    if (TRACES && CACHE_MB > 0)
+      Cache = New_Read_Cache(CACHE_MB);
+    else
+      Cache = NULL;
+
+    Fhead  = Ftail = 0;
+    Nomore = 0;
+    for (t = 0; t < NTHREADS; t++)
+      pthread_create(threads+t,NULL,check_thread,work+t);
 
     //  For each file do
 
     status = 0;
     for (i = 2+ISTWO; i < argc; i++)
       { Block_Looper *parse;
-        FILE     *input;
-        char     *disp;
-        char     *iptr, *itop;
-        Overlap   last, prev;
-        int64     novl;
-        int       tspace, tbytes;
-        int       has_chains;
-
-        //  Establish IO and (novl,tspace) header
+        FILE         *input;
+        char         *path;
 
         parse = Parse_Block_LAS_Arg(argv[i]);
 
         while ((input = Next_Block_Arg(parse)) != NULL)
-          { disp = Block_Arg_Root(parse);
-
-            if (fread(&novl,sizeof(int64),1,input) != 1)
-              SYSTEM_READ_ERROR
-            if (fread(&tspace,sizeof(int),1,input) != 1)
-              SYSTEM_READ_ERROR
-            if (novl < 0)
-              { if (VERBOSE)
-                  fprintf(stderr,"  %s: Number of alignments < 0\n",disp);
-                goto error;
-              }
-            if (tspace < 0)
-              { if (VERBOSE)
-                  fprintf(stderr,"  %s: Trace spacing < 0\n",disp);
-                goto error;
+          { if (Ftail - Fhead >= NFILE)
+              { status |= report_file(Files + (Fhead % NFILE));
+                pthread_mutex_lock(&Check_Lock);
+                Fhead += 1;
+                pthread_cond_broadcast(&Check_Cond);
+                pthread_mutex_unlock(&Check_Lock);
               }
 
-            if (tspace <= TRACE_XOVR && tspace != 0)
-              tbytes = sizeof(uint8);
-            else
-              tbytes = sizeof(uint16);
-
-            iptr = iblock;
-            itop = iblock + fread(iblock,1,bsize,input);
-
-            //  For each record in file do
-
-            has_chains = 0;
-            last.aread = -1;
-            last.bread = -1;
-            last.flags =  0;
-            last.path.bbpos = last.path.abpos = 0;
-            last.path.bepos = last.path.aepos = 0;
-            prev = last;
-            for (j = 0; j < novl; j++)
-              { Overlap ovl;
-                int     tsize;
-                int     equal;
-
-                //  Fetch next record
-
-                if (iptr + ovlsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
-                    if (iptr + ovlsize > itop)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: Too few alignment records\n",disp);
-                        goto error;
-                      }
-                  }
-
-                ovl   = *((Overlap *) (iptr - ptrsize));
-                iptr += ovlsize;
-                tsize = ovl.path.tlen*tbytes;
-
-                if (iptr + tsize > itop)
-                  { int64 remains = itop-iptr;
-                    if (remains > 0)
-                      memmove(iblock,iptr,remains);
-                    iptr  = iblock;
-                    itop  = iblock + remains;
-                    itop += fread(itop,1,bsize-remains,input);
-                    if (iptr + tsize > itop)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: Too few alignment records\n",disp);
-                        goto error;
-                      }
-                  }
-                ovl.path.trace = iptr;
-                iptr += tsize;
-
-                //  Basic checks
-
-                if (ovl.aread < 0 || ovl.bread < 0)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Read indices < 0\n",disp);
-                    goto error;
-                  }
-                if (ovl.aread >= nreads1 || ovl.bread >= nreads2)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Read indices out of range\n",disp);
-                    goto error;
-                  }
-
-                if (ovl.path.abpos >= ovl.path.aepos || ovl.path.aepos > reads1[ovl.aread].rlen ||
-                    ovl.path.bbpos >= ovl.path.bepos || ovl.path.bepos > reads2[ovl.bread].rlen ||
-                    ovl.path.abpos < 0               || ovl.path.bbpos < 0                       )
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Non-sense alignment intervals\n",disp);
-                    goto error;
-                  }
-
-                if (ovl.path.diffs < 0 || ovl.path.diffs > reads1[ovl.aread].rlen ||
-                                          ovl.path.diffs > reads2[ovl.bread].rlen)
-                  { if (VERBOSE)
-                      fprintf(stderr,"  %s: Non-sense number of differences\n",disp);
-                    goto error;
-                  }
-
-                if (Check_Trace_Points(&ovl,tspace,VERBOSE,disp))
-                  goto error;
-
-                if (j == 0)
-                  has_chains = ((ovl.flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0);
-                if (has_chains)
-                  { if (CHAIN_START(ovl.flags) && CHAIN_NEXT(ovl.flags))
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: LA has both start & next flag set\n",disp);
-                        goto error;
-                      }
-                    if (BEST_CHAIN(ovl.flags) && CHAIN_NEXT(ovl.flags))
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: LA has both best & next flag set\n",disp);
-                        goto error;
-                      }
-                  }
-                else
-                  { if ((ovl.flags & (START_FLAG | NEXT_FLAG | BEST_FLAG)) != 0)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: LAs should not have chain flags\n",disp);
-                        goto error;
-                      }
-                  }
-
-                //  Duplicate check and sort check if -S set
-
-                equal = 0;
-                if (SORTED)
-                  { if (CHAIN_NEXT(ovl.flags))
-                      { if (ovl.aread == last.aread && ovl.bread != last.bread &&
-                            COMP(ovl.flags) != COMP(last.flags) &&
-                            ovl.path.abpos >= last.path.abpos &&
-                            ovl.path.bbpos >= last.path.bbpos)
-                          goto dupcheck;
-                        if (VERBOSE)
-                          fprintf(stderr,"  %s: Chain is not valid (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
-                      }
-                    else if (!has_chains)
-                      { if (ovl.aread > last.aread) goto inorder;
-                        if (ovl.aread == last.aread)
-                          { if (MAP_ORDER)
-                              { if (ovl.path.abpos > prev.path.abpos) goto inorder;
-                                if (ovl.path.abpos == prev.path.abpos)
-                                  goto dupcheck;
-                              }
-                            else
-                              { if (ovl.bread > last.bread) goto inorder;
-                                if (ovl.bread == last.bread)
-                                  { if (COMP(ovl.flags) > COMP(last.flags)) goto inorder;
-                                    if (COMP(ovl.flags) == COMP(last.flags))
-                                      { if (ovl.path.abpos > last.path.abpos) goto inorder;
-                                        if (ovl.path.abpos == last.path.abpos)
-                                          { equal = 1;
-                                            goto inorder;
-                                          }
-                                      }
-                                  }
-                              }
-                          }
-                        if (VERBOSE)
-                          fprintf(stderr,"  %s: LAs are not sorted (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
-                      }
-                    else //  First element of a chain
-                      { if (ovl.aread > prev.aread) goto inorder;
-                        if (ovl.aread == prev.aread)
-                          { if (MAP_ORDER)
-                              { if (ovl.path.abpos > prev.path.abpos) goto inorder;
-                                if (ovl.path.abpos == prev.path.abpos)
-                                  goto dupcheck;
-                              }
-                            else
-                              { if (ovl.bread > prev.bread) goto inorder;
-                                if (ovl.bread == prev.bread)
-                                  { if (COMP(ovl.flags) > COMP(prev.flags)) goto inorder;
-                                    if (COMP(ovl.flags) == COMP(prev.flags))
-                                      { if (ovl.path.abpos > prev.path.abpos) goto inorder;
-                                        if (ovl.path.abpos == prev.path.abpos)
-                                          { equal = 1;
-                                            goto dupcheck;
-                                          }
-                                      }
-                                  }
-                              }
-                          }
-                        if (VERBOSE)
-                          fprintf(stderr,"  %s: Chains are not sorted (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
-                      }
-                  }
-              dupcheck:
-                if (ovl.aread == last.aread && ovl.bread == last.bread &&
-                    COMP(ovl.flags) == COMP(last.flags) && ovl.path.abpos == last.path.abpos)
-                  equal = 1;
-              inorder:
-                if (equal)
-                  { if (ovl.path.aepos == last.path.aepos &&
-                        ovl.path.bbpos == last.path.bbpos &&
-                        ovl.path.bepos == last.path.bepos)
-                      { if (VERBOSE)
-                          fprintf(stderr,"  %s: Duplicate LAs (%d vs %d)\n",
-                                         disp,ovl.aread+1,ovl.bread+1);
-                        goto error;
-                      }
-                  }
-
-                last = ovl;
-                if (CHAIN_START(ovl.flags))
-                  prev = ovl;
-              }
+            path = Block_Arg_Path(parse);
+            open_file(Files + (Ftail % NFILE),input,path,Block_Arg_Root(parse));
+            free(path);
 
-            //  File processing epilog: Check all data read and print OK if -v
-
-            if (iptr < itop)
-              { if (VERBOSE)
-                  fprintf(stderr,"  %s: Too many alignment records\n",disp);
-                goto error;
-              }
-
-            if (VERBOSE)
-              { printf("  %s: ",disp);
-                Print_Number(novl,0,stdout);
-                printf(" all OK\n");
-                fflush(stdout);
-              }
-            goto cleanup;
-
-          error:
-            status = 1;
-            if (VERBOSE)
-              { printf("  %s: Not OK, see stderr\n",disp);
-                fflush(stdout);
-              }
-          cleanup:
-            if (input != NULL)
-              fclose(input);
+            pthread_mutex_lock(&Check_Lock);
+            Ftail += 1;
+            pthread_cond_broadcast(&Check_Cond);
+            pthread_mutex_unlock(&Check_Lock);
           }
 
         Free_Block_Arg(parse);
       }
 
-    free(iblock-ptrsize);
+    while (Fhead < Ftail)
+      { status |= report_file(Files + (Fhead % NFILE));
+        pthread_mutex_lock(&Check_Lock);
+        Fhead += 1;
+        pthread_cond_broadcast(&Check_Cond);
+        pthread_mutex_unlock(&Check_Lock);
+      }
+
+    pthread_mutex_lock(&Check_Lock);
+    Nomore = 1;
+    pthread_cond_broadcast(&Check_Cond);
+    pthread_mutex_unlock(&Check_Lock);
+    for (t = 0; t < NTHREADS; t++)
+      pthread_join(threads[t],NULL);
+
+    if (TRACES)
+      for (t = 0; t < NTHREADS; t++)
+        { Check_Work *w = work+t;
+
+          free(w->tbuffer);
+          free(w->bbuffer-1);
+          free(w->abuffer-1);
+          Free_Work_Data(w->work);
+          if (ISTWO)
+            fclose((FILE *) w->_db2.bases);
+          fclose((FILE *) w->_db1.bases);
+        }
+    if (Cache != NULL)
+      { if (CACHE_STATS)
+          { DAZZ_CACHE_STATS stats;
+            int64            loads;
+
+            Read_Cache_Stats(Cache,&stats);
+            loads = stats.hits + stats.misses;
+            fprintf(stderr,"%s: Read cache: %lld hits of %lld loads (%.1f%%), %lld evicted\n",
+                           Prog_Name,stats.hits,loads,(100.*stats.hits)/(loads > 0 ? loads : 1),
+                           stats.evicted);
+          }
+        Free_Read_Cache(Cache);
+      }
+    free(Files);
+    free(threads);
+    free(work);
   }
 
   Close_DB(db1);
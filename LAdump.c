@@ -20,9 +20,12 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
+
+#define IO_BLOCK 10000000   //  Buffer size of the reader of a .las that cannot be mapped
 
 static char *Usage =
-    "[-cdtlo] <src1:db|dam> [<src2:db|dam>] <align:las> [<reads:FILE> | <reads:range> ...]";
+    "[-cdtlob] <src1:db|dam> [<src2:db|dam>] <align:las> [<reads:FILE> | <reads:range> ...]";
 
 static int ORDER(const void *l, const void *r)
 { int x = *((int *) l);
@@ -30,20 +33,185 @@ static int ORDER(const void *l, const void *r)
   return (x-y);
 }
 
+  //  With -b the selected information is written to the standard output in a single pass as
+  //    a binary columnar container: a header giving the schema of the columns, then chunks of
+  //    up to COL_CHUNK LAs, each holding a fixed-width array per column, and finally an empty
+  //    chunk.  Every array is padded to a multiple of 8 bytes so that the whole of the output
+  //    can be mapped and each array used in place.
+
+#define COL_CHUNK  0x10000
+#define COL_MAX    11
+
+#define COL_LA     0   //  Column tables: one value per LA ...
+#define COL_TRACE  1   //    or per trace value
+
+typedef struct
+  { char  name[8];
+    int   width;
+    int   table;
+  } Col_Schema;
+
+static int         Ncol;           //  # of int columns, and their schemas and values
+static Col_Schema  Schema[COL_MAX];
+static int        *Cval[COL_MAX];
+
+static int     Clens, Ccoords, Cdiffs;   //  Which of the optional columns are present
+
+static int64   Nrec;               //  # of LAs in the current chunk
+static int64  *Tbeg;               //  Index of the first trace value of each LA (if -t)
+static int64   Tnext;              //  Index of the next trace value in the output
+static char   *Tval;               //  Trace values of the current chunk, as in the .las
+static int64   Nval, Vmax;
+static int     Tbytes;
+
+static void add_column(char *name)
+{ memset(Schema[Ncol].name,0,8);
+  strncpy(Schema[Ncol].name,name,8);
+  Schema[Ncol].width = sizeof(int);
+  Schema[Ncol].table = COL_LA;
+  Cval[Ncol] = (int *) Malloc(COL_CHUNK*sizeof(int),"Allocating column buffers");
+  if (Cval[Ncol] == NULL)
+    exit (1);
+  Ncol += 1;
+}
+
+static void write_padded(void *data, int64 size)
+{ static char zero[8];
+
+  FFWRITE(data,1,size,stdout)
+  if (size % 8 != 0)
+    FFWRITE(zero,1,8 - size%8,stdout)
+}
+
+static void write_chunk()
+{ int c;
+
+  FFWRITE(&Nrec,sizeof(int64),1,stdout)
+  FFWRITE(&Nval,sizeof(int64),1,stdout)
+  for (c = 0; c < Ncol; c++)
+    write_padded(Cval[c],Nrec*sizeof(int));
+  if (Tval != NULL)
+    { write_padded(Tbeg,Nrec*sizeof(int64));
+      write_padded(Tval,Nval*Tbytes);
+    }
+  Nrec = 0;
+  Nval = 0;
+}
+
+static void write_schema(int tspace, int docoords, int dodiffs, int dotrace, int dolens)
+{ static char magic[8] = { 'D', 'A', 'Z', 'Z', 'C', 'O', 'L', '1' };
+  int ncol, c;
+
+  Clens   = dolens;
+  Ccoords = docoords;
+  Cdiffs  = dodiffs;
+
+  Ncol = 0;
+  add_column("aread");
+  add_column("bread");
+  add_column("flags");
+  if (dolens)
+    { add_column("alen");
+      add_column("blen");
+    }
+  if (docoords)
+    { add_column("abpos");
+      add_column("aepos");
+      add_column("bbpos");
+      add_column("bepos");
+    }
+  if (dodiffs)
+    add_column("diffs");
+  ncol = Ncol;
+
+  Nrec  = 0;
+  Nval  = 0;
+  Tnext = 0;
+  Tval  = NULL;
+  if (dotrace)
+    { add_column("tlen");
+      ncol = Ncol+2;
+      Vmax = 4*COL_CHUNK;
+      Tbeg = (int64 *) Malloc(COL_CHUNK*sizeof(int64),"Allocating column buffers");
+      Tval = (char *) Malloc(Vmax*Tbytes,"Allocating column buffers");
+      if (Tbeg == NULL || Tval == NULL)
+        exit (1);
+    }
+
+  FFWRITE(magic,1,8,stdout)
+  FFWRITE(&tspace,sizeof(int),1,stdout)
+  FFWRITE(&ncol,sizeof(int),1,stdout)
+  for (c = 0; c < Ncol; c++)
+    FFWRITE(Schema+c,sizeof(Col_Schema),1,stdout)
+  if (dotrace)
+    { Col_Schema tbeg  = { "tbeg",  sizeof(int64), COL_LA };
+      Col_Schema trace = { "trace", 0, COL_TRACE };
+
+      trace.width = Tbytes;
+      FFWRITE(&tbeg,sizeof(Col_Schema),1,stdout)
+      FFWRITE(&trace,sizeof(Col_Schema),1,stdout)
+    }
+}
+
+static void write_record(Overlap *ovl, DAZZ_READ *read1, DAZZ_READ *read2)
+{ int v[COL_MAX];
+  int n, c;
+
+  n = 0;
+  v[n++] = ovl->aread+1;
+  v[n++] = ovl->bread+1;
+  v[n++] = ovl->flags;
+  if (Clens)
+    { v[n++] = read1[ovl->aread].rlen;
+      v[n++] = read2[ovl->bread].rlen;
+    }
+  if (Ccoords)
+    { v[n++] = ovl->path.abpos;
+      v[n++] = ovl->path.aepos;
+      v[n++] = ovl->path.bbpos;
+      v[n++] = ovl->path.bepos;
+    }
+  if (Cdiffs)
+    v[n++] = ovl->path.diffs;
+  if (Tval != NULL)
+    { int64 tlen = ovl->path.tlen;
+
+      v[n++] = tlen;
+      if (Nval + tlen > Vmax)
+        { Vmax = 1.2*(Nval+tlen) + 1000;
+          Tval = (char *) Realloc(Tval,Vmax*Tbytes,"Allocating column buffers");
+          if (Tval == NULL)
+            exit (1);
+        }
+      memcpy(Tval + Nval*Tbytes,LAS_TRACE(ovl),tlen*Tbytes);
+      Tbeg[Nrec] = Tnext;
+      Nval  += tlen;
+      Tnext += tlen;
+    }
+
+  for (c = 0; c < n; c++)
+    Cval[c][Nrec] = v[c];
+  Nrec += 1;
+  if (Nrec >= COL_CHUNK)
+    write_chunk();
+}
+
 int main(int argc, char *argv[])
 { DAZZ_DB   _db1, *db1 = &_db1; 
   DAZZ_DB   _db2, *db2 = &_db2; 
-  Overlap   _ovl, *ovl = &_ovl;
+  Overlap  *ovl;
 
   FILE   *input;
+  Las_Reader *reader;
+  Las_Index  *lidx;
   int64   novl;
-  int     tspace, tbytes, small;
-  int     trmax;
+  int     tspace, small;
   int     reps, *pts;
   int     input_pts;
 
   int     OVERLAP;
   int     DOCOORDS, DODIFFS, DOTRACE, DOLENS;
+  int     BINARY;
   int     ISTWO;
 
   //  Process options
@@ -58,7 +226,7 @@ int main(int argc, char *argv[])
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("ocdtl")
+            ARG_FLAGS("ocdtlb")
             break;
         }
       else
@@ -70,6 +238,7 @@ int main(int argc, char *argv[])
     DODIFFS   = flags['d'];
     DOTRACE   = flags['t'];
     DOLENS    = flags['l'];
+    BINARY    = flags['b'];
 
     if (DOTRACE)
       DOCOORDS = 1;
@@ -95,6 +264,7 @@ int main(int argc, char *argv[])
         fprintf(stderr," #la is the length of the a-read and #lb that of the b-read\n");
         fprintf(stderr,"\n");
         fprintf(stderr,"      -o: Output proper overlaps only\n");
+        fprintf(stderr,"      -b: Output binary columns of the above in place of 1-code lines\n");
 
         exit (1);
       }
@@ -183,7 +353,7 @@ int main(int argc, char *argv[])
           reps += 1;
 
       reps *= 2;
-      pts   = (int *) Malloc(sizeof(int)*reps,"Allocating read parameters");
+      pts   = (int *) Malloc(sizeof(int)*(reps+1),"Allocating read parameters");
       if (pts == NULL)
         exit (1);
 
@@ -192,6 +362,7 @@ int main(int argc, char *argv[])
         { fscanf(input," %d",&x);
           pts[v] = pts[v+1] = x;
         }
+      pts[reps] = INT32_MAX;
 
       fclose(input);
     }
@@ -277,133 +448,142 @@ int main(int argc, char *argv[])
     if (input == NULL)
       exit (1);
 
-    if (fread(&novl,sizeof(int64),1,input) != 1)
-      SYSTEM_READ_ERROR
-    if (fread(&tspace,sizeof(int),1,input) != 1)
-      SYSTEM_READ_ERROR
+    reader = Open_Las_Map(input,0);
+    if (reader == NULL)
+      reader = Open_Las_Reader(input,IO_BLOCK);
+    novl   = reader->novl;
+    tspace = reader->tspace;
+    small  = (reader->tbytes == sizeof(uint8));
 
-    if (tspace <= TRACE_XOVR && tspace != 0)
-      { small  = 1;
-        tbytes = sizeof(uint8);
-      }
-    else
-      { small  = 0;
-        tbytes = sizeof(uint16);
-      }
+    lidx = NULL;
+    { struct stat info;
+
+      if (reader->pack != NULL)     //  A packed .las is indexed by its footer
+        lidx = Las_Block_Index(reader,LAS_STRIDE);
+      else if (fstat(fileno(input),&info) == 0 && S_ISREG(info.st_mode))
+        lidx = Read_Las_Index(Las_Index_Name(pwd,root),novl,&info);
+    }
 
     free(pwd);
     free(root);
   }
 
-  //  Scan to count sizes of things
-
-  { int   j, al, tlen;
-    int   in, npt, idx, ar;
-    int64 novls, odeg, omax, sdeg, smax, tmax, ttot;
+  //  Scan to count sizes of things (the columns of -b are written without them)
 
-    in  = 0;
-    npt = pts[0];
-    idx = 1;
+  if (BINARY)
+    { Tbytes = reader->tbytes;
+      write_schema(tspace,DOCOORDS,DODIFFS,DOTRACE,DOLENS);
+    }
+  else
+    { int   j, al, tlen;
+      int   in, npt, idx, ar;
+      int64 novls, odeg, omax, sdeg, smax, tmax, ttot;
 
-    //  For each record do
+      in  = 0;
+      npt = pts[0];
+      idx = 1;
 
-    trmax = 0;
-    novls = omax = smax = ttot = tmax = 0;
-    sdeg  = odeg = 0;
+      //  For each record do
 
-    al = 0;
-    for (j = 0; j < novl; j++)
+      novls = omax = smax = ttot = tmax = 0;
+      sdeg  = odeg = 0;
 
-       //  Read it in
+      al = 0;
+      for (j = 0; j < novl; j++)
 
-      { Read_Overlap(input,ovl);
-        tlen = ovl->path.tlen;
-        fseeko(input,tlen*tbytes,SEEK_CUR);
-        if (tlen > trmax)
-          trmax = tlen;
+         //  Read it in
 
-        //  Determine if it should be displayed
+        { if (!in && lidx != NULL)     //  Skip straight to the next range if indexed
+            { int64 off, cnt;
 
-        ar = ovl->aread+1;
-        if (in)
-          { while (ar > npt)
-              { npt = pts[idx++];
-                if (ar < npt)
-                  { in = 0;
-                    break;
-                  }
-                npt = pts[idx++];
-              }
-          }
-        else
-          { while (ar >= npt)
-              { npt = pts[idx++];
-                if (ar <= npt)
-                  { in = 1;
+              Las_Index_Seek(lidx,npt-1,&off,&cnt);
+              if (cnt > j)
+                { Las_Goto(reader,off,cnt);
+                  j = cnt;
+                  if (j >= novl)
                     break;
-                  }
-                npt = pts[idx++];
-              }
-          }
-        if (!in)
-          continue;
+                }
+            }
 
-        //  If -o check display only overlaps
+          ovl  = Las_Next(reader);
+          tlen = ovl->path.tlen;
 
-        if (OVERLAP)
-          { if (ovl->path.abpos != 0 && ovl->path.bbpos != 0)
-              continue;
-            if (ovl->path.aepos != db1->reads[ovl->aread].rlen &&
-                ovl->path.bepos != db2->reads[ovl->bread].rlen)
-              continue;
-          }
+          //  Determine if it should be displayed
 
-        if (ar != al)
-          { if (sdeg > smax)
-              smax = sdeg;
-            if (odeg > omax)
-              omax = odeg;
-            sdeg = odeg = 0;
-            al = ar;
-          }
+          ar = ovl->aread+1;
+          if (in)
+            { while (ar > npt)
+                { npt = pts[idx++];
+                  if (ar < npt)
+                    { in = 0;
+                      break;
+                    }
+                  npt = pts[idx++];
+                }
+            }
+          else
+            { while (ar >= npt)
+                { npt = pts[idx++];
+                  if (ar <= npt)
+                    { in = 1;
+                      break;
+                    }
+                  npt = pts[idx++];
+                }
+            }
+          if (!in)
+            continue;
 
-        novls += 1;
-        odeg  += 1;
-        sdeg  += tlen;
-        ttot  += tlen;
-        if (tlen > tmax)
-          tmax = tlen;
-      }
+          //  If -o check display only overlaps
 
-    if (sdeg > smax)
-      smax = sdeg;
-    if (odeg > omax)
-      omax = odeg;
+          if (OVERLAP)
+            { if (ovl->path.abpos != 0 && ovl->path.bbpos != 0)
+                continue;
+              if (ovl->path.aepos != db1->reads[ovl->aread].rlen &&
+                  ovl->path.bepos != db2->reads[ovl->bread].rlen)
+                continue;
+            }
 
-    printf("+ P %lld\n",novls);
-    printf("%% P %lld\n",omax);
-    if (DOTRACE)
-      { printf("+ T %lld\n",ttot);
-        printf("%% T %lld\n",smax);
-        printf("@ T %lld\n",tmax);
-        printf("X %d\n",tspace);
-      }
-  }
+          if (ar != al)
+            { if (sdeg > smax)
+                smax = sdeg;
+              if (odeg > omax)
+                omax = odeg;
+              sdeg = odeg = 0;
+              al = ar;
+            }
+
+          novls += 1;
+          odeg  += 1;
+          sdeg  += tlen;
+          ttot  += tlen;
+          if (tlen > tmax)
+            tmax = tlen;
+        }
+
+      if (sdeg > smax)
+        smax = sdeg;
+      if (odeg > omax)
+        omax = odeg;
+
+      printf("+ P %lld\n",novls);
+      printf("%% P %lld\n",omax);
+      if (DOTRACE)
+        { printf("+ T %lld\n",ttot);
+          printf("%% T %lld\n",smax);
+          printf("@ T %lld\n",tmax);
+          printf("X %d\n",tspace);
+        }
+    }
 
   //  Read the file and display selected records
   
   { int        j, k;
-    uint16    *trace;
     int        in, npt, idx, ar;
     DAZZ_READ *read1, *read2;
 
-    rewind(input);
-    fread(&novl,sizeof(int64),1,input);
-    fread(&tspace,sizeof(int),1,input);
-
-    trace = (uint16 *) Malloc(sizeof(uint16)*trmax,"Allocating trace vector");
-    if (trace == NULL)
-      exit (1);
+    if (!BINARY)
+      Las_Goto(reader,0,0);
 
     read1 = db1->reads;
     read2 = db2->reads;
@@ -418,9 +598,19 @@ int main(int argc, char *argv[])
 
        //  Read it in
 
-      { Read_Overlap(input,ovl);
-        ovl->path.trace = (void *) trace;
-        Read_Trace(input,ovl,tbytes);
+      { if (!in && lidx != NULL)     //  Skip straight to the next range if indexed
+          { int64 off, cnt;
+
+            Las_Index_Seek(lidx,npt-1,&off,&cnt);
+            if (cnt > j)
+              { Las_Goto(reader,off,cnt);
+                j = cnt;
+                if (j >= novl)
+                  break;
+              }
+          }
+
+        ovl = Las_Next(reader);
 
         //  Determine if it should be displayed
 
@@ -459,7 +649,12 @@ int main(int argc, char *argv[])
           }
 
         //  Display it
-            
+
+        if (BINARY)
+          { write_record(ovl,read1,read2);
+            continue;
+          }
+
         printf("P %d %d",ovl->aread+1,ovl->bread+1);
         if (COMP(ovl->flags))
           printf(" c");
@@ -485,20 +680,34 @@ int main(int argc, char *argv[])
           printf("D %d\n",ovl->path.diffs);
 
         if (DOTRACE)
-          { uint16 *trace = (uint16 *) ovl->path.trace;
-            int     tlen  = ovl->path.tlen;
+          { int tlen = ovl->path.tlen;
 
-            if (small)
-              Decompress_TraceTo16(ovl);
             printf("T %d\n",tlen>>1);
-            for (k = 0; k < tlen; k += 2)
-              printf(" %d %d\n",trace[k],trace[k+1]);
+            if (small)
+              { uint8 *trace = (uint8 *) LAS_TRACE(ovl);
+
+                for (k = 0; k < tlen; k += 2)
+                  printf(" %d %d\n",trace[k],trace[k+1]);
+              }
+            else
+              { uint16 *trace = (uint16 *) LAS_TRACE(ovl);
+
+                for (k = 0; k < tlen; k += 2)
+                  printf(" %d %d\n",trace[k],trace[k+1]);
+              }
           }
       }
-
-    free(trace);
   }
 
+  if (BINARY)
+    { if (Nrec > 0)
+        write_chunk();
+      write_chunk();
+    }
+
+  Close_Las_Reader(reader);
+  fclose(input);
+
   Close_DB(db1);
   if (ISTWO)
     Close_DB(db2);
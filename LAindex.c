@@ -0,0 +1,137 @@
+/*******************************************************************************************
+ *
+ *  Index each of the sorted .las files U.las given, placing the byte offset of the first LA
+ *    of every stride of a-reads in a hidden sidecar file .U.las.idx.  LAshow and LAdump use
+ *    the index to go straight to the LAs of the read ranges they are asked for.
+ *
+ *  Date  :  October 2026
+ *
+ *******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "DB.h"
+#include "align.h"
+#include "las.h"
+
+static char *Usage = "[-v] [-s<int(16)>] <align:las> ...";
+
+#define IO_BLOCK 10000000   //  Buffer size of the reader
+
+int main(int argc, char *argv[])
+{ int       i;
+
+  int       VERBOSE;
+  int       STRIDE;
+
+  //  Process options
+
+  { int   j, k;
+    int   flags[128];
+    char *eptr;
+
+    ARG_INIT("LAindex")
+
+    STRIDE = LAS_STRIDE;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("v")
+            break;
+          case 's':
+            ARG_POSITIVE(STRIDE,"Index stride")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    VERBOSE = flags['v'];
+
+    if (argc <= 1)
+      { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
+        fprintf(stderr,"      -s: Index the first LA of every -s a-reads.\n");
+        exit (1);
+      }
+  }
+
+  //  For each file do
+
+  for (i = 1; i < argc; i++)
+    { Block_Looper *parse;
+      FILE         *input;
+      Las_Reader   *in;
+      Las_Index    *idx;
+      struct stat   info;
+
+      parse = Parse_Block_LAS_Arg(argv[i]);
+
+      while ((input = Next_Block_Arg(parse)) != NULL)
+        { char *root, *path;
+
+          path = Block_Arg_Path(parse);
+          root = Block_Arg_Root(parse);
+
+          if (fstat(fileno(input),&info) != 0 || ! S_ISREG(info.st_mode))
+            { fprintf(stderr,"%s: %s.las is not a regular file\n",Prog_Name,root);
+              exit (1);
+            }
+
+          in = Open_Las_Reader(input,IO_BLOCK);
+          if (in->pack != NULL)
+            { if (VERBOSE)
+                { printf("  %s: packed, indexed by its own footer\n",root);
+                  fflush(stdout);
+                }
+              Close_Las_Reader(in);
+              fclose(input);
+              free(root);
+              free(path);
+              continue;
+            }
+          idx = Build_Las_Index(in,STRIDE);
+          Close_Las_Reader(in);
+          fclose(input);
+
+          if (idx == NULL)
+            { fprintf(stderr,"%s: %s.las is not sorted on a-read, not indexed\n",
+                             Prog_Name,root);
+              exit (1);
+            }
+          if (idx->fsize != info.st_size)
+            { fprintf(stderr,"%s: %s.las is not of the size its header implies\n",
+                             Prog_Name,root);
+              exit (1);
+            }
+
+          Write_Las_Index(idx,Las_Index_Name(path,root),&info);
+
+          if (VERBOSE)
+            { printf("  %s: ",root);
+              Print_Number(idx->novl,0,stdout);
+              printf(" records, ");
+              Print_Number(idx->nent,0,stdout);
+              printf(" index entries\n");
+              fflush(stdout);
+            }
+
+          Free_Las_Index(idx);
+          free(root);
+          free(path);
+        }
+      Free_Block_Arg(parse);
+    }
+
+  exit (0);
+}
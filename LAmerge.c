@@ -10,201 +10,562 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <sys/resource.h>
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
-#undef   DEBUG
+static char *Usage = "[-vaz] [-T<int(4)>] [-M<int(4)>] [-P<dir(/tmp)>] <merge:las> <parts:las> ...";
 
-static char *Usage = "[-va] [-P<dir(/tmp)>] <merge:las> <parts:las> ...";
-
-#define MEMORY 4000   // in Mb
+static int64 MEMORY;   //  Bytes for I/O buffers (-M)
+static int   PACKED;   //  Write the merged output packed (-z)
 
 #define MAX_FILES 250
 
-  //  Heap sort of records according to (aread,bread,COMP(flags),abpos) order
-
-#define COMPARE(lp,rp)				\
-  if (lp->aread > rp->aread)			\
-    bigger = 1;					\
-  else if (lp->aread < rp->aread)		\
-    bigger = 0;					\
-  else if (lp->bread > rp->bread)		\
-    bigger = 1;					\
-  else if (lp->bread < rp->bread)		\
-    bigger = 0;					\
-  else if (COMP(lp->flags) > COMP(rp->flags))	\
-    bigger = 1;					\
-  else if (COMP(lp->flags) < COMP(rp->flags))	\
-    bigger = 0;					\
-  else if (lp->path.abpos > rp->path.abpos)	\
-    bigger = 1;					\
-  else if (lp->path.abpos < rp->path.abpos)	\
-    bigger = 0;					\
-  else if (lp > rp)				\
-    bigger = 1;					\
-  else						\
-    bigger = 0;
-
-static void reheap(int s, Overlap **heap, int hsize)
-{ int      c, l, r;
-  int      bigger;
-  Overlap *hs, *hr, *hl;
-
-  c  = s;
-  hs = heap[s];
-  while ((l = 2*c) <= hsize)
-    { r  = l+1;
-      hl = heap[l];
-      if (r > hsize)
-        bigger = 1;
-      else
-        { hr = heap[r];
-          COMPARE(hr,hl)
-        }
-      if (bigger)
-        { COMPARE(hs,hl)
-          if (bigger)
-            { heap[c] = hl;
-              c = l;
+  //  An input to a merge: the .las file 'name', or a run of 'novl' LAs (with a header) that
+  //    begins at 'offset' in the temporary file 'name'
+
+typedef struct
+  { char  *name;
+    int64  offset;
+    int64  novl;
+    char  *iname;    //  Name of the index the file may have (NULL for a run)
+    int    packed;   //  The input is a packed .las
+  } Merge_Input;
+
+  //  Write the index 'idx' of a merge to file 'iname' (if not NULL), once all of the merge
+  //    has been written to 'output', or remove any earlier index if there is none
+
+static void write_index(Las_Index *idx, FILE *output, char *iname)
+{ struct stat info;
+
+  if (iname == NULL)
+    return;
+  if (idx == NULL)
+    { unlink(iname);
+      return;
+    }
+  if (fflush(output) != 0 || fstat(fileno(output),&info) != 0)
+    SYSTEM_WRITE_ERROR
+  Write_Las_Index(idx,iname,&info);
+  Free_Las_Index(idx);
+}
+
+  //  Merge the 'nin' inputs in[0..nin-1], claimed to hold 'novl' LAs in all, to 'output'
+  //    (the file 'oname'), and if 'iname' is not NULL index the result in file iname
+
+static void serial_merge(Merge_Input *in, int nin, FILE *output, char *oname, char *iname,
+                         int64 novl, int tspace, int map_sort)
+{ Las_Reader **rdr;
+  Las_Writer  *out;
+  Las_Index   *idx;
+  FILE        *input;
+  int64        bsize, nout;
+  int          i;
+
+  bsize = MEMORY/(2*(nin + 1));        //  Readers and writer are double-buffered
+  rdr   = (Las_Reader **) Malloc(sizeof(Las_Reader *)*nin,"Allocating LAmerge readers");
+  if (rdr == NULL)
+    exit (1);
+
+  for (i = 0; i < nin; i++)
+    { input = Fopen(in[i].name,"r");
+      if (input == NULL)
+        exit (1);
+      if (in[i].offset > 0 && fseeko(input,in[i].offset,SEEK_SET) != 0)
+        SYSTEM_READ_ERROR
+      rdr[i] = Open_Las_Reader(input,bsize);
+      Set_Las_Read_Ahead(rdr[i]);
+    }
+
+  if (iname != NULL && PACKED)
+    out = Open_Las_Packed_Writer(output,novl,tspace,bsize);
+  else
+    out = Open_Las_Writer(output,novl,tspace,bsize);
+  Set_Las_Write_Behind(out);
+  if (iname != NULL)
+    Set_Las_Index(out,LAS_STRIDE,LAS_HEADER,0);
+  nout = Merge_Las(rdr,nin,out,map_sort);
+  idx  = Las_Writer_Index(out);
+  Close_Las_Writer(out);
+  write_index(idx,output,iname);
+
+  for (i = 0; i < nin; i++)
+    { input = rdr[i]->input;
+      Close_Las_Reader(rdr[i]);     //  First, as it waits for any read-ahead
+      fclose(input);
+    }
+  free(rdr);
+
+  if (nout != novl)
+    { fprintf(stderr,"%s: Did not write all records to %s (%lld)\n",Prog_Name,oname,novl-nout);
+      exit (1);
+    }
+}
+
+  //  A parallel merge divides the a-read range into segments, finds where each segment starts
+  //    in every input, and then merges the segments independently, each writing directly to
+  //    its place in the output.  The a-read and position of a unit (LA or chain) head about
+  //    every SAMPLE_RATE LAs of each input is sampled, from the input's index if it has a
+  //    current one and otherwise by scanning the input.  An index entry serves as a sample
+  //    whose a-read is that of the entry, which is no more than that of the LA it locates.
+  //    The splitters between segments are quantiles of the sampled a-reads, and the start
+  //    of a segment in an input is found by a binary search of its samples followed by a
+  //    short scan.
+
+#define SAMPLE_RATE 1000
+
+typedef struct
+  { int    aread;    //  A unit head of an input: its a-read,
+    int64  offset;   //    file offset,
+    int64  count;    //    and the number of LAs before it in the input
+  } Las_Mark;
+
+typedef struct
+  { Merge_Input *in;
+    int          nin;
+    int          tspace;
+    int          tbytes;
+    int          map_sort;
+    int64        bsize;     //  Buffer size for each reader and writer of a segment merge
+    Las_Mark   **samp;      //  samp[i][0..nsamp[i]-1] are the samples of input i
+    int         *nsamp;
+    int          nseg;      //  # of segments ...
+    int         *split;     //    split[r] is the least a-read of segment r > 0
+    Las_Mark    *bound;     //  bound[r*nin+i] is the start of segment r in input i (r <= nseg)
+    int64       *obase;     //  obase[r] is the output offset of segment r
+    char        *oname;
+    Las_Index  **index;     //  index[r] is that of segment r (NULL if not indexing)
+  } Merge_Plan;
+
+typedef struct
+  { Merge_Plan *plan;
+    int         beg, end;   //  Inputs or segments [beg,end) to process
+    int64       nout;
+  } Merge_Arg;
+
+static Las_Reader *open_segment(Merge_Plan *plan, int i, int64 offset, int64 novl)
+{ FILE *input;
+
+  input = Fopen(plan->in[i].name,"r");
+  if (input == NULL)
+    exit (1);
+  if (fseeko(input,offset,SEEK_SET) != 0)
+    SYSTEM_READ_ERROR
+  return (Open_Las_Segment_Reader(input,novl,plan->tspace,plan->bsize));
+}
+
+static void close_segment(Las_Reader *rdr)
+{ FILE *input = rdr->input;
+
+  Close_Las_Reader(rdr);     //  First, as it waits for any read-ahead
+  fclose(input);
+}
+
+  //  Sample input i from its index if it has a current one, returning 0 if it does not
+
+static int sample_index(Merge_Plan *plan, int i)
+{ Merge_Input *in = plan->in + i;
+  Las_Index   *idx;
+  Las_Mark    *samp;
+  struct stat  info;
+  int64        k, last;
+  int          ns;
+
+  if (in->iname == NULL || stat(in->name,&info) != 0)
+    return (0);
+  idx = Read_Las_Index(in->iname,in->novl,&info);
+  if (idx == NULL)
+    return (0);
+
+  samp = (Las_Mark *) Malloc(sizeof(Las_Mark)*(idx->nent+1),"Allocating merge samples");
+  if (samp == NULL)
+    exit (1);
+  ns   = 0;
+  last = -SAMPLE_RATE;
+  for (k = 0; k < idx->nent; k++)
+    if (k == 0 || idx->count[k]-last >= SAMPLE_RATE)
+      { samp[ns].aread  = k*idx->stride;
+        samp[ns].offset = idx->offset[k];
+        samp[ns].count  = idx->count[k];
+        ns  += 1;
+        last = idx->count[k];
+      }
+
+  plan->samp[i]  = samp;
+  plan->nsamp[i] = ns;
+
+  plan->bound[plan->nseg*plan->nin + i].aread  = -1;     //  End of input i
+  plan->bound[plan->nseg*plan->nin + i].offset = idx->fsize;
+  plan->bound[plan->nseg*plan->nin + i].count  = idx->novl;
+
+  Free_Las_Index(idx);
+  return (1);
+}
+
+static void *sample_thread(void *arg)
+{ Merge_Arg  *data = (Merge_Arg *) arg;
+  Merge_Plan *plan = data->plan;
+  Las_Reader *rdr;
+  Overlap    *ovl;
+  Las_Mark   *samp;
+  int64       off, n, last;
+  int         i, ns, nmax;
+
+  for (i = data->beg; i < data->end; i++)
+    { if (sample_index(plan,i))
+        continue;
+
+      off  = plan->in[i].offset + sizeof(int64) + sizeof(int);
+      rdr  = open_segment(plan,i,off,plan->in[i].novl);
+      nmax = plan->in[i].novl/SAMPLE_RATE + 10;
+      samp = (Las_Mark *) Malloc(sizeof(Las_Mark)*nmax,"Allocating merge samples");
+      if (samp == NULL)
+        exit (1);
+
+      ns   = 0;
+      last = -SAMPLE_RATE;
+      for (n = 0; (ovl = Las_Peek(rdr)) != NULL; n++)
+        { if (n == 0 || ( ! CHAIN_NEXT(ovl->flags) && n-last >= SAMPLE_RATE))
+            { if (ns >= nmax)
+                { nmax = 1.2*ns + 10;
+                  samp = (Las_Mark *) Realloc(samp,sizeof(Las_Mark)*nmax,
+                                              "Allocating merge samples");
+                  if (samp == NULL)
+                    exit (1);
+                }
+              samp[ns].aread  = ovl->aread;
+              samp[ns].offset = off;
+              samp[ns].count  = n;
+              ns  += 1;
+              last = n;
             }
-          else
-            break;
+          off += LAS_SPAN(ovl,plan->tbytes);
+          Las_Advance(rdr);
         }
-      else
-        { COMPARE(hs,hr)
-          if (bigger)
-            { heap[c] = hr;
-              c = r;
+      close_segment(rdr);
+
+      plan->samp[i]  = samp;
+      plan->nsamp[i] = ns;
+
+      plan->bound[plan->nseg*plan->nin + i].aread  = -1;     //  End of input i
+      plan->bound[plan->nseg*plan->nin + i].offset = off;
+      plan->bound[plan->nseg*plan->nin + i].count  = n;
+    }
+  return (NULL);
+}
+
+static void *bound_thread(void *arg)
+{ Merge_Arg  *data = (Merge_Arg *) arg;
+  Merge_Plan *plan = data->plan;
+  Las_Reader *rdr;
+  Overlap    *ovl;
+  Las_Mark   *samp, *b, *e;
+  int64       off, n;
+  int         r, i, s, l, h, m;
+
+  for (r = data->beg+1; r <= data->end; r++)      //  Splitters are numbered from 1
+    { s = plan->split[r];
+      for (i = 0; i < plan->nin; i++)
+        { samp = plan->samp[i];
+          b    = plan->bound + (r*plan->nin + i);
+          e    = plan->bound + (plan->nseg*plan->nin + i);
+
+          //  Find the last sample with a-read < s (if any), and scan from it to the first
+          //    unit head with a-read >= s
+
+          l = -1;
+          h = plan->nsamp[i];
+          while (h-l > 1)
+            { m = (l+h)/2;
+              if (samp[m].aread < s)
+                l = m;
+              else
+                h = m;
             }
-          else
-            break;
+          if (l < 0)
+            { if (plan->nsamp[i] > 0)
+                *b = samp[0];
+              else
+                *b = *e;
+              continue;
+            }
+
+          off = samp[l].offset;
+          n   = samp[l].count;
+          rdr = open_segment(plan,i,off,e->count - n);
+          while ((ovl = Las_Peek(rdr)) != NULL)
+            { if (ovl->aread >= s && ! CHAIN_NEXT(ovl->flags))
+                break;
+              off += LAS_SPAN(ovl,plan->tbytes);
+              n   += 1;
+              Las_Advance(rdr);
+            }
+          close_segment(rdr);
+
+          b->aread  = s;
+          b->offset = off;
+          b->count  = n;
         }
     }
-  if (c != s)
-    heap[c] = hs;
+  return (NULL);
 }
 
-  //  Heap sort of records according to (aread,abpos) order
-
-#define MAPARE(lp,rp)				\
-  if (lp->aread > rp->aread)			\
-    bigger = 1;					\
-  else if (lp->aread < rp->aread)		\
-    bigger = 0;					\
-  else if (lp->path.abpos > rp->path.abpos)	\
-    bigger = 1;					\
-  else if (lp->path.abpos < rp->path.abpos)	\
-    bigger = 0;					\
-  else if (lp > rp)				\
-    bigger = 1;					\
-  else						\
-    bigger = 0;
-
-static void maheap(int s, Overlap **heap, int hsize)
-{ int      c, l, r;
-  int      bigger;
-  Overlap *hs, *hr, *hl;
-
-  c  = s;
-  hs = heap[s];
-  while ((l = 2*c) <= hsize)
-    { r  = l+1;
-      hl = heap[l];
-      if (r > hsize)
-        bigger = 1;
-      else
-        { hr = heap[r];
-          MAPARE(hr,hl)
-        }
-      if (bigger)
-        { MAPARE(hs,hl)
-          if (bigger)
-            { heap[c] = hl;
-              c = l;
-            }
-          else
-            break;
+static void *segment_thread(void *arg)
+{ Merge_Arg   *data = (Merge_Arg *) arg;
+  Merge_Plan  *plan = data->plan;
+  Las_Reader **rdr;
+  Las_Writer  *out;
+  Las_Mark    *b, *e;
+  FILE        *output;
+  int          r, i, nin;
+
+  nin = plan->nin;
+  rdr = (Las_Reader **) Malloc(sizeof(Las_Reader *)*nin,"Allocating LAmerge readers");
+  if (rdr == NULL)
+    exit (1);
+
+  data->nout = 0;
+  for (r = data->beg; r < data->end; r++)
+    { for (i = 0; i < nin; i++)
+        { b = plan->bound + (r*nin + i);
+          e = plan->bound + ((r+1)*nin + i);
+          rdr[i] = open_segment(plan,i,b->offset,e->count - b->count);
+          Set_Las_Read_Ahead(rdr[i]);
         }
-      else
-        { MAPARE(hs,hr)
-          if (bigger)
-            { heap[c] = hr;
-              c = r;
-            }
-          else
-            break;
+
+      output = Fopen(plan->oname,"r+");
+      if (output == NULL)
+        exit (1);
+      if (fseeko(output,plan->obase[r],SEEK_SET) != 0)
+        SYSTEM_WRITE_ERROR
+
+      out = Open_Las_Segment_Writer(output,plan->tspace,plan->bsize);
+      Set_Las_Write_Behind(out);
+      if (plan->index != NULL)
+        { int64 count = 0;
+
+          for (i = 0; i < nin; i++)
+            count += plan->bound[r*nin + i].count;
+          Set_Las_Index(out,LAS_STRIDE,plan->obase[r]-plan->obase[0]+LAS_HEADER,count);
         }
+      data->nout += Merge_Las(rdr,nin,out,plan->map_sort);
+      if (plan->index != NULL)
+        plan->index[r] = Las_Writer_Index(out);
+      Close_Las_Writer(out);
+      if (fclose(output) != 0)
+        SYSTEM_CLOSE_ERROR
+
+      for (i = 0; i < nin; i++)
+        close_segment(rdr[i]);
     }
-  if (c != s)
-    heap[c] = hs;
+
+  free(rdr);
+  return (NULL);
+}
+
+static int INT_SORT(const void *l, const void *r)
+{ int x = *((int *) l);
+  int y = *((int *) r);
+  return (x - y);
 }
 
-#ifdef DEBUG
+  //  Run [0,n) divided evenly over nthreads threads with body 'thread'
+
+static void run_threads(void *(*thread)(void *), Merge_Plan *plan, int n, int nthreads,
+                        Merge_Arg *parm)
+{ pthread_t threads[nthreads];
+  int       t;
 
-static void showheap(Overlap **heap, int hsize)
-{ int i;
-  printf("\n");
-  for (i = 1; i <= hsize; i++)
-    printf(" %3d: %5d, %5d\n",i,heap[i]->aread,heap[i]->bread);
+  for (t = 0; t < nthreads; t++)
+    { parm[t].plan = plan;
+      parm[t].beg  = (n*t)/nthreads;
+      parm[t].end  = (n*(t+1))/nthreads;
+      pthread_create(threads+t,NULL,thread,parm+t);
+    }
+  for (t = 0; t < nthreads; t++)
+    pthread_join(threads[t],NULL);
 }
 
-#endif
+  //  Merge as for serial_merge but with up to 'nthreads' threads, returning 0 if the
+  //    inputs cannot usefully be divided (and so nothing was done).  At most 'nthreads'
+  //    segments are merged, each opening every input, and so their number is limited by
+  //    the number of files a process may have open.  Segments are located by file offset,
+  //    and so a packed input or output is always merged serially.
+
+static int parallel_merge(Merge_Input *in, int nin, FILE *output, char *oname, char *iname,
+                          int64 novl, int tspace, int map_sort, int nthreads)
+{ Merge_Plan    plan;
+  Merge_Arg     parm[nthreads];
+  struct rlimit rlim;
+  int          *areads;
+  int64         nout, base, size;
+  int           i, r, t, na, nseg;
+
+  if (getrlimit(RLIMIT_NOFILE,&rlim) == 0 && rlim.rlim_cur != RLIM_INFINITY)
+    { if ((int64) rlim.rlim_cur < 2*(nin+1) + 20)
+        return (0);
+      if (nthreads > (int) ((rlim.rlim_cur - 20) / (nin+1)))
+        nthreads = (rlim.rlim_cur - 20) / (nin+1);
+    }
+  if (nthreads <= 1 || (iname != NULL && PACKED))
+    return (0);
+  for (i = 0; i < nin; i++)
+    if (in[i].packed)
+      return (0);
+
+  plan.in       = in;
+  plan.nin      = nin;
+  plan.tspace   = tspace;
+  plan.tbytes   = Las_Trace_Bytes(tspace);
+  plan.map_sort = map_sort;
+  plan.oname    = oname;
+  plan.index    = NULL;
+  plan.bsize    = MEMORY/(2*nthreads*(nin + 1));
+  plan.nseg     = nthreads;
+  plan.samp     = (Las_Mark **) Malloc(sizeof(Las_Mark *)*nin,"Allocating merge plan");
+  plan.nsamp    = (int *) Malloc(sizeof(int)*nin,"Allocating merge plan");
+  plan.split    = (int *) Malloc(sizeof(int)*(nthreads+1),"Allocating merge plan");
+  plan.bound    = (Las_Mark *) Malloc(sizeof(Las_Mark)*(nthreads+1)*nin,"Allocating merge plan");
+  plan.obase    = (int64 *) Malloc(sizeof(int64)*(nthreads+1),"Allocating merge plan");
+  if (plan.samp == NULL || plan.nsamp == NULL || plan.split == NULL || plan.bound == NULL
+                        || plan.obase == NULL)
+    exit (1);
 
-  //  Input block data structure and block fetcher
+  //  Sample the inputs, placing the end of each in bound[nthreads]
 
-typedef struct
-  { FILE   *stream;
-    char   *block;
-    char   *ptr;
-    char   *top;
-    int64   count;
-  } IO_block;
-
-static void ovl_reload(IO_block *in, int64 bsize)
-{ int64 remains;
-
-  remains = in->top - in->ptr;
-  if (remains > 0)
-    memmove(in->block, in->ptr, remains);
-  in->ptr  = in->block;
-  in->top  = in->block + remains;
-  in->top += fread(in->top,1,bsize-remains,in->stream);
+  run_threads(sample_thread,&plan,nin,(nin < nthreads ? nin : nthreads),parm);
+
+  //  Choose the splitters as distinct quantiles of the sampled a-reads
+
+  na = 0;
+  for (i = 0; i < nin; i++)
+    na += plan.nsamp[i];
+  areads = (int *) Malloc(sizeof(int)*(na+1),"Allocating merge plan");
+  if (areads == NULL)
+    exit (1);
+  na = 0;
+  for (i = 0; i < nin; i++)
+    for (t = 0; t < plan.nsamp[i]; t++)
+      areads[na++] = plan.samp[i][t].aread;
+  qsort(areads,na,sizeof(int),INT_SORT);
+
+  nseg = 1;
+  for (t = 1; t < nthreads; t++)
+    { r = areads[(((int64) na)*t)/nthreads];
+      if (r > (nseg == 1 ? areads[0] : plan.split[nseg-1]))
+        plan.split[nseg++] = r;
+    }
+  free(areads);
+
+  if (nseg > 1)
+    { for (i = 0; i < nin; i++)     //  Move the input ends to bound[nseg]
+        plan.bound[nseg*nin + i] = plan.bound[nthreads*nin + i];
+      plan.nseg = nseg;
+
+      for (i = 0; i < nin; i++)
+        { plan.bound[i].aread  = 0;
+          plan.bound[i].offset = in[i].offset + sizeof(int64) + sizeof(int);
+          plan.bound[i].count  = 0;
+        }
+      run_threads(bound_thread,&plan,nseg-1,nseg-1,parm);
+
+      //  Place the segments in the output after the header, and merge them
+
+      base = ftello(output);
+      if (fwrite(&novl,sizeof(int64),1,output) != 1)
+        SYSTEM_WRITE_ERROR
+      if (fwrite(&tspace,sizeof(int),1,output) != 1)
+        SYSTEM_WRITE_ERROR
+      if (fflush(output) != 0)
+        SYSTEM_WRITE_ERROR
+
+      size = base + sizeof(int64) + sizeof(int);
+      for (r = 0; r < nseg; r++)
+        { plan.obase[r] = size;
+          for (i = 0; i < nin; i++)
+            size += plan.bound[(r+1)*nin + i].offset - plan.bound[r*nin + i].offset;
+        }
+
+      if (iname != NULL)
+        { plan.index = (Las_Index **) Malloc(sizeof(Las_Index *)*nseg,"Allocating merge plan");
+          if (plan.index == NULL)
+            exit (1);
+        }
+
+      run_threads(segment_thread,&plan,nseg,nseg,parm);
+
+      if (iname != NULL)
+        { write_index(Join_Las_Index(plan.index,nseg),output,iname);
+          for (r = 0; r < nseg; r++)
+            if (plan.index[r] != NULL)
+              Free_Las_Index(plan.index[r]);
+          free(plan.index);
+        }
+
+      nout = 0;
+      for (t = 0; t < nseg; t++)
+        nout += parm[t].nout;
+
+      if (fseeko(output,size,SEEK_SET) != 0)
+        SYSTEM_WRITE_ERROR
+      if (nout != novl)
+        { fprintf(stderr,"%s: Did not write all records to %s (%lld)\n",
+                         Prog_Name,oname,novl-nout);
+          exit (1);
+        }
+    }
+
+  for (i = 0; i < nin; i++)
+    free(plan.samp[i]);
+  free(plan.obase);
+  free(plan.bound);
+  free(plan.split);
+  free(plan.nsamp);
+  free(plan.samp);
+
+  return (nseg > 1);
 }
 
-  //  The program
+static void merge_group(Merge_Input *in, int nin, FILE *output, char *oname, char *iname,
+                        int64 novl, int tspace, int map_sort, int nthreads)
+{ if (nthreads > 1 && parallel_merge(in,nin,output,oname,iname,novl,tspace,map_sort,nthreads))
+    return;
+  serial_merge(in,nin,output,oname,iname,novl,tspace,map_sort);
+}
 
 int main(int argc, char *argv[])
-{ IO_block *in;
-  int64     bsize, osize, psize;
-  char     *block, *oblock;
-  int       i, c, fway, clen, nfile[argc];
-  Overlap **heap;
-  int       hsize;
-  Overlap  *ovls;
+{ int       i, c, fway, fmax;
+  char    **fname;
+  char    **finame;   //  Names of the indices the files may have
+  int64    *fnovl;
+  int      *fpack;
   int64     totl;
-  int       tspace, tbytes;
-  FILE     *output;
-  char     *optr, *otop;
+  int       tspace;
 
   int       VERBOSE;
   int       MAP_SORT;
+  int       NTHREADS;
   char     *TEMP_PATH;
 
   //  Process command line
 
-  { int  j, k;
-    int  flags[128];
-    DIR *dirp;
+  { int   j, k;
+    int   flags[128];
+    char *eptr;
+    DIR  *dirp;
 
     ARG_INIT("LAmerge")
 
+    NTHREADS  = 4;
+    MEMORY    = 4*0x40000000ll;
     TEMP_PATH = "/tmp";
 
     j = 1;
@@ -212,8 +573,18 @@ int main(int argc, char *argv[])
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("va")
+            ARG_FLAGS("vaz")
             break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+          case 'M':
+            { int limit;
+
+              ARG_POSITIVE(limit,"Memory for I/O buffers (in Gb)")
+              MEMORY = limit * 0x40000000ll;
+              break;
+            }
           case 'P':
             TEMP_PATH = argv[i]+2;
             if ((dirp = opendir(TEMP_PATH)) == NULL)
@@ -229,6 +600,7 @@ int main(int argc, char *argv[])
 
     VERBOSE  = flags['v'];
     MAP_SORT = flags['a'];
+    PACKED   = flags['z'];
 
     if (argc < 3)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
@@ -236,6 +608,9 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
         fprintf(stderr,"      -a: sort .las by A-read,A-position pairs for map usecase\n");
         fprintf(stderr,"          off => sort .las by A,B-read pairs for overlap piles\n");
+        fprintf(stderr,"      -z: Write the merged .las packed.\n");
+        fprintf(stderr,"      -T: Use -T threads.\n");
+        fprintf(stderr,"      -M: Use -M GB of memory for I/O buffers.\n");
         fprintf(stderr,"      -P: Do any intermediate merging in directory -P.\n");
         exit (1);
       }
@@ -243,35 +618,29 @@ int main(int argc, char *argv[])
 
   //  Determine the number of files and check they are all mergeable
 
-  clen   = 2*strlen(TEMP_PATH) + 50;
+  fname  = NULL;
+  finame = NULL;
+  fnovl  = NULL;
+  fpack  = NULL;
+  fmax   = 0;
   fway   = 0;
   totl   = 0;
   tspace = -1;
   for (c = 2; c < argc; c++)
     { Block_Looper *parse;
       FILE *input;
-      char *root, *path;
 
       parse = Parse_Block_LAS_Arg(argv[c]);
 
-      path = Block_Arg_Path(parse);
-      root = Block_Arg_Root(parse);
-
-      clen += strlen(path) + strlen(root) + 30;
-
-      free(root);
-      free(path);
-
-      nfile[c] = 0;
       while ((input = Next_Block_Arg(parse)) != NULL)
         { int64 povl;
-          int   mspace;
+          int   mspace, version;
+          char *root, *path;
 
-          if (fread(&povl,sizeof(int64),1,input) != 1)
-            SYSTEM_READ_ERROR
+          version = Las_Header(input,&povl,&mspace);
+          if (version < 0)
+            exit (1);
           totl += povl;
-          if (fread(&mspace,sizeof(int),1,input) != 1)
-            SYSTEM_READ_ERROR
           if (tspace < 0)
             tspace = mspace;
           else if (tspace != mspace)
@@ -280,13 +649,31 @@ int main(int argc, char *argv[])
               fprintf(stderr," (%d vs %d)\n",tspace,mspace);
               exit (1);
             }
-
           fclose(input);
-          nfile[c] += 1;
+
+          if (fway >= fmax)
+            { fmax   = 1.2*fway + 100;
+              fname  = (char **) Realloc(fname,sizeof(char *)*fmax,"Allocating file list");
+              finame = (char **) Realloc(finame,sizeof(char *)*fmax,"Allocating file list");
+              fnovl  = (int64 *) Realloc(fnovl,sizeof(int64)*fmax,"Allocating file list");
+              fpack  = (int *) Realloc(fpack,sizeof(int)*fmax,"Allocating file list");
+              if (fname == NULL || finame == NULL || fnovl == NULL || fpack == NULL)
+                exit (1);
+            }
+          path = Block_Arg_Path(parse);
+          root = Block_Arg_Root(parse);
+          fname[fway]  = Strdup(Catenate(path,"/",root,".las"),"Allocating file list");
+          finame[fway] = Strdup(Las_Index_Name(path,root),"Allocating file list");
+          fnovl[fway]  = povl;
+          fpack[fway]  = (version == 2);
+          if (fname[fway] == NULL || finame[fway] == NULL)
+            exit (1);
+          fway += 1;
+          free(root);
+          free(path);
         }
 
       Free_Block_Arg(parse);
-      fway += nfile[c];
     }
 
   if (VERBOSE)
@@ -296,229 +683,103 @@ int main(int argc, char *argv[])
       fflush(stdout);
     }
 
-  //  Must recursively merge, emit sub-merges, then merge their results
-
-  if (fway > MAX_FILES)
-    { Block_Looper *parse;
-      int   mul, dim, fsum, cut;
-      char  command[clen], *com;
-      int   pid;
+  //  Merge in passes, each merging groups of at most MAX_FILES inputs into runs that are
+  //    appended to a single temporary file, until the inputs can be merged in one go.
+  //    Groups are of consecutive inputs so that ties still go to the earlier input.
 
-      mul = 1;
-      for (c = 0; mul < fway; c++)
-        mul *= MAX_FILES;
-      dim = pow(1.*fway,1./c)+1;
+  { Merge_Input *src, *trg;
+    FILE        *temp;
+    char        *tname;
+    int          nsrc, ntrg, lo, hi;
 
-      fsum = 0;
-      c = 2;
-
-      parse = Parse_Block_LAS_Arg(argv[c]);
-
-      pid = getpid();
-      for (i = 1; i <= dim; i++)
-        { com = command;
-          com += sprintf(com,"LAmerge");
-          if (MAP_SORT)
-            com += sprintf(com," -a");
-          if (mul > 2)
-            com += sprintf(com," -P%s",TEMP_PATH);
-          com += sprintf(com," %s/LM%d.P%d",TEMP_PATH,pid,i);
-
-          cut = (fway * i) / dim;
-          while (fsum + nfile[c] <= cut)
-            { com  += sprintf(com," %s",Next_Block_Slice(parse,nfile[c]));
-              fsum += nfile[c];
-
-              c += 1;
-              if (c >= argc)
-                break;
-
-              Free_Block_Arg(parse);
-
-              parse = Parse_Block_LAS_Arg(argv[c]);
-            }
-          if (c < argc && fsum < cut)
-            { int n = cut-fsum;
-              com += sprintf(com," %s",Next_Block_Slice(parse,n));
-              nfile[c] -= n;
-              fsum     += n;
-            }
-          system(command);
-        }
-
-      Free_Block_Arg(parse);
-
-      com = command;
-      com += sprintf(com,"LAmerge");
-      if (MAP_SORT)
-        com += sprintf(com," -a");
-      com += sprintf(com," %s %s/LM%d.P%c",argv[1],TEMP_PATH,pid,BLOCK_SYMBOL);
-      system(command);
-
-      sprintf(command,"rm %s/LM%d.P*.las",TEMP_PATH,pid);
-      system(command);
-
-      exit (0);
-    }
-
-  //  Base level merge: Open all the input files and initialize their buffers
-
-  psize  = sizeof(void *);
-  osize  = sizeof(Overlap) - psize;
-  bsize  = (MEMORY*1000000ll)/(fway + 1);
-  block  = (char *) Malloc(bsize*(fway+1)+psize,"Allocating LAmerge blocks");
-  in     = (IO_block *) Malloc(sizeof(IO_block)*fway,"Allocating LAmerge IO-reacords");
-  if (block == NULL || in == NULL)
-    exit (1);
-  block += psize;
-
-  fway = 0;
-  for (c = 2; c < argc; c++)
-    { Block_Looper *parse;
-      FILE  *input;
-
-      parse = Parse_Block_LAS_Arg(argv[c]);
-
-      while ((input = Next_Block_Arg(parse)) != NULL)
-        { int64  novl;
-          int    mspace;
-          char  *iblock;
-
-          if (fread(&novl,sizeof(int64),1,input) != 1)
-            SYSTEM_READ_ERROR
-          if (fread(&mspace,sizeof(int),1,input) != 1)
-            SYSTEM_READ_ERROR
-
-          in[fway].stream = input;
-          in[fway].block  = iblock = block+fway*bsize;
-          in[fway].ptr    = iblock;
-          in[fway].top    = iblock + fread(in[fway].block,1,bsize,input);
-          in[fway].count  = 0;
-          fway += 1;
-        }
-
-      Free_Block_Arg(parse);
-    }
-  if (tspace <= TRACE_XOVR && tspace != 0)
-    tbytes = sizeof(uint8);
-  else
-    tbytes = sizeof(uint16);
-
-  //  Open the output file buffer and write (novl,tspace) header
-
-  { char *pwd, *root;
-
-    pwd    = PathTo(argv[1]);
-    root   = Root(argv[1],".las");
-    output = Fopen(Catenate(pwd,"/",root,".las"),"w");
-    if (output == NULL)
+    src = (Merge_Input *) Malloc(sizeof(Merge_Input)*fway,"Allocating merge inputs");
+    if (src == NULL)
       exit (1);
-    free(pwd);
-    free(root);
-
-    if (fwrite(&totl,sizeof(int64),1,output) != 1)
-      SYSTEM_READ_ERROR
-    if (fwrite(&tspace,sizeof(int),1,output) != 1)
-      SYSTEM_READ_ERROR
-
-    oblock = block+fway*bsize;
-    optr   = oblock;
-    otop   = oblock + bsize;
-  }
-
-  //  Initialize the heap
-
-  heap = (Overlap **) Malloc(sizeof(Overlap *)*(fway+1),"Allocating heap");
-  ovls = (Overlap *) Malloc(sizeof(Overlap)*fway,"Allocating heap");
-  if (heap == NULL || ovls == NULL)
-    exit (1);
-
-  hsize = 0;
-  for (i = 0; i < fway; i++)
-    { if (in[i].ptr < in[i].top)
-        { ovls[i]     = *((Overlap *) (in[i].ptr - psize));
-          in[i].ptr  += osize;
-          hsize      += 1;
-          heap[hsize] = ovls + i;
-        }
-    }
-
-  if (hsize > 3)
-    { if (MAP_SORT)
-        for (i = hsize/2; i > 1; i--)
-          maheap(i,heap,hsize);
-      else
-        for (i = hsize/2; i > 1; i--)
-          reheap(i,heap,hsize);
-    }
-
-  //  While the heap is not empty do
-
-  while (hsize > 0)
-    { Overlap  *ov;
-      IO_block *src;
-      int64     tsize, span;
+    for (i = 0; i < fway; i++)
+      { src[i].name   = fname[i];
+        src[i].offset = 0;
+        src[i].novl   = fnovl[i];
+        src[i].iname  = finame[i];
+        src[i].packed = fpack[i];
+      }
+    nsrc = fway;
+
+    temp  = NULL;
+    tname = NULL;
+    while (nsrc > MAX_FILES)
+      { if (temp == NULL)
+          { tname = Strdup(Numbered_Suffix(Catenate(TEMP_PATH,"/","LM",""),getpid(),".las"),
+                           "Allocating temporary file name");
+            if (tname == NULL)
+              exit (1);
+            temp = Fopen(tname,"w");
+            if (temp == NULL)
+              exit (1);
+          }
+
+        ntrg = (nsrc-1)/MAX_FILES + 1;
+        trg  = (Merge_Input *) Malloc(sizeof(Merge_Input)*ntrg,"Allocating merge inputs");
+        if (trg == NULL)
+          exit (1);
+        for (c = 0; c < ntrg; c++)
+          { lo = (nsrc*c)/ntrg;
+            hi = (nsrc*(c+1))/ntrg;
+            trg[c].name   = tname;
+            trg[c].offset = ftello(temp);
+            trg[c].novl   = 0;
+            trg[c].iname  = NULL;
+            trg[c].packed = 0;
+            for (i = lo; i < hi; i++)
+              trg[c].novl += src[i].novl;
+            merge_group(src+lo,hi-lo,temp,tname,NULL,trg[c].novl,tspace,MAP_SORT,NTHREADS);
+            if (fflush(temp) != 0)
+              SYSTEM_WRITE_ERROR
+          }
+        free(src);
+        src  = trg;
+        nsrc = ntrg;
+      }
 
-      if (MAP_SORT)
-        maheap(1,heap,hsize);
-      else
-        reheap(1,heap,hsize);
-
-      ov  = heap[1];
-      src = in + (ov - ovls);
-
-      do
-        { src->count += 1;
-
-          tsize = ov->path.tlen*tbytes;
-          span  = osize + tsize;
-          if (src->ptr + span > src->top)
-            ovl_reload(src,bsize);
-          if (optr + span > otop)
-            { if (fwrite(oblock,1,optr-oblock,output) != (size_t) (optr-oblock))
-                SYSTEM_READ_ERROR
-              optr = oblock;
-            }
+    if (temp != NULL && fclose(temp) != 0)
+      SYSTEM_CLOSE_ERROR
 
-          memmove(optr,((char *) ov) + psize,osize);
-          optr += osize;
-          memmove(optr,src->ptr,tsize);
-          optr += tsize;
+    { FILE *output;
+      char *pwd, *root, *oname, *iname;
 
-          src->ptr += tsize;
-          if (src->ptr >= src->top)
-            { heap[1] = heap[hsize];
-              hsize  -= 1;
-              break;
-            }
-          *ov       = *((Overlap *) (src->ptr - psize));
-          src->ptr += osize;
-        }
-      while (CHAIN_NEXT(ov->flags));
-    }
-
-  //  Flush output buffer and wind up
+      pwd    = PathTo(argv[1]);
+      root   = Root(argv[1],".las");
+      oname  = Strdup(Catenate(pwd,"/",root,".las"),"Allocating output name");
+      iname  = Strdup(Las_Index_Name(pwd,root),"Allocating output name");
+      if (oname == NULL || iname == NULL)
+        exit (1);
+      output = Fopen(oname,"w");
+      if (output == NULL)
+        exit (1);
+      free(pwd);
+      free(root);
 
-  if (optr > oblock)
-    { if (fwrite(oblock,1,optr-oblock,output) != (size_t) (optr-oblock))
-        SYSTEM_READ_ERROR
+      merge_group(src,nsrc,output,oname,iname,totl,tspace,MAP_SORT,NTHREADS);
+      if (fclose(output) != 0)
+        SYSTEM_CLOSE_ERROR
+      free(iname);
+      free(oname);
     }
-  fclose(output);
 
-  for (i = 0; i < fway; i++)
-    fclose(in[i].stream);
+    if (tname != NULL)
+      { unlink(tname);
+        free(tname);
+      }
+    free(src);
+  }
 
   for (i = 0; i < fway; i++)
-    totl -= in[i].count;
-  if (totl != 0)
-    { fprintf(stderr,"%s: Did not write all records to %s (%lld)\n",argv[0],argv[1],totl);
-      exit (1);
+    { free(finame[i]);
+      free(fname[i]);
     }
-
-  free(ovls);
-  free(heap);
-  free(in);
-  free(block-psize);
+  free(fpack);
+  free(fnovl);
+  free(finame);
+  free(fname);
 
   exit (0);
 }
@@ -15,14 +15,18 @@
 #include <stdint.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
+
+#define IO_BLOCK 10000000   //  Buffer size of the reader of a .las that cannot be mapped
 
 static char *Usage[] =
-    { "[-caroUF] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] ",
+    { "[-caroUFW] [-i<int(4)>] [-w<int(100)>] [-b<int(10)>] [-T<int(4)>] [-C<int(64)>]",
       "    <src1:db|dam> [ <src2:db|dam> ] <align:las> [ <reads:FILE> | <reads:range> ... ]"
     };
 
@@ -32,23 +36,442 @@ static int ORDER(const void *l, const void *r)
   return (x-y);
 }
 
+static int ALIGN, CARTOON, REFERENCE;
+static int FLIP, WAVEFRONT;
+static int INDENT, WIDTH, BORDER, UPPERCASE;
+
+static int tspace, small, sameDB;                //  Of the .las and the DBs
+static int ar_wide, br_wide, ai_wide, bi_wide;   //  Print widths
+static int mn_wide, mx_wide, tp_wide;
+
+static DAZZ_CACHE *Cache;   //  Reads recently loaded for alignments (if -C > 0)
+
+  //  The DBs, work data, and buffers with which LAs are shown.  A thread computing alignments
+  //    has its own copies of the DBs, each with its own .bps file to load reads from.
+
+typedef struct
+  { DAZZ_DB   *db1, *db2;
+    Work_Data *work;
+    char      *abuffer, *bbuffer;
+    uint16    *trace;
+    int        tmax;
+    DAZZ_DB    _db1, _db2;
+  } Show_Work;
+
+static void show_missing(FILE *out, Show_Work *w, int blast)
+{ DAZZ_DB *db2 = w->db2;
+
+  fprintf(out,"Missing ");
+  Print_Number((int64) blast+1,br_wide+1,out);
+  fprintf(out," %d ->%lld\n",db2->reads[blast].rlen,db2->reads[blast].coff);
+}
+
+static void show_record(FILE *out, Show_Work *w, Overlap *ovl)
+{ DAZZ_DB   *db1 = w->db1;
+  DAZZ_DB   *db2 = w->db2;
+  Alignment _aln, *aln = &_aln;
+  int64      tps;
+
+  aln->path  = &(ovl->path);
+  aln->alen  = db1->reads[ovl->aread].rlen;
+  aln->blen  = db2->reads[ovl->bread].rlen;
+  aln->flags = ovl->flags;
+  tps        = ovl->path.tlen/2;
+
+  if (ALIGN || CARTOON || REFERENCE)
+    fprintf(out,"\n");
+
+  if (BEST_CHAIN(ovl->flags))
+    fprintf(out,"> ");
+  else if (CHAIN_START(ovl->flags))
+    fprintf(out,"+ ");
+  else if (CHAIN_NEXT(ovl->flags))
+    fprintf(out," -");
+
+  if (FLIP)
+    { Flip_Alignment(aln,0);
+      Print_Number((int64) ovl->bread+1,ar_wide+1,out);
+      fprintf(out,"  ");
+      Print_Number((int64) ovl->aread+1,br_wide+1,out);
+    }
+  else
+    { Print_Number((int64) ovl->aread+1,ar_wide+1,out);
+      fprintf(out,"  ");
+      Print_Number((int64) ovl->bread+1,br_wide+1,out);
+    }
+  if (COMP(ovl->flags))
+    fprintf(out," c");
+  else
+    fprintf(out," n");
+  if (ovl->path.abpos == 0)
+    fprintf(out,"   <");
+  else
+    fprintf(out,"   [");
+  Print_Number((int64) ovl->path.abpos,ai_wide,out);
+  fprintf(out,"..");
+  Print_Number((int64) ovl->path.aepos,ai_wide,out);
+  if (ovl->path.aepos == aln->alen)
+    fprintf(out,"> x ");
+  else
+    fprintf(out,"] x ");
+  if (ovl->path.bbpos == 0)
+    fprintf(out,"<");
+  else
+    fprintf(out,"[");
+  if (COMP(ovl->flags))
+    { Print_Number((int64) (aln->blen - ovl->path.bbpos),bi_wide,out);
+      fprintf(out,"..");
+      Print_Number((int64) (aln->blen - ovl->path.bepos),bi_wide,out);
+    }
+  else
+    { Print_Number((int64) ovl->path.bbpos,bi_wide,out);
+      fprintf(out,"..");
+      Print_Number((int64) ovl->path.bepos,bi_wide,out);
+    }
+  if (ovl->path.bepos == aln->blen)
+    fprintf(out,">");
+  else
+    fprintf(out,"]");
+
+  if (!CARTOON)
+    fprintf(out,"  ~  %5.2f%% ",(200.*ovl->path.diffs) /
+           ((ovl->path.aepos - ovl->path.abpos) + (ovl->path.bepos - ovl->path.bbpos)) );
+  fprintf(out,"  (");
+  Print_Number(aln->alen,ai_wide,out);
+  fprintf(out," x ");
+  Print_Number(aln->blen,bi_wide,out);
+  fprintf(out," bps,");
+  if (CARTOON)
+    { Print_Number(tps,tp_wide,out);
+      fprintf(out," trace pts)\n\n");
+    }
+  else
+    { Print_Number((int64) ovl->path.diffs,mn_wide,out);
+      fprintf(out," diffs, ");
+      Print_Number(tps,tp_wide,out);
+      fprintf(out," trace pts)\n");
+    }
+
+  if (ALIGN || CARTOON || REFERENCE)
+    { if (ALIGN || REFERENCE)
+        { char *aseq, *bseq;
+          int   amin,  amax;
+          int   bmin,  bmax;
+          int   self;
+
+          if (FLIP)
+            Flip_Alignment(aln,0);
+          if (small)     //  Widen the trace, which lies in the reader's buffer
+            { uint8 *t8 = (uint8 *) ovl->path.trace;
+              int    k;
+
+              if (ovl->path.tlen > w->tmax)
+                { w->tmax  = ((int) 1.2*ovl->path.tlen) + 100;
+                  w->trace = (uint16 *) Realloc(w->trace,sizeof(uint16)*w->tmax,
+                                                "Allocating trace vector");
+                  if (w->trace == NULL)
+                    exit (1);
+                }
+              for (k = 0; k < ovl->path.tlen; k++)
+                w->trace[k] = t8[k];
+              ovl->path.trace = (void *) w->trace;
+            }
+
+          self = sameDB && (ovl->aread == ovl->bread) && !COMP(ovl->flags);
+
+          amin = ovl->path.abpos - BORDER;
+          if (amin < 0) amin = 0;
+          amax = ovl->path.aepos + BORDER;
+          if (amax > aln->alen) amax = aln->alen;
+          if (COMP(aln->flags))
+            { bmin = (aln->blen-ovl->path.bepos) - BORDER;
+              if (bmin < 0) bmin = 0;
+              bmax = (aln->blen-ovl->path.bbpos) + BORDER;
+              if (bmax > aln->blen) bmax = aln->blen;
+            }
+          else
+            { bmin = ovl->path.bbpos - BORDER;
+              if (bmin < 0) bmin = 0;
+              bmax = ovl->path.bepos + BORDER;
+              if (bmax > aln->blen) bmax = aln->blen;
+              if (self)
+                { if (bmin < amin)
+                    amin = bmin;
+                  if (bmax > amax)
+                    amax = bmax;
+                }
+            }
+
+          aseq = Cache_Subread(Cache,db1,ovl->aread,amin,amax,w->abuffer,0);
+          if (!self)
+            bseq = Cache_Subread(Cache,db2,ovl->bread,bmin,bmax,w->bbuffer,0);
+          else
+            bseq = aseq;
+
+          aln->aseq = aseq - amin;
+          if (COMP(aln->flags))
+            { Complement_Seq(bseq,bmax-bmin);
+              aln->bseq = bseq - (aln->blen - bmax);
+            }
+          else if (self)
+            aln->bseq = aln->aseq;
+          else
+            aln->bseq = bseq - bmin;
+
+          if (WAVEFRONT)
+            Compute_Trace_WFA(aln,w->work,tspace,GREEDIEST);
+          else if (tspace == 0)
+            Compute_Trace_IRR(aln,w->work,GREEDIEST);
+          else
+            Compute_Trace_PTS(aln,w->work,tspace,GREEDIEST);
+
+          if (FLIP)
+            { if (COMP(aln->flags))
+                { Complement_Seq(aseq,amax-amin);
+                  Complement_Seq(bseq,bmax-bmin);
+                  aln->aseq = aseq - (aln->alen - amax);
+                  aln->bseq = bseq - bmin;
+                }
+              Flip_Alignment(aln,1);
+            }
+        }
+      if (CARTOON)
+        Alignment_Cartoon(out,aln,INDENT,mx_wide);
+      if (REFERENCE)
+        Print_Reference(out,aln,w->work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
+      if (ALIGN)
+        Print_Alignment(out,aln,w->work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
+    }
+}
+
+  //  Set up w to show the LAs between db1 and db2, opening copies of them if own is set
+
+static void new_show_work(Show_Work *w, DAZZ_DB *db1, DAZZ_DB *db2, int own)
+{ if (own)
+    { w->_db1 = *db1;
+      w->_db1.bases = Fopen(Catenate(db1->path,"","",".bps"),"r");
+      if (w->_db1.bases == NULL)
+        exit (1);
+      if (db2 != db1)
+        { w->_db2 = *db2;
+          w->_db2.bases = Fopen(Catenate(db2->path,"","",".bps"),"r");
+          if (w->_db2.bases == NULL)
+            exit (1);
+          db2 = &(w->_db2);
+        }
+      else
+        db2 = &(w->_db1);
+      db1 = &(w->_db1);
+    }
+  w->db1 = db1;
+  w->db2 = db2;
+  if (ALIGN || REFERENCE)
+    { w->work    = New_Work_Data();
+      w->abuffer = New_Read_Buffer(db1);
+      w->bbuffer = New_Read_Buffer(db2);
+    }
+  else
+    { w->work    = NULL;
+      w->abuffer = NULL;
+      w->bbuffer = NULL;
+    }
+  w->tmax  = 1000;
+  w->trace = (uint16 *) Malloc(sizeof(uint16)*w->tmax,"Allocating trace vector");
+  if (w->trace == NULL)
+    exit (1);
+}
+
+static void free_show_work(Show_Work *w, int own)
+{ free(w->trace);
+  if (ALIGN || REFERENCE)
+    { free(w->bbuffer-1);
+      free(w->abuffer-1);
+      Free_Work_Data(w->work);
+    }
+  if (own)
+    { if (w->db2 != w->db1)
+        fclose((FILE *) w->_db2.bases);
+      fclose((FILE *) w->_db1.bases);
+    }
+}
+
+  //  With -T threads, the LAs to be shown (and the "Missing" lines of -M) are gathered into
+  //    batches that the threads take in turn and render into memory, and a writer thread
+  //    then outputs the rendered batches in the order they were filled.  Batch s is the
+  //    s % NBATCH'th of a ring of NBATCH, which bounds the number in flight.
+
+#define BATCH_SIZE  64
+
+#define BATCH_EMPTY  0
+#define BATCH_FULL   1
+#define BATCH_SHOWN  2
+
+typedef struct
+  { Overlap ovl;     //  An LA whose trace is at toff in the batch's trace buffer, or if
+    int64   toff;    //    toff < 0, the "Missing" line for b-read ovl.bread
+  } Show_Item;
+
+typedef struct
+  { Show_Item  item[BATCH_SIZE];
+    int        nitem;
+    uint8     *tbuf;     //  Traces of the items
+    int64      tlen;
+    int64      tmax;
+    char      *text;     //  Rendering of the items
+    size_t     size;
+    int        state;
+  } Show_Batch;
+
+static pthread_mutex_t Show_Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  Show_Cond = PTHREAD_COND_INITIALIZER;
+
+static Show_Batch *Batch;
+static int         NBATCH;
+static int64       Nfull;     //  # of batches filled so far
+static int64       Ntaken;    //  # of those taken by a thread
+static int         Nomore;    //  Set when no more batches will be filled
+static Show_Batch *Cur;       //  Batch being filled, NULL if none
+
+static void *show_thread(void *arg)
+{ Show_Work  *w = (Show_Work *) arg;
+  Show_Batch *b;
+  Show_Item  *it;
+  FILE       *out;
+  int         i;
+
+  while (1)
+    { pthread_mutex_lock(&Show_Lock);
+      while (Ntaken >= Nfull && !Nomore)
+        pthread_cond_wait(&Show_Cond,&Show_Lock);
+      if (Ntaken >= Nfull)
+        { pthread_mutex_unlock(&Show_Lock);
+          break;
+        }
+      b = Batch + (Ntaken++ % NBATCH);
+      pthread_mutex_unlock(&Show_Lock);
+
+      out = open_memstream(&b->text,&b->size);
+      if (out == NULL)
+        { fprintf(stderr,"%s: Cannot open an in-memory stream\n",Prog_Name);
+          exit (1);
+        }
+      for (i = 0; i < b->nitem; i++)
+        { it = b->item + i;
+          if (it->toff < 0)
+            show_missing(out,w,it->ovl.bread);
+          else
+            { it->ovl.path.trace = b->tbuf + it->toff;
+              show_record(out,w,&(it->ovl));
+            }
+        }
+      fclose(out);
+
+      pthread_mutex_lock(&Show_Lock);
+      b->state = BATCH_SHOWN;
+      pthread_cond_broadcast(&Show_Cond);
+      pthread_mutex_unlock(&Show_Lock);
+    }
+  return (NULL);
+}
+
+static void *write_thread(void *arg)
+{ Show_Batch *b;
+  int64       s;
+  int         last;
+
+  (void) arg;
+  for (s = 0; 1; s++)
+    { b = Batch + (s % NBATCH);
+      pthread_mutex_lock(&Show_Lock);
+      while ((s >= Nfull || b->state != BATCH_SHOWN) && !(Nomore && s >= Nfull))
+        pthread_cond_wait(&Show_Cond,&Show_Lock);
+      last = (s >= Nfull);
+      pthread_mutex_unlock(&Show_Lock);
+      if (last)
+        break;
+
+      if (fwrite(b->text,1,b->size,stdout) != b->size)
+        { fprintf(stderr,"%s: System write to stdout failed\n",Prog_Name);
+          exit (1);
+        }
+      free(b->text);
+
+      pthread_mutex_lock(&Show_Lock);
+      b->state = BATCH_EMPTY;
+      pthread_cond_broadcast(&Show_Cond);
+      pthread_mutex_unlock(&Show_Lock);
+    }
+  return (NULL);
+}
+
+  //  Hand the batch being filled to the threads
+
+static void post_batch()
+{ pthread_mutex_lock(&Show_Lock);
+  Cur->state = BATCH_FULL;
+  Nfull += 1;
+  pthread_cond_broadcast(&Show_Cond);
+  pthread_mutex_unlock(&Show_Lock);
+  Cur = NULL;
+}
+
+  //  Add LA ovl with trace bytes of size tbytes, or if ovl is NULL the "Missing" line for
+  //    b-read blast, to the batch being filled, waiting for a free batch if need be
+
+static void queue_item(Overlap *ovl, int tbytes, int blast)
+{ Show_Item *it;
+  int64      len;
+
+  if (Cur == NULL)
+    { Cur = Batch + (Nfull % NBATCH);
+      pthread_mutex_lock(&Show_Lock);
+      while (Cur->state != BATCH_EMPTY)
+        pthread_cond_wait(&Show_Cond,&Show_Lock);
+      pthread_mutex_unlock(&Show_Lock);
+      Cur->nitem = 0;
+      Cur->tlen  = 0;
+    }
+
+  it = Cur->item + Cur->nitem++;
+  if (ovl == NULL)
+    { it->ovl.bread = blast;
+      it->toff      = -1;
+    }
+  else
+    { len = ((int64) ovl->path.tlen) * tbytes;
+      Cur->tlen = (Cur->tlen + 1) & ~1ll;     //  Keep 16-bit traces aligned
+      if (Cur->tlen + len > Cur->tmax)
+        { Cur->tmax = 1.2*(Cur->tlen + len) + 10000;
+          Cur->tbuf = (uint8 *) Realloc(Cur->tbuf,Cur->tmax,"Allocating trace buffer");
+          if (Cur->tbuf == NULL)
+            exit (1);
+        }
+      memcpy(Cur->tbuf + Cur->tlen,ovl->path.trace,len);
+      it->ovl   = *ovl;
+      it->toff  = Cur->tlen;
+      Cur->tlen += len;
+    }
+
+  if (Cur->nitem >= BATCH_SIZE)
+    post_batch();
+}
+
 int main(int argc, char *argv[])
 { DAZZ_DB   _db1, *db1 = &_db1; 
   DAZZ_DB   _db2, *db2 = &_db2; 
   Overlap   _ovl, *ovl = &_ovl;
-  Alignment _aln, *aln = &_aln;
 
   FILE   *input;
-  int     sameDB;
+  Las_Reader *reader;
+  Las_Index  *lidx;
   int64   novl;
-  int     tspace, tbytes, small;
   int     reps, *pts;
   int     input_pts;
 
-  int     ALIGN, CARTOON, REFERENCE, OVERLAP;
-  int     FLIP, MAP;
-  int     INDENT, WIDTH, BORDER, UPPERCASE;
+  int     OVERLAP, MAP;
+  int     NTHREADS;
   int     ISTWO;
+  int     CACHE_MB, CACHE_STATS;
 
   //  Process options
 
@@ -58,16 +481,19 @@ int main(int argc, char *argv[])
 
     ARG_INIT("LAshow")
 
-    INDENT    = 4;
-    WIDTH     = 100;
-    BORDER    = 10;
+    INDENT      = 4;
+    WIDTH       = 100;
+    BORDER      = 10;
+    NTHREADS    = 4;
+    CACHE_MB    = 64;
+    CACHE_STATS = 0;
 
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("caroUFM")
+            ARG_FLAGS("caroUFMW")
             break;
           case 'i':
             ARG_NON_NEGATIVE(INDENT,"Indent")
@@ -78,6 +504,13 @@ int main(int argc, char *argv[])
           case 'b':
             ARG_NON_NEGATIVE(BORDER,"Alignment border")
             break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+          case 'C':
+            ARG_NON_NEGATIVE(CACHE_MB,"Read cache size")
+            CACHE_STATS = 1;
+            break;
         }
       else
         argv[j++] = argv[i];
@@ -90,6 +523,7 @@ int main(int argc, char *argv[])
     UPPERCASE = flags['U'];
     FLIP      = flags['F'];
     MAP       = flags['M'];
+    WAVEFRONT = flags['W'];
 
     if (argc <= 2)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
@@ -100,11 +534,16 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -r: Show the alignment of each LA with -w bp's of A in each row.\n");
         fprintf(stderr,"      -o: Show only proper overlaps.\n");
         fprintf(stderr,"      -F: Switch the roles of A- and B-reads.\n");
+        fprintf(stderr,"      -W: Compute alignments with the wavefront (WFA) engine.\n");
         fprintf(stderr,"\n");
         fprintf(stderr,"      -U: Show alignments in upper case.\n");
         fprintf(stderr,"      -i: Indent alignments and cartoons by -i.\n");
         fprintf(stderr,"      -w: Width of each row of alignment in symbols (-a) or bps (-r).\n");
         fprintf(stderr,"      -b: # of border bp.s to show on each side of LA.\n");
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -T: Compute and format alignments (-a, -r) with -T threads.\n");
+        fprintf(stderr,"      -C: Cache up to -C MB of the reads aligned (0 = none).\n");
+        fprintf(stderr,"          If given, report the hit rate of the cache on stderr.\n");
         exit (1);
       }
   }
@@ -198,7 +637,7 @@ int main(int argc, char *argv[])
           reps += 1;
 
       reps *= 2;
-      pts   = (int *) Malloc(sizeof(int)*reps,"Allocating read parameters");
+      pts   = (int *) Malloc(sizeof(int)*(reps+1),"Allocating read parameters");
       if (pts == NULL)
         exit (1);
 
@@ -207,6 +646,7 @@ int main(int argc, char *argv[])
         { fscanf(input," %d",&x);
           pts[v] = pts[v+1] = x;
         }
+      pts[reps] = INT32_MAX;
 
       fclose(input);
     }
@@ -292,23 +732,26 @@ int main(int argc, char *argv[])
     if (input == NULL)
       exit (1);
 
-    if (fread(&novl,sizeof(int64),1,input) != 1)
-      SYSTEM_READ_ERROR
-    if (fread(&tspace,sizeof(int),1,input) != 1)
-      SYSTEM_READ_ERROR
+    reader = Open_Las_Map(input,0);
+    if (reader == NULL)
+      reader = Open_Las_Reader(input,IO_BLOCK);
+    novl   = reader->novl;
+    tspace = reader->tspace;
     if (tspace < 0)
       { fprintf(stderr,"%s: Garbage .las file, trace spacing < 0 !\n",Prog_Name);
         exit (1);
       }
 
-    if (tspace <= TRACE_XOVR && tspace != 0)
-      { small  = 1;
-        tbytes = sizeof(uint8);
-      }
-    else
-      { small  = 0;
-        tbytes = sizeof(uint16);
-      }
+    small = (reader->tbytes == sizeof(uint8));
+
+    lidx = NULL;
+    { struct stat info;
+
+      if (reader->pack != NULL)     //  A packed .las is indexed by its footer
+        lidx = Las_Block_Index(reader,LAS_STRIDE);
+      else if (fstat(fileno(input),&info) == 0 && S_ISREG(info.st_mode))
+        lidx = Read_Las_Index(Las_Index_Name(pwd,root),novl,&info);
+    }
 
     printf("\n%s: ",root);
     Print_Number(novl,0,stdout);
@@ -319,37 +762,16 @@ int main(int argc, char *argv[])
   }
 
   //  Read the file and display selected records
-  
+
   { int        j;
-    uint16    *trace;
-    Work_Data *work;
-    int        tmax;
+    Show_Work  show;
+    Show_Work *work;
+    pthread_t *threads;
+    Overlap   *view;
     int        in, npt, idx, ar;
-    int64      tps;
-
-    char      *abuffer, *bbuffer;
-    int        ar_wide, br_wide;
-    int        ai_wide, bi_wide;
-    int        mn_wide, mx_wide;
-    int        tp_wide;
+    int        alen, blen;
     int        blast, match, seen, lhalf, rhalf;
-
-    aln->path = &(ovl->path);
-    if (ALIGN || REFERENCE)
-      { work = New_Work_Data();
-        abuffer = New_Read_Buffer(db1);
-        bbuffer = New_Read_Buffer(db2);
-      }
-    else
-      { abuffer = NULL;
-        bbuffer = NULL;
-        work = NULL;
-      }
-
-    tmax  = 1000;
-    trace = (uint16 *) Malloc(sizeof(uint16)*tmax,"Allocating trace vector");
-    if (trace == NULL)
-      exit (1);
+    int        t;
 
     in  = 0;
     npt = pts[0];
@@ -388,6 +810,46 @@ int main(int argc, char *argv[])
         x = ai_wide; ai_wide = bi_wide; bi_wide = x;
       }
 
+    //  Only computing alignments is worth the threads, otherwise show records directly
+
+    if ( ! (ALIGN || REFERENCE))
+      NTHREADS = 1;
+
+    if ((ALIGN || REFERENCE) && CACHE_MB > 0)
+      Cache = New_Read_Cache(CACHE_MB);
+    else
+      Cache = NULL;
+
+    if (NTHREADS > 1)
+      { fflush(stdout);
+        NBATCH  = 4*NTHREADS;
+        Batch   = (Show_Batch *) Malloc(sizeof(Show_Batch)*NBATCH,"Allocating batches");
+        work    = (Show_Work *) Malloc(sizeof(Show_Work)*NTHREADS,"Allocating thread data");
+        threads = (pthread_t *) Malloc(sizeof(pthread_t)*(NTHREADS+1),"Allocating threads");
+        if (Batch == NULL || work == NULL || threads == NULL)
+          exit (1);
+        for (t = 0; t < NBATCH; t++)
+          { Batch[t].tbuf  = NULL;
+            Batch[t].tmax  = 0;
+            Batch[t].state = BATCH_EMPTY;
+          }
+        Nfull  = 0;
+        Ntaken = 0;
+        Nomore = 0;
+        Cur    = NULL;
+
+        for (t = 0; t < NTHREADS; t++)
+          { new_show_work(work+t,db1,db2,1);
+            pthread_create(threads+t,NULL,show_thread,work+t);
+          }
+        pthread_create(threads+NTHREADS,NULL,write_thread,NULL);
+      }
+    else
+      { new_show_work(&show,db1,db2,0);
+        work    = NULL;
+        threads = NULL;
+      }
+
     //  For each record do
 
     blast = -1;
@@ -398,15 +860,21 @@ int main(int argc, char *argv[])
 
        //  Read it in
 
-      { Read_Overlap(input,ovl);
-        if (ovl->path.tlen > tmax)
-          { tmax = ((int) 1.2*ovl->path.tlen) + 100;
-            trace = (uint16 *) Realloc(trace,sizeof(uint16)*tmax,"Allocating trace vector");
-            if (trace == NULL)
-              exit (1);
+      { if (!in && lidx != NULL)     //  Skip straight to the next range if indexed
+          { int64 off, cnt;
+
+            Las_Index_Seek(lidx,npt-1,&off,&cnt);
+            if (cnt > j)
+              { Las_Goto(reader,off,cnt);
+                j = cnt;
+                if (j >= novl)
+                  break;
+              }
           }
-        ovl->path.trace = (void *) trace;
-        Read_Trace(input,ovl,tbytes);
+
+        view = Las_Next(reader);
+        *ovl = *view;
+        ovl->path.trace = LAS_TRACE(view);
 
         if (ovl->aread >= db1->nreads)
           { fprintf(stderr,"%s: A-read is out-of-range of DB %s\n",Prog_Name,argv[1]);
@@ -445,15 +913,13 @@ int main(int argc, char *argv[])
 
         //  If -o check display only overlaps
 
-        aln->alen  = db1->reads[ovl->aread].rlen;
-        aln->blen  = db2->reads[ovl->bread].rlen;
-        aln->flags = ovl->flags;
-        tps        = ovl->path.tlen/2;
+        alen = db1->reads[ovl->aread].rlen;
+        blen = db2->reads[ovl->bread].rlen;
 
         if (OVERLAP)
           { if (ovl->path.abpos != 0 && ovl->path.bbpos != 0)
               continue;
-            if (ovl->path.aepos != aln->alen && ovl->path.bepos != aln->blen)
+            if (ovl->path.aepos != alen && ovl->path.bepos != blen)
               continue;
           }
 
@@ -462,184 +928,71 @@ int main(int argc, char *argv[])
         if (MAP)
           { while (ovl->bread != blast)
               { if (!match && seen && !(lhalf && rhalf))
-                  { printf("Missing ");
-                    Print_Number((int64) blast+1,br_wide+1,stdout);
-                    printf(" %d ->%lld\n",db2->reads[blast].rlen,db2->reads[blast].coff);
+                  { if (NTHREADS > 1)
+                      queue_item(NULL,0,blast);
+                    else
+                      show_missing(stdout,&show,blast);
                   }
                 match = 0;
-                seen  = 0; 
+                seen  = 0;
                 lhalf = rhalf = 0;
                 blast += 1;
               }
             seen = 1;
             if (ovl->path.abpos == 0)
               rhalf = 1;
-            if (ovl->path.aepos == aln->alen)
+            if (ovl->path.aepos == alen)
               lhalf = 1;
-            if (ovl->path.bbpos != 0 || ovl->path.bepos != aln->blen)
+            if (ovl->path.bbpos != 0 || ovl->path.bepos != blen)
               continue;
             match = 1;
           }
 
         //  Display it
-            
-        if (ALIGN || CARTOON || REFERENCE)
-          printf("\n");
-
-        if (BEST_CHAIN(ovl->flags))
-          printf("> ");
-        else if (CHAIN_START(ovl->flags))
-          printf("+ ");
-        else if (CHAIN_NEXT(ovl->flags))
-          printf(" -");
-
-        if (FLIP)
-          { Flip_Alignment(aln,0);
-            Print_Number((int64) ovl->bread+1,ar_wide+1,stdout);
-            printf("  ");
-            Print_Number((int64) ovl->aread+1,br_wide+1,stdout);
-          }
-        else
-          { Print_Number((int64) ovl->aread+1,ar_wide+1,stdout);
-            printf("  ");
-            Print_Number((int64) ovl->bread+1,br_wide+1,stdout);
-          }
-        if (COMP(ovl->flags))
-          printf(" c");
-        else
-          printf(" n");
-        if (ovl->path.abpos == 0)
-          printf("   <");
-        else
-          printf("   [");
-        Print_Number((int64) ovl->path.abpos,ai_wide,stdout);
-        printf("..");
-        Print_Number((int64) ovl->path.aepos,ai_wide,stdout);
-        if (ovl->path.aepos == aln->alen)
-          printf("> x ");
-        else
-          printf("] x ");
-        if (ovl->path.bbpos == 0)
-          printf("<");
-        else
-          printf("[");
-        if (COMP(ovl->flags))
-          { Print_Number((int64) (aln->blen - ovl->path.bbpos),bi_wide,stdout);
-            printf("..");
-            Print_Number((int64) (aln->blen - ovl->path.bepos),bi_wide,stdout);
-          }
-        else
-          { Print_Number((int64) ovl->path.bbpos,bi_wide,stdout);
-            printf("..");
-            Print_Number((int64) ovl->path.bepos,bi_wide,stdout);
-          }
-        if (ovl->path.bepos == aln->blen)
-          printf(">");
-        else
-          printf("]");
-
-        if (!CARTOON)
-          printf("  ~  %5.2f%% ",(200.*ovl->path.diffs) /
-                 ((ovl->path.aepos - ovl->path.abpos) + (ovl->path.bepos - ovl->path.bbpos)) );
-        printf("  (");
-        Print_Number(aln->alen,ai_wide,stdout);
-        printf(" x ");
-        Print_Number(aln->blen,bi_wide,stdout);
-        printf(" bps,");
-        if (CARTOON)
-          { Print_Number(tps,tp_wide,stdout);
-            printf(" trace pts)\n\n");
-          }
-        else
-          { Print_Number((int64) ovl->path.diffs,mn_wide,stdout);
-            printf(" diffs, ");
-            Print_Number(tps,tp_wide,stdout);
-            printf(" trace pts)\n");
-          }
-
-        if (ALIGN || CARTOON || REFERENCE)
-          { if (ALIGN || REFERENCE)
-              { char *aseq, *bseq;
-                int   amin,  amax;
-                int   bmin,  bmax;
-                int   self;
-
-                if (FLIP)
-                  Flip_Alignment(aln,0);
-                if (small)
-                  Decompress_TraceTo16(ovl);
-
-                self = sameDB && (ovl->aread == ovl->bread) && !COMP(ovl->flags);
-
-                amin = ovl->path.abpos - BORDER;
-                if (amin < 0) amin = 0;
-                amax = ovl->path.aepos + BORDER;
-                if (amax > aln->alen) amax = aln->alen;
-                if (COMP(aln->flags))
-                  { bmin = (aln->blen-ovl->path.bepos) - BORDER;
-                    if (bmin < 0) bmin = 0;
-                    bmax = (aln->blen-ovl->path.bbpos) + BORDER;
-                    if (bmax > aln->blen) bmax = aln->blen;
-                  }
-                else
-                  { bmin = ovl->path.bbpos - BORDER;
-                    if (bmin < 0) bmin = 0;
-                    bmax = ovl->path.bepos + BORDER;
-                    if (bmax > aln->blen) bmax = aln->blen;
-                    if (self)
-                      { if (bmin < amin)
-                          amin = bmin;
-                        if (bmax > amax)
-                          amax = bmax;
-                      }
-                  }
-
-                aseq = Load_Subread(db1,ovl->aread,amin,amax,abuffer,0);
-                if (!self)
-                  bseq = Load_Subread(db2,ovl->bread,bmin,bmax,bbuffer,0);
-                else
-                  bseq = aseq;
 
-                aln->aseq = aseq - amin;
-                if (COMP(aln->flags))
-                  { Complement_Seq(bseq,bmax-bmin);
-                    aln->bseq = bseq - (aln->blen - bmax);
-                  }
-                else if (self)
-                  aln->bseq = aln->aseq;
-                else
-                  aln->bseq = bseq - bmin;
+        if (NTHREADS > 1)
+          queue_item(ovl,reader->tbytes,0);
+        else
+          show_record(stdout,&show,ovl);
+      }
 
-                if (tspace == 0)
-                  Compute_Trace_IRR(aln,work,GREEDIEST);
-                else
-                  Compute_Trace_PTS(aln,work,tspace,GREEDIEST);
-
-                if (FLIP)
-                  { if (COMP(aln->flags))
-                      { Complement_Seq(aseq,amax-amin);
-                        Complement_Seq(bseq,bmax-bmin);
-                        aln->aseq = aseq - (aln->alen - amax);
-                        aln->bseq = bseq - bmin;
-                      }
-                    Flip_Alignment(aln,1);
-                  }
-              }
-            if (CARTOON)
-              Alignment_Cartoon(stdout,aln,INDENT,mx_wide);
-            if (REFERENCE)
-              Print_Reference(stdout,aln,work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
-            if (ALIGN)
-              Print_Alignment(stdout,aln,work,INDENT,WIDTH,BORDER,UPPERCASE,mx_wide);
+    if (NTHREADS > 1)
+      { if (Cur != NULL)
+          post_batch();
+        pthread_mutex_lock(&Show_Lock);
+        Nomore = 1;
+        pthread_cond_broadcast(&Show_Cond);
+        pthread_mutex_unlock(&Show_Lock);
+
+        for (t = 0; t <= NTHREADS; t++)
+          pthread_join(threads[t],NULL);
+        for (t = 0; t < NTHREADS; t++)
+          free_show_work(work+t,1);
+        for (t = 0; t < NBATCH; t++)
+          free(Batch[t].tbuf);
+        free(threads);
+        free(work);
+        free(Batch);
+      }
+    else
+      free_show_work(&show,0);
+
+    if (Cache != NULL)
+      { if (CACHE_STATS)
+          { DAZZ_CACHE_STATS stats;
+            int64            loads;
+
+            Read_Cache_Stats(Cache,&stats);
+            loads = stats.hits + stats.misses;
+            fprintf(stderr,"%s: Read cache: %lld hits of %lld loads (%.1f%%), %lld evicted\n",
+                           Prog_Name,stats.hits,loads,(100.*stats.hits)/(loads > 0 ? loads : 1),
+                           stats.evicted);
           }
+        Free_Read_Cache(Cache);
       }
 
-    free(trace);
-    if (ALIGN)
-      { free(bbuffer-1);
-        free(abuffer-1);
-        Free_Work_Data(work);
-      }
+    Close_Las_Reader(reader);
+    fclose(input);
   }
 
   Close_DB(db1);
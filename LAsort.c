@@ -1,7 +1,8 @@
 /*******************************************************************************************
  *
  *  Load a file U.las of overlaps into memory, sort them all by A,B index,
- *    and then output the result to U.S.las
+ *    and then output the result to U.S.las.  With a memory limit, a file too big for it
+ *    is sorted in runs that are written to a temporary directory and then merged.
  *
  *  Author:  Gene Myers
  *  Date  :  July 2013
@@ -15,209 +16,276 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <dirent.h>
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
-static char *Usage = "[-va] <align:las> ...";
-
-#define MEMORY   1000   //  How many megabytes for output buffer
-
-static char *IBLOCK;
-
-static int SORT_OVL(const void *x, const void *y)
-{ int64 l = *((int64 *) x);
-  int64 r = *((int64 *) y);
-
-  Overlap *ol, *or;
-  int      al, ar;
-  int      bl, br;
-  int      cl, cr;
-  int      pl, pr;
-
-  ol = (Overlap *) (IBLOCK+l);
-  or = (Overlap *) (IBLOCK+r);
-
-  al = ol->aread;
-  ar = or->aread;
-  if (al != ar)
-    return (al-ar);
-
-  bl = ol->bread;
-  br = or->bread;
-  if (bl != br)
-    return (bl-br);
-
-  cl = COMP(ol->flags);
-  cr = COMP(or->flags);
-  if (cl != cr)
-    return (cl-cr);
-
-  pl = ol->path.abpos;
-  pr = or->path.abpos;
-  if (pl != pr)
-    return (pl-pr);
-
-  pl = ol->path.aepos;
-  pr = or->path.aepos;
-  if (pl != pr)
-    return (pl-pr);
-
-  pl = ol->path.bbpos;
-  pr = or->path.bbpos;
-  if (pl != pr)
-    return (pl-pr);
-
-  pl = ol->path.bepos;
-  pr = or->path.bepos;
-  if (pl != pr)
-    return (pl-pr);
-
-  pl = ol->path.diffs;
-  pr = or->path.diffs;
-  if (pl != pr)
-    return (pl-pr);
-
-  if (ol < or)
-    return (-1);
-  else if (ol > or)
-    return (1);
-  else
-    return (0);
+static char *Usage = "[-vaz] [-T<int(4)>] [-M<int>] [-P<dir(/tmp)>] <align:las> ...";
+
+#define MEMORY   1000       //  How many megabytes for output buffer
+
+#define IO_BLOCK 10000000   //  Buffer size of run readers and writers in an external sort
+#define MAX_RUNS 250        //  Most runs merged at once
+
+static char *run_name(char *dir, int pid, int pass, int run)
+{ char *name;
+
+  name = (char *) Malloc(strlen(dir)+50,"Allocating run name");
+  if (name == NULL)
+    exit (1);
+  sprintf(name,"%s/LS%d.%d.%d.las",dir,pid,pass,run);
+  return (name);
 }
 
-static int SORT_MAP(const void *x, const void *y)
-{ int64 l = *((int64 *) x);
-  int64 r = *((int64 *) y);
-
-  Overlap *ol, *or;
-  int      al, ar;
-  int      bl, br;
-  int      cl, cr;
-  int      pl, pr;
-
-  ol = (Overlap *) (IBLOCK+l);
-  or = (Overlap *) (IBLOCK+r);
-
-  al = ol->aread;
-  ar = or->aread;
-  if (al != ar)
-    return (al-ar);
-
-  pl = ol->path.abpos;
-  pr = or->path.abpos;
-  if (pl != pr)
-    return (pl-pr);
-
-  bl = ol->bread;
-  br = or->bread;
-  if (bl != br)
-    return (bl-br);
-
-  cl = COMP(ol->flags);
-  cr = COMP(or->flags);
-  if (cl != cr)
-    return (cl-cr);
-
-  pl = ol->path.aepos;
-  pr = or->path.aepos;
-  if (pl != pr)
-    return (pl-pr);
-
-  pl = ol->path.bbpos;
-  pr = or->path.bbpos;
-  if (pl != pr)
-    return (pl-pr);
-
-  pl = ol->path.bepos;
-  pr = or->path.bepos;
-  if (pl != pr)
-    return (pl-pr);
-
-  pl = ol->path.diffs;
-  pr = or->path.diffs;
-  if (pl != pr)
-    return (pl-pr);
-
-  if (ol < or)
-    return (-1);
-  else if (ol > or)
-    return (1);
+static int PACKED;   //  -z: write the sorted output packed
+
+  //  Open a writer of the sorted output, indexing it, unless it is packed in which case its
+  //    footer serves as the index
+
+static Las_Writer *open_output(FILE *output, int64 novl, int tspace, int64 bsize)
+{ Las_Writer *out;
+
+  if (PACKED)
+    return (Open_Las_Packed_Writer(output,novl,tspace,bsize));
+  out = Open_Las_Writer(output,novl,tspace,bsize);
+  Set_Las_Index(out,LAS_STRIDE,LAS_HEADER,0);
+  return (out);
+}
+
+  //  Close writer 'out' of file 'output', and then write the index it built to file 'iname'
+  //    (if not NULL), so that the index is of the complete file, or remove any earlier index
+  //    if it built none (e.g. the output is packed)
+
+static void close_indexed(Las_Writer *out, FILE *output, char *iname)
+{ Las_Index  *idx;
+  struct stat info;
+
+  idx = Las_Writer_Index(out);
+  Close_Las_Writer(out);
+  if (iname == NULL)
+    return;
+  if (idx == NULL)
+    { unlink(iname);
+      return;
+    }
+  if (fflush(output) != 0 || fstat(fileno(output),&info) != 0)
+    SYSTEM_WRITE_ERROR
+  Write_Las_Index(idx,iname,&info);
+  Free_Las_Index(idx);
+}
+
+  //  Merge the 'nrun' runs in files name[0..nrun-1] into 'output', then remove them.
+  //    If 'iname' is not NULL, index the result in file iname.
+
+static int64 merge_runs(char **name, int nrun, FILE *output, char *iname, int64 novl,
+                        int tspace, int64 budget, int map_order)
+{ Las_Reader **in;
+  Las_Writer  *out;
+  FILE        *input;
+  int64        bsize, nout;
+  int          i;
+
+  bsize = budget/(nrun+1);
+  if (bsize > IO_BLOCK)
+    bsize = IO_BLOCK;
+
+  in = (Las_Reader **) Malloc(sizeof(Las_Reader *)*nrun,"Allocating run readers");
+  if (in == NULL)
+    exit (1);
+  for (i = 0; i < nrun; i++)
+    { input = Fopen(name[i],"r");
+      if (input == NULL)
+        exit (1);
+      in[i] = Open_Las_Reader(input,bsize);
+    }
+
+  if (iname != NULL)
+    out = open_output(output,novl,tspace,bsize);
   else
-    return (0);
+    out = Open_Las_Writer(output,novl,tspace,bsize);
+  nout = Merge_Las_Runs(in,nrun,out,map_order);
+  close_indexed(out,output,iname);
+
+  for (i = 0; i < nrun; i++)
+    { fclose(in[i]->input);
+      Close_Las_Reader(in[i]);
+      unlink(name[i]);
+      free(name[i]);
+    }
+  free(in);
+  return (nout);
 }
 
-static int EQUAL(Overlap *ol, Overlap *or)
-{ int      al, ar;
-  int      bl, br;
-  int      cl, cr;
-  int      pl, pr;
-
-  al = ol->aread;
-  ar = or->aread;
-  if (al != ar)
-    return (0);
-
-  bl = ol->bread;
-  br = or->bread;
-  if (bl != br)
-    return (0);
-
-  cl = COMP(ol->flags);
-  cr = COMP(or->flags);
-  if (cl != cr)
-    return (0);
-
-  pl = ol->path.abpos;
-  pr = or->path.abpos;
-  if (pl != pr)
-    return (0);
-
-  pl = ol->path.aepos;
-  pr = or->path.aepos;
-  if (pl != pr)
-    return (0);
-
-  pl = ol->path.bbpos;
-  pr = or->path.bbpos;
-  if (pl != pr)
-    return (0);
-
-  pl = ol->path.bepos;
-  pr = or->path.bepos;
-  if (pl != pr)
-    return (0);
-
-  return (1);
+  //  Sort the .las file on 'input' into 'output', indexed in file 'iname', in chunks of at
+  //    most 'budget' bytes, spilling each chunk as a sorted run to directory 'dir' if it
+  //    does not all fit.
+
+static void external_sort(FILE *input, FILE *output, char *iname, char *root, int64 budget,
+                          char *dir, int map_order, int nthreads, int verbose)
+{ Las_Reader  *in;
+  Las_Writer  *out;
+  Las_Set     *set;
+  Overlap     *ovl;
+  FILE        *rfile;
+  char       **name;
+  int64        nbyte;
+  int          nrun, rmax, chains, pid, pass;
+
+  budget -= 2*IO_BLOCK;
+  if (budget < IO_BLOCK)
+    budget = IO_BLOCK;
+
+  in     = Open_Las_Reader(input,IO_BLOCK);
+  ovl    = Las_Peek(in);
+  chains = (ovl != NULL && CHAIN_START(ovl->flags));
+  pid    = getpid();
+
+  nrun  = 0;
+  rmax  = 0;
+  name  = NULL;
+  nbyte = 0;
+  do
+    { set    = Read_Las_Chunk(in,budget,chains);
+      nbyte += set->size;
+      Sort_Las_Set(set,map_order,nthreads);
+
+      if (nrun == 0 && in->nread >= in->novl)     //  It all fit: write it out directly
+        { if (verbose)
+            { printf("  %s: ",root);
+              Print_Number(set->novl,0,stdout);
+              printf(" records ");
+              Print_Number((nbyte + sizeof(int64) + sizeof(int)) - set->novl*LAS_OVL,0,stdout);
+              printf(" trace bytes\n");
+              fflush(stdout);
+            }
+          out = open_output(output,set->novl,set->tspace,IO_BLOCK);
+          Write_Las_Set(set,out);
+          close_indexed(out,output,iname);
+          Free_Las_Set(set);
+          Close_Las_Reader(in);
+          return;
+        }
+
+      if (nrun >= rmax)
+        { rmax = 1.2*nrun + 10;
+          name = (char **) Realloc(name,sizeof(char *)*rmax,"Allocating run names");
+          if (name == NULL)
+            exit (1);
+        }
+      name[nrun] = run_name(dir,pid,0,nrun);
+      rfile = Fopen(name[nrun],"w");
+      if (rfile == NULL)
+        exit (1);
+      out = Open_Las_Writer(rfile,set->novl,set->tspace,IO_BLOCK);
+      Write_Las_Set(set,out);
+      Close_Las_Writer(out);
+      if (fclose(rfile) != 0)
+        SYSTEM_CLOSE_ERROR
+      Free_Las_Set(set);
+      nrun += 1;
+    }
+  while (in->nread < in->novl);
+
+  if (verbose)
+    { printf("  %s: ",root);
+      Print_Number(in->novl,0,stdout);
+      printf(" records ");
+      Print_Number((nbyte + sizeof(int64) + sizeof(int)) - in->novl*LAS_OVL,0,stdout);
+      printf(" trace bytes, sorted in %d runs\n",nrun);
+      fflush(stdout);
+    }
+
+  //  Merge groups of consecutive runs until there are few enough to merge into the output
+
+  for (pass = 1; nrun > MAX_RUNS; pass++)
+    { int k, nnew, lo, hi;
+
+      nnew = (nrun-1)/MAX_RUNS + 1;
+      if (nrun+nnew > rmax)
+        { rmax = nrun+nnew;
+          name = (char **) Realloc(name,sizeof(char *)*rmax,"Allocating run names");
+          if (name == NULL)
+            exit (1);
+        }
+      for (k = 0; k < nnew; k++)
+        { lo = (nrun*k)/nnew;
+          hi = (nrun*(k+1))/nnew;
+          name[nrun+k] = run_name(dir,pid,pass,k);
+          rfile = Fopen(name[nrun+k],"w");
+          if (rfile == NULL)
+            exit (1);
+          merge_runs(name+lo,hi-lo,rfile,NULL,0,in->tspace,budget,map_order);
+          if (fclose(rfile) != 0)
+            SYSTEM_CLOSE_ERROR
+        }
+      for (k = 0; k < nnew; k++)
+        name[k] = name[nrun+k];
+      nrun = nnew;
+    }
+
+  merge_runs(name,nrun,output,iname,in->novl,in->tspace,budget,map_order);
+
+  free(name);
+  Close_Las_Reader(in);
 }
 
 int main(int argc, char *argv[])
-{ char     *iblock, *fblock, *iend;
-  int64     isize,   osize;
-  int64     ovlsize, ptrsize;
-  int       tspace, tbytes;
-  int       i;
+{ int       i;
 
   int       VERBOSE;
   int       MAP_ORDER;
+  int       NTHREADS;
+  int64     MEM_LIMIT;
+  char     *TEMP_PATH;
  
   //  Process options
 
-  { int j, k;
-    int flags[128];
+  { int   j, k;
+    int   flags[128];
+    char *eptr;
+    DIR  *dirp;
 
     ARG_INIT("LAsort")
 
+    NTHREADS  = 4;
+    MEM_LIMIT = 0;
+    TEMP_PATH = "/tmp";
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
-        { ARG_FLAGS("va") }
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("vaz")
+            break;
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+          case 'M':
+            { int limit;
+
+              ARG_NON_NEGATIVE(limit,"Memory allocation (in Gb)")
+              MEM_LIMIT = limit * 0x40000000ll;
+              break;
+            }
+          case 'P':
+            TEMP_PATH = argv[i]+2;
+            if ((dirp = opendir(TEMP_PATH)) == NULL)
+              { fprintf(stderr,"%s: -P option: cannot open directory %s\n",Prog_Name,TEMP_PATH);
+                exit (1);
+              }
+            closedir(dirp);
+            break;
+        }
       else
         argv[j++] = argv[i];
     argc = j;
 
     VERBOSE   = flags['v'];
     MAP_ORDER = flags['a'];
+    PACKED    = flags['z'];
 
     if (argc <= 1)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage);
@@ -225,189 +293,90 @@ int main(int argc, char *argv[])
         fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
         fprintf(stderr,"      -a: sort .las by A-read,A-position pairs for map usecase\n");
         fprintf(stderr,"          off => sort .las by A,B-read pairs for overlap piles\n");
+        fprintf(stderr,"      -z: Write the sorted .las packed.\n");
+        fprintf(stderr,"      -T: Use -T threads.\n");
+        fprintf(stderr,"      -M: Use only -M GB of memory, sorting a larger file in runs.\n");
+        fprintf(stderr,"      -P: Place the runs of any such sort in directory -P.\n");
         exit (1);
       }
   }
 
   //  For each file do
 
-  ptrsize = sizeof(void *);
-  ovlsize = sizeof(Overlap) - ptrsize;
-  isize   = 0;
-  iblock  = NULL;
-  osize   = MEMORY * 1000000ll;
-  fblock  = Malloc(osize,"Allocating LAsort output block");
-
   for (i = 1; i < argc; i++)
-    { int64    *perm;
-      FILE     *input, *foutput;
-      int64     novl, sov;
-      Block_Looper *parse;
+    { Block_Looper *parse;
+      FILE         *input, *foutput;
+      Las_Set      *set;
+      Las_Writer   *out;
 
       parse = Parse_Block_LAS_Arg(argv[i]);
 
       while ((input = Next_Block_Arg(parse)) != NULL)
-        {
-          //  Read in the entire file and output header
-
-          { int64  size;
-            struct stat info;
-            char  *root, *path;
-
-            path = Block_Arg_Path(parse);
-            root = Block_Arg_Root(parse);
-
-            stat(Catenate(path,"/",root,".las"),&info);
-            size = info.st_size;
-
-            if (fread(&novl,sizeof(int64),1,input) != 1)
-              SYSTEM_READ_ERROR
-            if (fread(&tspace,sizeof(int),1,input) != 1)
-              SYSTEM_READ_ERROR
-
-            if (tspace <= TRACE_XOVR && tspace != 0)
-              tbytes = sizeof(uint8);
-            else
-              tbytes = sizeof(uint16);
-
-            if (VERBOSE)
-              { printf("  %s: ",root);
-                Print_Number(novl,0,stdout);
-                printf(" records ");
-                Print_Number(size-novl*ovlsize,0,stdout);
-                printf(" trace bytes\n");
-                fflush(stdout);
-              }
+        { char *root, *path, *sroot, *iname;
 
-            foutput = Fopen(Catenate(path,"/",root,".S.las"),"w");
-            if (foutput == NULL)
-              exit (1);
+          path  = Block_Arg_Path(parse);
+          root  = Block_Arg_Root(parse);
+          sroot = Strdup(Catenate(root,".S","",""),"Allocating name");
+          if (sroot == NULL)
+            exit (1);
+          iname = Strdup(Las_Index_Name(path,sroot),"Allocating name");
+          if (iname == NULL)
+            exit (1);
+          free(sroot);
 
-            if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
-              SYSTEM_WRITE_ERROR
-            if (fwrite(&tspace,sizeof(int),1,foutput) != 1)
-              SYSTEM_WRITE_ERROR
- 
-            if (size > isize)
-              { if (iblock == NULL)
-                  iblock = Malloc(size+ptrsize,"Allocating LAsort input block");
-                else
-                  iblock = Realloc(iblock-ptrsize,size+ptrsize,"Allocating LAsort input block");
-                if (iblock == NULL)
-                  exit (1);
-                iblock += ptrsize;
-                isize   = size;
-              }
-            size -= (sizeof(int64) + sizeof(int));
-            if (size > 0)
-              { if (fread(iblock,size,1,input) != 1)
-                  SYSTEM_READ_ERROR
-              }
-            fclose(input);
-            iend = iblock + (size - ptrsize);
+          //  Under a memory limit, sort in runs should the file not fit
+
+          if (MEM_LIMIT > 0)
+            { foutput = Fopen(Catenate(path,"/",root,".S.las"),"w");
+              if (foutput == NULL)
+                exit (1);
 
-            free(root);
-            free(path);
-          }
+              external_sort(input,foutput,iname,root,MEM_LIMIT,TEMP_PATH,MAP_ORDER,NTHREADS,VERBOSE);
+              fclose(input);
 
-          if (novl == 0)
-            { fclose(foutput);
+              if (fclose(foutput) != 0)
+                SYSTEM_CLOSE_ERROR
+
+              free(iname);
+              free(root);
+              free(path);
               continue;
             }
-    
-          //  Set up unsorted permutation array
-        
-          perm = (int64 *) Malloc(sizeof(int64)*novl,"Allocating LAsort permutation vector");
-          if (perm == NULL)
+
+          //  Read in the entire file, sort it, and output the result
+
+          set = Read_Las_Set(input,0);
+          fclose(input);
+
+          if (VERBOSE)
+            { printf("  %s: ",root);
+              Print_Number(set->novl,0,stdout);
+              printf(" records ");
+              Print_Number((set->size + sizeof(int64) + sizeof(int)) - set->novl*LAS_OVL,0,stdout);
+              printf(" trace bytes\n");
+              fflush(stdout);
+            }
+
+          foutput = Fopen(Catenate(path,"/",root,".S.las"),"w");
+          if (foutput == NULL)
             exit (1);
-    
-          { int64 off;
-            int   j;
-    
-            if (CHAIN_START(((Overlap *) (iblock-ptrsize))->flags))
-              { sov = 0;
-                off = -ptrsize;
-                for (j = 0; j < novl; j++)
-                  { if (CHAIN_START(((Overlap *) (iblock+off))->flags))
-                      perm[sov++] = off;
-                    off += ovlsize + ((Overlap *) (iblock+off))->path.tlen*tbytes;
-                  }
-              }
-            else
-              { off = -ptrsize;
-                for (j = 0; j < novl; j++)
-                  { perm[j] = off;
-                    off += ovlsize + ((Overlap *) (iblock+off))->path.tlen*tbytes;
-                  }
-                sov = novl;
-              }
-          }
-
-          //  Sort permutation array of ptrs to records
-    
-          IBLOCK = iblock;
-          if (MAP_ORDER)
-            qsort(perm,sov,sizeof(int64),SORT_MAP);
-          else
-            qsort(perm,sov,sizeof(int64),SORT_OVL);
-
-          //  Output the records in sorted order
-    
-          { int      j, equal;
-            Overlap *w, *x, y;
-            int64    tsize, span;
-            char    *fptr, *ftop, *wo;
-    
-            y.aread = ((Overlap *) (iblock+perm[0]))->aread+1;
-            x = &y;
-
-            fptr = fblock;
-            ftop = fblock + osize;
-            for (j = 0; j < sov; j++)
-              { w = (Overlap *) (wo = iblock+perm[j]);
-                do
-                  { equal = EQUAL(w,x); 
-                    tsize = w->path.tlen*tbytes;
-                    span  = ovlsize + tsize;
-                    if (fptr + span > ftop)
-                      { if (fwrite(fblock,1,fptr-fblock,foutput) != (size_t) (fptr-fblock))
-                          SYSTEM_WRITE_ERROR
-                        fptr = fblock;
-                      }
-                    if (equal)
-                      { fptr += (ovlsize + tsize);
-                        novl -= 1;
-                      }
-                    else
-                      { memmove(fptr,((char *) w)+ptrsize,ovlsize);
-                        fptr += ovlsize;
-                        memmove(fptr,(char *) (w+1),tsize);
-                        fptr += tsize;
-                      }
-                    x = w;
-                    w = (Overlap *) (wo += span);
-                  }
-                while (wo < iend && CHAIN_NEXT(w->flags));
-              }
-            if (fptr > fblock)
-              { if (fwrite(fblock,1,fptr-fblock,foutput) != (size_t) (fptr-fblock))
-                  SYSTEM_WRITE_ERROR
-              }
-          }
 
-          rewind(foutput);
-          if (fwrite(&novl,sizeof(int64),1,foutput) != 1)
-            SYSTEM_WRITE_ERROR
+          Sort_Las_Set(set,MAP_ORDER,NTHREADS);
+
+          out = open_output(foutput,set->novl,set->tspace,MEMORY*1000000ll);
+          Write_Las_Set(set,out);
+          close_indexed(out,foutput,iname);
+
+          if (fclose(foutput) != 0)
+            SYSTEM_CLOSE_ERROR
 
-          free(perm);
-          fclose(foutput);
+          Free_Las_Set(set);
+          free(iname);
+          free(root);
+          free(path);
         }
       Free_Block_Arg(parse);
     }
-    
-  if (iblock != NULL)
-    free(iblock - ptrsize);
-  free(fblock);
 
   exit (0);
 }
@@ -18,32 +18,47 @@
 
 #include "DB.h"
 #include "align.h"
+#include "las.h"
 
-static char *Usage = "-v <target:las> (<parts:int> | <path:db|dam>) < <source>.las";
-
-#define MEMORY   1000   //  How many megabytes for output buffer
+static char *Usage = "-v [-M<int(1)>] <target:las> (<parts:int> | <path:db|dam>) < <source>.las";
 
 int main(int argc, char *argv[])
-{ char      *iblock, *oblock;
-  FILE      *output;
-  DAZZ_STUB *stub;
-  int64      novl, bsize, ovlsize, ptrsize;
-  int        parts, tspace, tbytes;
-  char      *pwd, *root, *root2;
+{ FILE       *output;
+  DAZZ_STUB  *stub;
+  Las_Reader *in;
+  Las_Writer *out;
+  int64       novl;
+  int         parts;
+  char       *pwd, *root, *root2;
 
   int        VERBOSE;
+  int64      MEMORY;
 
   //  Process options
 
-  { int i, j, k;
-    int flags[128];
+  { int   i, j, k;
+    int   flags[128];
+    char *eptr;
 
     ARG_INIT("LAsplit")
 
+    MEMORY = 0x40000000ll;
+
     j = 1;
     for (i = 1; i < argc; i++)
       if (argv[i][0] == '-')
-        { ARG_FLAGS("v") }
+        switch (argv[i][1])
+        { default:
+            ARG_FLAGS("v")
+            break;
+          case 'M':
+            { int limit;
+
+              ARG_POSITIVE(limit,"Memory for I/O buffers (in Gb)")
+              MEMORY = limit * 0x40000000ll;
+              break;
+            }
+        }
       else
         argv[j++] = argv[i];
     argc = j;
@@ -56,6 +71,9 @@ int main(int argc, char *argv[])
         fprintf(stderr,"    <target> is a template that must have a single %c-sign in it\n",
                        BLOCK_SYMBOL);
         fprintf(stderr,"    This symbol is replaced by numbers 1 to n = the number of parts\n");
+        fprintf(stderr,"\n");
+        fprintf(stderr,"      -v: Verbose mode, output statistics as proceed.\n");
+        fprintf(stderr,"      -M: Use -M GB of memory for I/O buffers.\n");
         exit (1);
       }
   }
@@ -87,15 +105,6 @@ int main(int argc, char *argv[])
       }
   }
 
-  ptrsize = sizeof(void *);
-  ovlsize = sizeof(Overlap) - ptrsize;
-  bsize   = MEMORY * 1000000ll;
-  oblock  = (char *) Malloc(bsize,"Allocating output block");
-  iblock  = (char *) Malloc(bsize + ptrsize,"Allocating input block");
-  if (oblock == NULL || iblock == NULL)
-    exit (1);
-  iblock += ptrsize;
-
   pwd   = PathTo(argv[1]);
   root  = Root(argv[1],".las");
 
@@ -111,29 +120,19 @@ int main(int argc, char *argv[])
     }
   *root2++ = '\0';
 
-  if (fread(&novl,sizeof(int64),1,stdin) != 1)
-    SYSTEM_READ_ERROR
-  if (fread(&tspace,sizeof(int),1,stdin) != 1)
-    SYSTEM_READ_ERROR
-  if (tspace <= TRACE_XOVR && tspace != 0)
-    tbytes = sizeof(uint8);
-  else
-    tbytes = sizeof(uint16);
+  //  Input and output are each double-buffered, reading ahead and writing behind
+
+  in   = Open_Las_Reader(stdin,MEMORY/4);
+  Set_Las_Read_Ahead(in);
+  novl = in->novl;
 
   if (VERBOSE)
     { printf("  Distributing %lld la\'s\n",novl);
       fflush(stdout);
     }
 
-  { int      i;
-    Overlap *w;
-    int64    j, low, hgh, last;
-    int64    tsize, povl;
-    char    *iptr, *itop;
-    char    *optr, *otop;
-
-    iptr = iblock;
-    itop = iblock + fread(iblock,1,bsize,stdin);
+  { int   i;
+    int64 low, hgh, povl;
 
     hgh = 0;
     for (i = 0; i < parts; i++)
@@ -142,73 +141,14 @@ int main(int argc, char *argv[])
           exit (1);
 
         low = hgh;
+        out = Open_Las_Writer(output,0,in->tspace,MEMORY/4);
+        Set_Las_Write_Behind(out);
         if (stub != NULL)
-          { last = stub->tblocks[i+1];
-            hgh  = 0;
-          }
+          povl = Split_Las(in,out,0,stub->tblocks[i+1]);
         else
-          { last = 0;
-            hgh  = (novl*(i+1))/parts;
-          }
-
-        povl = 0;
-        fwrite(&povl,sizeof(int64),1,output);
-        fwrite(&tspace,sizeof(int),1,output);
-
-        optr = oblock;
-        otop = oblock + bsize;
-
-        for (j = low; j < novl; j++)
-          { if (iptr + ovlsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memmove(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,stdin);
-              }
-
-            w = (Overlap *) (iptr-ptrsize);
-            if (stub == NULL)
-              { if (j >= hgh && w->aread > last)
-                  break;
-                last = w->aread;
-              }
-            else
-              { if (w->aread >= last)
-                  break;
-              }
-
-            tsize = w->path.tlen*tbytes;
-            if (optr + ovlsize + tsize > otop)
-              { fwrite(oblock,1,optr-oblock,output);
-                optr = oblock;
-              }
-            
-            memmove(optr,iptr,ovlsize);
-            optr += ovlsize;
-            iptr += ovlsize;
-
-            if (iptr + tsize > itop)
-              { int64 remains = itop-iptr;
-                if (remains > 0)
-                  memmove(iblock,iptr,remains);
-                iptr  = iblock;
-                itop  = iblock + remains;
-                itop += fread(itop,1,bsize-remains,stdin);
-              }
-	    memmove(optr,iptr,tsize);
-            optr += tsize;
-            iptr += tsize;
-          }
-        hgh = j;
-
-        if (optr > oblock)
-          fwrite(oblock,1,optr-oblock,output);
-
-        rewind(output);
-        povl = hgh-low;
-        fwrite(&povl,sizeof(int64),1,output);
+          povl = Split_Las(in,out,(novl*(i+1))/parts-low,-1);
+        Close_Las_Writer(out);
+        hgh = low + povl;
 
         if (VERBOSE)
           { printf("  Split off %s: %lld la\'s\n",Numbered_Suffix(root,i+1,root2),povl);
@@ -222,8 +162,7 @@ int main(int argc, char *argv[])
   free(pwd);
   free(root);
   Free_DB_Stub(stub);
-  free(iblock-ptrsize);
-  free(oblock);
+  Close_Las_Reader(in);
 
   exit (0);
 }
@@ -49,17 +49,62 @@
 *                                                                                        *
 \****************************************************************************************/
 
+  /*  The trace cells (Pebbles) of the wave routines live in an arena of geometrically
+      growing segments: segment s holds CELL_BASE << s cells and covers the cell indices
+      [CELL_BASE*(2^s-1),CELL_BASE*(2^(s+1)-1)).  Growing the arena adds a segment and
+      never moves or copies the cells already in use.  Each segment pointer is biased by
+      the index of its first cell so that CELL(seg,h) is simply seg[s]+h.                */
+
+typedef struct
+  { int ptr;
+    int diag;
+    int diff;
+    int mark;
+  } Pebble;
+
+#define CELL_LOG   16                  //  First segment has 2^CELL_LOG cells
+#define CELL_BASE  (1 << CELL_LOG)
+#define CELL_SEGS  (31 - CELL_LOG)     //  Enough segments to index INT32_MAX cells
+
+#ifdef __GNUC__
+
+#define CELL(seg,h)  ((seg)[(31-CELL_LOG) - __builtin_clz((uint32) (h) + CELL_BASE)] + (h))
+
+#else
+
+static inline Pebble *cell_ptr(Pebble **seg, int h)
+{ uint32 x;
+  int    s;
+
+  x = ((uint32) h + CELL_BASE) >> (CELL_LOG+1);
+  for (s = 0; x != 0; s++)
+    x >>= 1;
+  return (seg[s] + h);
+}
+
+#define CELL(seg,h)  cell_ptr(seg,h)
+
+#endif
+
 typedef struct            //  Hidden from the user, working space for each thread
   { int     vecmax;
     void   *vector;
-    int     celmax;
-    void   *cells;
+    int     celmax;             //  # of cells in the arena
+    int     cellim;             //  # of cells available to a call (celmax or less if capped)
+    int     celcap;             //  Hard cap on the # of cells per call (0 => none)
+    int     celseg;             //  # of arena segments allocated
+    Pebble *cells[CELL_SEGS];   //  Biased segment pointers of the cell arena
     int     pntmax;
     void   *points;
     int     tramax;
     void   *trace;
     int     alnmax;
     void   *alnpts;
+    int     txtmax;
+    char   *text;               //  Display being rendered by a Print routine
+    int64   celhwm;             //  Most cells used by a call
+    int64   capped;             //  # of calls that ran into celcap
+    int64   spent;              //  D.p. cells explored so far by the current call
   } _Work_Data;
 
 Work_Data *New_Work_Data()
@@ -76,11 +121,20 @@ Work_Data *New_Work_Data()
   work->trace  = NULL;
   work->alnmax = 0;
   work->alnpts = NULL;
+  work->txtmax = 0;
+  work->text   = NULL;
   work->celmax = 0;
-  work->cells  = NULL;
+  work->cellim = 0;
+  work->celcap = 0;
+  work->celseg = 0;
+  work->celhwm = 0;
+  work->capped = 0;
+  work->spent  = 0;
   return ((Work_Data *) work);
 }
 
+  //  Grow the vector, preserving its contents, for the routines that extend it mid-computation
+
 static int enlarge_vector(_Work_Data *work, int newmax)
 { void *vec;
   int   max;
@@ -94,57 +148,138 @@ static int enlarge_vector(_Work_Data *work, int newmax)
   return (0);
 }
 
-static int enlarge_points(_Work_Data *work, int newmax)
-{ void *vec;
-  int   max;
+  //  The remaining routines set up storage whose current contents are dead, so a larger
+  //    block is simply allocated in place of the old one rather than copying the latter
+
+static void *renew_block(void *block, int *bmax, int newmax, char *mesg)
+{ int max;
 
   max = ((int) (newmax*1.2)) + 10000;
-  vec = Realloc(work->points,max,"Enlarging point vector");
-  if (vec == NULL)
+  free(block);
+  block = Malloc(max,mesg);
+  if (block == NULL)
+    { *bmax = 0;
+      return (NULL);
+    }
+  *bmax = max;
+  return (block);
+}
+
+static int renew_vector(_Work_Data *work, int newmax)
+{ work->vector = renew_block(work->vector,&(work->vecmax),newmax,"Enlarging DP vector");
+  if (work->vector == NULL)
     EXIT(1);
-  work->pntmax = max;
-  work->points = vec;
   return (0);
 }
 
-static int enlarge_alnpts(_Work_Data *work, int newmax)
-{ void *vec;
-  int   max;
+static int enlarge_points(_Work_Data *work, int newmax)
+{ work->points = renew_block(work->points,&(work->pntmax),newmax,"Enlarging point vector");
+  if (work->points == NULL)
+    EXIT(1);
+  return (0);
+}
 
-  max = ((int) (newmax*1.2)) + 10000;
-  vec = Realloc(work->alnpts,max,"Enlarging point vector");
-  if (vec == NULL)
+static int enlarge_alnpts(_Work_Data *work, int newmax)
+{ work->alnpts = renew_block(work->alnpts,&(work->alnmax),newmax,"Enlarging point vector");
+  if (work->alnpts == NULL)
     EXIT(1);
-  work->alnmax = max;
-  work->alnpts = vec;
   return (0);
 }
 
 static int enlarge_trace(_Work_Data *work, int newmax)
-{ void *vec;
-  int   max;
-
-  max = ((int) (newmax*1.2)) + 10000;
-  vec = Realloc(work->trace,max,"Enlarging trace vector");
-  if (vec == NULL)
+{ work->trace = renew_block(work->trace,&(work->tramax),newmax,"Enlarging trace vector");
+  if (work->trace == NULL)
     EXIT(1);
-  work->tramax = max;
-  work->trace  = vec;
   return (0);
 }
 
+  //  Make cell index 'need' available by adding arena segments.  Returns 1 if the cap
+  //    has been reached, 0 if the cell is available, and -1 if out of memory.
+
+static int enlarge_cells(_Work_Data *work, int need)
+{ Pebble *seg;
+  int     s, size;
+
+  if (work->celcap > 0 && need >= work->celcap)
+    { work->capped += 1;
+      return (1);
+    }
+  while (need >= work->celmax)
+    { s = work->celseg;
+      if (s >= CELL_SEGS)
+        { EPRINTF(EPLACE,"%s: Trace cell arena is exhausted\n",Prog_Name);
+          EXIT(-1);
+        }
+      size = (CELL_BASE << s);
+      seg  = (Pebble *) Malloc(size*sizeof(Pebble),"Enlarging trace cell arena");
+      if (seg == NULL)
+        EXIT(-1);
+      work->cells[s] = seg - work->celmax;
+      work->celmax  += size;
+      work->celseg   = s+1;
+    }
+  if (work->celcap > 0 && work->celcap < work->celmax)
+    work->cellim = work->celcap;
+  else
+    work->cellim = work->celmax;
+  return (0);
+}
+
+  //  Cell allocation within a wave routine: on reaching the cap control passes to 'label'
+
+#define NEW_CELL(need,label)				\
+  if ((need) >= cmax)					\
+    { int _x = enlarge_cells(work,need);		\
+      if (_x < 0)					\
+        EXIT(1);					\
+      if (_x > 0)					\
+        { align->flags |= TRUNC_FLAG;			\
+          goto label;					\
+        }						\
+      cmax = work->cellim;				\
+    }
+
+void Set_Work_Cap(Work_Data *ework, int maxcells)
+{ _Work_Data *work = (_Work_Data *) ework;
+
+  if (maxcells == 1)      //  The first two cells (for the start point) must always be made
+    maxcells = 2;
+  work->celcap = maxcells;
+  if (maxcells > 0 && maxcells < work->celmax)
+    work->cellim = maxcells;
+  else
+    work->cellim = work->celmax;
+}
+
+void Work_Data_Stats(Work_Data *ework, Work_Stats *stats)
+{ _Work_Data *work = (_Work_Data *) ework;
+
+  stats->cells  = work->celhwm;
+  stats->arena  = ((int64) work->celmax) * sizeof(Pebble);
+  stats->vector = ((int64) work->vecmax) + work->pntmax + work->tramax + work->alnmax
+                + work->txtmax;
+  stats->capped = work->capped;
+}
+
 void Free_Work_Data(Work_Data *ework)
 { _Work_Data *work = (_Work_Data *) ework;
+  int         s, base;
+
   if (work->vector != NULL)
     free(work->vector);
-  if (work->cells != NULL)
-    free(work->cells);
+  base = 0;
+  for (s = 0; s < work->celseg; s++)
+    { free(work->cells[s] + base);
+      base += (CELL_BASE << s);
+    }
   if (work->trace != NULL)
     free(work->trace);
   if (work->points != NULL)
     free(work->points);
   if (work->alnpts != NULL)
     free(work->alnpts);
+  if (work->text != NULL)
+    free(work->text);
   free(work);
 }
 
@@ -178,7 +313,7 @@ static double Bias_Factor[10] = { .690, .690, .690, .690, .780,
 
   //  Adjustable paramters
 
-typedef struct
+typedef struct _Align_Spec
   { double ave_corr;
     int    trace_space;
     int    reach;
@@ -186,7 +321,14 @@ typedef struct
     int    ave_path;
     int16 *score;
     int16 *table;
+    int64  budget;     //  Most d.p. cells a Local_Alignment call may explore (0 => no limit)
+    int  (*fwave)(_Work_Data *, struct _Align_Spec *, Alignment *, Path *,  //  Wave kernels
+                  int *, int, int, int, int, int, int);                     //    specialized to
+    int  (*rwave)(_Work_Data *, struct _Align_Spec *, Alignment *, Path *,  //    trace_space and
+                  int, int, int, int, int, int, int);                       //    reach
   } _Align_Spec;
+
+static void set_wave_kernels(_Align_Spec *spec);
  
 /* Fill in bit table: TABLE[x] = 1 iff the alignment modeled by x (1 = match, 0 = mismatch)
      has a non-negative score for every suffix of the alignment under the scoring scheme
@@ -258,8 +400,11 @@ Align_Spec *New_Align_Spec(double ave_corr, int trace_space, float *freq, int re
 
   set_table(0,0,0,0,&parms);
 
-  spec->table = parms.table;
-  spec->score = parms.score;
+  spec->table  = parms.table;
+  spec->score  = parms.score;
+  spec->budget = 0;
+
+  set_wave_kernels(spec);
 
   return ((Align_Spec *) spec);
 }
@@ -282,6 +427,12 @@ float *Base_Frequencies(Align_Spec *espec)
 int Overlap_If_Possible(Align_Spec *espec)
 { return (((_Align_Spec *) espec)->reach); }
 
+void Set_Align_Budget(Align_Spec *espec, int64 maxcells)
+{ ((_Align_Spec *) espec)->budget = maxcells; }
+
+int64 Align_Budget(Align_Spec *espec)
+{ return (((_Align_Spec *) espec)->budget); }
+
 
 /****************************************************************************************\
 *                                                                                        *
@@ -337,17 +488,22 @@ static void print_wave(int *V, int *M, int low, int hgh, int besta)
      recording the last TRIM_LEN columns of the implied alignment (T), and the
      # of matches (1-bits) in the bitvector (M).                               */
 
-typedef struct
-  { int ptr;
-    int diag;
-    int diff;
-    int mark;
-  } Pebble;
+  //  The wave routines are templates in TRACE_SPACE and REACH: they are always inlined into
+  //    the thin kernels generated by WAVE_KERNELS below, so that for the common trace spacings
+  //    the divisions and modulos by TRACE_SPACE become constant-divisor arithmetic and the
+  //    REACH branches fold away.
+
+#ifdef __GNUC__
+#define WAVE_INLINE inline __attribute__((always_inline))
+#else
+#define WAVE_INLINE inline
+#endif
 
 static int VectorEl = 6*sizeof(int) + sizeof(BVEC);
 
-static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, Path *bpath,
-                        int *mind, int maxd, int mida, int minp, int maxp, int aoff, int boff)
+static WAVE_INLINE int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align,
+                                    Path *bpath, int *mind, int maxd, int mida, int minp,
+                                    int maxp, int aoff, int boff, int TRACE_SPACE, int REACH)
 { char *aseq  = align->aseq;
   char *bseq  = align->bseq;
   Path *apath = align->path;
@@ -363,12 +519,11 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
   int    *_HA, *_HB;
   int    *NA, *NB;
   int    *_NA, *_NB;
-  Pebble *cells;
+  Pebble **cells;
   int     avail, cmax;
 
-  int     TRACE_SPACE = spec->trace_space;
   int     PATH_AVE    = spec->ave_path;
-  int     REACH       = spec->reach;
+  int64   BUDGET      = spec->budget;
   int16  *SCORE       = spec->score;
   int16  *TABLE       = spec->table;
 
@@ -408,8 +563,8 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
     NB = _NB-vmin;
     T  = _T-vmin;
 
-    cells = (Pebble *) (work->cells);
-    cmax  = work->celmax;
+    cells = work->cells;
+    cmax  = work->cellim;
     avail = 0;
   }
 
@@ -438,20 +593,13 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 
         y = (mida-k) >> 1;
 
-        if (avail >= cmax-1)
-          { cmax  = ((int) (avail*1.2)) + 10000;
-            cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-            if (cells == NULL)
-              EXIT(1);
-            work->celmax = cmax;
-            work->cells  = (void *) cells;
-          }
+        NEW_CELL(avail+1,capped)
 
         na = (((y+k)+(TRACE_SPACE-aoff))/TRACE_SPACE-1)*TRACE_SPACE+aoff;
 #ifdef SHOW_TPS
         printf(" A %d: %d,%d,0,%d\n",avail,-1,k,na); fflush(stdout);
 #endif
-        pb = cells+avail;
+        pb = CELL(cells,avail);
         pb->ptr  = -1;
         pb->diag = k;
         pb->diff = 0;
@@ -463,7 +611,7 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 #ifdef SHOW_TPS
         printf(" B %d: %d,%d,0,%d\n",avail,-1,k,nb); fflush(stdout);
 #endif
-        pb = cells+avail;
+        pb = CELL(cells,avail);
         pb->ptr  = -1;
         pb->diag = k;
         pb->diff = 0;
@@ -492,18 +640,11 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
         c = (y << 1) + k;
 
         while (y+k >= na)
-          { if (avail >= cmax)
-              { cmax  = ((int) (avail*1.2)) + 10000;
-                cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-                if (cells == NULL)
-                  EXIT(1);
-                work->celmax = cmax;
-                work->cells  = (void *) cells;
-              }
+          { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
             printf(" A %d: %d,%d,0,%d\n",avail,ha,k,na); fflush(stdout);
 #endif
-            pb = cells+avail;
+            pb = CELL(cells,avail);
             pb->ptr  = ha;
             pb->diag = k;
             pb->diff = 0;
@@ -512,18 +653,11 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
             na += TRACE_SPACE;
           }
         while (y >= nb)
-          { if (avail >= cmax)
-              { cmax  = ((int) (avail*1.2)) + 10000;
-                cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-                if (cells == NULL)
-                  EXIT(1);
-                work->celmax = cmax;
-                work->cells  = (void *) cells;
-              }
+          { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
             printf(" B %d: %d,%d,0,%d\n",avail,hb,k,nb); fflush(stdout);
 #endif
-            pb = cells+avail;
+            pb = CELL(cells,avail);
             pb->ptr  = hb;
             pb->diag = k;
             pb->diff = 0;
@@ -765,20 +899,12 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
           c = (y << 1) + k;
 
           while (y+k >= NA[k])
-            { if (cells[ha].mark < NA[k])
-                { if (avail >= cmax)
-                    { cmax  = ((int) (avail*1.2)) + 10000;
-                      cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),
-                                                       "Reallocating trace cells");
-                      if (cells == NULL)
-                        EXIT(1);
-                      work->celmax = cmax;
-                      work->cells  = (void *) cells;
-                    }
+            { if (CELL(cells,ha)->mark < NA[k])
+                { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
                   printf(" A %d: %d,%d,%d,%d\n",avail,ha,k,dif,NA[k]); fflush(stdout);
 #endif
-                  pb = cells+avail;
+                  pb = CELL(cells,avail);
                   pb->ptr  = ha;
                   pb->diag = k;
                   pb->diff = dif;
@@ -789,20 +915,12 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
             }
 
           while (y >= NB[k])
-            { if (cells[hb].mark < NB[k])
-                { if (avail >= cmax)
-                    { cmax  = ((int) (avail*1.2)) + 10000;
-                      cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),
-                                                       "Reallocating trace cells");
-                      if (cells == NULL)
-                        EXIT(1);
-                      work->celmax = cmax;
-                      work->cells  = (void *) cells;
-                    }
+            { if (CELL(cells,hb)->mark < NB[k])
+                { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
                   printf(" B %d: %d,%d,%d,%d\n",avail,hb,k,dif,NB[k]); fflush(stdout);
 #endif
-                  pb = cells+avail;
+                  pb = CELL(cells,avail);
                   pb->ptr  = hb;
                   pb->diag = k;
                   pb->diff = dif;
@@ -880,6 +998,14 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
             break;
           }
 
+      if (BUDGET > 0)
+        { work->spent += (hgh-low)+1;
+          if (work->spent > BUDGET)
+            { align->flags |= TRUNC_FLAG;
+              break;
+            }
+        }
+
 #ifdef WAVE_STATS
       k = (hgh-low)+1;
       if (k > MAX)
@@ -893,6 +1019,13 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 #endif
     }
 
+  //  If the cell cap or the budget is reached, the wave stops and the best trim point
+  //    so far is reported
+
+capped:
+  if (avail > work->celhwm)
+    work->celhwm = avail;
+
   { uint16 *atrace = (uint16 *) apath->trace;
     uint16 *btrace = (uint16 *) bpath->trace;
     int     atlen, btlen;
@@ -914,22 +1047,22 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 
     a = -1;
     for (h = trimha; h >= 0; h = b)
-      { b = cells[h].ptr; 
-        cells[h].ptr = a;
+      { b = CELL(cells,h)->ptr; 
+        CELL(cells,h)->ptr = a;
         a = h;
       }
     h = a;
 
-    k = cells[h].diag;
+    k = CELL(cells,h)->diag;
     b = (mida-k)/2;
     e = 0;
 #ifdef SHOW_TRAIL
     printf("  A path = (%5d,%5d)\n",(mida+k)/2,b); fflush(stdout);
 #endif
-    for (h = cells[h].ptr; h >= 0; h = cells[h].ptr)
-      { k = cells[h].diag;
-        a = cells[h].mark - k;
-        d = cells[h].diff;
+    for (h = CELL(cells,h)->ptr; h >= 0; h = CELL(cells,h)->ptr)
+      { k = CELL(cells,h)->diag;
+        a = CELL(cells,h)->mark - k;
+        d = CELL(cells,h)->diff;
         atrace[atlen++] = (uint16) (d-e);
         atrace[atlen++] = (uint16) (a-b);
 #ifdef SHOW_TRAIL
@@ -955,23 +1088,23 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 
     a = -1;
     for (h = trimhb; h >= 0; h = b)
-      { b = cells[h].ptr; 
-        cells[h].ptr = a;
+      { b = CELL(cells,h)->ptr; 
+        CELL(cells,h)->ptr = a;
         a = h;
       }
     h = a;
 
-    k = cells[h].diag;
+    k = CELL(cells,h)->diag;
     b = (mida+k)/2;
     e = 0;
     low = k;
 #ifdef SHOW_TRAIL
     printf("  B path = (%5d,%5d)\n",b,(mida-k)/2); fflush(stdout);
 #endif
-    for (h = cells[h].ptr; h >= 0; h = cells[h].ptr)
-      { k = cells[h].diag;
-        a = cells[h].mark + k;
-        d = cells[h].diff;
+    for (h = CELL(cells,h)->ptr; h >= 0; h = CELL(cells,h)->ptr)
+      { k = CELL(cells,h)->diag;
+        a = CELL(cells,h)->mark + k;
+        d = CELL(cells,h)->diff;
         btrace[btlen++] = (uint16) (d-e);
         btrace[btlen++] = (uint16) (a-b);  
 #ifdef SHOW_TRAIL
@@ -1008,8 +1141,9 @@ static int forward_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 
 /*** Reverse Wave ***/
 
-static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, Path *bpath,
-                        int mind, int maxd, int mida, int minp, int maxp, int aoff, int boff)
+static WAVE_INLINE int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align,
+                                    Path *bpath, int mind, int maxd, int mida, int minp,
+                                    int maxp, int aoff, int boff, int TRACE_SPACE, int REACH)
 { char *aseq  = align->aseq - 1;
   char *bseq  = align->bseq - 1;
   Path *apath = align->path;
@@ -1025,12 +1159,11 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
   int    *_HA, *_HB;
   int    *NA, *NB;
   int    *_NA, *_NB;
-  Pebble *cells;
+  Pebble **cells;
   int     avail, cmax;
 
-  int     TRACE_SPACE = spec->trace_space;
   int     PATH_AVE    = spec->ave_path;
-  int     REACH       = spec->reach;
+  int64   BUDGET      = spec->budget;
   int16  *SCORE       = spec->score;
   int16  *TABLE       = spec->table;
 
@@ -1070,8 +1203,8 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
     NB = _NB-vmin;
     T  = _T-vmin;
 
-    cells = (Pebble *) (work->cells);
-    cmax  = work->celmax;
+    cells = work->cells;
+    cmax  = work->cellim;
     avail = 0;
   }
 
@@ -1098,20 +1231,13 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 
         y = (mida-k) >> 1;
 
-        if (avail >= cmax-1)
-          { cmax  = ((int) (avail*1.2)) + 10000;
-            cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-            if (cells == NULL)
-              EXIT(1);
-            work->celmax = cmax;
-            work->cells  = (void *) cells;
-          }
+        NEW_CELL(avail+1,capped)
 
         na = (((y+k)+(TRACE_SPACE-aoff)-1)/TRACE_SPACE-1)*TRACE_SPACE+aoff;
 #ifdef SHOW_TPS
         printf(" A %d: -1,%d,0,%d\n",avail,k,na+TRACE_SPACE); fflush(stdout);
 #endif
-        pb = cells+avail;
+        pb = CELL(cells,avail);
         pb->ptr  = -1;
         pb->diag = k;
         pb->diff = 0;
@@ -1122,7 +1248,7 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 #ifdef SHOW_TPS
         printf(" B %d: -1,%d,0,%d\n",avail,k,nb+TRACE_SPACE); fflush(stdout);
 #endif
-        pb = cells+avail;
+        pb = CELL(cells,avail);
         pb->ptr  = -1;
         pb->diag = k;
         pb->diff = 0;
@@ -1150,18 +1276,11 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
         c = (y << 1) + k;
 
         while (y+k <= na)
-          { if (avail >= cmax)
-              { cmax  = ((int) (avail*1.2)) + 10000;
-                cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-                if (cells == NULL)
-                  EXIT(1);
-                work->celmax = cmax;
-                work->cells  = (void *) cells;
-              }
+          { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
             printf(" A %d: %d,%d,0,%d\n",avail,ha,k,na); fflush(stdout);
 #endif
-            pb = cells+avail;
+            pb = CELL(cells,avail);
             pb->ptr  = ha;
             pb->diag = k;
             pb->diff = 0;
@@ -1170,18 +1289,11 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
             na -= TRACE_SPACE;
           }
         while (y <= nb)
-          { if (avail >= cmax)
-              { cmax  = ((int) (avail*1.2)) + 10000;
-                cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-                if (cells == NULL)
-                  EXIT(1);
-                work->celmax = cmax;
-                work->cells  = (void *) cells;
-              }
+          { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
             printf(" B %d: %d,%d,0,%d\n",avail,hb,k,nb); fflush(stdout);
 #endif
-            pb = cells+avail;
+            pb = CELL(cells,avail);
             pb->ptr  = hb;
             pb->diag = k;
             pb->diff = 0;
@@ -1420,20 +1532,12 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
           c = (y << 1) + k;
 
           while (y+k <= NA[k])
-            { if (cells[ha].mark > NA[k])
-                { if (avail >= cmax)
-                    { cmax  = ((int) (avail*1.2)) + 10000;
-                      cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),
-                                                       "Reallocating trace cells");
-                      if (cells == NULL)
-                        EXIT(1);
-                      work->celmax = cmax;
-                      work->cells  = (void *) cells;
-                    }
+            { if (CELL(cells,ha)->mark > NA[k])
+                { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
                   printf(" A %d: %d,%d,%d,%d\n",avail,ha,k,dif,NA[k]); fflush(stdout);
 #endif
-                  pb = cells+avail;
+                  pb = CELL(cells,avail);
                   pb->ptr  = ha;
                   pb->diag = k;
                   pb->diff = dif;
@@ -1443,20 +1547,12 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
               NA[k] -= TRACE_SPACE;
             }
           while (y <= NB[k])
-            { if (cells[hb].mark > NB[k])
-                { if (avail >= cmax)
-                    { cmax  = ((int) (avail*1.2)) + 10000;
-                      cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),
-                                                       "Reallocating trace cells");
-                      if (cells == NULL)
-                        EXIT(1);
-                      work->celmax = cmax;
-                      work->cells  = (void *) cells;
-                    }
+            { if (CELL(cells,hb)->mark > NB[k])
+                { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
                   printf(" B %d: %d,%d,%d,%d\n",avail,hb,k,dif,NB[k]); fflush(stdout);
 #endif
-                  pb = cells+avail;
+                  pb = CELL(cells,avail);
                   pb->ptr  = hb;
                   pb->diag = k;
                   pb->diff = dif;
@@ -1534,6 +1630,14 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
             break;
           }
 
+      if (BUDGET > 0)
+        { work->spent += (hgh-low)+1;
+          if (work->spent > BUDGET)
+            { align->flags |= TRUNC_FLAG;
+              break;
+            }
+        }
+
 #ifdef WAVE_STATS
       k = (hgh-low)+1;
       if (k > MAX)
@@ -1547,6 +1651,13 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 #endif
     }
 
+  //  If the cell cap or the budget is reached, the wave stops and the best trim point
+  //    so far is reported
+
+capped:
+  if (avail > work->celhwm)
+    work->celhwm = avail;
+
   { uint16 *atrace = (uint16 *) apath->trace;
     uint16 *btrace = (uint16 *) bpath->trace;
     int     atlen, btlen;
@@ -1568,28 +1679,28 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 
     a = -1;
     for (h = trimha; h >= 0; h = b)
-      { b = cells[h].ptr; 
-        cells[h].ptr = a;
+      { b = CELL(cells,h)->ptr; 
+        CELL(cells,h)->ptr = a;
         a = h;
       }
     h = a;
 
-    k = cells[h].diag;
-    b = cells[h].mark - k;
+    k = CELL(cells,h)->diag;
+    b = CELL(cells,h)->mark - k;
     e = 0;
 #ifdef SHOW_TRAIL
     printf("  A path = (%5d,%5d)\n",b+k,b); fflush(stdout);
 #endif
     if ((b+k)%TRACE_SPACE != aoff)
-      { h = cells[h].ptr;
+      { h = CELL(cells,h)->ptr;
         if (h < 0)
           { a = trimy;
             d = trimd;
           }
         else
-          { k = cells[h].diag;
-            a = cells[h].mark - k;
-            d = cells[h].diff;
+          { k = CELL(cells,h)->diag;
+            a = CELL(cells,h)->mark - k;
+            d = CELL(cells,h)->diff;
           }
 #ifdef SHOW_TRAIL
         printf("    +%4d: (%5d,%5d): %3d / %3d\n",h,a+k,a,d-e,b-a); fflush(stdout);
@@ -1606,11 +1717,11 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
         e = d;
       }
     if (h >= 0)
-      { for (h = cells[h].ptr; h >= 0; h = cells[h].ptr)
-          { k = cells[h].diag;
-            a = cells[h].mark - k;
+      { for (h = CELL(cells,h)->ptr; h >= 0; h = CELL(cells,h)->ptr)
+          { k = CELL(cells,h)->diag;
+            a = CELL(cells,h)->mark - k;
             atrace[--atlen] = (uint16) (b-a);
-            d = cells[h].diff;
+            d = CELL(cells,h)->diff;
             atrace[--atlen] = (uint16) (d-e);
 #ifdef SHOW_TRAIL
             printf("     %4d: (%5d,%5d): %3d / %3d\n",h,a+k,a,d-e,b-a); fflush(stdout);
@@ -1636,28 +1747,28 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 
     a = -1;
     for (h = trimhb; h >= 0; h = b)
-      { b = cells[h].ptr; 
-        cells[h].ptr = a;
+      { b = CELL(cells,h)->ptr; 
+        CELL(cells,h)->ptr = a;
         a = h;
       }
     h = a;
 
-    k = cells[h].diag;
-    b = cells[h].mark + k;
+    k = CELL(cells,h)->diag;
+    b = CELL(cells,h)->mark + k;
     e = 0;
 #ifdef SHOW_TRAIL
     printf("  B path = (%5d,%5d)\n",b,b-k); fflush(stdout);
 #endif
     if ((b-k)%TRACE_SPACE != boff)
-      { h = cells[h].ptr;
+      { h = CELL(cells,h)->ptr;
         if (h < 0)
           { a = trimx;
             d = trimd;
           } 
         else
-          { k = cells[h].diag;
-            a = cells[h].mark + k;
-            d = cells[h].diff;
+          { k = CELL(cells,h)->diag;
+            a = CELL(cells,h)->mark + k;
+            d = CELL(cells,h)->diff;
           }
 #ifdef SHOW_TRAIL
         printf("    +%4d: (%5d,%5d): %3d / %3d\n",h,a,a-k,d-e,b-a); fflush(stdout);
@@ -1675,11 +1786,11 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
       }
 
     if (h >= 0)
-      { for (h = cells[h].ptr; h >= 0; h = cells[h].ptr)
-          { k = cells[h].diag;
-            a = cells[h].mark + k;
+      { for (h = CELL(cells,h)->ptr; h >= 0; h = CELL(cells,h)->ptr)
+          { k = CELL(cells,h)->diag;
+            a = CELL(cells,h)->mark + k;
             btrace[--btlen] = (uint16) (b-a);
-            d = cells[h].diff;
+            d = CELL(cells,h)->diff;
             btrace[--btlen] = (uint16) (d-e);
 #ifdef SHOW_TRAIL
             printf("     %4d: (%5d,%5d): %3d / %3d\n",h,a,a-k,d-e,b-a); fflush(stdout);
@@ -1716,6 +1827,53 @@ static int reverse_wave(_Work_Data *work, _Align_Spec *spec, Alignment *align, P
 }
 
 
+/*** Specialized wave kernels ***/
+
+#define WAVE_KERNELS(tag,tspace,reach)                                                  \
+                                                                                        \
+static int forward_wave ## tag(_Work_Data *work, _Align_Spec *spec, Alignment *align,  \
+                               Path *bpath, int *mind, int maxd, int mida, int minp,    \
+                               int maxp, int aoff, int boff)                            \
+{ return (forward_wave(work,spec,align,bpath,mind,maxd,mida,minp,maxp,aoff,boff,        \
+                       tspace,reach));                                                  \
+}                                                                                       \
+                                                                                        \
+static int reverse_wave ## tag(_Work_Data *work, _Align_Spec *spec, Alignment *align,  \
+                               Path *bpath, int mind, int maxd, int mida, int minp,     \
+                               int maxp, int aoff, int boff)                            \
+{ return (reverse_wave(work,spec,align,bpath,mind,maxd,mida,minp,maxp,aoff,boff,        \
+                       tspace,reach));                                                  \
+}
+
+WAVE_KERNELS(_100_0,100,0)
+WAVE_KERNELS(_100_1,100,1)
+WAVE_KERNELS(_500_0,500,0)
+WAVE_KERNELS(_500_1,500,1)
+WAVE_KERNELS(_any_0,spec->trace_space,0)
+WAVE_KERNELS(_any_1,spec->trace_space,1)
+
+  //  Select the kernel pair for spec once, at creation time
+
+static void set_wave_kernels(_Align_Spec *spec)
+{ int reach = (spec->reach != 0);
+
+  switch (spec->trace_space)
+  { case 100:
+      spec->fwave = reach ? forward_wave_100_1 : forward_wave_100_0;
+      spec->rwave = reach ? reverse_wave_100_1 : reverse_wave_100_0;
+      break;
+    case 500:
+      spec->fwave = reach ? forward_wave_500_1 : forward_wave_500_0;
+      spec->rwave = reach ? reverse_wave_500_1 : reverse_wave_500_0;
+      break;
+    default:
+      spec->fwave = reach ? forward_wave_any_1 : forward_wave_any_0;
+      spec->rwave = reach ? reverse_wave_any_1 : reverse_wave_any_0;
+      break;
+  }
+}
+
+
 /* Find the longest local alignment between aseq and bseq through (xcnt,ycnt)
    See associated .h file for the precise definition of the interface.
 */
@@ -1741,7 +1899,7 @@ Path *Local_Alignment(Alignment *align, Work_Data *ework, Align_Spec *espec,
     else
       wsize = VectorEl*10000;
     if (wsize >= work->vecmax)
-      if (enlarge_vector(work,wsize))
+      if (renew_vector(work,wsize))
         EXIT(NULL);
 
     if (alen < blen)
@@ -1796,7 +1954,10 @@ Path *Local_Alignment(Alignment *align, Work_Data *ework, Align_Spec *espec,
       boff = 0;
     }
 
-  if (forward_wave(work,spec,align,bpath,&low,hgh,anti,minp,maxp,aoff,boff))
+  align->flags &= ~TRUNC_FLAG;
+  work->spent   = 0;
+
+  if (spec->fwave(work,spec,align,bpath,&low,hgh,anti,minp,maxp,aoff,boff))
     EXIT(NULL);
 
 #ifdef DEBUG_PASSES
@@ -1805,7 +1966,7 @@ Path *Local_Alignment(Alignment *align, Work_Data *ework, Align_Spec *espec,
          apath->aepos,apath->bepos,apath->diffs);
 #endif
 
-  if (reverse_wave(work,spec,align,bpath,low,low,anti,minp,maxp,aoff,boff))
+  if (spec->rwave(work,spec,align,bpath,low,low,anti,minp,maxp,aoff,boff))
     EXIT(NULL);
 
 #ifdef DEBUG_PASSES
@@ -1928,11 +2089,12 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 
   int    *HA, *NA;
   int    *_HA, *_NA;
-  Pebble *cells;
+  Pebble **cells;
   int     avail, cmax;
 
   int     TRACE_SPACE = spec->trace_space;
   int     PATH_AVE    = spec->ave_path;
+  int64   BUDGET      = spec->budget;
   int16  *SCORE       = spec->score;
   int16  *TABLE       = spec->table;
 
@@ -1968,8 +2130,8 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
     NA = _NA-vmin;
     T  = _T-vmin;
 
-    cells = (Pebble *) (work->cells);
-    cmax  = work->celmax;
+    cells = work->cells;
+    cmax  = work->cellim;
     avail = 0;
   }
 
@@ -1996,20 +2158,13 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 
         y = (mida-k) >> 1;
 
-        if (avail >= cmax-1)
-          { cmax  = ((int) (avail*1.2)) + 10000;
-            cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-            if (cells == NULL)
-              EXIT(1);
-            work->celmax = cmax;
-            work->cells  = (void *) cells;
-          }
+        NEW_CELL(avail+1,capped)
 
         na = ((y+k)/TRACE_SPACE)*TRACE_SPACE;
 #ifdef SHOW_TPS
         printf(" A %d: %d,%d,0,%d\n",avail,-1,k,na); fflush(stdout);
 #endif
-        pb = cells+avail;
+        pb = CELL(cells,avail);
         pb->ptr  = -1;
         pb->diag = k;
         pb->diff = 0;
@@ -2038,18 +2193,11 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
         c = (y << 1) + k;
 
         while (y+k >= na)
-          { if (avail >= cmax)
-              { cmax  = ((int) (avail*1.2)) + 10000;
-                cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-                if (cells == NULL)
-                  EXIT(1);
-                work->celmax = cmax;
-                work->cells  = (void *) cells;
-              }
+          { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
             printf(" A %d: %d,%d,0,%d\n",avail,ha,k,na); fflush(stdout);
 #endif
-            pb = cells+avail;
+            pb = CELL(cells,avail);
             pb->ptr  = ha;
             pb->diag = k;
             pb->diff = 0;
@@ -2261,20 +2409,12 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
           c = (y << 1) + k;
 
           while (y+k >= NA[k])
-            { if (cells[ha].mark < NA[k])
-                { if (avail >= cmax)
-                    { cmax  = ((int) (avail*1.2)) + 10000;
-                      cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),
-                                                       "Reallocating trace cells");
-                      if (cells == NULL)
-                        EXIT(1);
-                      work->celmax = cmax;
-                      work->cells  = (void *) cells;
-                    }
+            { if (CELL(cells,ha)->mark < NA[k])
+                { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
                   printf(" A %d: %d,%d,%d,%d\n",avail,ha,k,dif,NA[k]); fflush(stdout);
 #endif
-                  pb = cells+avail;
+                  pb = CELL(cells,avail);
                   pb->ptr  = ha;
                   pb->diag = k;
                   pb->diff = dif;
@@ -2347,6 +2487,14 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
             break;
           }
 
+      if (BUDGET > 0)
+        { work->spent += (hgh-low)+1;
+          if (work->spent > BUDGET)
+            { align->flags |= TRUNC_FLAG;
+              break;
+            }
+        }
+
 #ifdef WAVE_STATS
       k = (hgh-low)+1;
       if (k > MAX)
@@ -2360,6 +2508,13 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 #endif
     }
 
+  //  If the cell cap or the budget is reached, the wave stops and the best trim point
+  //    so far is reported
+
+capped:
+  if (avail > work->celhwm)
+    work->celhwm = avail;
+
   { uint16 *atrace = (uint16 *) apath->trace;
     int     atlen;
     int     trimx;
@@ -2379,22 +2534,22 @@ static int forward_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 
     a = -1;
     for (h = trimha; h >= 0; h = b)
-      { b = cells[h].ptr; 
-        cells[h].ptr = a;
+      { b = CELL(cells,h)->ptr; 
+        CELL(cells,h)->ptr = a;
         a = h;
       }
     h = a;
 
-    k = cells[h].diag;
+    k = CELL(cells,h)->diag;
     b = (mida-k)/2;
     e = 0;
 #ifdef SHOW_TRAIL
     printf("  A path = (%5d,%5d)\n",(mida+k)/2,b); fflush(stdout);
 #endif
-    for (h = cells[h].ptr; h >= 0; h = cells[h].ptr)
-      { k = cells[h].diag;
-        a = cells[h].mark - k;
-        d = cells[h].diff;
+    for (h = CELL(cells,h)->ptr; h >= 0; h = CELL(cells,h)->ptr)
+      { k = CELL(cells,h)->diag;
+        a = CELL(cells,h)->mark - k;
+        d = CELL(cells,h)->diff;
         atrace[atlen++] = (uint16) (d-e);
         atrace[atlen++] = (uint16) (a-b);
 #ifdef SHOW_TRAIL
@@ -2442,11 +2597,12 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 
   int    *HA, *NA;
   int    *_HA, *_NA;
-  Pebble *cells;
+  Pebble **cells;
   int     avail, cmax;
 
   int     TRACE_SPACE = spec->trace_space;
   int     PATH_AVE    = spec->ave_path;
+  int64   BUDGET      = spec->budget;
   int16  *SCORE       = spec->score;
   int16  *TABLE       = spec->table;
 
@@ -2482,8 +2638,8 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
     NA = _NA-vmin;
     T  = _T-vmin;
 
-    cells = (Pebble *) (work->cells);
-    cmax  = work->celmax;
+    cells = work->cells;
+    cmax  = work->cellim;
     avail = 0;
   }
 
@@ -2508,20 +2664,13 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 
         y = (mida-k) >> 1;
 
-        if (avail >= cmax-1)
-          { cmax  = ((int) (avail*1.2)) + 10000;
-            cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-            if (cells == NULL)
-              EXIT(1);
-            work->celmax = cmax;
-            work->cells  = (void *) cells;
-          }
+        NEW_CELL(avail+1,capped)
 
         na = ((y+k+TRACE_SPACE-1)/TRACE_SPACE-1)*TRACE_SPACE;
 #ifdef SHOW_TPS
         printf(" A %d: -1,%d,0,%d\n",avail,k,na+TRACE_SPACE); fflush(stdout);
 #endif
-        pb = cells+avail;
+        pb = CELL(cells,avail);
         pb->ptr  = -1;
         pb->diag = k;
         pb->diff = 0;
@@ -2549,18 +2698,11 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
         c = (y << 1) + k;
 
         while (y+k <= na)
-          { if (avail >= cmax)
-              { cmax  = ((int) (avail*1.2)) + 10000;
-                cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),"Reallocating trace cells");
-                if (cells == NULL)
-                  EXIT(1);
-                work->celmax = cmax;
-                work->cells  = (void *) cells;
-              }
+          { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
             printf(" A %d: %d,%d,0,%d\n",avail,ha,k,na); fflush(stdout);
 #endif
-            pb = cells+avail;
+            pb = CELL(cells,avail);
             pb->ptr  = ha;
             pb->diag = k;
             pb->diff = 0;
@@ -2769,20 +2911,12 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
           c = (y << 1) + k;
 
           while (y+k <= NA[k])
-            { if (cells[ha].mark > NA[k])
-                { if (avail >= cmax)
-                    { cmax  = ((int) (avail*1.2)) + 10000;
-                      cells = (Pebble *) Realloc(cells,cmax*sizeof(Pebble),
-                                                       "Reallocating trace cells");
-                      if (cells == NULL)
-                        EXIT(1);
-                      work->celmax = cmax;
-                      work->cells  = (void *) cells;
-                    }
+            { if (CELL(cells,ha)->mark > NA[k])
+                { NEW_CELL(avail,capped)
 #ifdef SHOW_TPS
                   printf(" A %d: %d,%d,%d,%d\n",avail,ha,k,dif,NA[k]); fflush(stdout);
 #endif
-                  pb = cells+avail;
+                  pb = CELL(cells,avail);
                   pb->ptr  = ha;
                   pb->diag = k;
                   pb->diff = dif;
@@ -2855,6 +2989,14 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
             break;
           }
 
+      if (BUDGET > 0)
+        { work->spent += (hgh-low)+1;
+          if (work->spent > BUDGET)
+            { align->flags |= TRUNC_FLAG;
+              break;
+            }
+        }
+
 #ifdef WAVE_STATS
       k = (hgh-low)+1;
       if (k > MAX)
@@ -2868,6 +3010,13 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 #endif
     }
 
+  //  If the cell cap or the budget is reached, the wave stops and the best trim point
+  //    so far is reported
+
+capped:
+  if (avail > work->celhwm)
+    work->celhwm = avail;
+
   { uint16 *atrace = (uint16 *) apath->trace;
     int     atlen;
     int     trimx;
@@ -2887,28 +3036,28 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
 
     a = -1;
     for (h = trimha; h >= 0; h = b)
-      { b = cells[h].ptr; 
-        cells[h].ptr = a;
+      { b = CELL(cells,h)->ptr; 
+        CELL(cells,h)->ptr = a;
         a = h;
       }
     h = a;
 
-    k = cells[h].diag;
-    b = cells[h].mark - k;
+    k = CELL(cells,h)->diag;
+    b = CELL(cells,h)->mark - k;
     e = 0;
 #ifdef SHOW_TRAIL
     printf("  A path = (%5d,%5d)\n",b+k,b); fflush(stdout);
 #endif
     if ((b+k)%TRACE_SPACE != 0)
-      { h = cells[h].ptr;
+      { h = CELL(cells,h)->ptr;
         if (h < 0)
           { a = trimy;
             d = trimd;
           }
         else
-          { k = cells[h].diag;
-            a = cells[h].mark - k;
-            d = cells[h].diff;
+          { k = CELL(cells,h)->diag;
+            a = CELL(cells,h)->mark - k;
+            d = CELL(cells,h)->diff;
           }
 #ifdef SHOW_TRAIL
         printf("    +%4d: (%5d,%5d): %3d / %3d\n",h,a+k,a,d-e,b-a); fflush(stdout);
@@ -2919,11 +3068,11 @@ static int reverse_extend(_Work_Data *work, _Align_Spec *spec, Alignment *align,
         e = d;
       }
     if (h >= 0)
-      { for (h = cells[h].ptr; h >= 0; h = cells[h].ptr)
-          { k = cells[h].diag;
-            a = cells[h].mark - k;
+      { for (h = CELL(cells,h)->ptr; h >= 0; h = CELL(cells,h)->ptr)
+          { k = CELL(cells,h)->diag;
+            a = CELL(cells,h)->mark - k;
             atrace[--atlen] = (uint16) (b-a);
-            d = cells[h].diff;
+            d = CELL(cells,h)->diff;
             atrace[--atlen] = (uint16) (d-e);
 #ifdef SHOW_TRAIL
             printf("     %4d: (%5d,%5d): %3d / %3d\n",h,a+k,a,d-e,b-a); fflush(stdout);
@@ -2978,7 +3127,7 @@ int Find_Extension(Alignment *align, Work_Data *ework, Align_Spec *espec,
 
     wsize = VectorEn*10000;
     if (wsize >= work->vecmax)
-      if (enlarge_vector(work,wsize))
+      if (renew_vector(work,wsize))
         EXIT(1);
 
     if (alen < blen)
@@ -3007,6 +3156,9 @@ int Find_Extension(Alignment *align, Work_Data *ework, Align_Spec *espec,
   else
     maxp = diag+hbord;
 
+  align->flags &= ~TRUNC_FLAG;
+  work->spent   = 0;
+
   if (prefix)
     { if (reverse_extend(work,spec,align,diag,anti,minp,maxp))
         EXIT(1);
@@ -3286,28 +3438,207 @@ void Complement_Seq(char *aseq, int len)
 }
 
 
+/* The display routines below render into a buffer, the text vector of the work data for the
+   Print routines, and hand it to the file with a single fwrite.  Numbers are formatted by
+   hand, exactly as printf would with the formats the routines have always used.         */
+
+static int enlarge_text(_Work_Data *work, int newmax)
+{ void *txt;
+  int   max;
+
+  max = ((int) (newmax*1.2)) + 10000;
+  txt = Realloc(work->text,max,"Enlarging display buffer");
+  if (txt == NULL)
+    EXIT(1);
+  work->txtmax = max;
+  work->text   = txt;
+  return (0);
+}
+
+static inline char *put_rep(char *t, int symbol, int rep)
+{ if (rep > 0)
+    { memset(t,symbol,rep);
+      t += rep;
+    }
+  return (t);
+}
+
+  //  As sprintf(t,"%*d",w,x), returning the end of the output
+
+static char *put_int(char *t, int64 x, int w)
+{ char   d[24];
+  uint64 y;
+  int    n;
+
+  if (x < 0)
+    y = - (uint64) x;
+  else
+    y = (uint64) x;
+  n = 0;
+  do
+    { d[n++] = (char) ('0' + y%10);
+      y /= 10;
+    }
+  while (y > 0);
+  if (x < 0)
+    d[n++] = '-';
+  if (w < 0)
+    { w = -w-n;
+      while (n > 0)
+        *t++ = d[--n];
+      return (put_rep(t,' ',w));
+    }
+  t = put_rep(t,' ',w-n);
+  while (n > 0)
+    *t++ = d[--n];
+  return (t);
+}
+
+  //  As sprintf(t,"%*.*f",w,p,((double) num)/den) for p <= 2.  The rounding of the exact
+  //    quotient agrees with that of the double save when the former is a tie, in which case
+  //    (and for the degenerate quotients) printf settles it.
+
+static char *put_fixed(char *t, int64 num, int64 den, int p, int w)
+{ static int64 Ten[3] = { 1, 10, 100 };
+  char   d[32];
+  int64  s, r;
+  int    n, k;
+
+  s = 2*num*Ten[p];
+  if (den <= 0 || num < 0 || s % (2*den) == den)
+    return (t + sprintf(t,"%*.*f",w,p,((double) num)/den));
+
+  r = (s + den) / (2*den);
+  n = 0;
+  for (k = 0; k < p; k++)
+    { d[n++] = (char) ('0' + r%10);
+      r /= 10;
+    }
+  if (p > 0)
+    d[n++] = '.';
+  do
+    { d[n++] = (char) ('0' + r%10);
+      r /= 10;
+    }
+  while (r > 0);
+  t = put_rep(t,' ',w-n);
+  while (n > 0)
+    *t++ = d[--n];
+  return (t);
+}
+
+  //  The layout of the rows of Print_Alignment and Print_Reference
+
+typedef struct
+  { int indent, coord;
+    int aend, bend;
+    int comp, blen;
+  } Row_Form;
+
+  //  Render a row of o columns in Abuf, Dbuf, and Bbuf that starts at A- and B-positions sa and
+  //    sb, at text position t, returning the end of the row (or NULL if out of memory).  The
+  //    row ends with its %-difference, omitted if it is the final row and has no aligned columns.
+
+static char *print_row(_Work_Data *work, char *t, Row_Form *f, int sa, int sb,
+                       char *Abuf, char *Dbuf, char *Bbuf, int o, int diff, int match, int final)
+{ int c = f->coord;
+  int need;
+
+  need = 3*((f->indent > 0 ? f->indent : 0) + (c > 11 ? c : 11) + o + 4) + 64;
+  if (t + need > work->text + work->txtmax)
+    { int off = t - work->text;
+
+      if (enlarge_text(work,off+need))
+        EXIT(NULL);
+      t = work->text + off;
+    }
+
+  *t++ = '\n';
+  t = put_rep(t,' ',f->indent);
+  *t++ = ' ';
+  if (c > 0)
+    { if (sa < f->aend)
+        t = put_int(t,sa,c);
+      else
+        t = put_rep(t,' ',c);
+      *t++ = ' ';
+    }
+  memcpy(t,Abuf,o);
+  t += o;
+  *t++ = '\n';
+
+  t = put_rep(t,' ',f->indent);
+  *t++ = ' ';
+  if (c > 0)
+    { t = put_rep(t,' ',c);
+      *t++ = ' ';
+    }
+  memcpy(t,Dbuf,o);
+  t += o;
+  *t++ = '\n';
+
+  t = put_rep(t,' ',f->indent);
+  *t++ = ' ';
+  if (c > 0)
+    { if (sb < f->bend)
+        if (f->comp)
+          t = put_int(t,f->blen-sb,c);
+        else
+          t = put_int(t,sb,c);
+      else
+        t = put_rep(t,' ',c);
+      *t++ = ' ';
+    }
+  memcpy(t,Bbuf,o);
+  t += o;
+
+  if (final && diff+match <= 0)
+    *t++ = '\n';
+  else
+    { *t++ = ' ';
+      t = put_fixed(t,100ll*diff,diff+match,1,5);
+      *t++ = '%';
+      *t++ = '\n';
+    }
+  return (t);
+}
+
 /* Print an alignment to file between a and b given in trace (unpacked).
    Prefix gives the length of the initial prefix of a that is unaligned.  */
 
 static char ToL[8] = { 'a', 'c', 'g', 't', '.', '[', ']', '-' };
 static char ToU[8] = { 'A', 'C', 'G', 'T', '.', '[', ']', '-' };
 
+  //  The symbol between two columns is tag[Dclass[x][y]]: blank if either is a terminator (4),
+  //    the match tag if they are equal, and the difference tag otherwise
+
+static char Dclass[8][8] =
+  { { 1, 2, 2, 2, 0, 2, 2, 2 },
+    { 2, 1, 2, 2, 0, 2, 2, 2 },
+    { 2, 2, 1, 2, 0, 2, 2, 2 },
+    { 2, 2, 2, 1, 0, 2, 2, 2 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 2, 2, 2, 2, 0, 1, 2, 2 },
+    { 2, 2, 2, 2, 0, 2, 1, 2 },
+    { 2, 2, 2, 2, 0, 2, 2, 1 },
+  };
+
 int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
                     int indent, int width, int border, int upper, int coord)
 { _Work_Data *work  = (_Work_Data *) ework;
   int        *trace = align->path->trace;
   int         tlen  = align->path->tlen;
 
-  char *Abuf, *Bbuf, *Dbuf;
-  int   i, j, o;
-  char *a, *b;
-  char  mtag, dtag;
-  int   prefa, prefb;
-  int   aend, bend;
-  int   comp, blen;
-  int   sa, sb;
-  int   match, diff;
-  char *N2A;
+  char    *Abuf, *Bbuf, *Dbuf;
+  int      i, j, o;
+  char    *a, *b;
+  char     tag[3];
+  int      prefa, prefb;
+  int      sa, sb;
+  int      match, diff;
+  char    *N2A;
+  char    *t;
+  Row_Form form;
 
   if (trace == NULL) return (0);
 
@@ -3319,7 +3650,10 @@ int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
 
   o = sizeof(char)*3*(width+1);
   if (o > work->vecmax)
-    if (enlarge_vector(work,o))
+    if (renew_vector(work,o))
+      EXIT(1);
+  if (work->text == NULL)
+    if (enlarge_text(work,0))
       EXIT(1);
 
   if (upper)
@@ -3331,42 +3665,21 @@ int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
   Bbuf = Abuf + (width+1);
   Dbuf = Bbuf + (width+1);
 
-  aend = align->path->aepos;
-  bend = align->path->bepos;
-
-  comp = COMP(align->flags);
-  blen = align->blen;
+  form.indent = indent;
+  form.coord  = coord;
+  form.aend   = align->path->aepos;
+  form.bend   = align->path->bepos;
+  form.comp   = COMP(align->flags);
+  form.blen   = align->blen;
 
-  Abuf[width] = Bbuf[width] = Dbuf[width] = '\0';
+  t = work->text;
                                            /* buffer/output next column */
 #define COLUMN(x,y)							\
 { int u, v;								\
   if (o >= width)							\
-    { fprintf(file,"\n");						\
-      fprintf(file,"%*s",indent,"");					\
-      if (coord > 0)							\
-        { if (sa < aend)						\
-            fprintf(file," %*d",coord,sa);				\
-          else								\
-            fprintf(file," %*s",coord,"");				\
-          fprintf(file," %s\n",Abuf);					\
-          fprintf(file,"%*s %*s %s\n",indent,"",coord,"",Dbuf);		\
-          fprintf(file,"%*s",indent,"");				\
-          if (sb < bend)						\
-            if (comp)							\
-              fprintf(file," %*d",coord,blen-sb);			\
-            else							\
-              fprintf(file," %*d",coord,sb);				\
-          else								\
-            fprintf(file," %*s",coord,"");				\
-          fprintf(file," %s",Bbuf);					\
-        }								\
-      else								\
-        { fprintf(file," %s\n",Abuf);					\
-          fprintf(file,"%*s %s\n",indent,"",Dbuf);			\
-          fprintf(file,"%*s %s",indent,"",Bbuf);			\
-        }								\
-      fprintf(file," %5.1f%%\n",(100.*diff)/(diff+match));		\
+    { t = print_row(work,t,&form,sa,sb,Abuf,Dbuf,Bbuf,o,diff,match,0);	\
+      if (t == NULL)							\
+        EXIT(1);							\
       o  = 0;								\
       sa = i-1;								\
       sb = j-1;								\
@@ -3374,12 +3687,7 @@ int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
     }									\
   u = (x);								\
   v = (y);								\
-  if (u == 4 || v == 4)							\
-    Dbuf[o] = ' ';							\
-  else if (u == v)							\
-    Dbuf[o] = mtag;							\
-  else									\
-    Dbuf[o] = dtag;							\
+  Dbuf[o] = tag[(int) Dclass[u][v]];					\
   Abuf[o] = N2A[u];							\
   Bbuf[o] = N2A[v];							\
   o += 1;								\
@@ -3403,10 +3711,12 @@ int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
       prefb = border;
     }
 
-  sa   = i-1;
-  sb   = j-1;
-  mtag = ':';
-  dtag = ':';
+  sa     = i-1;
+  sb     = j-1;
+  tag[0] = ' ';
+  tag[1] = ':';
+  tag[2] = ':';
+  match  = diff = 0;
 
   while (prefa > prefb)
     { COLUMN(a[i],4)
@@ -3425,12 +3735,12 @@ int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
       prefa -= 1;
     }
 
-  mtag = '[';
+  tag[1] = '[';
   if (prefb > 0)
     COLUMN(5,5)
 
-  mtag  = '|';
-  dtag  = '*';
+  tag[1] = '|';
+  tag[2] = '*';
 
   match = diff = 0;
 
@@ -3480,12 +3790,12 @@ int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
 
   { int c;     /* Output remaining column including unaligned suffix */
 
-    mtag = ']';
+    tag[1] = ']';
     if (a[i] != 4 && b[j] != 4 && border > 0)
       COLUMN(6,6)
 
-    mtag = ':';
-    dtag = ':';
+    tag[1] = ':';
+    tag[2] = ':';
 
     c = 0;
     while (c < border && (a[i] != 4 || b[j] != 4))
@@ -3509,35 +3819,11 @@ int Print_Alignment(FILE *file, Alignment *align, Work_Data *ework,
 
   /* Print remainder of buffered col.s */
 
-  fprintf(file,"\n");
-  fprintf(file,"%*s",indent,"");
-  if (coord > 0)
-    { if (sa < aend)
-        fprintf(file," %*d",coord,sa);
-      else
-        fprintf(file," %*s",coord,"");
-      fprintf(file," %.*s\n",o,Abuf);
-      fprintf(file,"%*s %*s %.*s\n",indent,"",coord,"",o,Dbuf);
-      fprintf(file,"%*s",indent,"");
-      if (sb < bend)
-        if (comp)
-          fprintf(file," %*d",coord,blen-sb);
-        else
-          fprintf(file," %*d",coord,sb);
-      else
-        fprintf(file," %*s",coord,"");
-      fprintf(file," %.*s",o,Bbuf);
-    }
-  else
-    { fprintf(file," %.*s\n",o,Abuf);
-      fprintf(file,"%*s %.*s\n",indent,"",o,Dbuf);
-      fprintf(file,"%*s %.*s",indent,"",o,Bbuf);
-    }
-  if (diff+match > 0)
-    fprintf(file," %5.1f%%\n",(100.*diff)/(diff+match));
-  else
-    fprintf(file,"\n");
+  t = print_row(work,t,&form,sa,sb,Abuf,Dbuf,Bbuf,o,diff,match,1);
+  if (t == NULL)
+    EXIT(1);
 
+  fwrite(work->text,1,t-work->text,file);
   fflush(file);
   return (0);
 }
@@ -3548,17 +3834,17 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
   int        *trace = align->path->trace;
   int         tlen  = align->path->tlen;
 
-  char *Abuf, *Bbuf, *Dbuf;
-  int   i, j, o;
-  char *a, *b;
-  char  mtag, dtag;
-  int   prefa, prefb;
-  int   aend, bend;
-  int   comp, blen;
-  int   sa, sb, s0;
-  int   match, diff;
-  char *N2A;
-  int   vmax;
+  char    *Abuf, *Bbuf, *Dbuf;
+  int      i, j, o;
+  char    *a, *b;
+  char     tag[3];
+  int      prefa, prefb;
+  int      sa, sb, s0;
+  int      match, diff;
+  char    *N2A;
+  int      vmax;
+  char    *t;
+  Row_Form form;
 
   if (trace == NULL) return (0);
 
@@ -3571,10 +3857,13 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
   vmax = work->vecmax/3;
   o = sizeof(char)*6*(block+1);
   if (o > vmax)
-    { if (enlarge_vector(work,3*o))
+    { if (renew_vector(work,3*o))
         EXIT(1);
       vmax = work->vecmax/3;
     }
+  if (work->text == NULL)
+    if (enlarge_text(work,0))
+      EXIT(1);
 
   Abuf = (char *) work->vector;
   Bbuf = Abuf + vmax;
@@ -3585,40 +3874,24 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
   else
     N2A = ToL;
 
-  aend = align->path->aepos;
-  bend = align->path->bepos;
+  form.indent = indent;
+  form.coord  = coord;
+  form.aend   = align->path->aepos;
+  form.bend   = align->path->bepos;
+  form.comp   = COMP(align->flags);
+  form.blen   = align->blen;
 
-  comp = COMP(align->flags);
-  blen = align->blen;
+  t = work->text;
+
+  //  On growing the vector, its rows are moved to their new places from their old offsets
+  //    in the (possibly moved) vector
 
 #define BLOCK(x,y)							\
 { int u, v;								\
   if (i%block == 1 && i != s0 && x < 4 && o > 0)			\
-    { fprintf(file,"\n");						\
-      fprintf(file,"%*s",indent,"");					\
-      if (coord > 0)							\
-        { if (sa < aend)						\
-            fprintf(file," %*d",coord,sa);				\
-          else								\
-            fprintf(file," %*s",coord,"");				\
-          fprintf(file," %.*s\n",o,Abuf);				\
-          fprintf(file,"%*s %*s %.*s\n",indent,"",coord,"",o,Dbuf);	\
-          fprintf(file,"%*s",indent,"");				\
-          if (sb < bend)						\
-            if (comp)							\
-              fprintf(file," %*d",coord,blen-sb);			\
-            else							\
-              fprintf(file," %*d",coord,sb);				\
-          else								\
-            fprintf(file," %*s",coord,"");				\
-          fprintf(file," %.*s",o,Bbuf);					\
-        }								\
-      else								\
-        { fprintf(file," %.*s\n",o,Abuf);				\
-          fprintf(file,"%*s %.*s\n",indent,"",o,Dbuf);			\
-          fprintf(file,"%*s %.*s",indent,"",o,Bbuf);			\
-        }								\
-      fprintf(file," %5.1f%%\n",(100.*diff)/(diff+match));		\
+    { t = print_row(work,t,&form,sa,sb,Abuf,Dbuf,Bbuf,o,diff,match,0);	\
+      if (t == NULL)							\
+        EXIT(1);							\
       o  = 0;								\
       sa = i-1;								\
       sb = j-1;								\
@@ -3626,25 +3899,20 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
     }									\
   u = (x);								\
   v = (y);								\
-  if (u == 4 || v == 4)							\
-    Dbuf[o] = ' ';							\
-  else if (u == v)							\
-    Dbuf[o] = mtag;							\
-  else									\
-    Dbuf[o] = dtag;							\
+  Dbuf[o] = tag[(int) Dclass[u][v]];					\
   Abuf[o] = N2A[u];							\
   Bbuf[o] = N2A[v];							\
   o += 1;								\
   if (o >= vmax)							\
-    { if (enlarge_vector(work,3*o))					\
+    { int omax = vmax;							\
+      if (enlarge_vector(work,3*o))					\
         EXIT(1);							\
       vmax = work->vecmax/3;						\
-      memmove(work->vector+2*vmax,Dbuf,o);				\
-      memmove(work->vector+vmax,Bbuf,o);				\
-      memmove(work->vector,Abuf,o);					\
       Abuf = (char *) work->vector;					\
       Bbuf = Abuf + vmax;						\
       Dbuf = Bbuf + vmax;						\
+      memmove(Dbuf,Abuf+2*omax,o);					\
+      memmove(Bbuf,Abuf+omax,o);					\
     }									\
 }
 
@@ -3666,11 +3934,13 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
       prefb = border;
     }
 
-  s0   = i;
-  sa   = i-1;
-  sb   = j-1;
-  mtag = ':';
-  dtag = ':';
+  s0     = i;
+  sa     = i-1;
+  sb     = j-1;
+  tag[0] = ' ';
+  tag[1] = ':';
+  tag[2] = ':';
+  match  = diff = 0;
 
   while (prefa > prefb)
     { BLOCK(a[i],4)
@@ -3689,12 +3959,12 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
       prefa -= 1;
     }
 
-  mtag = '[';
+  tag[1] = '[';
   if (prefb > 0)
     BLOCK(5,5)
 
-  mtag  = '|';
-  dtag  = '*';
+  tag[1] = '|';
+  tag[2] = '*';
 
   match = diff = 0;
 
@@ -3744,12 +4014,12 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
 
   { int c;     /* Output remaining column including unaligned suffix */
 
-    mtag = ']';
+    tag[1] = ']';
     if (a[i] != 4 && b[j] != 4 && border > 0)
       BLOCK(6,6)
 
-    mtag = ':';
-    dtag = ':';
+    tag[1] = ':';
+    tag[2] = ':';
 
     c = 0;
     while (c < border && (a[i] != 4 || b[j] != 4))
@@ -3773,35 +4043,11 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
 
   /* Print remainder of buffered col.s */
 
-  fprintf(file,"\n");
-  fprintf(file,"%*s",indent,"");
-  if (coord > 0)
-    { if (sa < aend)
-        fprintf(file," %*d",coord,sa);
-      else
-        fprintf(file," %*s",coord,"");
-      fprintf(file," %.*s\n",o,Abuf);
-      fprintf(file,"%*s %*s %.*s\n",indent,"",coord,"",o,Dbuf);
-      fprintf(file,"%*s",indent,"");
-      if (sb < bend)
-        if (comp)
-          fprintf(file," %*d",coord,blen-sb);
-        else
-          fprintf(file," %*d",coord,sb);
-      else
-        fprintf(file," %*s",coord,"");
-      fprintf(file," %.*s",o,Bbuf);
-    }
-  else
-    { fprintf(file," %.*s\n",o,Abuf);
-      fprintf(file,"%*s %.*s\n",indent,"",o,Dbuf);
-      fprintf(file,"%*s %.*s",indent,"",o,Bbuf);
-    }
-  if (diff+match > 0)
-    fprintf(file," %5.1f%%\n",(100.*diff)/(diff+match));
-  else
-    fprintf(file,"\n");
+  t = print_row(work,t,&form,sa,sb,Abuf,Dbuf,Bbuf,o,diff,match,1);
+  if (t == NULL)
+    EXIT(1);
 
+  fwrite(work->text,1,t-work->text,file);
   fflush(file);
   return (0);
 }
@@ -3809,11 +4055,6 @@ int Print_Reference(FILE *file, Alignment *align, Work_Data *ework,
 /* Print an ASCII representation of the overlap in align between fragments
    a and b to given file.                                                  */
 
-static inline void repchar(FILE *file, int symbol, int rep)
-{ while (rep-- > 0)
-    fputc(symbol,file);
-}
-
 void Alignment_Cartoon(FILE *file, Alignment *align, int indent, int coord)
 { int   alen = align->alen;
   int   blen = align->blen;
@@ -3821,47 +4062,75 @@ void Alignment_Cartoon(FILE *file, Alignment *align, int indent, int coord)
   int   comp = COMP(align->flags);
   int   w;
 
-  fprintf(file,"%*s",indent,"");
+  char  _text[2048], *text, *t;
+  int   need;
+
+  need = 4*((indent > 0 ? indent : 0) + 4*(coord > 11 ? coord : 11) + 100);
+  if (need > (int) sizeof(_text))
+    { text = (char *) Malloc(need,"Allocating display buffer");
+      if (text == NULL)
+        return;
+    }
+  else
+    text = _text;
+  t = text;
+
+  t = put_rep(t,' ',indent);
   if (path->abpos > 0)
-    fprintf(file,"    %*d ",coord,path->abpos);
+    { t = put_rep(t,' ',4);
+      t = put_int(t,path->abpos,coord);
+      *t++ = ' ';
+    }
   else
-    fprintf(file,"%*s",coord+5,"");
+    t = put_rep(t,' ',coord+5);
   if (path->aepos < alen)
-    fprintf(file,"%*s%d",coord+8,"",alen-path->aepos);
-  fprintf(file,"\n");
+    { t = put_rep(t,' ',coord+8);
+      t = put_int(t,alen-path->aepos,0);
+    }
+  *t++ = '\n';
 
-  fprintf(file,"%*s",indent,"");
+  t = put_rep(t,' ',indent);
+  *t++ = 'A';
+  *t++ = ' ';
   if (path->abpos > 0)
-    { fprintf(file,"A ");
-      w = Number_Digits((int64) path->abpos);
-      repchar(file,' ',coord-w);
-      repchar(file,'=',w+3);
-      fputc('+',file);
-      repchar(file,'-',coord+5);
+    { w = Number_Digits((int64) path->abpos);
+      t = put_rep(t,' ',coord-w);
+      t = put_rep(t,'=',w+3);
+      *t++ = '+';
+      t = put_rep(t,'-',coord+5);
     }
   else
-    { fprintf(file,"A %*s",coord+4,"");
-      repchar(file,'-',coord+5);
+    { t = put_rep(t,' ',coord+4);
+      t = put_rep(t,'-',coord+5);
     }
 
   if (path->aepos < alen)
-    { fputc('+',file);
+    { *t++ = '+';
       w = Number_Digits((int64) (alen-path->aepos));
-      repchar(file,'=',w+2);
-      fputc('>',file);
-      repchar(file,' ',w);
+      t = put_rep(t,'=',w+2);
+      *t++ = '>';
+      t = put_rep(t,' ',w);
     }
   else
-    { fputc('>',file);
-      repchar(file,' ',coord+3);
+    { *t++ = '>';
+      t = put_rep(t,' ',coord+3);
     }
 
   { int asub, bsub;
 
     asub = path->aepos - path->abpos;
     bsub = path->bepos - path->bbpos;
-    fprintf(file,"   dif/(len1+len2) = %d/(%d+%d) = %5.2f%%\n",
-                 path->diffs,asub,bsub,(200.*path->diffs)/(asub+bsub));
+    memcpy(t,"   dif/(len1+len2) = ",21);
+    t = put_int(t+21,path->diffs,0);
+    *t++ = '/';
+    *t++ = '(';
+    t = put_int(t,asub,0);
+    *t++ = '+';
+    t = put_int(t,bsub,0);
+    memcpy(t,") = ",4);
+    t = put_fixed(t+4,200ll*path->diffs,asub+bsub,2,5);
+    *t++ = '%';
+    *t++ = '\n';
   }
 
   { int   sym1e, sym2e;
@@ -3872,45 +4141,258 @@ void Alignment_Cartoon(FILE *file, Alignment *align, int indent, int coord)
     else
       { sym1p = '-'; sym2p = '>'; sym1e = '='; sym2e = '>'; }
 
-    fprintf(file,"%*s",indent,"");
+    t = put_rep(t,' ',indent);
+    *t++ = 'B';
+    *t++ = ' ';
     if (path->bbpos > 0)
-      { fprintf(file,"B ");
-        w = Number_Digits((int64) path->bbpos);
-        repchar(file,' ',coord-w);
-        fputc(sym1e,file);
-        repchar(file,'=',w+2);
-        fputc('+',file);
-        repchar(file,'-',coord+5);
+      { w = Number_Digits((int64) path->bbpos);
+        t = put_rep(t,' ',coord-w);
+        *t++ = (char) sym1e;
+        t = put_rep(t,'=',w+2);
+        *t++ = '+';
+        t = put_rep(t,'-',coord+5);
       }
     else
-      { fprintf(file,"B ");
-        repchar(file,' ',coord+3);
-        fputc(sym1p,file);
-        repchar(file,'-',coord+5);
+      { t = put_rep(t,' ',coord+3);
+        *t++ = (char) sym1p;
+        t = put_rep(t,'-',coord+5);
       }
     if (path->bepos < blen)
-      { fprintf(file,"+");
+      { *t++ = '+';
         w = Number_Digits((int64) (blen-path->bepos));
-        repchar(file,'=',w+2);
-        fprintf(file,"%c\n",sym2e);
+        t = put_rep(t,'=',w+2);
+        *t++ = (char) sym2e;
       }
     else
-      fprintf(file,"%c\n",sym2p);
+      *t++ = (char) sym2p;
+    *t++ = '\n';
   }
 
-  fprintf(file,"%*s",indent,"");
+  t = put_rep(t,' ',indent);
   if (path->bbpos > 0)
-    fprintf(file,"    %*d ",coord,path->bbpos);
+    { t = put_rep(t,' ',4);
+      t = put_int(t,path->bbpos,coord);
+      *t++ = ' ';
+    }
   else
-    fprintf(file,"%*s",coord+5,"");
+    t = put_rep(t,' ',coord+5);
   if (path->bepos < blen)
-    fprintf(file,"%*s%d",coord+8,"",blen-path->bepos);
-  fprintf(file,"\n");
+    { t = put_rep(t,' ',coord+8);
+      t = put_int(t,blen-path->bepos,0);
+    }
+  *t++ = '\n';
 
+  fwrite(text,1,t-text,file);
+  if (text != _text)
+    free(text);
   fflush(file);
 }
 
 
+/****************************************************************************************\
+*                                                                                        *
+*  Edit distance wavefront (WFA) algorithm                                               *
+*                                                                                        *
+\****************************************************************************************/
+
+/* A plain unit-cost wavefront: wave d holds the furthest reaching point, in B, of every
+     diagonal k = i-j in [-d,d] that can be reached with d differences.  The waves are laid
+     out one after the other in the work vector, wave d starting at offset d*d, and since each
+     is a simple function of its predecessor, the backtrace needs nothing more than these
+     offsets to recover the path.  Space is thus O(D^2) and time is O((M+N)D), but the inner
+     loop is a word-at-a-time match extension, making it best suited to the short, lightly
+     divergent segments between trace points.
+*/
+
+#define WFA_NONE  -0x40000000                   //  Offset of an unreachable diagonal
+#define WFA_VMAX   0x60000000                   //  Largest vector (in bytes) it will build
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define WFA_WORDS                               //  Compare 8 bases at a time while extending
+#endif
+
+static char *WFA_Align =
+         "Bad alignment between trace points (Compute_Trace_WFA), source DB likely incorrect";
+static char *WFA_Error = "Alignment is too divergent for a wavefront trace (Compute_Trace_WFA)";
+
+  //  Extend the match run along a diagonal where a[x] is opposite b[x] from j up to lim
+
+static WAVE_INLINE int wfa_extend(char *a, char *b, int j, int lim)
+{
+#ifdef WFA_WORDS
+  uint64 x, y;
+
+  while (j+8 <= lim)
+    { memcpy(&x,a+j,8);
+      memcpy(&y,b+j,8);
+      if (x != y)
+        return (j + (__builtin_ctzll(x^y) >> 3));
+      j += 8;
+    }
+#endif
+  while (j < lim && a[j] == b[j])
+    j += 1;
+  return (j);
+}
+
+  //  Best predecessor of diagonal k in wave W1 (that of d-1) with its extension point in *pj,
+  //    ties going to the move favored by mode.  Returns -1 (from k-1, a deletion of A),
+  //    0 (from k, a substitution), or 1 (from k+1, an insertion of B).
+
+static WAVE_INLINE int wfa_origin(int *W1, int d, int k, int M, int N, int mode, int *pj)
+{ int dj, sj, ij;
+  int j, e;
+
+  dj = sj = ij = WFA_NONE;
+  if (k > 1-d)
+    { dj = W1[k-1];
+      if (dj+k > M)
+        dj = WFA_NONE;
+    }
+  if (k >= 1-d && k < d)
+    { sj = W1[k]+1;
+      if (sj > N || sj+k > M)
+        sj = WFA_NONE;
+    }
+  if (k < d-1)
+    { ij = W1[k+1]+1;
+      if (ij > N)
+        ij = WFA_NONE;
+    }
+
+  if (mode == LOWERMOST)
+    { j = dj; e = -1;
+      if (sj > j) { j = sj; e = 0; }
+      if (ij > j) { j = ij; e = 1; }
+    }
+  else if (mode == UPPERMOST)
+    { j = ij; e = 1;
+      if (sj > j) { j = sj; e = 0; }
+      if (dj > j) { j = dj; e = -1; }
+    }
+  else
+    { j = sj; e = 0;
+      if (dj > j) { j = dj; e = -1; }
+      if (ij > j) { j = ij; e = 1; }
+    }
+
+  *pj = j;
+  return (e);
+}
+
+  //  Find an optimal alignment between A[0..M-1] and B[0..N-1], pushing its indels onto *Stop
+  //    in the usual encoding and returning the number of differences (or -1 on an error).
+
+static int wfa_np(char *A, int M, char *B, int N, char *Aabs, char *Babs,
+                  _Work_Data *work, int **Stop, int mode, int dmax)
+{ int  *V, *W0, *W1;
+  int64 vmax;
+  int   del, posl, posh;
+  int   d, k, j;
+
+  del  = M-N;
+  posl = -N;
+  posh = M;
+  if (Aabs == Babs)
+    { if (B == A)
+        { EPRINTF(EPLACE,"%s: self comparison starts on diagonal 0 (Compute_Trace)\n",Prog_Name);
+          EXIT(-1);
+        }
+      else if (B < A)
+        { if ((B-A)+1 > posl)
+            posl = (B-A)+1;
+        }
+      else
+        { if ((B-A)-1 < posh)
+            posh = (B-A)-1;
+        }
+    }
+
+  V    = (int *) work->vector;
+  vmax = work->vecmax / sizeof(int);
+
+  for (d = 0; 1; d++)
+    { int klo, khi;
+
+      if (d > dmax)
+        { EPRINTF(EPLACE,"%s: %s\n",Prog_Name,WFA_Align);
+          EXIT(-1);
+        }
+      if ((d+1)*(d+1) > vmax)
+        { if ((d+1)*(d+1)*((int64) sizeof(int)) > WFA_VMAX)
+            { EPRINTF(EPLACE,"%s: %s\n",Prog_Name,WFA_Error);
+              EXIT(-1);
+            }
+          if (enlarge_vector(work,(d+1)*(d+1)*sizeof(int)))
+            EXIT(-1);
+          V    = (int *) work->vector;
+          vmax = work->vecmax / sizeof(int);
+        }
+
+      W0 = V + (d*d + d);
+      W1 = V + ((d-1)*(d-1) + (d-1));
+
+      klo = -d;
+      if (klo < posl)
+        klo = posl;
+      khi = d;
+      if (khi > posh)
+        khi = posh;
+      for (k = -d; k < klo; k++)
+        W0[k] = WFA_NONE;
+      for (k = khi+1; k <= d; k++)
+        W0[k] = WFA_NONE;
+
+      if (d == 0)
+        { if (klo <= 0 && 0 <= khi)
+            W0[0] = wfa_extend(A,B,0,(M < N ? M : N));
+        }
+      else
+        for (k = klo; k <= khi; k++)
+          { wfa_origin(W1,d,k,M,N,mode,&j);
+            if (j < 0)
+              W0[k] = WFA_NONE;
+            else if (N < M-k)
+              W0[k] = wfa_extend(A+k,B,j,N);
+            else
+              W0[k] = wfa_extend(A+k,B,j,M-k);
+          }
+
+      if (-d <= del && del <= d && W0[del] >= N)
+        break;
+    }
+
+  { int *S, *T;
+    int  ap = (Aabs-A)-1;
+    int  bp = (B-Babs)+1;
+    int  D, e;
+
+    S = *Stop;
+    k = del;
+    for (D = d; d > 0; d--)
+      { W1 = V + ((d-1)*(d-1) + (d-1));
+        e  = wfa_origin(W1,d,k,M,N,mode,&j);
+        if (e < 0)
+          { *S++ = bp + j;
+            k -= 1;
+          }
+        else if (e > 0)
+          { *S++ = ap - (j+k);
+            k += 1;
+          }
+      }
+
+    for (T = *Stop, *Stop = S--; T < S; T++, S--)
+      { e  = *T;
+        *T = *S;
+        *S = e;
+      }
+
+    return (D);
+  }
+}
+
+
 /****************************************************************************************\
 *                                                                                        *
 *  O(ND) trace algorithm                                                                 *
@@ -4362,6 +4844,18 @@ int Compute_Alignment(Alignment *align, Work_Data *ework, int task, int tspace)
   trace  = ((int *) work->alnpts);
   strace = ((uint16 *) work->alnpts);
 
+  if (task == WFA_ALIGN)
+    { int *stop = trace;
+
+      D = wfa_np(aseq,asub,bseq,bsub,align->aseq,align->bseq,work,&stop,GREEDIEST,asub+bsub);
+      if (D < 0)
+        EXIT(1);
+      path->diffs = D;
+      path->tlen  = stop - trace;
+      path->trace = trace;
+      return (0);
+    }
+
   if (asub > bsub)
     D = (4*asub+6)*sizeof(int);
   else
@@ -5159,7 +5653,7 @@ int Compute_Trace_PTS(Alignment *align, Work_Data *ework, int trace_spacing, int
     s = (dmax+3)*2*((trace_spacing+nmax+3)*sizeof(int) + sizeof(int *));
 
     if (s > work->vecmax)
-      if (enlarge_vector(work,s))
+      if (renew_vector(work,s))
         EXIT(1);
 
     wave.PVF = PVF = ((int **) (work->vector)) + 2;
@@ -5269,7 +5763,7 @@ int Compute_Trace_MID(Alignment *align, Work_Data *ework, int trace_spacing, int
     s = (dmax+3)*4*((trace_spacing+nmax+3)*sizeof(int) + sizeof(int *));
 
     if (s > work->vecmax)
-      if (enlarge_vector(work,s))
+      if (renew_vector(work,s))
         EXIT(1);
 
     wave.PVF = PVF = ((int **) (work->vector)) + 2;
@@ -5405,7 +5899,7 @@ int Compute_Trace_IRR(Alignment *align, Work_Data *ework, int mode)
     s = (dmax+3)*2*((mmax+nmax+3)*sizeof(int) + sizeof(int *));
 
     if (s > work->vecmax)
-      if (enlarge_vector(work,s))
+      if (renew_vector(work,s))
         EXIT(1);
 
     wave.PVF = PVF = ((int **) (work->vector)) + 2;
@@ -5451,3 +5945,70 @@ int Compute_Trace_IRR(Alignment *align, Work_Data *ework, int mode)
 
   return (0);
 }
+
+int Compute_Trace_WFA(Alignment *align, Work_Data *ework, int trace_spacing, int mode)
+{ _Work_Data *work = (_Work_Data *) ework;
+  Path   *path;
+  char   *aseq, *bseq;
+  int     alen, blen;
+  uint16 *points;
+  int     tlen;
+  int     ab, bb;
+  int     ae, be;
+  int     diffs;
+  int    *stop;
+
+  alen   = align->alen;
+  blen   = align->blen;
+  path   = align->path;
+  aseq   = align->aseq;
+  bseq   = align->bseq;
+  tlen   = path->tlen;
+  points = (uint16 *) path->trace;
+
+  { int64 s;
+
+    s = ((path->aepos-path->abpos) + (path->bepos-path->bbpos))*sizeof(int);
+    if (s > work->tramax)
+      if (enlarge_trace(work,s))
+        EXIT(1);
+  }
+
+  stop = (int *) (work->trace);
+
+  { int i, d;
+
+    diffs = 0;
+    ab = path->abpos;
+    bb = path->bbpos;
+    if (trace_spacing > 0)
+      ae = (ab/trace_spacing)*trace_spacing;
+    else
+      ae = ab;
+    for (i = 0; i < tlen; i += 2)
+      { if (trace_spacing == 0)
+          ae = ab + points[i];
+        else if (i+2 < tlen)
+          ae = ae + trace_spacing;
+        else
+          ae = path->aepos;
+        be = bb + points[i+1];
+        if (ae > alen || be > blen)
+          { EPRINTF(EPLACE,"%s: %s\n",Prog_Name,TP_Error);
+            EXIT(1);
+          }
+        d = wfa_np(aseq+ab,ae-ab,bseq+bb,be-bb,aseq,bseq,work,&stop,mode,(ae-ab)+(be-bb));
+        if (d < 0)
+          EXIT(1);
+        diffs += d;
+        ab = ae;
+        bb = be;
+      }
+  }
+
+  path->trace = work->trace;
+  path->tlen  = stop - ((int *) path->trace);
+  path->diffs = diffs;
+
+  return (0);
+}
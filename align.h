@@ -142,6 +142,11 @@ typedef struct
 
 #define ELIM(x)  ((x) & ELIM_FLAG)
 
+#define TRUNC_FLAG 0x40  //  Search for LA was cut short by a budget or cap !  Only
+                         //    Local_Alignment and Find_Extension set it, on the Alignment
+
+#define TRUNCATED(x)  ((x) & TRUNC_FLAG)
+
 typedef struct
   { Path   *path;
     uint32  flags;        /* Pipeline status and complementation flags          */
@@ -167,6 +172,25 @@ void Complement_Seq(char *a, int n);
 
   void       Free_Work_Data(Work_Data *work);
 
+  /* The trace cells recorded by Local_Alignment and Find_Extension are kept in an arena that
+     grows in geometrically larger segments without ever copying the cells already in use.
+     Set_Work_Cap places a hard limit of 'maxcells' cells on any one call (0, the default,
+     means no limit, and a limit of 1 is taken as 2, the cells every call needs to start
+     with).  A call that reaches the cap stops extending its alignment, reports the best
+     end-point found so far, and sets TRUNC_FLAG (see below) of its Alignment.
+     Work_Data_Stats returns the high-water marks of 'work'.
+  */
+
+  typedef struct
+    { int64 cells;     /* Most trace cells used by a single call                 */
+      int64 arena;     /* Bytes currently held by the trace cell arena          */
+      int64 vector;    /* Bytes currently held by the other working vectors     */
+      int64 capped;    /* # of calls that were cut short by the cell cap        */
+    } Work_Stats;
+
+  void Set_Work_Cap(Work_Data *work, int maxcells);
+  void Work_Data_Stats(Work_Data *work, Work_Stats *stats);
+
   /* Local_Alignment seeks local alignments of a quality determined by a number of parameters.
      These are coded in an Align_Spec object that can be created with New_Align_Spec and
      freed with Free_Align_Spec when no longer needed.  There are 4 essential parameters:
@@ -189,6 +213,11 @@ void Complement_Seq(char *a, int n);
 
      You can get back the original parameters used to create an Align_Spec with the simple
      utility functions below.
+
+     Set_Align_Budget bounds the work of any one call to Local_Alignment or Find_Extension
+     with the spec to exploring 'maxcells' cells of the d.p. matrix (0, the default, means no
+     bound).  A call that exhausts its budget stops extending the alignment, reports the best
+     end-point found so far, and sets the TRUNC_FLAG of the Alignment record it was given.
   */
 
   typedef void Align_Spec;
@@ -202,6 +231,9 @@ void Complement_Seq(char *a, int n);
   float *Base_Frequencies   (Align_Spec *spec);
   int    Overlap_If_Possible(Align_Spec *spec);
 
+  void   Set_Align_Budget(Align_Spec *spec, int64 maxcells);
+  int64  Align_Budget    (Align_Spec *spec);
+
   /* Local_Alignment finds the longest significant local alignment between the sequences in
      'align' subject to:
 
@@ -266,6 +298,19 @@ void Complement_Seq(char *a, int n);
 
   int Compute_Trace_IRR(Alignment *align, Work_Data *work, int mode);   //  experimental !!
 
+  /* Compute_Trace_WFA computes the same trace as Compute_Trace_PTS, i.e. an optimal alignment
+     between each successive pair of trace points, but does so with a unit-cost wavefront
+     (WFA) whose inner loop compares 8 bases at a time.  It is faster than Compute_Trace_PTS
+     on the short, low-error segments between trace points, and as both are exact between
+     trace points, the number of differences it reports is the same.  If trace_spacing is 0
+     then the trace points are interpreted as for Compute_Trace_IRR.  The mode determines
+     which of several optimal alignments is chosen:  the one that favors substitutions
+     (GREEDIEST), dashes in B (LOWERMOST), or dashes in A (UPPERMOST).  It returns 1 if an
+     error occurred and 0 otherwise.
+  */
+
+  int Compute_Trace_WFA(Alignment *align, Work_Data *work, int trace_spacing, int mode);
+
   /* Compute Alignment determines the best alignment between the substrings specified by align.
      If the task is DIFF_ONLY, then only the difference of this alignment is computed and placed
      in the "diffs" field of align's path.  If the task is PLUS_TRACE or DIFF_TRACE, then
@@ -274,7 +319,10 @@ void Complement_Seq(char *a, int n);
      or DIFF_ALIGN, then it points to an optimal trace of an optimatl alignment.  The PLUS
      tasks can only be called if the immmediately proceeding call was a DIFF_ONLY on the same
      alignment record and sequences, in which case a little efficiency is gained by avoiding
-     the repetition of the top level search for an optimal mid-point.
+     the repetition of the top level search for an optimal mid-point.  The WFA_ALIGN task
+     is as DIFF_ALIGN save that the alignment is found with the wavefront engine underlying
+     Compute_Trace_WFA.  This uses space quadratic in the number of differences, and so is
+     best reserved for alignments of modest divergence.
   */
 
 #define PLUS_ALIGN   0
@@ -282,6 +330,7 @@ void Complement_Seq(char *a, int n);
 #define DIFF_ONLY    2
 #define DIFF_ALIGN   3
 #define DIFF_TRACE   4
+#define WFA_ALIGN    5
 
   int Compute_Alignment(Alignment *align, Work_Data *work, int task, int trace_spacing);
 
@@ -304,6 +353,7 @@ void Complement_Seq(char *a, int n);
      A as segments are guaranteed to cover the same interval of A in a segment.
 
      Both Print routines return 1 if an error occurred (not enough memory), and 0 otherwise.
+     They, and Alignment_Cartoon, build the display in memory and write it with one fwrite.
 
      Flip_Alignment modifies align so the roles of A and B are reversed.  If full is off then
      the trace is ignored, otherwise the trace must be to a full alignment trace and this trace
@@ -52,8 +52,8 @@
 #include "filter.h"
 
 static char *Usage[] =
-  { "[-vaABI] [-k<int(16)>] [-%<int(28)>] [-h<int(50)>] [-w<int(6)>] [-t<int>]",
-    "         [-M<int>] [-e<double(.75)] [-l<int(1500)>] [-s<int(100)>] [-H<int>]",
+  { "[-vaABCIu] [-k<int(16)>] [-%<int(28)>] [-h<int(50)>] [-w<int(6)>] [-t<int>]",
+    "         [-M<int>] [-e<double(.75)] [-l<int(1500)>] [-s<int(100)>] [-H<int>] [-b<int>]",
     "         [-T<int(4)>] [-P<dir(/tmp)>] [-m<track>]+",
     "         <subject:db|dam> <target:db|dam> ...",
   };
@@ -64,11 +64,15 @@ int     HGAP_MIN;
 int     SYMMETRIC;
 int     IDENTITY;
 int     BRIDGE;
+int     COMP_BLOCK;
+int     MAP_ORDER;
 char   *SORT_PATH;
 
 uint64  MEM_LIMIT;
 uint64  MEM_PHYSICAL;
 
+static int MAP_READS;   //  Map the reads of each block from its .ubs sidecar  (-u)
+
 /*  Adapted from code by David Robert Nadeau (http://NadeauSoftware.com) licensed under
  *     "Creative Commons Attribution 3.0 Unported License"
  *          (http://creativecommons.org/licenses/by/3.0/deed.en_US)
@@ -414,7 +418,10 @@ static int read_DB(DAZZ_DB *block, char *name, char **mask, int *mstat, int mtop
           }
     }
 
-  Load_All_Reads(block,0);
+  if (MAP_READS)
+    Map_All_Reads(block);
+  else
+    Load_All_Reads(block,0);
 
   return (isdam);
 }
@@ -468,8 +475,8 @@ int main(int argc, char *argv[])
   int    HIT_MIN;
   double AVE_ERROR;
   int    SPACING;
+  int    BUDGET;
   int    NTHREADS;
-  int    MAP_ORDER;
 
 #ifdef PROFILE
   struct rusage stime, etime;
@@ -492,6 +499,7 @@ int main(int argc, char *argv[])
     HGAP_MIN  = 0;
     AVE_ERROR = .75;
     SPACING   = 100;
+    BUDGET    = 0;
     MINOVER   = 1500;    //   Globally visible to filter.c
     NTHREADS  = 4;
     SORT_PATH = "/tmp";
@@ -515,7 +523,7 @@ int main(int argc, char *argv[])
       if (argv[i][0] == '-')
         switch (argv[i][1])
         { default:
-            ARG_FLAGS("vaABI")
+            ARG_FLAGS("vaABCIu")
             break;
           case 'k':
             ARG_POSITIVE(KMER_LEN,"K-mer length")
@@ -550,6 +558,9 @@ int main(int argc, char *argv[])
           case 's':
             ARG_POSITIVE(SPACING,"Trace spacing")
             break;
+          case 'b':
+            ARG_POSITIVE(BUDGET,"Alignment work budget (in millions of cells)")
+            break;
           case 'M':
             { int limit;
 
@@ -591,7 +602,9 @@ int main(int argc, char *argv[])
     SYMMETRIC = 1-flags['A'];
     IDENTITY  = flags['I'];
     BRIDGE    = flags['B'];
+    COMP_BLOCK = flags['C'];
     MAP_ORDER = flags['a'];
+    MAP_READS = flags['u'];
 
     if (argc <= 2)
       { fprintf(stderr,"Usage: %s %s\n",Prog_Name,Usage[0]);
@@ -606,12 +619,18 @@ int main(int argc, char *argv[])
         fprintf(stderr," targest read.\n");
         fprintf(stderr,"      -t: Ignore k-mers that occur >= -t times in a block.\n");
         fprintf(stderr,"      -M: Use only -M GB of memory by ignoring most frequent k-mers.\n");
+        fprintf(stderr,"      -C: Complement each target block once, not each read per hit,\n");
+        fprintf(stderr,"          (the default when it fits in the -M memory limit).\n");
+        fprintf(stderr,"      -u: Map the uncompressed reads of each block from a sidecar file,\n");
+        fprintf(stderr,"          .<db>.<block>.ubs, making it first if need be.\n");
         fprintf(stderr,"\n");
         fprintf(stderr,"      -e: Look for alignments with -e percent similarity.\n");
         fprintf(stderr,"      -l: Look for alignments of length >= -l.\n");
         fprintf(stderr,"      -s: The trace point spacing for encoding alignments.\n");
         fprintf(stderr,"      -B: Bridge consecutive aligned segments into one if possible\n");
         fprintf(stderr,"      -H: HGAP option: align only target reads of length >= -H.\n");
+        fprintf(stderr,"      -b: Cut short any one alignment search after -b million");
+        fprintf(stderr," d.p. cells.\n");
         fprintf(stderr,"\n");
         fprintf(stderr,"      -T: Use -T threads.\n");
         fprintf(stderr,"      -P: Do block level sorts and merges in directory -P.\n");
@@ -656,6 +675,8 @@ int main(int argc, char *argv[])
   apath = PathTo(afile);
 
   asettings = New_Align_Spec( AVE_ERROR, SPACING, ablock->freq, 1);
+  if (BUDGET > 0)
+    Set_Align_Budget(asettings,BUDGET*1000000ll);
 
   if (VERBOSE)
     printf("\nBuilding index for %s\n",aroot);
@@ -665,7 +686,6 @@ int main(int argc, char *argv[])
 
   { int           i, j;
     Block_Looper *parse;
-    char         *command;
 
     for (i = 2; i < argc; i++)
       { parse = Parse_Block_DB_Arg(argv[i]);
@@ -688,37 +708,6 @@ int main(int argc, char *argv[])
             else
               Match_Filter(aroot,ablock,aroot,ablock,aindex,alen,aindex,alen,asettings);
 
-#define SYSTEM_CHECK(command)						\
- if (VERBOSE)								\
-   printf("\n%s\n",command);						\
- if (system(command) != 0)						\
-   { fprintf(stderr,"\n%s: Command Failed:\n%*s      %s\n",		\
-                    Prog_Name,(int) strlen(Prog_Name),"",command);	\
-     Clean_Exit(1);							\
-   }
-
-            command = CommandBuffer(aroot,broot,SORT_PATH);
-
-            sprintf(command,"LAsort %s %s %s/%s.%s.N%c",VERBOSE?"-v":"",
-                            MAP_ORDER?"-a":"",SORT_PATH,aroot,broot,BLOCK_SYMBOL);
-            SYSTEM_CHECK(command)
-
-            sprintf(command,"LAmerge %s %s %s.%s.las %s/%s.%s.N%c.S",VERBOSE?"-v":"",
-                            MAP_ORDER?"-a":"",aroot,broot,SORT_PATH,aroot,broot,BLOCK_SYMBOL);
-            SYSTEM_CHECK(command)
-
-            if (strcmp(broot,aroot) != 0 || strcmp(bpath,apath) != 0)
-              { if (SYMMETRIC)
-                  { sprintf(command,"LAsort %s %s %s/%s.%s.N%c",VERBOSE?"-v":"",
-                                 MAP_ORDER?"-a":"",SORT_PATH,broot,aroot,BLOCK_SYMBOL);
-                    SYSTEM_CHECK(command)
-
-                    sprintf(command,"LAmerge %s %s %s.%s.las %s/%s.%s.N%c.S",VERBOSE?"-v":"",
-                                 MAP_ORDER?"-a":"",broot,aroot,SORT_PATH,broot,aroot,BLOCK_SYMBOL);
-                    SYSTEM_CHECK(command)
-                  }
-              }
-
             free(bpath);
             free(broot);
           }
@@ -0,0 +1,348 @@
+/*******************************************************************************************
+ *
+ *  Buffered parsing and formatting of the 1-code dumps of LAdump, and a pipeline that
+ *    converts them in blocks in parallel.
+ *
+ *  Date  :  October 2026
+ *
+ ********************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "DB.h"
+#include "dump.h"
+
+#define BLOCK_SIZE  0x400000   //  Bytes read per block
+
+  //  Tokens
+
+static char Space[256] = { ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1 };
+
+int Dump_Char(char **p, char *end)
+{ char *q = *p;
+
+  while (q < end && Space[(uint8) *q])
+    q += 1;
+  if (q >= end)
+    { *p = q;
+      return (-1);
+    }
+  *p = q+1;
+  return ((uint8) *q);
+}
+
+int Dump_Int(char **p, char *end, int64 *v)
+{ char  *q = *p;
+  uint64 x;
+  int    neg;
+
+  while (q < end && Space[(uint8) *q])
+    q += 1;
+  *p = q;
+
+  neg = 0;
+  if (q < end && (*q == '-' || *q == '+'))
+    { neg = (*q == '-');
+      q += 1;
+    }
+  if (q >= end || *q < '0' || *q > '9')
+    return (0);
+
+  x = 0;
+  while (q < end && *q >= '0' && *q <= '9')
+    x = 10*x + (*q++ - '0');
+
+  if (neg)
+    *v = - (int64) x;
+  else
+    *v = (int64) x;
+  *p = q;
+  return (1);
+}
+
+char *Dump_Put_Int(char *o, int64 v)
+{ char   d[24];
+  uint64 x;
+  int    n;
+
+  if (v < 0)
+    { *o++ = '-';
+      x = - (uint64) v;
+    }
+  else
+    x = v;
+
+  n = 0;
+  do
+    { d[n++] = '0' + x%10;
+      x /= 10;
+    }
+  while (x > 0);
+  while (n > 0)
+    *o++ = d[--n];
+  return (o);
+}
+
+  //  Blocks
+
+char *Dump_Room(Dump_Block *b, int64 need)
+{ if (b->olen + need > b->omax)
+    { b->omax = 1.2*(b->olen+need) + 0x10000;
+      b->out  = (char *) Realloc(b->out,b->omax,"Allocating output block");
+      if (b->out == NULL)
+        exit (1);
+    }
+  return (b->out + b->olen);
+}
+
+char *Dump_Head(FILE *input, int64 max, int64 *len)
+{ char *buf;
+
+  buf = (char *) Malloc(max+1,"Allocating input buffer");
+  if (buf == NULL)
+    exit (1);
+  *len = fread(buf,1,max,input);
+  return (buf);
+}
+
+int64 Dump_Cut_P(char *buf, int64 len, int eof, void *arg)
+{ int64 i;
+
+  (void) arg;
+
+  if (eof)
+    return (len);
+  for (i = len-1; i > 0; i--)
+    if (buf[i] == 'P' && buf[i-1] == '\n')
+      return (i);
+  return (0);
+}
+
+  //  Pipeline: the main thread reads the blocks into a ring of NBLK slots, the threads convert
+  //    them, and a writer thread outputs them in order.
+
+#define SLOT_EMPTY  0   //  Free to be read into
+#define SLOT_FULL   1   //  Read and awaiting its task
+#define SLOT_DONE   2   //  Converted and awaiting output
+
+typedef struct
+  { Dump_Block block;
+    int        state;
+  } Dump_Slot;
+
+static pthread_mutex_t Pipe_Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  Pipe_Cond = PTHREAD_COND_INITIALIZER;
+
+static Dump_Slot   *Slot;
+static int          NBLK;
+static int64        Nfull, Ntaken, Nout;   //  # of blocks read, taken for a task, and output
+static int          Nomore;                //  All the blocks have been read
+
+static Dump_Task   *Task;
+static Dump_Output *Output;
+static int          Isize;
+static void        *Arg;
+
+static char  *Carry;        //  Bytes read past the last unit of the previous block
+static int64  Clen, Cmax;
+
+  //  Read the next block of input into b, returning 0 if there is none
+
+static int read_block(FILE *input, Dump_Block *b, Dump_Cut *cut)
+{ int64 len, n;
+  int   eof;
+
+  if (b->tmax < Clen + BLOCK_SIZE + 1)
+    { b->tmax = Clen + BLOCK_SIZE + 1;
+      b->text = (char *) Realloc(b->text,b->tmax,"Allocating input block");
+      if (b->text == NULL)
+        exit (1);
+    }
+  memcpy(b->text,Carry,Clen);
+  len = Clen;
+
+  while (1)
+    { len += fread(b->text+len,1,(b->tmax-1)-len,input);
+      eof  = (len < b->tmax-1);
+      n    = cut(b->text,len,eof,Arg);
+      if (n > 0 || eof)
+        break;
+      b->tmax = 2*b->tmax;
+      b->text = (char *) Realloc(b->text,b->tmax,"Allocating input block");
+      if (b->text == NULL)
+        exit (1);
+    }
+
+  Clen = len-n;
+  if (Clen > Cmax)
+    { Cmax  = 1.2*Clen + BLOCK_SIZE;
+      Carry = (char *) Realloc(Carry,Cmax,"Allocating input block");
+      if (Carry == NULL)
+        exit (1);
+    }
+  memcpy(Carry,b->text+n,Clen);
+
+  b->tlen = n;
+  b->olen = 0;
+  memset(b->info,0,Isize);
+  return (n > 0);
+}
+
+static void *task_thread(void *arg)
+{ Dump_Slot *s;
+
+  (void) arg;
+
+  while (1)
+    { pthread_mutex_lock(&Pipe_Lock);
+      while (Ntaken >= Nfull && ! Nomore)
+        pthread_cond_wait(&Pipe_Cond,&Pipe_Lock);
+      if (Ntaken >= Nfull)
+        { pthread_mutex_unlock(&Pipe_Lock);
+          break;
+        }
+      s = Slot + (Ntaken++ % NBLK);
+      pthread_mutex_unlock(&Pipe_Lock);
+
+      Task(&(s->block),Arg);
+
+      pthread_mutex_lock(&Pipe_Lock);
+      s->state = SLOT_DONE;
+      pthread_cond_broadcast(&Pipe_Cond);
+      pthread_mutex_unlock(&Pipe_Lock);
+    }
+  return (NULL);
+}
+
+static void *output_thread(void *arg)
+{ Dump_Slot *s;
+
+  (void) arg;
+
+  while (1)
+    { pthread_mutex_lock(&Pipe_Lock);
+      while (1)
+        { s = Slot + (Nout % NBLK);
+          if (Nout < Nfull && s->state == SLOT_DONE)
+            break;
+          if (Nout >= Nfull && Nomore)
+            break;
+          pthread_cond_wait(&Pipe_Cond,&Pipe_Lock);
+        }
+      if (Nout >= Nfull)
+        { pthread_mutex_unlock(&Pipe_Lock);
+          break;
+        }
+      pthread_mutex_unlock(&Pipe_Lock);
+
+      Output(&(s->block),Arg);
+
+      pthread_mutex_lock(&Pipe_Lock);
+      s->state = SLOT_EMPTY;
+      Nout += 1;
+      pthread_cond_broadcast(&Pipe_Cond);
+      pthread_mutex_unlock(&Pipe_Lock);
+    }
+  return (NULL);
+}
+
+void Dump_Pipe(FILE *input, char *buf, int64 blen, int nthreads,
+               Dump_Cut *cut, Dump_Task *task, Dump_Output *output, int isize, void *arg)
+{ pthread_t *threads;
+  int        i;
+
+  Task   = task;
+  Output = output;
+  Isize  = isize;
+  Arg    = arg;
+
+  Cmax  = blen + BLOCK_SIZE;
+  Carry = (char *) Malloc(Cmax,"Allocating input block");
+  if (Carry == NULL)
+    exit (1);
+  memcpy(Carry,buf,blen);
+  Clen = blen;
+
+  if (nthreads <= 1)
+    NBLK = 1;
+  else
+    NBLK = 2*nthreads+2;
+  Slot = (Dump_Slot *) Malloc(NBLK*sizeof(Dump_Slot),"Allocating blocks");
+  if (Slot == NULL)
+    exit (1);
+  for (i = 0; i < NBLK; i++)
+    { Dump_Block *b = &(Slot[i].block);
+
+      b->text    = NULL;
+      b->tmax    = 0;
+      b->out     = NULL;
+      b->omax    = 0;
+      b->scratch = NULL;
+      b->info    = Malloc(isize,"Allocating blocks");
+      if (b->info == NULL)
+        exit (1);
+      Slot[i].state = SLOT_EMPTY;
+    }
+
+  if (nthreads <= 1)
+    { Dump_Block *b = &(Slot[0].block);
+
+      while (read_block(input,b,cut))
+        { task(b,arg);
+          output(b,arg);
+        }
+    }
+
+  else
+    { threads = (pthread_t *) Malloc((nthreads+1)*sizeof(pthread_t),"Allocating threads");
+      if (threads == NULL)
+        exit (1);
+
+      Nfull  = Ntaken = Nout = 0;
+      Nomore = 0;
+      for (i = 0; i < nthreads; i++)
+        pthread_create(threads+i,NULL,task_thread,NULL);
+      pthread_create(threads+nthreads,NULL,output_thread,NULL);
+
+      while (1)
+        { Dump_Slot *s = Slot + (Nfull % NBLK);
+
+          pthread_mutex_lock(&Pipe_Lock);
+          while (s->state != SLOT_EMPTY)
+            pthread_cond_wait(&Pipe_Cond,&Pipe_Lock);
+          pthread_mutex_unlock(&Pipe_Lock);
+
+          if ( ! read_block(input,&(s->block),cut))
+            break;
+
+          pthread_mutex_lock(&Pipe_Lock);
+          s->state = SLOT_FULL;
+          Nfull   += 1;
+          pthread_cond_broadcast(&Pipe_Cond);
+          pthread_mutex_unlock(&Pipe_Lock);
+        }
+
+      pthread_mutex_lock(&Pipe_Lock);
+      Nomore = 1;
+      pthread_cond_broadcast(&Pipe_Cond);
+      pthread_mutex_unlock(&Pipe_Lock);
+
+      for (i = 0; i <= nthreads; i++)
+        pthread_join(threads[i],NULL);
+      free(threads);
+    }
+
+  for (i = 0; i < NBLK; i++)
+    { Dump_Block *b = &(Slot[i].block);
+
+      free(b->text);
+      free(b->out);
+      free(b->scratch);
+      free(b->info);
+    }
+  free(Slot);
+  free(Carry);
+}
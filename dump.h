@@ -0,0 +1,93 @@
+/*******************************************************************************************
+ *
+ *  Buffered parsing and formatting of the 1-code dumps of LAdump (and their binary form), and
+ *    a pipeline that converts the body of a dump in blocks, in parallel, and outputs the
+ *    results of the blocks in order.  The basis of LAa2b, LAb2a, and dumpLA.
+ *
+ *  Date  :  October 2026
+ *
+ ********************************************************************************************/
+
+#ifndef _DUMP_MODULE
+
+#define _DUMP_MODULE
+
+#include "DB.h"
+
+/*** TOKENS
+
+     Dump_Char returns the first character at or after *p that is not white space, and moves
+       *p past it, or returns -1 if there is none before 'end'.  Dump_Int skips white space and
+       then parses an optionally signed decimal integer at *p, moving *p past it, as does scanf
+       with " %d" or " %lld".  It returns 0 if there is no integer there (leaving *p past any
+       white space) and 1 otherwise.
+
+     Dump_Put_Int places the decimal text of 'v' at 'o' and returns a pointer to the byte
+       after it, as would printf with "%lld".
+
+***/
+
+int   Dump_Char(char **p, char *end);
+int   Dump_Int(char **p, char *end, int64 *v);
+char *Dump_Put_Int(char *o, int64 v);
+
+/*** BLOCKS
+
+     The text of a block is the bytes of some number of whole units (e.g. LAs) of the input,
+       with a byte to spare after its end.  Its output is accumulated in 'out' by Dump_Room,
+       which ensures there is room for 'need' more bytes after out[olen], and returns a pointer
+       to the first of them.  'scratch' is kept with the block for the use of the task on it,
+       and 'info' holds what the task reports about the block to the routine that outputs it.
+
+***/
+
+typedef struct
+  { char  *text;     //  Input of the block: text[0..tlen-1]
+    int64  tlen;
+    int64  tmax;
+    char  *out;      //  Output of the block: out[0..olen-1]
+    int64  olen;
+    int64  omax;
+    void  *scratch;  //  Space the task keeps with the block
+    void  *info;     //  What the task tells the output routine
+  } Dump_Block;
+
+char *Dump_Room(Dump_Block *b, int64 need);
+
+/*** PIPELINE
+
+     Dump_Pipe converts the bytes buf[0..blen-1] (already read from 'input') followed by the
+       remainder of 'input'.  The bytes are read in blocks of about 4MB, where 'cut' gives the
+       number of bytes of buf[0..len-1] that are whole units (the rest are carried on to the
+       next block), or all of them if 'eof' is set.  Should it return 0 when 'eof' is not set,
+       the block is enlarged until a unit fits.  'task' converts a block, and is called on
+       up to 'nthreads' blocks at once.  'output' is called on each block in the order of the
+       input after its task, and may exit after outputting what precedes an error in it.
+       Each block has an info record of 'isize' bytes, zeroed before its task.
+
+***/
+
+typedef int64 Dump_Cut(char *buf, int64 len, int eof, void *arg);
+typedef void  Dump_Task(Dump_Block *block, void *arg);
+typedef void  Dump_Output(Dump_Block *block, void *arg);
+
+void Dump_Pipe(FILE *input, char *buf, int64 blen, int nthreads,
+               Dump_Cut *cut, Dump_Task *task, Dump_Output *output, int isize, void *arg);
+
+/*** HEADS
+
+     Dump_Head reads the first 'max' bytes of 'input' (or all of them if fewer) into a new buffer
+       (with a byte to spare after them) for parsing the head of a dump, returning the number
+       read in *len.  A tool then hands the bytes after the head to Dump_Pipe, and frees the
+       buffer.
+
+     Dump_Cut_P cuts a 1-code dump at the last line that starts with a P, so that each block is
+       of whole LAs.
+
+***/
+
+char *Dump_Head(FILE *input, int64 max, int64 *len);
+
+int64 Dump_Cut_P(char *buf, int64 len, int eof, void *arg);
+
+#endif // _DUMP_MODULE
@@ -1,151 +1,143 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "DB.h"
 #include "align.h"
+#include "dump.h"
 
-int main(int argc, char *argv[])
-{ char    code, which;
-  int64   total;
-  int     aread, bread;
-  char    orient, chain;
-  int     alen, blen;
-  int     ab, ae, bb, be;
-  int     diffs;
-  int     len;
-  int     tspace, small, tbytes;
-  uint8  *tbuffer = NULL;
-  uint16 *sbuffer = NULL;
-  int     hasNext, haveC, haveT, haveD;
-  int     nline;
-  int     i;
-  int64   novls;
-  Overlap _ovl, *ovl = &_ovl;
-  Path   *path = & (ovl->path);
-  FILE   *output;
-  char   *pwd, *root;
+#define HEAD_SIZE 0x100000   //  Bytes read to parse the header lines from
 
-  //  Process arguments
+#define OVL_IO  ((int64) (sizeof(Overlap) - sizeof(void *)))   //  Bytes of an LA in a .las
 
-  if (argc != 2)
-    { fprintf(stderr,"Usage: dumpLA <align:las> < (ascii dump)\n");
-      exit (1);
-    }
+static int     Small;     //  Trace values are bytes
+static int     Tbytes;
+static int64   Nline;     //  Line number of the start of the next block to output
+static int64   Novls;     //  # of LAs output
+static FILE   *Output;
 
-  pwd = PathTo(argv[1]);
-  root = Root(argv[1],".las");
-  if ((output = fopen(Catenate(pwd,"/",root,".las"),"w")) == NULL)
-    { fprintf(stderr,"DumpLA: Cannot open %s for writing\n",argv[1]);
-      exit (1);
-    }
-  free(root);
-  free(pwd);
+#define NO_ERROR    0
+#define BAD_LINE    1     //  Unrecognized line type
+#define NO_C_LINE   2     //  Alignment record does not have a C-line
+#define NO_T_LINE   3     //  Alignment record does not have a T-line
 
-  nline   = 1;
-  small   = 0;
-  tbytes  = 2;
-  hasNext = 0;
-  while (scanf(" %c",&code) == 1)       //  Header lines
-    if (code == '@' || code == '+' || code == '%')
-      { scanf(" %c %lld",&which,&total);
-        if (code == '@' && which == 'T')
-          { tbuffer = (uint8 *) malloc(2*total*sizeof(uint16));
-            sbuffer = (uint16 *) tbuffer;
-          }
-        nline += 1;
-      }
-    else
-      { if (tbuffer == NULL)
-          { fprintf(stderr,"DumpLA: Line %d: .las dump must contain trace header lines\n",nline);
-            exit (1);
-          }
-        if (code != 'X')
-          { fprintf(stderr,"DumpLA: Line %d: .las dump must have an X-line after header\n",nline);
-            exit (1);
-          }
-        scanf(" %d",&tspace);
-        if (tspace <= TRACE_XOVR && tspace != 0)
-          { small  = 1;
-            tbytes = 1;
-          }
-        else
-          { small  = 0;
-            tbytes = 2;
-          }
-        nline += 1;
-        if (scanf(" %c",&code) == 1)
-          { if (code != 'P')
-              { fprintf(stderr,"DumpLA: Line %d: .las dump data must being with a P-line\n",nline);
-                exit (1);
-              }
-            hasNext = 1;
-          }
-        break;
-      }
+typedef struct
+  { int64 count;          //  # of LAs in the block
+    int64 lines;          //  # of lines in the block (up to an error)
+    int   error;          //  Error at the end of the block (if any) ...
+    int   code;           //    and the unrecognized line type of a BAD_LINE
+  } Dump_Info;
+
+  //  Convert the LAs of block b, stopping at the first that is not well-formed
+
+static void dump_task(Dump_Block *b, void *arg)
+{ Dump_Info *info = (Dump_Info *) b->info;
+  char      *p, *end;
+  int        code, i;
+  int64      x;
+  int        aread, bread;
+  char       orient, chain;
+  int        ab, ae, bb, be;
+  int        diffs, len;
+  int        haveC, haveT, haveD;
+  Overlap    _ovl, *ovl = &_ovl;
+  Path      *path = &(ovl->path);
+
+  (void) arg;
+
+  memset(ovl,0,sizeof(Overlap));
+  aread = bread = 0;
+  orient = chain = 0;
+  ab = ae = bb = be = 0;
+  diffs = len = 0;
 
-  novls = 0;
-  fwrite(&novls,sizeof(int64),1,output);
-  fwrite(&tspace,sizeof(int),1,output);
+  p   = b->text;
+  end = b->text + b->tlen;
+  while (Dump_Char(&p,end) >= 0)       //  For each LA (at its P-line) do
+    { if (Dump_Int(&p,end,&x)) aread = x;
+      if (Dump_Int(&p,end,&x)) bread = x;
+      if ((code = Dump_Char(&p,end)) >= 0) orient = code;
+      if ((code = Dump_Char(&p,end)) >= 0) chain = code;
+      info->lines += 1;
 
-  while (hasNext)       //  For each data line do
-    { scanf(" %d %d %c %c",&aread,&bread,&orient,&chain);
-      nline += 1;
       haveC = haveT = haveD = 0;
-      hasNext = 0;
-      while (scanf(" %c",&code) == 1)       //  For each data line do
+      while ((code = Dump_Char(&p,end)) >= 0)       //  For each data line do
         if (code == 'P')
-          { hasNext = 1;
+          { p -= 1;
             break;
           }
         else
           switch (code)
           { case 'L':                         //  Read lengths
-              scanf(" %d %d",&alen,&blen);
-              nline += 1;
+              Dump_Int(&p,end,&x);
+              Dump_Int(&p,end,&x);
+              info->lines += 1;
               break;
             case 'C':                         //  Coordinate intervals
-              scanf(" %d %d %d %d",&ab,&ae,&bb,&be);
-              nline += 1;
+              if (Dump_Int(&p,end,&x)) ab = x;
+              if (Dump_Int(&p,end,&x)) ae = x;
+              if (Dump_Int(&p,end,&x)) bb = x;
+              if (Dump_Int(&p,end,&x)) be = x;
+              info->lines += 1;
               haveC = 1;
               break;
             case 'D':                         //  Differences
-              scanf(" %d",&diffs);
-              nline += 1;
+              if (Dump_Int(&p,end,&x)) diffs = x;
+              info->lines += 1;
               haveD = 1;
               break;
-            case 'T':                         //  Mask
+            case 'T':                         //  Mask: parsed into place after the record
               haveT = 1;
-              scanf(" %d",&len);
-              nline += (len+1);
+              if (Dump_Int(&p,end,&x)) len = x;
+              info->lines += (len+1);
               len *= 2;
-              if (small)
-                { for (int i = 0; i < len; i += 2)
-                    scanf(" %hhd %hhd",tbuffer+i,tbuffer+(i+1));
+              if (len < 0)
+                len = 0;
+              Dump_Room(b,OVL_IO + len*Tbytes);
+              if (Small)
+                { uint8 *t8 = (uint8 *) (b->out + b->olen + OVL_IO);
+
+                  for (i = 0; i < len; i++)
+                    if (Dump_Int(&p,end,&x))
+                      t8[i] = x;
                 }
               else
-                { for (int i = 0; i < len; i += 2)
-                    scanf(" %hd %hd",sbuffer+i,sbuffer+(i+1));
+                { uint16 *t16 = (uint16 *) (b->out + b->olen + OVL_IO);
+
+                  for (i = 0; i < len; i++)
+                    if (Dump_Int(&p,end,&x))
+                      t16[i] = x;
                 }
               break;
             default:
-              fprintf(stderr,"DumpLA: Line %d: Unrecognized line type '%c'\n",nline,code);
-              exit (1);
+              info->error = BAD_LINE;
+              info->code  = code;
+              return;
           }
       if (!haveC)
-        { fprintf(stderr,"DumpLA: Line %d: Alignment record does not have a C-line\n",nline);
-            exit (1);
+        { info->error = NO_C_LINE;
+          return;
         }
       if (!haveT)
-        { fprintf(stderr,"DumpLA: Line %d: Alignment record does not have a T-line\n",nline);
-            exit (1);
+        { info->error = NO_T_LINE;
+          return;
         }
       if (!haveD)
         { diffs = 0;
-          for (i = 0; i < len; i += 2)
-            diffs += tbuffer[i];
+          if (Small)
+            { uint8 *t8 = (uint8 *) (b->out + b->olen + OVL_IO);
+
+              for (i = 0; i < len; i += 2)
+                diffs += t8[i];
+            }
+          else
+            { uint16 *t16 = (uint16 *) (b->out + b->olen + OVL_IO);
+
+              for (i = 0; i < len; i += 2)
+                diffs += t16[i];
+            }
         }
 
-      novls += 1;
       ovl->aread = aread-1;
       ovl->bread = bread-1;
       ovl->flags = 0;
@@ -163,15 +155,144 @@ int main(int argc, char *argv[])
       path->bepos = be;
       path->diffs = diffs;
       path->tlen  = len;
-      path->trace = (void *) tbuffer;
 
-      Write_Overlap(output,ovl,tbytes);
+      memcpy(b->out + b->olen,((char *) ovl) + sizeof(void *),OVL_IO);
+      b->olen    += OVL_IO + len*Tbytes;
+      info->count += 1;
+    }
+}
+
+static void dump_output(Dump_Block *b, void *arg)
+{ Dump_Info *info = (Dump_Info *) b->info;
+
+  (void) arg;
+
+  fwrite(b->out,1,b->olen,Output);
+  Novls += info->count;
+  Nline += info->lines;
+  switch (info->error)
+  { case BAD_LINE:
+      fprintf(stderr,"DumpLA: Line %lld: Unrecognized line type '%c'\n",Nline,info->code);
+      exit (1);
+    case NO_C_LINE:
+      fprintf(stderr,"DumpLA: Line %lld: Alignment record does not have a C-line\n",Nline);
+      exit (1);
+    case NO_T_LINE:
+      fprintf(stderr,"DumpLA: Line %lld: Alignment record does not have a T-line\n",Nline);
+      exit (1);
+  }
+}
+
+int main(int argc, char *argv[])
+{ char    *head, *p, *end;
+  int64    hlen, x;
+  int      code, which;
+  int      tspace;
+  int      hasTrace, hasNext;
+  char    *pwd, *root;
+  int      NTHREADS;
+
+  //  Process arguments
+
+  { int   i, j;
+    char *eptr;
+
+    Prog_Name = Strdup("dumpLA","");
+
+    NTHREADS = 4;
+
+    j = 1;
+    for (i = 1; i < argc; i++)
+      if (argv[i][0] == '-')
+        switch (argv[i][1])
+        { default:
+            fprintf(stderr,"%s: -%c is an illegal option\n",Prog_Name,argv[i][1]);
+            exit (1);
+          case 'T':
+            ARG_POSITIVE(NTHREADS,"Number of threads")
+            break;
+        }
+      else
+        argv[j++] = argv[i];
+    argc = j;
+
+    if (argc != 2)
+      { fprintf(stderr,"Usage: dumpLA [-T<int(4)>] <align:las> < (ascii dump)\n");
+        exit (1);
+      }
+  }
+
+  pwd = PathTo(argv[1]);
+  root = Root(argv[1],".las");
+  if ((Output = fopen(Catenate(pwd,"/",root,".las"),"w")) == NULL)
+    { fprintf(stderr,"DumpLA: Cannot open %s for writing\n",argv[1]);
+      exit (1);
     }
+  free(root);
+  free(pwd);
+
+  head = Dump_Head(stdin,HEAD_SIZE,&hlen);
+  p    = head;
+  end  = head + hlen;
+
+  Nline    = 1;
+  Small    = 0;
+  Tbytes   = 2;
+  tspace   = 0;
+  hasTrace = 0;
+  hasNext  = 0;
+  while ((code = Dump_Char(&p,end)) >= 0)       //  Header lines
+    if (code == '@' || code == '+' || code == '%')
+      { which = Dump_Char(&p,end);
+        Dump_Int(&p,end,&x);
+        if (code == '@' && which == 'T')
+          hasTrace = 1;
+        Nline += 1;
+      }
+    else
+      { if (!hasTrace)
+          { fprintf(stderr,"DumpLA: Line %lld: .las dump must contain trace header lines\n",Nline);
+            exit (1);
+          }
+        if (code != 'X')
+          { fprintf(stderr,"DumpLA: Line %lld: .las dump must have an X-line after header\n",Nline);
+            exit (1);
+          }
+        if (Dump_Int(&p,end,&x))
+          tspace = x;
+        if (tspace <= TRACE_XOVR && tspace != 0)
+          { Small  = 1;
+            Tbytes = 1;
+          }
+        else
+          { Small  = 0;
+            Tbytes = 2;
+          }
+        Nline += 1;
+        if ((code = Dump_Char(&p,end)) >= 0)
+          { if (code != 'P')
+              { fprintf(stderr,"DumpLA: Line %lld: .las dump data must being with a P-line\n",Nline);
+                exit (1);
+              }
+            hasNext = 1;
+          }
+        break;
+      }
+
+  Novls = 0;
+  fwrite(&Novls,sizeof(int64),1,Output);
+  fwrite(&tspace,sizeof(int),1,Output);
+
+  //  Convert the LAs, a block of whole LAs at a time
+
+  if (hasNext)
+    Dump_Pipe(stdin,p-1,end-(p-1),NTHREADS,Dump_Cut_P,dump_task,dump_output,sizeof(Dump_Info),NULL);
 
-  rewind(output);
-  fwrite(&novls,sizeof(int64),1,output);
+  rewind(Output);
+  fwrite(&Novls,sizeof(int64),1,Output);
 
-  fclose(output);
+  fclose(Output);
+  free(head);
 
   exit (0);
 }
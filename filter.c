@@ -27,6 +27,7 @@
 #include "lsd.sort.h"
 #include "filter.h"
 #include "align.h"
+#include "las.h"
 
                        //  WHen running sensitivity trials, compute histogram of
 #define MAXHIT   1000  //    false & true positive hit scores
@@ -81,6 +82,7 @@
 
 #define MATCH_CHUNK    100     //  Max initial number of hits between two reads
 #define TRACE_CHUNK  20000     //  Max initial trace points in hits between two reads
+#define FUSE_DIRECT     32     //  Below this many LAs for a pair, fuse by direct comparison
 
 typedef struct
   { uint32 rpos;
@@ -1119,6 +1121,7 @@ static SeedPair   *MR_hits;
 static int         MR_two;
 static Align_Spec *MR_spec;
 static int         MR_tspace;
+static char       *MR_bcomp;   //  Complement of every read of MR_bblock, if not NULL
 
 typedef struct
   { uint64   max;
@@ -1556,15 +1559,291 @@ static void Bridge(Path *path1, Path *path2, Path *path3, Trace_Buffer *tbuf)
   path1->tlen  = len;
 }
 
-static int Handle_Redundancies(Path *amatch, int novls, Path *bmatch,
-                               Alignment *align, Work_Data *work, Trace_Buffer *tbuf)
+  //  If LAs j and k (k < j) share a trace point then fuse them into j, or if one contains
+  //    the other keep the longer in j, and in either case remove k.  Returns FUSE_NONE if
+  //    nothing happened, FUSE_DROP if only k was removed, FUSE_GROW if j changed, and
+  //    FUSE_RESTART if j changed and all earlier LAs must be compared with it again.
+
+#define FUSE_NONE     0
+#define FUSE_DROP     1
+#define FUSE_GROW     2
+#define FUSE_RESTART  3
+
+static int Fuse_Pair(Path *amatch, Path *bmatch, int j, int k, int comp, Trace_Buffer *tbuf)
+{ Path *jpath = amatch+j;
+  Path *kpath = amatch+k;
+  int   dist, result;
+  int   awhen = 0, bwhen = 0;
+
+  if (jpath->abpos < kpath->abpos)
+
+    { if (kpath->abpos <= jpath->aepos && kpath->bbpos <= jpath->bepos)
+        { dist = Entwine(jpath,kpath,tbuf,&awhen);
+          if (dist == 0)
+            { result = FUSE_DROP;
+              if (kpath->aepos > jpath->aepos)
+                { if (comp)
+                    { dist = Entwine(bmatch+k,bmatch+j,tbuf,&bwhen);
+                      if (dist != 0)
+                        return (FUSE_NONE);
+                      Fusion(jpath,awhen,kpath,tbuf);
+                      Fusion(bmatch+k,bwhen,bmatch+j,tbuf);
+                      bmatch[j] = bmatch[k];
+#ifdef TEST_CONTAIN
+                      printf("  Really 1");
+#endif
+                    }
+                  else
+                    { dist = Entwine(bmatch+j,bmatch+k,tbuf,&bwhen);
+                      if (dist != 0)
+                        return (FUSE_NONE);
+                      Fusion(jpath,awhen,kpath,tbuf);
+                      Fusion(bmatch+j,bwhen,bmatch+k,tbuf);
+#ifdef TEST_CONTAIN
+                      printf("  Really 2");
+#endif
+                    }
+                  result = FUSE_RESTART;
+                }
+              kpath->abpos = -1;
+#ifdef TEST_CONTAIN
+              printf("  Fuse! A %d %d\n",j,k);
+#endif
+              return (result);
+            }
+        }
+    }
+
+  else // kpath->abpos <= jpath->abpos
+
+    { if (jpath->abpos <= kpath->aepos && jpath->bbpos <= kpath->bepos)
+        { dist = Entwine(kpath,jpath,tbuf,&awhen);
+          if (dist == 0)
+            { result = FUSE_DROP;
+              if (kpath->abpos == jpath->abpos)
+                { if (kpath->aepos > jpath->aepos)
+                    { *jpath = *kpath;
+                      bmatch[j] = bmatch[k];
+                      result = FUSE_GROW;
+                    }
+                }
+              else if (jpath->aepos > kpath->aepos)
+                { if (comp)
+                    { dist = Entwine(bmatch+j,bmatch+k,tbuf,&bwhen);
+                      if (dist != 0)
+                        return (FUSE_NONE);
+                      Fusion(kpath,awhen,jpath,tbuf);
+                      *jpath = *kpath;
+                      Fusion(bmatch+j,bwhen,bmatch+k,tbuf);
+#ifdef TEST_CONTAIN
+                      printf("  Really 4");
+#endif
+                    }
+                  else
+                    { dist = Entwine(bmatch+k,bmatch+j,tbuf,&bwhen);
+                      if (dist != 0)
+                        return (FUSE_NONE);
+                      Fusion(kpath,awhen,jpath,tbuf);
+                      *jpath = *kpath;
+                      Fusion(bmatch+k,bwhen,bmatch+j,tbuf);
+                      bmatch[j] = bmatch[k];
+#ifdef TEST_CONTAIN
+                      printf("  Really 5");
+#endif
+                    }
+                  result = FUSE_RESTART;
+                }
+              else
+                { *jpath = *kpath;
+                  bmatch[j] = bmatch[k];
+                  result = FUSE_GROW;
+                }
+              kpath->abpos = -1;
+#ifdef TEST_CONTAIN
+              printf("  Fuse! B %d %d\n",j,k);
+#endif
+              return (result);
+            }
+        }
+    }
+
+  return (FUSE_NONE);
+}
+
+  //  Two LAs can only be fused if they pass through a common point, i.e. they have the same
+  //    start, the same end, or the same b-coordinate at one of the a-read trace points
+  //    (see Entwine).  So for pairs with many LAs, every LA already considered has its
+  //    points hashed, and LA j is only compared against those earlier LAs that share a
+  //    point with it, in the same (descending) order as the direct double loop, giving
+  //    identical results without the quadratic number of comparisons.
+
+typedef struct
+  { int64 point;   //  a << 32 | b
+    int   path;    //  index of LA through the point
+    int   next;    //  next node in the same hash bucket
+  } Fuse_Node;
+
+typedef struct
+  { int       *bucket;
+    int        bmax;     //  # of buckets, a power of 2
+    Fuse_Node *node;
+    int        ntop, nmax;
+    int       *cand;     //  candidate list and marks over LA indices
+    int       *mark;
+    int        cmax;
+  } Fuse_Index;
+
+static inline int64 fuse_point(int a, int b)
+{ return ((((int64) a) << 32) | ((uint32) b)); }
+
+static inline int fuse_hash(int64 point, int bmax)
+{ uint64 h = ((uint64) point) * 0x9e3779b97f4a7c15ull;
+  return ((int) (h >> 32) & (bmax-1));
+}
+
+  //  Call 'visit' on every point of path through which another can be fused (see Entwine)
+
+#define FOR_FUSE_POINTS(path,tbuf,visit)				\
+{ uint16 *_t = (tbuf)->trace + (uint64) ((path)->trace);		\
+  int     _a, _b, _i;						\
+								\
+  visit((path)->abpos,(path)->bbpos)				\
+  _a = ((path)->abpos/MR_tspace)*MR_tspace;			\
+  _b = (path)->bbpos;						\
+  for (_i = 1; _i < (path)->tlen; _i += 2)			\
+    { _a += MR_tspace;						\
+      if (_a >= (path)->aepos)					\
+        break;							\
+      _b += _t[_i];						\
+      visit(_a,_b)						\
+    }								\
+  visit((path)->aepos,(path)->bepos)				\
+}
+
+static void fuse_insert(Fuse_Index *fidx, Path *path, int p, Trace_Buffer *tbuf)
+{ Fuse_Node *n;
+  int64      x;
+  int        h;
+
+#define INSERT_POINT(a,b)						\
+  { if (fidx->ntop >= fidx->nmax)					\
+      { fidx->nmax = 1.2*fidx->ntop + 1000;				\
+        fidx->node = (Fuse_Node *) Realloc(fidx->node,sizeof(Fuse_Node)*fidx->nmax,	\
+                                           "Reallocating fusion index");	\
+        if (fidx->node == NULL)					\
+          Clean_Exit(1);						\
+      }								\
+    x = fuse_point(a,b);						\
+    h = fuse_hash(x,fidx->bmax);					\
+    n = fidx->node + fidx->ntop;					\
+    n->point = x;							\
+    n->path  = p;							\
+    n->next  = fidx->bucket[h];					\
+    fidx->bucket[h] = fidx->ntop++;				\
+  }
+
+  FOR_FUSE_POINTS(path,tbuf,INSERT_POINT)
+}
+
+  //  Gather the live LAs with index less than 'top' that share a point with 'path' into
+  //    fidx->cand in descending order, returning their number.
+
+static int CAND_ORDER(const void *l, const void *r)
+{ int x = *((int *) l);
+  int y = *((int *) r);
+  return (y-x);
+}
+
+static int fuse_candidates(Fuse_Index *fidx, Path *amatch, Path *path, int top,
+                           int stamp, Trace_Buffer *tbuf)
+{ Fuse_Node *n;
+  int        ncand;
+  int        e;
+
+#define FIND_POINT(a,b)							\
+  { int64 x = fuse_point(a,b);					\
+    for (e = fidx->bucket[fuse_hash(x,fidx->bmax)]; e >= 0; e = n->next)	\
+      { n = fidx->node + e;						\
+        if (n->point == x && n->path < top && fidx->mark[n->path] != stamp	\
+                          && amatch[n->path].abpos >= 0)		\
+          { fidx->mark[n->path] = stamp;				\
+            fidx->cand[ncand++] = n->path;				\
+          }								\
+      }								\
+  }
+
+  ncand = 0;
+  FOR_FUSE_POINTS(path,tbuf,FIND_POINT)
+
+  if (ncand > 1)
+    qsort(fidx->cand,ncand,sizeof(int),CAND_ORDER);
+  return (ncand);
+}
+
+static void Fuse_Indexed(Path *amatch, int novls, Path *bmatch, int comp,
+                         Trace_Buffer *tbuf, Fuse_Index *fidx)
+{ int   j, k, c;
+  int   ncand, stamp;
+  int64 npts;
+
+  npts = 0;
+  for (j = 0; j < novls; j++)
+    npts += amatch[j].tlen/2 + 2;
+
+  if (novls > fidx->cmax)
+    { fidx->cmax = 1.2*novls + 100;
+      fidx->cand = (int *) Realloc(fidx->cand,2*sizeof(int)*fidx->cmax,
+                                   "Reallocating fusion index");
+      if (fidx->cand == NULL)
+        Clean_Exit(1);
+    }
+  fidx->mark = fidx->cand + fidx->cmax;
+
+  if (2*npts > fidx->bmax)
+    { while (2*npts > fidx->bmax)
+        fidx->bmax = 2*fidx->bmax;
+      fidx->bucket = (int *) Realloc(fidx->bucket,sizeof(int)*fidx->bmax,
+                                     "Reallocating fusion index");
+      if (fidx->bucket == NULL)
+        Clean_Exit(1);
+    }
+
+  for (j = 0; j < fidx->bmax; j++)
+    fidx->bucket[j] = -1;
+  for (j = 0; j < novls; j++)
+    fidx->mark[j] = -1;
+  fidx->ntop = 0;
+
+  stamp = 0;
+  fuse_insert(fidx,amatch,0,tbuf);
+  for (j = 1; j < novls; j++)
+    { ncand = fuse_candidates(fidx,amatch,amatch+j,j,stamp++,tbuf);
+      for (c = 0; c < ncand; c++)
+        { k = fidx->cand[c];
+          if (amatch[k].abpos < 0)
+            continue;
+          switch (Fuse_Pair(amatch,bmatch,j,k,comp,tbuf))
+          { case FUSE_RESTART:
+              ncand = fuse_candidates(fidx,amatch,amatch+j,j,stamp++,tbuf);
+              c = -1;
+              break;
+            case FUSE_GROW:
+              ncand = fuse_candidates(fidx,amatch,amatch+j,k,stamp++,tbuf);
+              c = -1;
+              break;
+          }
+        }
+      fuse_insert(fidx,amatch+j,j,tbuf);
+    }
+}
+
+static int Handle_Redundancies(Path *amatch, int novls, Path *bmatch, Alignment *align,
+                               Work_Data *work, Trace_Buffer *tbuf, Fuse_Index *fidx)
 { Path      *jpath, *kpath, *apath;
   Path      _bpath, *bpath = &_bpath;
   Alignment _blign, *blign = &_blign;
 
   int   j, k, no;
-  int   dist;
-  int   awhen = 0, bwhen = 0;
   int   comp;
 
 #if defined(TEST_CONTAIN) || defined(TEST_BRIDGE)
@@ -1588,101 +1867,16 @@ static int Handle_Redundancies(Path *amatch, int novls, Path *bmatch,
 
   (void) apath->tlen;   //  Just to shut up stupid compilers
 
-  for (j = 1; j < novls; j++)
-    { jpath = amatch+j;
+  if (novls < FUSE_DIRECT)
+    for (j = 1; j < novls; j++)
       for (k = j-1; k >= 0; k--)
-        { kpath = amatch+k;
-
-          if (kpath->abpos < 0)
+        { if (amatch[k].abpos < 0)
             continue;
-
-          if (jpath->abpos < kpath->abpos)
-
-            { if (kpath->abpos <= jpath->aepos && kpath->bbpos <= jpath->bepos)
-                { dist = Entwine(jpath,kpath,tbuf,&awhen);
-                  if (dist == 0)
-                    { if (kpath->aepos > jpath->aepos)
-                        { if (comp)
-                            { dist = Entwine(bmatch+k,bmatch+j,tbuf,&bwhen);
-                              if (dist != 0)
-                                continue;
-                              Fusion(jpath,awhen,kpath,tbuf);
-                              Fusion(bmatch+k,bwhen,bmatch+j,tbuf);
-                              bmatch[j] = bmatch[k];
-#ifdef TEST_CONTAIN
-                              printf("  Really 1");
-#endif
-                            }
-                          else
-                            { dist = Entwine(bmatch+j,bmatch+k,tbuf,&bwhen);
-                              if (dist != 0)
-                                continue;
-                              Fusion(jpath,awhen,kpath,tbuf);
-                              Fusion(bmatch+j,bwhen,bmatch+k,tbuf);
-#ifdef TEST_CONTAIN
-                              printf("  Really 2");
-#endif
-                            }
-                          k = j;
-                        }
-                      kpath->abpos = -1;
-#ifdef TEST_CONTAIN
-                      printf("  Fuse! A %d %d\n",j,k);
-#endif
-                    }
-                }
-            }
-
-          else // kpath->abpos <= jpath->abpos
-
-            { if (jpath->abpos <= kpath->aepos && jpath->bbpos <= kpath->bepos)
-                { dist = Entwine(kpath,jpath,tbuf,&awhen);
-                  if (dist == 0)
-                    { if (kpath->abpos == jpath->abpos)
-                        { if (kpath->aepos > jpath->aepos)
-                            { *jpath = *kpath;
-                              bmatch[j] = bmatch[k];
-                            }
-                        }
-                      else if (jpath->aepos > kpath->aepos)
-                        { if (comp)
-                            { dist = Entwine(bmatch+j,bmatch+k,tbuf,&bwhen);
-                              if (dist != 0)
-                                continue;
-                              Fusion(kpath,awhen,jpath,tbuf);
-                              *jpath = *kpath;
-                              Fusion(bmatch+j,bwhen,bmatch+k,tbuf);
-#ifdef TEST_CONTAIN
-                              printf("  Really 4");
-#endif
-                            }
-                          else
-                            { dist = Entwine(bmatch+k,bmatch+j,tbuf,&bwhen);
-                              if (dist != 0)
-                                continue;
-                              Fusion(kpath,awhen,jpath,tbuf);
-                              *jpath = *kpath;
-                              Fusion(bmatch+k,bwhen,bmatch+j,tbuf);
-                              bmatch[j] = bmatch[k];
-#ifdef TEST_CONTAIN
-                              printf("  Really 5");
-#endif
-                            }
-                          k = j;
-                        }
-                      else
-                        { *jpath = *kpath;
-                          bmatch[j] = bmatch[k];
-                        }
-                      kpath->abpos = -1;
-#ifdef TEST_CONTAIN
-                      printf("  Fuse! B %d %d\n",j,k);
-#endif
-                    }
-                }
-            }
+          if (Fuse_Pair(amatch,bmatch,j,k,comp,tbuf) == FUSE_RESTART)
+            k = j;
         }
-    }
+  else
+    Fuse_Indexed(amatch,novls,bmatch,comp,tbuf,fidx);
 
   //  Loop to catch LA's that have a narrow parallel overlap and bridge them
 
@@ -1839,16 +2033,259 @@ static void CopyAndComp(char *bcomp,char *bseq, int blen)
   t[0] = 4;
 }
 
+  //  Build the complement of every read of 'block' in an array with the same layout as
+  //    block->bases, so that the complement of read i is at reads[i].boff as well
+
+static char *Complement_Block(DAZZ_DB *block)
+{ DAZZ_READ *reads = block->reads;
+  char      *bases = (char *) block->bases;
+  char      *comp;
+  int        i;
+
+  comp = (char *) Malloc(reads[block->nreads].boff+1,"Allocating complemented block");
+  if (comp == NULL)
+    Clean_Exit(1);
+  comp += 1;
+  for (i = 0; i < block->nreads; i++)
+    CopyAndComp(comp+reads[i].boff,bases+reads[i].boff,reads[i].rlen);
+  return (comp);
+}
+
+  //  Sorted runs: each report thread collects the LAs of each of its outputs in a .las set
+  //    in memory.  Should a set exceed its share of the memory limit, it is sorted and
+  //    spilled to SORT_PATH as a run.  Once all report threads are done, the runs of each
+  //    thread are merged as LAsort would have sorted them, and the threads' LAs are then
+  //    merged into the final .las file as LAmerge would, exactly as the LAsort and LAmerge
+  //    of each thread's output once did.  A set still in memory is merged where it lies.
+
+#define OUT_BLOCK  0x400000      //  Size of .las reader and writer buffers
+#define RUN_MIN    0x4000000ll   //  Smallest spill threshold of a run buffer (64MB)
+
+typedef struct
+  { Las_Set *set;      //  LAs collected since the last spill
+    int64    max;      //  Bytes allocated for the LAs of set
+    int64    budget;   //  Spill before set->size would exceed this
+    int      nspill;   //  # of runs spilled to SORT_PATH
+    int      thread;   //  Report thread owning the buffer
+    char    *aname;    //  Name of the output is <aname>.<bname>.las
+    char    *bname;
+  } Run_Buffer;
+
+  //  Find the sort units of the set of run and sort them with nthreads threads
+
+static void Sort_Run(Run_Buffer *run, int nthreads)
+{ if (Find_Las_Units(run->set,0) || Sort_Las_Set(run->set,MAP_ORDER,nthreads))
+    Clean_Exit(1);
+}
+
+  //  Name of spill i of run, or if i < 0, of the merge of all its runs
+
+static char *Run_Name(Run_Buffer *run, int i)
+{ char *name;
+
+  name = Malloc(strlen(SORT_PATH)+strlen(run->aname)+strlen(run->bname)+50,"Allocating run name");
+  if (name == NULL)
+    Clean_Exit(1);
+  if (i < 0)
+    sprintf(name,"%s/%s.%s.N%d.las",SORT_PATH,run->aname,run->bname,run->thread+1);
+  else
+    sprintf(name,"%s/%s.%s.N%d.%d.las",SORT_PATH,run->aname,run->bname,run->thread+1,i+1);
+  return (name);
+}
+
+  //  Sort the set of a run and write it to the next spill file of the run
+
+static void Spill_Run(Run_Buffer *run)
+{ Las_Set    *set = run->set;
+  Las_Writer *out;
+  FILE       *output;
+  char       *name;
+
+  Sort_Run(run,1);
+
+  name   = Run_Name(run,run->nspill);
+  output = Fopen(name,"w");
+  if (output == NULL)
+    Clean_Exit(1);
+  free(name);
+  out = Open_Las_Writer(output,set->novl,MR_tspace,OUT_BLOCK);
+  if (out == NULL || Set_Las_Write_Behind(out))
+    Clean_Exit(1);
+  if (Write_Las_Set(set,out) < 0 || Close_Las_Writer(out) < 0)
+    Clean_Exit(1);
+  fclose(output);
+
+  free(set->perm);
+  set->perm    = NULL;
+  set->size    = 0;
+  set->novl    = 0;
+  run->nspill += 1;
+}
+
+static void Run_Overlap(Run_Buffer *run, Overlap *ovl, int tbytes)
+{ Las_Set *set  = run->set;
+  int64    tlen = ((int64) tbytes) * ovl->path.tlen;
+  int64    need = set->size + LAS_OVL + tlen;
+  char    *p;
+
+  if (need > run->budget && set->novl > 0)
+    { Spill_Run(run);
+      need = LAS_OVL + tlen;
+    }
+  if (need > run->max)
+    { run->max   = 1.2*need + OUT_BLOCK;
+      set->block = (char *) Realloc(set->block-LAS_PTR,run->max+LAS_PTR,"Enlarging run buffer");
+      if (set->block == NULL)
+        Clean_Exit(1);
+      set->block += LAS_PTR;
+    }
+  p = set->block + set->size;
+  memcpy(p,LAS_RECORD(ovl),LAS_OVL);
+  memcpy(p+LAS_OVL,ovl->path.trace,tlen);
+  set->size  = need;
+  set->novl += 1;
+}
+
+  //  Return a reader of all the LAs of run in sorted order: of its set in memory if it was
+  //    never spilled, and otherwise of the merge of its spills and set into SORT_PATH
+
+static Las_Reader *Open_Run(Run_Buffer *run, FILE **input)
+{ Las_Reader **in, *rd;
+  Las_Writer  *out;
+  FILE       **spill, *output;
+  char        *name;
+  int          j;
+
+  Sort_Run(run,NTHREADS);
+
+  *input = NULL;
+  if (run->nspill == 0)
+    { rd = Open_Las_Set_Reader(run->set);
+      if (rd == NULL)
+        Clean_Exit(1);
+      return (rd);
+    }
+
+  in    = (Las_Reader **) Malloc(sizeof(Las_Reader *)*(run->nspill+1),"Allocating run readers");
+  spill = (FILE **) Malloc(sizeof(FILE *)*run->nspill,"Allocating run readers");
+  if (in == NULL || spill == NULL)
+    Clean_Exit(1);
+  for (j = 0; j < run->nspill; j++)
+    { name     = Run_Name(run,j);
+      spill[j] = Fopen(name,"r");
+      if (spill[j] == NULL)
+        Clean_Exit(1);
+      free(name);
+      in[j] = Open_Las_Reader(spill[j],OUT_BLOCK);
+      if (in[j] == NULL)
+        Clean_Exit(1);
+    }
+  in[run->nspill] = Open_Las_Set_Reader(run->set);
+  if (in[run->nspill] == NULL)
+    Clean_Exit(1);
+
+  name   = Run_Name(run,-1);
+  output = Fopen(name,"w");
+  if (output == NULL)
+    Clean_Exit(1);
+  free(name);
+  out = Open_Las_Writer(output,0,MR_tspace,OUT_BLOCK);
+  if (out == NULL || Set_Las_Write_Behind(out))
+    Clean_Exit(1);
+  if (Merge_Las_Runs(in,run->nspill+1,out,MAP_ORDER) < 0 || Close_Las_Writer(out) < 0)
+    Clean_Exit(1);
+  fclose(output);
+
+  for (j = 0; j <= run->nspill; j++)
+    Close_Las_Reader(in[j]);
+  for (j = 0; j < run->nspill; j++)
+    { fclose(spill[j]);
+      name = Run_Name(run,j);
+      unlink(name);
+      free(name);
+    }
+  free(spill);
+  free(in);
+
+  name   = Run_Name(run,-1);
+  *input = Fopen(name,"r");
+  if (*input == NULL)
+    Clean_Exit(1);
+  free(name);
+  rd = Open_Las_Reader(*input,OUT_BLOCK);
+  if (rd == NULL)
+    Clean_Exit(1);
+  return (rd);
+}
+
+  //  Merge the runs of each of the nrun run buffers into the file fname
+
+static int64 Merge_Runs(char *fname, Run_Buffer **runs, int nrun)
+{ Las_Reader **in;
+  Las_Writer  *out;
+  FILE       **input, *output;
+  int64        novl, nspill;
+  int          i;
+
+  in    = (Las_Reader **) Malloc(sizeof(Las_Reader *)*nrun,"Allocating merge readers");
+  input = (FILE **) Malloc(sizeof(FILE *)*nrun,"Allocating merge readers");
+  if (in == NULL || input == NULL)
+    Clean_Exit(1);
+
+  nspill = 0;
+  for (i = 0; i < nrun; i++)
+    { in[i]   = Open_Run(runs[i],input+i);
+      nspill += runs[i]->nspill;
+    }
+
+  output = Fopen(fname,"w");
+  if (output == NULL)
+    Clean_Exit(1);
+  out = Open_Las_Writer(output,0,MR_tspace,OUT_BLOCK);
+  if (out == NULL || Set_Las_Write_Behind(out))
+    Clean_Exit(1);
+  novl = Merge_Las(in,nrun,out,MAP_ORDER);
+  if (novl < 0 || Close_Las_Writer(out) < 0)
+    Clean_Exit(1);
+  fclose(output);
+
+  for (i = 0; i < nrun; i++)
+    { Close_Las_Reader(in[i]);
+      if (input[i] != NULL)
+        { char *name = Run_Name(runs[i],-1);
+
+          fclose(input[i]);
+          unlink(name);
+          free(name);
+        }
+    }
+  free(input);
+  free(in);
+
+  if (VERBOSE)
+    { printf("\n   Wrote ");
+      Print_Number(novl,0,stdout);
+      printf(" LAs to %s",fname);
+      if (nspill > 0)
+        printf(" (merging %lld runs spilled to disk)",nspill);
+      printf("\n");
+      fflush(stdout);
+    }
+
+  return (novl);
+}
+
 typedef struct
   { int64       beg, end;
     int        *score;
     int        *lastp;
     int        *lasta;
     Work_Data  *work;
-    FILE       *ofile1;
-    FILE       *ofile2;
+    Run_Buffer *run1;
+    Run_Buffer *run2;
     int64       nfilt;
     int64       nlas;
+    int64       ntrunc;
 #ifdef PROFILE
     int         profyes[MAXHIT+1];
     int         profno[MAXHIT+1];
@@ -1868,6 +2305,7 @@ static void *report_thread(void *arg)
   DAZZ_READ   *aread  = MR_ablock->reads;
   char        *aseq   = (char *) (MR_ablock->bases);
   char        *bseq   = (char *) (MR_bblock->bases);
+  char        *bcache = MR_bcomp;
   int         *score  = data->score;
   int         *scorp  = data->score + 1;
   int         *scorm  = data->score - 1;
@@ -1875,8 +2313,8 @@ static void *report_thread(void *arg)
   int         *lasta  = data->lasta;
   int          afirst = MR_ablock->tfirst;
   int          bfirst = MR_bblock->tfirst;
-  FILE        *ofile1 = data->ofile1;
-  FILE        *ofile2 = data->ofile2;
+  Run_Buffer  *run1   = data->run1;
+  Run_Buffer  *run2   = data->run2;
   Work_Data   *work   = data->work;
   int          maxdiag = ( MR_ablock->maxlen >> Binshift);
   int          mindiag = (-MR_bblock->maxlen >> Binshift);
@@ -1898,6 +2336,7 @@ static void *report_thread(void *arg)
   Path  *amatch, *bmatch;
 
   Trace_Buffer _tbuf, *tbuf = &_tbuf;
+  Fuse_Index   _fidx, *fidx = &_fidx;
   int          small, tbytes;
 
   Double *hitc;
@@ -1906,16 +2345,21 @@ static void *report_thread(void *arg)
   uint64  npair = 0;
   int64   nidx, eidx;
 
-  int64 nfilt = 0;
-  int64 nlas  = 0;
-  int64 ahits = 0;
-  int64 bhits = 0;
+  int64 nfilt  = 0;
+  int64 nlas   = 0;
+  int64 ntrunc = 0;
 
   //  In ovl and align roles of A and B are reversed, as the B sequence must be the
   //    complemented sequence !!
 
   align->path = apath;
-  bcomp = New_Read_Buffer(MR_bblock);
+  if (bcache == NULL)
+    { bcomp = New_Read_Buffer(MR_bblock);
+      if (bcomp == NULL)
+        Clean_Exit(1);
+    }
+  else
+    bcomp = NULL;
 
   if (MR_tspace <= TRACE_XOVR)
     { small  = 1;
@@ -1933,15 +2377,15 @@ static void *report_thread(void *arg)
   tbuf->max   = 2*TRACE_CHUNK;
   tbuf->trace = Malloc(sizeof(short)*tbuf->max,"Allocating trace vector");
 
-  if (amatch == NULL || bmatch == NULL || tbuf->trace == NULL)
-    Clean_Exit(1);
+  fidx->bmax   = 1024;
+  fidx->bucket = Malloc(sizeof(int)*fidx->bmax,"Allocating fusion index");
+  fidx->nmax   = fidx->ntop = 0;
+  fidx->node   = NULL;
+  fidx->cmax   = 0;
+  fidx->cand   = NULL;
 
-  fwrite(&ahits,sizeof(int64),1,ofile1);
-  fwrite(&MR_tspace,sizeof(int),1,ofile1);
-  if (MR_two)
-    { fwrite(&bhits,sizeof(int64),1,ofile2);
-      fwrite(&MR_tspace,sizeof(int),1,ofile2);
-    }
+  if (amatch == NULL || bmatch == NULL || tbuf->trace == NULL || fidx->bucket == NULL)
+    Clean_Exit(1);
 
 #ifdef PROFILE
   { int i;
@@ -2038,8 +2482,12 @@ static void *report_thread(void *arg)
                         align->aseq = aseq + aread[ar].boff;
                         align->bseq = bseq + bread[br].boff;
                         if (bc)
-                          { CopyAndComp(bcomp,align->bseq,blen);
-                            align->bseq = bcomp;
+                          { if (bcache != NULL)
+                              align->bseq = bcache + bread[br].boff;
+                            else
+                              { CopyAndComp(bcomp,align->bseq,blen);
+                                align->bseq = bcomp;
+                              }
                           }
                         align->alen = alen;
                         align->blen = blen;
@@ -2071,6 +2519,8 @@ static void *report_thread(void *arg)
 
 #ifdef DO_ALIGNMENT
                     bpath = Local_Alignment(align,work,MR_spec,apos-bpos,apos-bpos,apos+bpos,-1,-1);
+                    if (TRUNCATED(align->flags))
+                      ntrunc += 1;
 
                     { int low, hgh, ae;
 
@@ -2194,7 +2644,7 @@ static void *report_thread(void *arg)
              printf("\n%5d vs %5d:\n",ar,br);
 #endif
 
-           novl = Handle_Redundancies(amatch,novl,bmatch,align,work,tbuf);
+           novl = Handle_Redundancies(amatch,novl,bmatch,align,work,tbuf,fidx);
 
            if (doA)
              { for (i = 0; i < novl; i++)
@@ -2202,12 +2652,8 @@ static void *report_thread(void *arg)
                    ovla->path.trace = tbuf->trace + (uint64) (ovla->path.trace);
                    if (small)
                      Compress_TraceTo8(ovla,1);
-                   if (Write_Overlap(ofile1,ovla,tbytes))
-                     { fprintf(stderr,"%s: Cannot write to %s too small?\n",SORT_PATH,Prog_Name);
-                       Clean_Exit(1);
-                     }
+                   Run_Overlap(run1,ovla,tbytes);
                  }
-               ahits += novl;
              }
            if (doB)
              { for (i = 0; i < novl; i++)
@@ -2215,37 +2661,26 @@ static void *report_thread(void *arg)
                    ovlb->path.trace = tbuf->trace + (uint64) (ovlb->path.trace);
                    if (small)
                      Compress_TraceTo8(ovlb,1);
-                   if (Write_Overlap(ofile2,ovlb,tbytes))
-                     { fprintf(stderr,"%s: Cannot write to %s, too small?\n",SORT_PATH,Prog_Name);
-                       Clean_Exit(1);
-                     }
+                   Run_Overlap(run2,ovlb,tbytes);
                  }
-               bhits += novl;
              }
 
            nlas += novl;
          }
       }
 
+  free(fidx->cand);
+  free(fidx->node);
+  free(fidx->bucket);
   free(tbuf->trace);
   free(bmatch);
   free(amatch);
-  free(bcomp-1);
-
-  data->nfilt = nfilt;
-  data->nlas  = nlas;
+  if (bcomp != NULL)
+    free(bcomp-1);
 
-  if (MR_two)
-    { rewind(ofile2);
-      fwrite(&bhits,sizeof(int64),1,ofile2);
-      fclose(ofile2);
-    }
-  else
-    ahits += bhits;
-
-  rewind(ofile1);
-  fwrite(&ahits,sizeof(int64),1,ofile1);
-  fclose(ofile1);
+  data->nfilt  = nfilt;
+  data->nlas   = nlas;
+  data->ntrunc = ntrunc;
 
   return (NULL);
 }
@@ -2283,7 +2718,8 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
   SeedPair *khit, *hhit;
   SeedPair *work1, *work2;
   int64     nhits;
-  int64     nfilt, nlas;
+  int64     nfilt, nlas, ntrunc;
+  int64     ncell, narena;
 
   KmerPos  *asort, *bsort;
   int64     atot, btot;
@@ -2296,7 +2732,8 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 
   MR_tspace = Trace_Spacing(aspec);
 
-  nfilt = nlas = nhits = 0;
+  nfilt = nlas = nhits = ntrunc = 0;
+  ncell = narena = 0;
 
   if (VERBOSE)
     printf("\nComparing %s to %s\n",aname,bname);
@@ -2523,6 +2960,8 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 
   { int  max_diag  = ((ablock->maxlen >> Binshift) - ((-bblock->maxlen) >> Binshift)) + 3;
     int *space;
+    Run_Buffer *runs;
+    int64 hwm, budget;
     int  i;
 
     MR_ablock = ablock;
@@ -2531,6 +2970,42 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
     MR_two    = ! MG_self && SYMMETRIC;
     MR_spec   = aspec;
 
+    //  Complement the B block once for all report threads if asked to, or if it fits
+    //    in what remains of the memory limit at the current high water mark
+
+    { int64 csize;
+
+      if (asort == bsort || nhits*sizeof(SeedPair) >= blen*sizeof(KmerPos))
+        hwm = alen*sizeof(KmerPos) + 2*nhits*sizeof(SeedPair);
+      else
+        hwm = (alen + blen)*sizeof(KmerPos) + nhits*sizeof(SeedPair);
+      hwm  += sizeof_DB(ablock) + sizeof_DB(bblock);
+      csize = bblock->reads[bblock->nreads].boff+1;
+
+      if (COMP_BLOCK || (MEM_LIMIT > 0 && hwm + csize <= (int64) MEM_LIMIT))
+        { MR_bcomp = Complement_Block(bblock);
+          if (VERBOSE)
+            { printf("   Complemented target block once (%.1fMb)\n",csize/1000000.);
+              fflush(stdout);
+            }
+        }
+      else
+        MR_bcomp = NULL;
+
+      //  Each run buffer may use its share of what then remains, but not less than RUN_MIN
+
+      if (MEM_LIMIT == 0)
+        budget = INT64_MAX;
+      else
+        { if (MR_bcomp != NULL)
+            hwm += csize;
+          budget = ((int64) MEM_LIMIT - hwm) / (NTHREADS * (MR_two ? 2 : 1));
+          budget -= budget/5;
+          if (budget < RUN_MIN)
+            budget = RUN_MIN;
+        }
+    }
+
     { int      p, r;
 
       parmr[0].beg = 0;
@@ -2546,8 +3021,9 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
       parmr[NTHREADS-1].end = nhits;
     }
 
-    space = (int *) Malloc(NTHREADS*3*max_diag*sizeof(int),"Allocating space for report thread");
-    if (space == NULL)
+    space   = (int *) Malloc(NTHREADS*3*max_diag*sizeof(int),"Allocating space for report thread");
+    runs    = (Run_Buffer *) Malloc(NTHREADS*2*sizeof(Run_Buffer),"Allocating run buffers");
+    if (space == NULL || runs == NULL)
       Clean_Exit(1);
 
     fname = NameBuffer(aname,bname);
@@ -2563,19 +3039,37 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
         parmr[i].lasta = parmr[i].lastp + max_diag;
         parmr[i].work  = New_Work_Data();
 
-        sprintf(fname,"%s/%s.%s.N%d.las",SORT_PATH,aname,bname,i+1);
-        parmr[i].ofile1 = Fopen(fname,"w");
-        if (parmr[i].ofile1 == NULL)
-          Clean_Exit(1);
-
+        parmr[i].run1 = runs + 2*i;
+        parmr[i].run2 = runs + (2*i+1);
         if (MG_self)
-          parmr[i].ofile2 = parmr[i].ofile1;
-        else if (SYMMETRIC)
-          { sprintf(fname,"%s/%s.%s.N%d.las",SORT_PATH,bname,aname,i+1);
-            parmr[i].ofile2 = Fopen(fname,"w");
-            if (parmr[i].ofile2 == NULL)
-              Clean_Exit(1);
-          }
+          parmr[i].run2 = parmr[i].run1;
+        { int k;
+
+          for (k = 0; k < 2; k++)
+            { Run_Buffer *run = runs + (2*i+k);
+              Las_Set    *set;
+
+              run->max    = OUT_BLOCK;
+              run->set    = set = (Las_Set *) Malloc(sizeof(Las_Set),"Allocating run buffer");
+              if (set == NULL)
+                Clean_Exit(1);
+              set->block  = (char *) Malloc(run->max+LAS_PTR,"Allocating run buffer");
+              if (set->block == NULL)
+                Clean_Exit(1);
+              set->block += LAS_PTR;
+              set->size   = 0;
+              set->novl   = 0;
+              set->tspace = MR_tspace;
+              set->tbytes = Las_Trace_Bytes(MR_tspace);
+              set->nsort  = 0;
+              set->perm   = NULL;
+              run->budget = budget;
+              run->nspill = 0;
+              run->thread = i;
+              run->aname  = (k == 0 ? aname : bname);
+              run->bname  = (k == 0 ? bname : aname);
+            }
+        }
       }
 
 #ifdef NOTHREAD
@@ -2593,12 +3087,47 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 
 #endif
 
+    //  Merge the runs of the threads into <A>.<B>.las, and <B>.<A>.las if symmetric
+
+    { Run_Buffer **rlist;
+
+      rlist = (Run_Buffer **) Malloc(sizeof(Run_Buffer *)*NTHREADS,"Allocating run list");
+      if (rlist == NULL)
+        Clean_Exit(1);
+
+      for (i = 0; i < NTHREADS; i++)
+        rlist[i] = parmr[i].run1;
+      sprintf(fname,"%s.%s.las",aname,bname);
+      Merge_Runs(fname,rlist,NTHREADS);
+
+      if (MR_two)
+        { for (i = 0; i < NTHREADS; i++)
+            rlist[i] = parmr[i].run2;
+          sprintf(fname,"%s.%s.las",bname,aname);
+          Merge_Runs(fname,rlist,NTHREADS);
+        }
+
+      free(rlist);
+      for (i = 0; i < 2*NTHREADS; i++)
+        Free_Las_Set(runs[i].set);
+    }
+
     for (i = 0; i < NTHREADS; i++)
-      { nfilt += parmr[i].nfilt;
-        nlas  += parmr[i].nlas;
+      { Work_Stats wstats;
+
+        nfilt  += parmr[i].nfilt;
+        nlas   += parmr[i].nlas;
+        ntrunc += parmr[i].ntrunc;
+        Work_Data_Stats(parmr[i].work,&wstats);
+        if (wstats.cells > ncell)
+          ncell = wstats.cells;
+        narena += wstats.arena;
         Free_Work_Data(parmr[i].work);
       }
+    free(runs);
     free(space);
+    if (MR_bcomp != NULL)
+      free(MR_bcomp-1);
 
 #ifdef PROFILE
     { int64 nyes, nno;
@@ -2633,24 +3162,25 @@ void Match_Filter(char *aname, DAZZ_DB *ablock, char *bname, DAZZ_DB *bblock,
 
 zerowork:
   { FILE *ofile;
-    int   i;
 
     fname = NameBuffer(aname,bname);
 
-    nhits  = 0;
-    for (i = 0; i < NTHREADS; i++)
-      { sprintf(fname,"%s/%s.%s.N%d.las",SORT_PATH,aname,bname,i+1);
+    nhits = 0;
+    sprintf(fname,"%s.%s.las",aname,bname);
+    ofile = Fopen(fname,"w");
+    if (ofile == NULL)
+      Clean_Exit(1);
+    fwrite(&nhits,sizeof(int64),1,ofile);
+    fwrite(&MR_tspace,sizeof(int),1,ofile);
+    fclose(ofile);
+    if (ablock != bblock && SYMMETRIC)
+      { sprintf(fname,"%s.%s.las",bname,aname);
         ofile = Fopen(fname,"w");
+        if (ofile == NULL)
+          Clean_Exit(1);
         fwrite(&nhits,sizeof(int64),1,ofile);
         fwrite(&MR_tspace,sizeof(int),1,ofile);
         fclose(ofile);
-        if (! MG_self && SYMMETRIC)
-          { sprintf(fname,"%s/%s.%s.N%d.las",SORT_PATH,bname,aname,i+1);
-            ofile = Fopen(fname,"w");
-            fwrite(&nhits,sizeof(int64),1,ofile);
-            fwrite(&MR_tspace,sizeof(int),1,ofile);
-            fclose(ofile);
-          }
       }
   }
 
@@ -2672,6 +3202,18 @@ epilogue:
       printf(" seed hits (%e of matrix)\n     ",(1.*nfilt/atot)/btot);
       Print_Number(nlas,width,stdout);
       printf(" confirmed hits (%e of matrix)\n",(1.*nlas/atot)/btot);
+      if (nlas > 0)
+        { printf("     ");
+          Print_Number(ncell,width,stdout);
+          printf(" trace cells at most per alignment (");
+          Print_Number((narena-1)/1000000+1,0,stdout);
+          printf("MB of cell arenas)\n");
+        }
+      if (ntrunc > 0)
+        { printf("     ");
+          Print_Number(ntrunc,width,stdout);
+          printf(" alignment searches cut short by the work budget\n");
+        }
       fflush(stdout);
     }
 }
@@ -22,6 +22,8 @@ extern int    HGAP_MIN;     //  HGap minimum (-H)
 extern int    SYMMETRIC;    //  output both A vs B and B vs A? ( ! -A)
 extern int    IDENTITY;     //  compare reads against themselves?  (-I)
 extern int    BRIDGE;       //  bridge consecutive, chainable alignments  (-B)
+extern int    COMP_BLOCK;   //  always cache the complement of the target block  (-C)
+extern int    MAP_ORDER;    //  sort LAs by A-read,A-position for the map use case  (-a)
 extern char  *SORT_PATH;    //  where to place temporary files (-P)
 
 extern uint64 MEM_LIMIT;    //  memory limit (-M)
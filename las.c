@@ -0,0 +1,2600 @@
+/*******************************************************************************************
+ *
+ *  .las file library (libdazzlas): buffered readers and writers, and the sort, merge,
+ *    concatenate, and split operations of LAsort, LAmerge, LAcat, and LAsplit.
+ *
+ *  Date  :  October 2026
+ *
+ ********************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "DB.h"
+#include "align.h"
+#include "lsd.sort.h"
+#include "las.h"
+
+#ifdef INTERACTIVE
+#define RETURN_ERROR(x)  return (x)
+#else
+#define RETURN_ERROR(x)  exit (2)
+#endif
+
+#define READ_ERROR(x)								\
+  { EPRINTF(EPLACE,"%s: System error, read failed!\n",Prog_Name);		\
+    RETURN_ERROR(x);								\
+  }
+
+#define WRITE_ERROR(x)								\
+  { EPRINTF(EPLACE,"%s: System error, write failed!\n",Prog_Name);		\
+    RETURN_ERROR(x);								\
+  }
+
+int Las_Trace_Bytes(int tspace)
+{ if (tspace <= TRACE_XOVR && tspace != 0)
+    return (sizeof(uint8));
+  else
+    return (sizeof(uint16));
+}
+
+
+/*******************************************************************************************
+ *
+ *  ASYNCHRONOUS I/O: A pool of IO_THREADS background threads, started on first use, performs
+ *    the reads and writes of I/O jobs queued by readers with read-ahead and writers with
+ *    write-behind, in the order they are queued.  A reader or writer has at most one job
+ *    pending, so the jobs on any one file are never concurrent.
+ *
+ ********************************************************************************************/
+
+#define IO_THREADS 4
+
+typedef struct _Las_Job
+  { struct _Las_Job *next;
+    FILE            *file;
+    char            *data;
+    int64            len;     //  Bytes to read or write
+    int64            done;    //  Bytes read or written, or -1 while the job is pending
+    int              write;
+  } Las_Job;
+
+static pthread_mutex_t Job_Lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  Job_Ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  Job_Done  = PTHREAD_COND_INITIALIZER;
+static pthread_once_t  Job_Once  = PTHREAD_ONCE_INIT;
+
+static Las_Job *Job_First = NULL;
+static Las_Job *Job_Last  = NULL;
+
+static void *io_thread(void *arg)
+{ Las_Job *job;
+  int64    done;
+
+  (void) arg;
+  pthread_mutex_lock(&Job_Lock);
+  while (1)
+    { while (Job_First == NULL)
+        pthread_cond_wait(&Job_Ready,&Job_Lock);
+      job = Job_First;
+      Job_First = job->next;
+      if (Job_First == NULL)
+        Job_Last = NULL;
+      pthread_mutex_unlock(&Job_Lock);
+
+      if (job->write)
+        done = fwrite(job->data,1,job->len,job->file);
+      else
+        done = fread(job->data,1,job->len,job->file);
+
+      pthread_mutex_lock(&Job_Lock);
+      job->done = done;
+      pthread_cond_broadcast(&Job_Done);
+    }
+  return (NULL);
+}
+
+static void io_start()
+{ pthread_t thread;
+  int       i;
+
+  for (i = 0; i < IO_THREADS; i++)
+    { pthread_create(&thread,NULL,io_thread,NULL);
+      pthread_detach(thread);
+    }
+}
+
+static void job_post(Las_Job *job, FILE *file, char *data, int64 len, int write)
+{ pthread_once(&Job_Once,io_start);
+
+  job->file  = file;
+  job->data  = data;
+  job->len   = len;
+  job->write = write;
+  job->done  = -1;
+  job->next  = NULL;
+
+  pthread_mutex_lock(&Job_Lock);
+  if (Job_Last == NULL)
+    Job_First = job;
+  else
+    Job_Last->next = job;
+  Job_Last = job;
+  pthread_cond_signal(&Job_Ready);
+  pthread_mutex_unlock(&Job_Lock);
+}
+
+  //  Wait for 'job' to finish and return the number of bytes it read or wrote
+
+static int64 job_wait(Las_Job *job)
+{ int64 done;
+
+  pthread_mutex_lock(&Job_Lock);
+  while (job->done < 0)
+    pthread_cond_wait(&Job_Done,&Job_Lock);
+  done = job->done;
+  pthread_mutex_unlock(&Job_Lock);
+  return (done);
+}
+
+  //  Read-ahead state of a reader: while the reader consumes one buffer the other is filled.
+  //    Each buffer has 'room' bytes before its data area (and LAS_PTR before that) in which
+  //    to place the unread tail of the previous buffer.
+
+typedef struct
+  { char    *buf[2];    //  Allocated buffers
+    int64    room[2];
+    int      cur;       //  buf[cur] is being consumed, buf[1-cur] is being filled by job
+    int      pending;
+    int      eof;
+    Las_Job  job;
+  } Read_Ahead;
+
+#define AHEAD_DATA(a,i)  ((a)->buf[i] + LAS_PTR + (a)->room[i])
+
+  //  Write-behind state of a writer: while one buffer is written the other is filled
+
+typedef struct
+  { char    *buf[2];
+    int      cur;       //  buf[cur] is being filled, buf[1-cur] is being written by job
+    int      pending;
+    Las_Job  job;
+  } Write_Behind;
+
+
+/*******************************************************************************************
+ *
+ *  PACKED BLOCKS: The LAs of a packed (v2) .las follow its header in blocks that can each
+ *    be decoded on its own.  A block is a header of three ints, the number of LAs and the
+ *    number of bytes they take unpacked and packed, followed by the packed LAs.  Each LA
+ *    is a sequence of varints: its a-read less that of the LA before it in the block, its
+ *    b-read less that of the LA before it if their a-reads are the same, its flags, abpos,
+ *    aepos-abpos, bbpos, bepos-bbpos, diffs, and tlen, and then its trace values, each
+ *    b-displacement less the trace spacing.  Every signed quantity is zig-zag coded.  The
+ *    bytes of the varints are then Huffman coded, the packed LAs being a byte 1, the number
+ *    of varint bytes, the 4-bit code lengths of the 256 byte values, and the codes, or if
+ *    that is no smaller, a byte 0 followed by the varint bytes.  A block header of zeros
+ *    ends the blocks, and is followed by a footer, a Pack_Block for each block, and then
+ *    by a Pack_Trailer that locates the footer.
+ *
+ ********************************************************************************************/
+
+#define PACK_BLOCK  1000000                        //  Target unpacked bytes of a block
+#define PACK_HEAD   ((int64) (3*sizeof(int)))      //  Bytes in a block header
+
+#define ZIG(x)  ((((uint32) (x)) << 1) ^ ((uint32) (((int) (x)) >> 31)))
+#define ZAG(u)  ((int) (((u) >> 1) ^ (-((u) & 1))))
+
+typedef struct
+  { int64  offset;   //  File offset of the block
+    int64  count;    //  # of LAs before the block
+    int    aread;    //  A-read of its first LA
+    int    nla;      //  # of LAs in the block
+  } Pack_Block;
+
+typedef struct
+  { int64  nblock;   //  # of blocks
+    int64  footer;   //  File offset of the footer
+    int    sorted;   //  The LAs are sorted on a-read
+    int    alast;    //  The greatest a-read of any LA
+  } Pack_Trailer;
+
+static inline uint8 *put_var(uint8 *p, uint32 v)
+{ while (v >= 0x80)
+    { *p++ = (uint8) (v | 0x80);
+      v >>= 7;
+    }
+  *p++ = (uint8) v;
+  return (p);
+}
+
+  //  Get the varint at p into v, returning the byte after it, or NULL if it overruns end
+
+static inline uint8 *get_var(uint8 *p, uint8 *end, uint32 *v)
+{ uint32 x;
+  int    s;
+
+  x = 0;
+  for (s = 0; s < 35 && p < end; s += 7)
+    { x |= ((uint32) (*p & 0x7f)) << s;
+      if (*p++ < 0x80)
+        { *v = x;
+          return (p);
+        }
+    }
+  return (NULL);
+}
+
+  //  Pack the nla LAs in raw[0..rlen-1] into pack, returning the number of bytes packed.
+  //    No more than 3*rlen bytes are ever needed.
+
+static int64 pack_block(char *raw, int64 rlen, int nla, int tspace, int tbytes, uint8 *pack)
+{ uint8   *p;
+  char    *r;
+  Overlap *o;
+  int      i, k, tlen;
+  int      aread, bread;
+
+  p = pack;
+  r = raw;
+  aread = bread = 0;
+  for (i = 0; i < nla; i++)
+    { o = (Overlap *) (r - LAS_PTR);
+      if (o->aread != aread)
+        bread = 0;
+      p = put_var(p,ZIG(o->aread - aread));
+      p = put_var(p,ZIG(o->bread - bread));
+      aread = o->aread;
+      bread = o->bread;
+      p = put_var(p,o->flags);
+      p = put_var(p,ZIG(o->path.abpos));
+      p = put_var(p,ZIG(o->path.aepos - o->path.abpos));
+      p = put_var(p,ZIG(o->path.bbpos));
+      p = put_var(p,ZIG(o->path.bepos - o->path.bbpos));
+      p = put_var(p,ZIG(o->path.diffs));
+      p = put_var(p,ZIG(o->path.tlen));
+
+      tlen = o->path.tlen;
+      if (tbytes == 1)
+        { uint8 *t = (uint8 *) LAS_TRACE(o);
+
+          for (k = 0; k < tlen; k += 2)
+            { p = put_var(p,t[k]);
+              if (k+1 < tlen)
+                p = put_var(p,ZIG(t[k+1] - tspace));
+            }
+        }
+      else
+        { uint16 *t = (uint16 *) LAS_TRACE(o);
+
+          for (k = 0; k < tlen; k += 2)
+            { p = put_var(p,t[k]);
+              if (k+1 < tlen)
+                p = put_var(p,ZIG(t[k+1] - tspace));
+            }
+        }
+      r += LAS_SPAN(o,tbytes);
+    }
+  (void) rlen;
+  return (p - pack);
+}
+
+  //  Unpack the nla LAs of the clen bytes at pack into the rlen bytes of raw, returning
+  //    non-zero if they do not fit exactly
+
+#define GET(x)                              \
+  { if ((p = get_var(p,end,&u)) == NULL)    \
+      return (1);                           \
+    x = u;                                  \
+  }
+
+static int unpack_block(uint8 *pack, int64 clen, int nla, int tspace, int tbytes,
+                        char *raw, int64 rlen)
+{ uint8   *p, *end;
+  char    *r, *rend;
+  Overlap *o;
+  uint32   u;
+  int      i, k, tlen;
+  int      aread, bread;
+
+  p    = pack;
+  end  = pack + clen;
+  r    = raw;
+  rend = raw + rlen;
+  aread = bread = 0;
+  for (i = 0; i < nla; i++)
+    { if (rend - r < LAS_OVL)
+        return (1);
+      o = (Overlap *) (r - LAS_PTR);
+      memset(r,0,LAS_OVL);
+
+      GET(u)
+      if (u != 0)
+        { aread += ZAG(u);
+          bread  = 0;
+        }
+      GET(u)
+      bread   += ZAG(u);
+      o->aread = aread;
+      o->bread = bread;
+      GET(o->flags)
+      GET(u) o->path.abpos = ZAG(u);
+      GET(u) o->path.aepos = o->path.abpos + ZAG(u);
+      GET(u) o->path.bbpos = ZAG(u);
+      GET(u) o->path.bepos = o->path.bbpos + ZAG(u);
+      GET(u) o->path.diffs = ZAG(u);
+      GET(u) o->path.tlen  = tlen = ZAG(u);
+
+      if (tlen < 0 || rend - r < LAS_SPAN(o,tbytes))
+        return (1);
+      if (tbytes == 1)
+        { uint8 *t = (uint8 *) LAS_TRACE(o);
+
+          for (k = 0; k < tlen; k += 2)
+            { GET(t[k])
+              if (k+1 < tlen)
+                { GET(u) t[k+1] = ZAG(u) + tspace; }
+            }
+        }
+      else
+        { uint16 *t = (uint16 *) LAS_TRACE(o);
+
+          for (k = 0; k < tlen; k += 2)
+            { GET(t[k])
+              if (k+1 < tlen)
+                { GET(u) t[k+1] = ZAG(u) + tspace; }
+            }
+        }
+      r += LAS_SPAN(o,tbytes);
+    }
+  return (p != end || r != rend);
+}
+
+  //  Huffman coding of the varint bytes of a block, with codes of at most HUFF_MAX bits
+
+#define HUFF_MAX    12
+#define HUFF_MASK   ((1 << HUFF_MAX) - 1)
+#define HUFF_HEAD   ((int64) (1 + sizeof(int) + 128))   //  Bytes before the codes
+
+  //  Set len[s] to the length of the Huffman code of byte s given counts hist, halving the
+  //    counts until no code is longer than HUFF_MAX
+
+static void huff_lengths(int64 *hist, uint8 *len)
+{ int64 weight[512], h[256];
+  int   parent[512], live[256];
+  int   i, k, a, b, n, nlive, depth, max;
+
+  for (i = 0; i < 256; i++)
+    h[i] = hist[i];
+  while (1)
+    { nlive = 0;
+      for (i = 0; i < 256; i++)
+        { weight[i] = h[i];
+          parent[i] = -1;
+          if (h[i] > 0)
+            live[nlive++] = i;
+        }
+      if (nlive <= 1)
+        { memset(len,0,256);
+          if (nlive == 1)
+            len[live[0]] = 1;
+          return;
+        }
+
+      for (n = 256; nlive > 1; n++)
+        { a = 0;
+          b = 1;
+          if (weight[live[b]] < weight[live[a]])
+            { a = 1;
+              b = 0;
+            }
+          for (k = 2; k < nlive; k++)
+            if (weight[live[k]] < weight[live[a]])
+              { b = a;
+                a = k;
+              }
+            else if (weight[live[k]] < weight[live[b]])
+              b = k;
+          weight[n] = weight[live[a]] + weight[live[b]];
+          parent[n] = -1;
+          parent[live[a]] = parent[live[b]] = n;
+          live[a] = n;
+          live[b] = live[--nlive];
+        }
+
+      max = 0;
+      for (i = 0; i < 256; i++)
+        { depth = 0;
+          if (h[i] > 0)
+            for (k = i; parent[k] >= 0; k = parent[k])
+              depth += 1;
+          len[i] = depth;
+          if (depth > max)
+            max = depth;
+        }
+      if (max <= HUFF_MAX)
+        return;
+      for (i = 0; i < 256; i++)
+        if (h[i] > 0)
+          h[i] = (h[i] >> 1) | 1;
+    }
+}
+
+  //  Set code[s] to the canonical code of length len[s], bit reversed so that the codes can
+  //    be emitted and decoded least significant bit first
+
+static void huff_codes(uint8 *len, uint32 *code)
+{ int    count[HUFF_MAX+1], next[HUFF_MAX+1];
+  int    i, l, c, r;
+
+  for (l = 0; l <= HUFF_MAX; l++)
+    count[l] = 0;
+  for (i = 0; i < 256; i++)
+    count[len[i]] += 1;
+  count[0] = 0;
+  c = 0;
+  for (l = 1; l <= HUFF_MAX; l++)
+    { c = (c + count[l-1]) << 1;
+      next[l] = c;
+    }
+  for (i = 0; i < 256; i++)
+    { code[i] = 0;
+      if (len[i] == 0)
+        continue;
+      c = next[len[i]]++;
+      r = 0;
+      for (l = 0; l < len[i]; l++)
+        r |= ((c >> l) & 1) << (len[i]-1-l);
+      code[i] = r;
+    }
+}
+
+  //  Huffman code the vlen bytes of var into out, returning the number of bytes output, which
+  //    is never more than vlen+1
+
+static int64 huff_pack(uint8 *var, int64 vlen, uint8 *out)
+{ int64  hist[256], bits;
+  uint8  len[256];
+  uint32 code[256];
+  uint64 acc;
+  uint8 *p;
+  int    i, n, nbits;
+
+  memset(hist,0,sizeof(hist));
+  for (i = 0; i < vlen; i++)
+    hist[var[i]] += 1;
+  huff_lengths(hist,len);
+  bits = 0;
+  for (i = 0; i < 256; i++)
+    bits += hist[i]*len[i];
+
+  if (HUFF_HEAD + (bits+7)/8 >= vlen+1)
+    { out[0] = 0;
+      memcpy(out+1,var,vlen);
+      return (vlen+1);
+    }
+
+  huff_codes(len,code);
+  n = vlen;
+  out[0] = 1;
+  memcpy(out+1,&n,sizeof(int));
+  for (i = 0; i < 128; i++)
+    out[1+sizeof(int)+i] = (uint8) (len[2*i] | (len[2*i+1] << 4));
+
+  p     = out + HUFF_HEAD;
+  acc   = 0;
+  nbits = 0;
+  for (i = 0; i < vlen; i++)
+    { acc   |= ((uint64) code[var[i]]) << nbits;
+      nbits += len[var[i]];
+      while (nbits >= 8)
+        { *p++ = (uint8) acc;
+          acc >>= 8;
+          nbits -= 8;
+        }
+    }
+  if (nbits > 0)
+    *p++ = (uint8) acc;
+  return (p - out);
+}
+
+  //  Return the varint bytes of the clen packed bytes at pack, setting *vlen to their number,
+  //    and decoding them if need be into the buffer *var of *vmax bytes, enlarged as needed.
+  //    NULL is returned if the codes are corrupt.
+
+static uint8 *huff_unpack(uint8 *pack, int64 clen, uint8 **var, int64 *vmax, int64 *vlen)
+{ uint16  table[HUFF_MASK+1];
+  uint8   len[256];
+  uint32  code[256];
+  uint64  acc;
+  uint8  *p, *end, *v;
+  int64   i, pad;
+  int     n, k, e, nbits;
+
+  if (clen < 1)
+    return (NULL);
+  if (pack[0] == 0)
+    { *vlen = clen-1;
+      return (pack+1);
+    }
+  if (pack[0] != 1 || clen < HUFF_HEAD)
+    return (NULL);
+
+  memcpy(&n,pack+1,sizeof(int));
+  if (n < 0)
+    return (NULL);
+  for (i = 0; i < 128; i++)
+    { len[2*i]   = pack[1+sizeof(int)+i] & 0xf;
+      len[2*i+1] = pack[1+sizeof(int)+i] >> 4;
+      if (len[2*i] > HUFF_MAX || len[2*i+1] > HUFF_MAX)
+        return (NULL);
+    }
+  huff_codes(len,code);
+  memset(table,0,sizeof(table));
+  for (i = 0; i < 256; i++)
+    if (len[i] > 0)
+      for (k = code[i]; k <= HUFF_MASK; k += (1 << len[i]))
+        table[k] = (uint16) (i | (len[i] << 8));
+
+  if (n > *vmax)
+    { *vmax = 1.2*n + 1000;
+      *var  = (uint8 *) Realloc(*var,*vmax,"Enlarging .las unpacking buffer");
+      if (*var == NULL)
+        return (NULL);
+    }
+
+  v     = *var;
+  p     = pack + HUFF_HEAD;
+  end   = pack + clen;
+  acc   = 0;
+  nbits = 0;
+  pad   = 0;
+  for (i = 0; i < n; i++)
+    { while (nbits <= 56)
+        { if (p < end)
+            acc |= ((uint64) *p++) << nbits;
+          else
+            pad += 8;
+          nbits += 8;
+        }
+      e = table[acc & HUFF_MASK];
+      if ((e >> 8) == 0)
+        return (NULL);
+      v[i]    = (uint8) e;
+      acc   >>= (e >> 8);
+      nbits  -= (e >> 8);
+    }
+  if (p != end || pad > nbits || nbits - pad >= 8)
+    return (NULL);
+  *vlen = n;
+  return (v);
+}
+
+  //  Packing state of a writer of a packed .las
+
+typedef struct
+  { uint8      *buf;      //  Varint bytes of the current block ...
+    uint8      *hbuf;     //    and their Huffman coding
+    int64       bmax;
+    int64       fpos;     //  # of bytes written so far
+    int64       count;    //  # of LAs before the current block
+    Pack_Block *blk;      //  The blocks written so far
+    int64       nblk, mblk;
+    int         sorted;
+    int         alast;
+  } Pack_Writer;
+
+  //  Unpacking state of a reader of a packed .las
+
+typedef struct
+  { char   *raw;     //  Buffer of unpacked LAs (LAS_PTR bytes before block)
+    int64   rmax;
+    uint8  *buf;     //  Packed bytes of a block read from a file
+    int64   bmax;
+    uint8  *var;     //  Varint bytes of a block once Huffman decoded
+    int64   vmax;
+    char   *image;   //  A memory image: image[0..size-1], the next block at image[next]
+    int64   size;
+    int64   next;
+    int     done;    //  The block of no LAs ending them has been seen
+  } Pack_Reader;
+
+
+/*******************************************************************************************
+ *
+ *  READERS
+ *
+ ********************************************************************************************/
+
+  //  State of a reader of a sorted set
+
+typedef struct
+  { Las_Set *set;
+    char    *end;    //  View of the LA after the last of the set
+    int64    unit;   //  Sort unit of cur
+    Overlap *cur;    //  Next LA to be read (NULL if none)
+  } Set_Reader;
+
+static void set_advance(Set_Reader *s);
+
+static Las_Reader *new_reader(int64 novl, int tspace)
+{ Las_Reader *in;
+
+  in = (Las_Reader *) Malloc(sizeof(Las_Reader),"Allocating .las reader");
+  if (in == NULL)
+    EXIT(NULL);
+  in->novl   = novl;
+  in->nread  = 0;
+  in->tspace = tspace;
+  in->tbytes = Las_Trace_Bytes(tspace);
+  in->ahead  = NULL;
+  in->msize  = 0;
+  in->offset = NULL;
+  in->pack   = NULL;
+  in->sort   = NULL;
+  return (in);
+}
+
+int Las_Header(FILE *input, int64 *novl, int *tspace)
+{ int64 first;
+  int   version;
+
+  if (fread(&first,sizeof(int64),1,input) != 1)
+    READ_ERROR(-1)
+  if (first == LAS_PACKED)
+    { if (fread(novl,sizeof(int64),1,input) != 1)
+        READ_ERROR(-1)
+      version = 2;
+    }
+  else
+    { *novl   = first;
+      version = 1;
+    }
+  if (fread(tspace,sizeof(int),1,input) != 1)
+    READ_ERROR(-1)
+  return (version);
+}
+
+  //  Return a reader of the packed .las open on input, or if input is NULL, of the packed
+  //    image[0..size-1], whose header has been read
+
+static Las_Reader *open_packed(FILE *input, char *image, int64 size, int64 novl, int tspace)
+{ Las_Reader  *in;
+  Pack_Reader *p;
+
+  in = new_reader(novl,tspace);
+  p  = (Pack_Reader *) Malloc(sizeof(Pack_Reader),"Allocating .las reader");
+  if (in == NULL || p == NULL)
+    EXIT(NULL);
+  p->rmax = PACK_BLOCK;
+  p->raw  = (char *) Malloc(p->rmax+LAS_PTR,"Allocating .las reader buffer");
+  if (p->raw == NULL)
+    EXIT(NULL);
+  p->buf   = NULL;
+  p->bmax  = 0;
+  p->var   = NULL;
+  p->vmax  = 0;
+  p->image = image;
+  p->size  = size;
+  p->next  = LAS_PACK_HEADER;
+  p->done  = 0;
+
+  in->input = input;
+  in->bsize = 0;
+  in->block = p->raw + LAS_PTR;
+  in->ptr   = in->block;
+  in->top   = in->block;
+  in->pack  = p;
+  return (in);
+}
+
+Las_Reader *Open_Las_Reader(FILE *input, int64 bsize)
+{ int64 novl;
+  int   tspace;
+
+  switch (Las_Header(input,&novl,&tspace))
+  { case 1:
+      return (Open_Las_Segment_Reader(input,novl,tspace,bsize));
+    case 2:
+      return (open_packed(input,NULL,0,novl,tspace));
+    default:
+      EXIT(NULL);
+  }
+}
+
+Las_Reader *Open_Las_Segment_Reader(FILE *input, int64 novl, int tspace, int64 bsize)
+{ Las_Reader *in;
+
+  in = new_reader(novl,tspace);
+  if (in == NULL)
+    EXIT(NULL);
+
+  if (bsize < 2*LAS_OVL)
+    bsize = 2*LAS_OVL;
+  in->input = input;
+  in->bsize = bsize;
+  in->block = (char *) Malloc(bsize+LAS_PTR,"Allocating .las reader buffer");
+  if (in->block == NULL)
+    { free(in);
+      EXIT(NULL);
+    }
+  in->block += LAS_PTR;
+  in->ptr    = in->block;
+  in->top    = in->block;
+  return (in);
+}
+
+Las_Reader *Open_Las_Memory(void *data, int64 size)
+{ Las_Reader *in;
+  int64       novl;
+  int         tspace;
+  int64       hsize = sizeof(int64) + sizeof(int);
+
+  if (size < hsize)
+    { EPRINTF(EPLACE,"%s: .las image is too short to have a header\n",Prog_Name);
+      EXIT(NULL);
+    }
+  memcpy(&novl,data,sizeof(int64));
+  memcpy(&tspace,((char *) data) + sizeof(int64),sizeof(int));
+  if (novl == LAS_PACKED)
+    { if (size < LAS_PACK_HEADER)
+        { EPRINTF(EPLACE,"%s: .las image is too short to have a header\n",Prog_Name);
+          EXIT(NULL);
+        }
+      memcpy(&novl,((char *) data) + sizeof(int64),sizeof(int64));
+      memcpy(&tspace,((char *) data) + 2*sizeof(int64),sizeof(int));
+      return (open_packed(NULL,(char *) data,size,novl,tspace));
+    }
+
+  in = new_reader(novl,tspace);
+  if (in == NULL)
+    EXIT(NULL);
+
+  in->input = NULL;     //  hsize >= LAS_PTR, so the view of the first record is valid
+  in->bsize = 0;
+  in->block = ((char *) data) + hsize;
+  in->ptr   = in->block;
+  in->top   = ((char *) data) + size;
+  return (in);
+}
+
+Las_Reader *Open_Las_Map(FILE *input, int huge)
+{ Las_Reader *in;
+  struct stat info;
+  char       *map;
+
+  if (fstat(fileno(input),&info) != 0 || ! S_ISREG(info.st_mode) || info.st_size < LAS_HEADER)
+    return (NULL);
+  map = (char *) mmap(NULL,info.st_size,PROT_READ,MAP_SHARED,fileno(input),0);
+  if (map == MAP_FAILED)
+    return (NULL);
+
+  madvise(map,info.st_size,MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  if (huge)
+    madvise(map,info.st_size,MADV_HUGEPAGE);
+#else
+  (void) huge;
+#endif
+
+  in = Open_Las_Memory(map,info.st_size);
+  if (in == NULL)
+    { munmap(map,info.st_size);
+      EXIT(NULL);
+    }
+  in->msize = info.st_size;
+  return (in);
+}
+
+int Set_Las_Offsets(Las_Reader *in)
+{ int64 *offset;
+  char  *rec;
+  int64  j;
+
+  if (in->offset != NULL)
+    return (0);
+  if (in->input != NULL || in->pack != NULL || in->sort != NULL)
+    { EPRINTF(EPLACE,"%s: Random access needs a memory or mapped unpacked .las reader\n",
+                     Prog_Name);
+      EXIT(1);
+    }
+
+  offset = (int64 *) Malloc(sizeof(int64)*(in->novl+1),"Allocating .las offsets");
+  if (offset == NULL)
+    EXIT(1);
+  rec = in->block;
+  for (j = 0; j < in->novl; j++)
+    { offset[j] = rec - in->block;
+      if (in->top - rec < LAS_OVL)
+        break;
+      rec += LAS_SPAN((Overlap *) (rec - LAS_PTR),in->tbytes);
+      if (rec > in->top)
+        break;
+    }
+  if (j < in->novl)
+    { free(offset);
+      EPRINTF(EPLACE,"%s: .las file holds fewer LAs than its header says (%lld)\n",
+                     Prog_Name,in->novl);
+      EXIT(1);
+    }
+  offset[j] = rec - in->block;
+  in->offset = offset;
+  return (0);
+}
+
+Overlap *Las_Record(Las_Reader *in, int64 j)
+{ if (in->offset == NULL || j < 0 || j >= in->novl)
+    return (NULL);
+  return ((Overlap *) (in->block + in->offset[j] - LAS_PTR));
+}
+
+int Las_Goto(Las_Reader *in, int64 offset, int64 count)
+{ Pack_Reader *p = (Pack_Reader *) in->pack;
+
+  if (in->sort != NULL)
+    { EPRINTF(EPLACE,"%s: Cannot reposition a reader of a sorted set\n",Prog_Name);
+      EXIT(1);
+    }
+  if (offset == 0)
+    offset = (p != NULL ? LAS_PACK_HEADER : LAS_HEADER);
+  if (p != NULL)
+    { if (p->image != NULL)
+        p->next = offset;
+      else if (fseeko(in->input,offset,SEEK_SET) != 0)
+        READ_ERROR(1)
+      p->done = 0;
+      in->ptr = in->top = in->block;
+    }
+  else if (in->input == NULL)
+    in->ptr = in->block + (offset - LAS_HEADER);
+  else
+    { if (in->ahead != NULL)
+        { EPRINTF(EPLACE,"%s: Cannot reposition a .las reader with read-ahead\n",Prog_Name);
+          EXIT(1);
+        }
+      if (fseeko(in->input,offset,SEEK_SET) != 0)
+        READ_ERROR(1)
+      in->ptr = in->top = in->block;
+    }
+  in->nread = count;
+  return (0);
+}
+
+  //  Ensure at least need bytes of input lie in block[ptr..top-1], returning the number
+  //    that actually do
+
+static int64 ahead_fill(Las_Reader *in, int64 need);
+static int64 pack_fill(Las_Reader *in, int64 need);
+
+static int64 reader_fill(Las_Reader *in, int64 need)
+{ int64 remains;
+
+  if (in->pack != NULL)
+    return (pack_fill(in,need));
+  remains = in->top - in->ptr;
+  if (remains >= need || in->input == NULL)
+    return (remains);
+  if (in->ahead != NULL)
+    return (ahead_fill(in,need));
+
+  if (remains > 0)
+    memmove(in->block,in->ptr,remains);
+  if (need > in->bsize)
+    { char *block;
+
+      in->bsize = 1.2*need + 1000;
+      block = (char *) Realloc(in->block-LAS_PTR,in->bsize+LAS_PTR,
+                               "Enlarging .las reader buffer");
+      if (block == NULL)
+        EXIT(-1);
+      in->block = block + LAS_PTR;
+    }
+  in->ptr  = in->block;
+  in->top  = in->block + remains;
+  in->top += fread(in->top,1,in->bsize-remains,in->input);
+  return (in->top - in->ptr);
+}
+
+  //  As reader_fill for a reader with read-ahead: switch to the buffer being filled, placing
+  //    the unread bytes of the current one just before its data, until need bytes are
+  //    available or the input is exhausted
+
+static int64 ahead_fill(Las_Reader *in, int64 need)
+{ Read_Ahead *a = (Read_Ahead *) in->ahead;
+  int64       remains, got, room;
+  char       *data, *buf;
+  int         nxt;
+
+  while ((remains = in->top - in->ptr) < need && a->pending)
+    { got = job_wait(&a->job);
+      a->pending = 0;
+      if (got < a->job.len)
+        { if (ferror(in->input))
+            READ_ERROR(-1)
+          a->eof = 1;
+        }
+
+      nxt = 1 - a->cur;
+      if (remains > a->room[nxt])
+        { room = 2*remains;
+          buf  = (char *) Malloc(LAS_PTR+room+in->bsize,"Enlarging .las reader buffer");
+          if (buf == NULL)
+            EXIT(-1);
+          memcpy(buf+LAS_PTR+room,AHEAD_DATA(a,nxt),got);
+          free(a->buf[nxt]);
+          a->buf[nxt]  = buf;
+          a->room[nxt] = room;
+        }
+      data = AHEAD_DATA(a,nxt);
+      memcpy(data-remains,in->ptr,remains);
+      in->block = data;
+      in->ptr   = data - remains;
+      in->top   = data + got;
+      a->cur    = nxt;
+
+      if ( ! a->eof)
+        { job_post(&a->job,in->input,AHEAD_DATA(a,1-nxt),in->bsize,0);
+          a->pending = 1;
+        }
+    }
+  return (remains);
+}
+
+  //  As reader_fill for a reader of a packed .las: unpack the next block after the unread
+  //    bytes of the current one until need bytes are available or the blocks are exhausted.
+  //    A file cut short simply ends, so that Las_Peek reports it as such.
+
+static int64 pack_fill(Las_Reader *in, int64 need)
+{ Pack_Reader *p = (Pack_Reader *) in->pack;
+  int64        remains;
+  int64        vlen;
+  int          head[3];
+  uint8       *pack, *var;
+  char        *raw;
+
+  remains = in->top - in->ptr;
+  while (remains < need && ! p->done)
+    { if (p->image != NULL)
+        { if (p->size - p->next < PACK_HEAD)
+            break;
+          memcpy(head,p->image + p->next,PACK_HEAD);
+          p->next += PACK_HEAD;
+        }
+      else if (fread(head,sizeof(int),3,in->input) != 3)
+        { if (ferror(in->input))
+            READ_ERROR(-1)
+          break;
+        }
+      if (head[0] == 0)
+        { p->done = 1;
+          break;
+        }
+      if (head[0] < 0 || head[1] < LAS_OVL || head[2] < 0)
+        goto corrupt;
+
+      if (p->image != NULL)
+        { if (p->size - p->next < head[2])
+            break;
+          pack = (uint8 *) (p->image + p->next);
+          p->next += head[2];
+        }
+      else
+        { if (head[2] > p->bmax)
+            { p->bmax = 1.2*head[2] + 1000;
+              p->buf  = (uint8 *) Realloc(p->buf,p->bmax,"Enlarging .las reader buffer");
+              if (p->buf == NULL)
+                EXIT(-1);
+            }
+          if (fread(p->buf,1,head[2],in->input) != (size_t) head[2])
+            { if (ferror(in->input))
+                READ_ERROR(-1)
+              break;
+            }
+          pack = p->buf;
+        }
+
+      if (remains + head[1] > p->rmax)
+        { p->rmax = 1.2*(remains + head[1]) + 1000;
+          raw = (char *) Malloc(p->rmax+LAS_PTR,"Enlarging .las reader buffer");
+          if (raw == NULL)
+            EXIT(-1);
+          memcpy(raw+LAS_PTR,in->ptr,remains);
+          free(p->raw);
+          p->raw = raw;
+        }
+      else
+        memmove(p->raw+LAS_PTR,in->ptr,remains);
+      in->block = p->raw + LAS_PTR;
+      in->ptr   = in->block;
+      var = huff_unpack(pack,head[2],&p->var,&p->vmax,&vlen);
+      if (var == NULL)
+        goto corrupt;
+      if (unpack_block(var,vlen,head[0],in->tspace,in->tbytes,in->block+remains,head[1]))
+        goto corrupt;
+      remains += head[1];
+      in->top  = in->block + remains;
+    }
+  return (remains);
+
+corrupt:
+  EPRINTF(EPLACE,"%s: Block of packed .las is corrupt\n",Prog_Name);
+  EXIT(-1);
+}
+
+int64 Las_Available(Las_Reader *in, int64 need)
+{ return (reader_fill(in,need)); }
+
+int Set_Las_Read_Ahead(Las_Reader *in)
+{ Read_Ahead *a;
+  int64       remains;
+
+  if (in->input == NULL || in->ahead != NULL || in->pack != NULL)
+    return (0);
+
+  a = (Read_Ahead *) Malloc(sizeof(Read_Ahead),"Allocating .las read-ahead");
+  if (a == NULL)
+    EXIT(1);
+  remains    = in->top - in->ptr;
+  a->room[0] = in->bsize/8 + 2*LAS_OVL;
+  a->room[1] = a->room[0];
+  a->buf[0]  = (char *) Malloc(LAS_PTR+a->room[0]+in->bsize,"Allocating .las read-ahead");
+  a->buf[1]  = (char *) Malloc(LAS_PTR+a->room[1]+in->bsize,"Allocating .las read-ahead");
+  if (a->buf[0] == NULL || a->buf[1] == NULL)
+    EXIT(1);
+
+  memcpy(AHEAD_DATA(a,0),in->ptr,remains);
+  free(in->block-LAS_PTR);
+  in->block = AHEAD_DATA(a,0);
+  in->ptr   = in->block;
+  in->top   = in->block + remains;
+  in->ahead = a;
+
+  a->cur     = 0;
+  a->eof     = 0;
+  a->pending = 1;
+  job_post(&a->job,in->input,AHEAD_DATA(a,1),in->bsize,0);
+  return (0);
+}
+
+Overlap *Las_Peek(Las_Reader *in)
+{ Overlap *ovl;
+  int64    span;
+
+  if (in->nread >= in->novl)
+    return (NULL);
+  if (in->sort != NULL)
+    return (((Set_Reader *) in->sort)->cur);
+
+  if (reader_fill(in,LAS_OVL) < LAS_OVL)
+    goto truncated;
+  ovl  = (Overlap *) (in->ptr - LAS_PTR);
+  span = LAS_SPAN(ovl,in->tbytes);
+  if (in->top - in->ptr < span)
+    { if (reader_fill(in,span) < span)
+        goto truncated;
+      ovl = (Overlap *) (in->ptr - LAS_PTR);
+    }
+  return (ovl);
+
+truncated:
+  EPRINTF(EPLACE,"%s: .las file holds fewer LAs than its header says (%lld)\n",
+                 Prog_Name,in->novl);
+  EXIT(NULL);
+}
+
+void Las_Advance(Las_Reader *in)
+{ if (in->sort != NULL)
+    set_advance((Set_Reader *) in->sort);
+  else
+    in->ptr += LAS_SPAN((Overlap *) (in->ptr - LAS_PTR),in->tbytes);
+  in->nread += 1;
+}
+
+Overlap *Las_Next(Las_Reader *in)
+{ Overlap *ovl;
+
+  ovl = Las_Peek(in);
+  if (ovl != NULL)
+    Las_Advance(in);
+  return (ovl);
+}
+
+void Close_Las_Reader(Las_Reader *in)
+{ Read_Ahead *a = (Read_Ahead *) in->ahead;
+
+  if (a != NULL)
+    { if (a->pending)
+        job_wait(&a->job);
+      free(a->buf[1]);
+      free(a->buf[0]);
+      free(a);
+    }
+  else if (in->pack != NULL)
+    { Pack_Reader *p = (Pack_Reader *) in->pack;
+
+      if (in->msize > 0)
+        munmap(p->image,in->msize);
+      free(p->var);
+      free(p->buf);
+      free(p->raw);
+      free(p);
+    }
+  else if (in->sort != NULL)
+    free(in->sort);
+  else if (in->input != NULL)
+    free(in->block-LAS_PTR);
+  if (in->msize > 0 && in->pack == NULL)
+    munmap(in->block-LAS_HEADER,in->msize);
+  free(in->offset);
+  free(in);
+}
+
+
+/*******************************************************************************************
+ *
+ *  WRITERS
+ *
+ ********************************************************************************************/
+
+Las_Writer *Open_Las_Writer(FILE *output, int64 novl, int tspace, int64 bsize)
+{ Las_Writer *out;
+
+  if (fwrite(&novl,sizeof(int64),1,output) != 1)
+    WRITE_ERROR(NULL)
+  if (fwrite(&tspace,sizeof(int),1,output) != 1)
+    WRITE_ERROR(NULL)
+
+  out = Open_Las_Segment_Writer(output,tspace,bsize);
+  if (out == NULL)
+    EXIT(NULL);
+  out->novl   = novl;
+  out->header = 1;
+  return (out);
+}
+
+Las_Writer *Open_Las_Packed_Writer(FILE *output, int64 novl, int tspace, int64 bsize)
+{ Las_Writer  *out;
+  Pack_Writer *p;
+  int64        magic = LAS_PACKED;
+
+  if (fwrite(&magic,sizeof(int64),1,output) != 1)
+    WRITE_ERROR(NULL)
+  if (fwrite(&novl,sizeof(int64),1,output) != 1)
+    WRITE_ERROR(NULL)
+  if (fwrite(&tspace,sizeof(int),1,output) != 1)
+    WRITE_ERROR(NULL)
+
+  if (bsize > PACK_BLOCK)
+    bsize = PACK_BLOCK;
+  out = Open_Las_Segment_Writer(output,tspace,bsize);
+  p   = (Pack_Writer *) Malloc(sizeof(Pack_Writer),"Allocating .las writer");
+  if (out == NULL || p == NULL)
+    EXIT(NULL);
+  p->buf    = NULL;
+  p->hbuf   = NULL;
+  p->bmax   = 0;
+  p->fpos   = LAS_PACK_HEADER;
+  p->count  = 0;
+  p->blk    = NULL;
+  p->nblk   = 0;
+  p->mblk   = 0;
+  p->sorted = 1;
+  p->alast  = 0;
+
+  out->novl   = novl;
+  out->header = 1;
+  out->pack   = p;
+  return (out);
+}
+
+Las_Writer *Open_Las_Segment_Writer(FILE *output, int tspace, int64 bsize)
+{ Las_Writer *out;
+
+  out = (Las_Writer *) Malloc(sizeof(Las_Writer),"Allocating .las writer");
+  if (out == NULL)
+    EXIT(NULL);
+
+  if (bsize < 2*LAS_OVL)
+    bsize = 2*LAS_OVL;
+  out->block = (char *) Malloc(bsize,"Allocating .las writer buffer");
+  if (out->block == NULL)
+    { free(out);
+      EXIT(NULL);
+    }
+  out->output = output;
+  out->ptr    = out->block;
+  out->top    = out->block + bsize;
+  out->novl   = 0;
+  out->count  = 0;
+  out->header = 0;
+  out->behind = NULL;
+  out->index  = NULL;
+  out->pack   = NULL;
+  out->tspace = tspace;
+  out->tbytes = Las_Trace_Bytes(tspace);
+  return (out);
+}
+
+  //  Wait for any write in progress of a writer with write-behind
+
+static int writer_wait(Las_Writer *out)
+{ Write_Behind *b = (Write_Behind *) out->behind;
+
+  if (b != NULL && b->pending)
+    { b->pending = 0;
+      if (job_wait(&b->job) != b->job.len)
+        WRITE_ERROR(1)
+    }
+  return (0);
+}
+
+  //  Pack the LAs in the buffer of a packed writer as the next block
+
+static int pack_flush(Las_Writer *out)
+{ Pack_Writer *p   = (Pack_Writer *) out->pack;
+  int64        len = out->ptr - out->block;
+  Pack_Block  *blk;
+  int          head[3];
+
+  if (len == 0)
+    return (0);
+  if (3*len >= p->bmax)
+    { p->bmax = 3*len + 1000;
+      p->buf  = (uint8 *) Realloc(p->buf,p->bmax,"Allocating .las packing buffer");
+      p->hbuf = (uint8 *) Realloc(p->hbuf,p->bmax+1,"Allocating .las packing buffer");
+      if (p->buf == NULL || p->hbuf == NULL)
+        EXIT(1);
+    }
+  if (p->nblk >= p->mblk)
+    { p->mblk = 1.2*p->nblk + 100;
+      p->blk  = (Pack_Block *) Realloc(p->blk,sizeof(Pack_Block)*p->mblk,
+                                       "Allocating .las block list");
+      if (p->blk == NULL)
+        EXIT(1);
+    }
+
+  head[0] = out->count - p->count;
+  head[1] = len;
+  head[2] = huff_pack(p->buf,pack_block(out->block,len,head[0],out->tspace,out->tbytes,p->buf),
+                      p->hbuf);
+  if (fwrite(head,sizeof(int),3,out->output) != 3)
+    WRITE_ERROR(1)
+  if (fwrite(p->hbuf,1,head[2],out->output) != (size_t) head[2])
+    WRITE_ERROR(1)
+
+  blk = p->blk + p->nblk++;
+  blk->offset = p->fpos;
+  blk->count  = p->count;
+  blk->aread  = ((Overlap *) (out->block - LAS_PTR))->aread;
+  blk->nla    = head[0];
+
+  p->fpos  += PACK_HEAD + head[2];
+  p->count  = out->count;
+  out->ptr  = out->block;
+  return (0);
+}
+
+static int writer_flush(Las_Writer *out)
+{ Write_Behind *b   = (Write_Behind *) out->behind;
+  int64         len = out->ptr - out->block;
+  int64         bsize;
+
+  if (out->pack != NULL)
+    return (pack_flush(out));
+  if (b != NULL)
+    { if (writer_wait(out))
+        EXIT(1);
+      if (len > 0)
+        { job_post(&b->job,out->output,out->block,len,1);
+          b->pending = 1;
+          bsize  = out->top - out->block;
+          b->cur = 1 - b->cur;
+          out->block = b->buf[b->cur];
+          out->top   = out->block + bsize;
+        }
+    }
+  else if (len > 0 && fwrite(out->block,1,len,out->output) != (size_t) len)
+    WRITE_ERROR(1)
+  out->ptr = out->block;
+  return (0);
+}
+
+int Set_Las_Write_Behind(Las_Writer *out)
+{ Write_Behind *b;
+
+  if (out->behind != NULL || out->pack != NULL)
+    return (0);
+
+  b = (Write_Behind *) Malloc(sizeof(Write_Behind),"Allocating .las write-behind");
+  if (b == NULL)
+    EXIT(1);
+  b->buf[0] = out->block;
+  b->buf[1] = (char *) Malloc(out->top - out->block,"Allocating .las write-behind");
+  if (b->buf[1] == NULL)
+    EXIT(1);
+  b->cur     = 0;
+  b->pending = 0;
+  out->behind = b;
+  return (0);
+}
+
+static void index_note(void *index, Overlap *ovl, int64 span, int64 count);
+
+int Las_Write(Las_Writer *out, Overlap *ovl)
+{ int64 span = LAS_SPAN(ovl,out->tbytes);
+
+  if (out->index != NULL)
+    index_note(out->index,ovl,span,out->count);
+  if (out->pack != NULL)
+    { Pack_Writer *p = (Pack_Writer *) out->pack;
+
+      if (ovl->aread < p->alast)
+        p->sorted = 0;
+      else
+        p->alast = ovl->aread;
+    }
+  if (out->ptr + span > out->top)
+    { if (writer_flush(out))
+        EXIT(1);
+      if (span > out->top - out->block && out->pack != NULL)
+        { out->block = (char *) Realloc(out->block,span,"Enlarging .las writer buffer");
+          if (out->block == NULL)
+            EXIT(1);
+          out->ptr = out->block;
+          out->top = out->block + span;
+        }
+      else if (span > out->top - out->block)
+        { if (writer_wait(out))
+            EXIT(1);
+          if (fwrite(LAS_RECORD(ovl),1,span,out->output) != (size_t) span)
+            WRITE_ERROR(1)
+          out->count += 1;
+          return (0);
+        }
+    }
+  memcpy(out->ptr,LAS_RECORD(ovl),span);
+  out->ptr   += span;
+  out->count += 1;
+  return (0);
+}
+
+int64 Close_Las_Writer(Las_Writer *out)
+{ int64 count = out->count;
+
+  if (writer_flush(out) || writer_wait(out))
+    EXIT(-1);
+  if (out->pack != NULL)
+    { Pack_Writer *p = (Pack_Writer *) out->pack;
+      Pack_Trailer  t;
+      int           head[3];
+
+      head[0] = head[1] = head[2] = 0;
+      t.nblock = p->nblk;
+      t.footer = p->fpos + PACK_HEAD;
+      t.sorted = p->sorted;
+      t.alast  = p->alast;
+      if (fwrite(head,sizeof(int),3,out->output) != 3)
+        WRITE_ERROR(-1)
+      if (fwrite(p->blk,sizeof(Pack_Block),p->nblk,out->output) != (size_t) p->nblk)
+        WRITE_ERROR(-1)
+      if (fwrite(&t,sizeof(Pack_Trailer),1,out->output) != 1)
+        WRITE_ERROR(-1)
+      free(p->blk);
+      free(p->hbuf);
+      free(p->buf);
+      free(p);
+    }
+  if (out->header && count != out->novl)
+    { if (fseeko(out->output,(out->pack != NULL ? sizeof(int64) : 0),SEEK_SET) != 0)
+        { EPRINTF(EPLACE,"%s: Cannot correct LA count of a .las on a non-seekable output\n",
+                         Prog_Name);
+          EXIT(-1);
+        }
+      if (fwrite(&count,sizeof(int64),1,out->output) != 1)
+        WRITE_ERROR(-1)
+      fseeko(out->output,0,SEEK_END);
+    }
+  if (out->behind != NULL)
+    { Write_Behind *b = (Write_Behind *) out->behind;
+
+      free(b->buf[1]);
+      free(b->buf[0]);
+      free(b);
+    }
+  else
+    free(out->block);
+  if (out->index != NULL)
+    { Las_Index *idx = Las_Writer_Index(out);
+
+      if (idx != NULL)
+        Free_Las_Index(idx);
+    }
+  free(out);
+  return (count);
+}
+
+
+/*******************************************************************************************
+ *
+ *  SORTING
+ *
+ ********************************************************************************************/
+
+#define KEY_BYTES  12
+
+typedef struct
+  { uint8    key[KEY_BYTES+4];   //  Word w, byte b (least significant first) at key[4*w+b]
+    Overlap *ovl;
+  } Sort_Key;
+
+#define UNIT_BYTES  ((int64) (sizeof(Overlap *) + 2*sizeof(Sort_Key)))   //  Per sort unit
+
+  //  Find the sort units of set: all LAs, or only those starting chains if 'chains' is set
+
+static int find_units(Las_Set *set, int chains)
+{ char  *o, *end;
+  int64  j;
+
+  set->perm = (Overlap **) Malloc(sizeof(Overlap *)*(set->novl+1),"Allocating .las set");
+  if (set->perm == NULL)
+    EXIT(1);
+
+  o   = set->block - LAS_PTR;
+  end = o + set->size;
+  set->nsort = 0;
+  for (j = 0; j < set->novl; j++)
+    { if (o + LAS_OVL > end || o + LAS_SPAN((Overlap *) o,set->tbytes) > end)
+        { EPRINTF(EPLACE,"%s: .las file holds fewer LAs than its header says (%lld)\n",
+                         Prog_Name,set->novl);
+          EXIT(1);
+        }
+      if (j == 0 || ! chains || CHAIN_START(((Overlap *) o)->flags))
+        set->perm[set->nsort++] = (Overlap *) o;
+      o += LAS_SPAN((Overlap *) o,set->tbytes);
+    }
+  return (0);
+}
+
+  //  Unpacking of the blocks of a packed .las read into memory is split over IO_THREADS
+  //    threads, each taking every IO_THREADS'th block
+
+typedef struct
+  { uint8 *pack;     //  Packed bytes of the block
+    char  *raw;      //  Where its LAs go
+    int    nla;
+    int    rlen;
+    int    clen;
+  } Unpack_Job;
+
+typedef struct
+  { Unpack_Job *job;
+    int64       njob;
+    int         beg, step;
+    int         tspace, tbytes;
+    uint8      *var;       //  Huffman decoding buffer of the thread
+    int64       vmax;
+    int         error;
+  } Unpack_Arg;
+
+static void *unpack_thread(void *arg)
+{ Unpack_Arg *a = (Unpack_Arg *) arg;
+  Unpack_Job *j;
+  uint8      *var;
+  int64       i, vlen;
+
+  for (i = a->beg; i < a->njob; i += a->step)
+    { j   = a->job + i;
+      var = huff_unpack(j->pack,j->clen,&a->var,&a->vmax,&vlen);
+      if (var == NULL || unpack_block(var,vlen,j->nla,a->tspace,a->tbytes,j->raw,j->rlen))
+        a->error = 1;
+    }
+  free(a->var);
+  return (NULL);
+}
+
+  //  Replace the size packed bytes of LAs at block+LAS_PTR with their unpacked form
+
+static int unpack_set(char **block, int64 *size, int tspace, int64 budget)
+{ Unpack_Job *job;
+  Unpack_Arg  arg[IO_THREADS];
+  pthread_t   thread[IO_THREADS];
+  int64       njob, pos, rlen;
+  int         head[3];
+  char       *pack, *raw;
+  int         i, nthreads;
+
+  pack = *block + LAS_PTR;
+  njob = 0;
+  rlen = 0;
+  for (pos = 0; pos + PACK_HEAD <= *size; pos += PACK_HEAD + head[2])
+    { memcpy(head,pack+pos,PACK_HEAD);
+      if (head[0] == 0)
+        break;
+      if (head[0] < 0 || head[1] < LAS_OVL || head[2] < 0 || pos + PACK_HEAD + head[2] > *size)
+        goto corrupt;
+      njob += 1;
+      rlen += head[1];
+    }
+  if (budget > 0 && rlen > budget)
+    { EPRINTF(EPLACE,"%s: LAs exceed the memory budget of %lldMB\n",Prog_Name,budget/1000000);
+      EXIT(1);
+    }
+
+  job = (Unpack_Job *) Malloc(sizeof(Unpack_Job)*(njob+1),"Allocating .las set");
+  raw = (char *) Malloc(rlen+LAS_PTR,"Allocating .las set");
+  if (job == NULL || raw == NULL)
+    EXIT(1);
+  rlen = 0;
+  pos  = 0;
+  for (i = 0; i < njob; i++)
+    { memcpy(head,pack+pos,PACK_HEAD);
+      job[i].pack = (uint8 *) (pack + pos + PACK_HEAD);
+      job[i].raw  = raw + LAS_PTR + rlen;
+      job[i].nla  = head[0];
+      job[i].rlen = head[1];
+      job[i].clen = head[2];
+      rlen += head[1];
+      pos  += PACK_HEAD + head[2];
+    }
+
+  nthreads = IO_THREADS;
+  if (nthreads > njob)
+    nthreads = njob;
+  for (i = 0; i < nthreads; i++)
+    { arg[i].job    = job;
+      arg[i].njob   = njob;
+      arg[i].beg    = i;
+      arg[i].step   = nthreads;
+      arg[i].tspace = tspace;
+      arg[i].tbytes = Las_Trace_Bytes(tspace);
+      arg[i].var    = NULL;
+      arg[i].vmax   = 0;
+      arg[i].error  = 0;
+      pthread_create(thread+i,NULL,unpack_thread,arg+i);
+    }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(thread[i],NULL);
+  free(job);
+
+  for (i = 0; i < nthreads; i++)
+    if (arg[i].error)
+      { free(raw);
+        goto corrupt;
+      }
+
+  free(*block);
+  *block = raw;
+  *size  = rlen;
+  return (0);
+
+corrupt:
+  EPRINTF(EPLACE,"%s: Block of packed .las is corrupt\n",Prog_Name);
+  EXIT(1);
+}
+
+Las_Set *Read_Las_Set(FILE *input, int64 budget)
+{ Las_Set    *set;
+  struct stat info;
+  int64       novl, size, max;
+  int         tspace, tbytes;
+  int         version;
+  char       *block;
+
+  version = Las_Header(input,&novl,&tspace);
+  if (version < 0)
+    EXIT(NULL);
+  tbytes = Las_Trace_Bytes(tspace);
+
+  //  Read the rest of the file, in one go if its size is known
+
+  if (fstat(fileno(input),&info) == 0 && S_ISREG(info.st_mode))
+    max = (info.st_size - ftello(input)) + 1;    //  + 1 so that EOF is seen on the first read
+  else
+    max = 1000000;
+  if (max <= 0)
+    max = 1;
+
+  block = NULL;
+  size  = 0;
+  while (1)
+    { if (budget > 0 && max > budget)
+        max = budget+1;
+      block = (char *) Realloc(block,max+LAS_PTR,"Allocating .las set");
+      if (block == NULL)
+        EXIT(NULL);
+      size += fread(block+LAS_PTR+size,1,max-size,input);
+      if (size < max || (budget > 0 && size > budget))
+        break;
+      max = 2*max;
+    }
+  if (ferror(input))
+    { free(block);
+      READ_ERROR(NULL)
+    }
+  if (budget > 0 && size > budget)
+    { EPRINTF(EPLACE,"%s: LAs exceed the memory budget of %lldMB\n",Prog_Name,budget/1000000);
+      free(block);
+      EXIT(NULL);
+    }
+  if (version == 2 && unpack_set(&block,&size,tspace,budget))
+    { free(block);
+      EXIT(NULL);
+    }
+
+  set = (Las_Set *) Malloc(sizeof(Las_Set),"Allocating .las set");
+  if (set == NULL)
+    { free(block);
+      EXIT(NULL);
+    }
+  set->block  = block + LAS_PTR;
+  set->size   = size;
+  set->novl   = novl;
+  set->tspace = tspace;
+  set->tbytes = tbytes;
+
+  if (find_units(set,size >= LAS_OVL && CHAIN_START(((Overlap *) (set->block-LAS_PTR))->flags)))
+    { Free_Las_Set(set);
+      EXIT(NULL);
+    }
+
+  return (set);
+}
+
+Las_Set *Read_Las_Chunk(Las_Reader *in, int64 budget, int chains)
+{ Las_Set *set;
+  Overlap *ovl;
+  int64    size, max, span, nunit;
+  char    *block;
+
+  set = (Las_Set *) Malloc(sizeof(Las_Set),"Allocating .las set");
+  if (set == NULL)
+    EXIT(NULL);
+
+  max = 1000000;
+  if (max > budget)
+    max = budget;
+  block = (char *) Malloc(max+LAS_PTR,"Allocating .las set");
+  if (block == NULL)
+    { free(set);
+      EXIT(NULL);
+    }
+
+  //  Copy whole sort units until the next would take the chunk over budget
+
+  size  = 0;
+  nunit = 0;
+  set->novl = 0;
+  while ((ovl = Las_Peek(in)) != NULL)
+    { span = LAS_SPAN(ovl,in->tbytes);
+      if ( ! chains || CHAIN_START(ovl->flags))
+        { if (size > 0 && size + span + (nunit+1)*UNIT_BYTES > budget)
+            break;
+          nunit += 1;
+        }
+      if (size + span > max)
+        { max = 2*max + span;
+          block = (char *) Realloc(block,max+LAS_PTR,"Enlarging .las set");
+          if (block == NULL)
+            { free(set);
+              EXIT(NULL);
+            }
+        }
+      memcpy(block+LAS_PTR+size,LAS_RECORD(ovl),span);
+      size      += span;
+      set->novl += 1;
+      Las_Advance(in);
+    }
+  if (ovl == NULL && in->nread < in->novl)
+    { free(block);
+      free(set);
+      EXIT(NULL);
+    }
+
+  set->block  = block + LAS_PTR;
+  set->size   = size;
+  set->tspace = in->tspace;
+  set->tbytes = in->tbytes;
+  if (find_units(set,chains))
+    { Free_Las_Set(set);
+      EXIT(NULL);
+    }
+
+  return (set);
+}
+
+int Find_Las_Units(Las_Set *set, int chains)
+{ free(set->perm);
+  set->perm = NULL;
+  return (find_units(set,chains));
+}
+
+static int ORDER_OVL(Overlap *ol, Overlap *or)
+{ int al, ar;
+  int bl, br;
+  int cl, cr;
+  int pl, pr;
+
+  al = ol->aread;
+  ar = or->aread;
+  if (al != ar)
+    return (al-ar);
+
+  bl = ol->bread;
+  br = or->bread;
+  if (bl != br)
+    return (bl-br);
+
+  cl = COMP(ol->flags);
+  cr = COMP(or->flags);
+  if (cl != cr)
+    return (cl-cr);
+
+  pl = ol->path.abpos;
+  pr = or->path.abpos;
+  if (pl != pr)
+    return (pl-pr);
+
+  pl = ol->path.aepos;
+  pr = or->path.aepos;
+  if (pl != pr)
+    return (pl-pr);
+
+  pl = ol->path.bbpos;
+  pr = or->path.bbpos;
+  if (pl != pr)
+    return (pl-pr);
+
+  pl = ol->path.bepos;
+  pr = or->path.bepos;
+  if (pl != pr)
+    return (pl-pr);
+
+  pl = ol->path.diffs;
+  pr = or->path.diffs;
+  if (pl != pr)
+    return (pl-pr);
+
+  return (0);
+}
+
+static int SORT_OVL(const void *x, const void *y)
+{ Overlap *ol = *((Overlap **) x);
+  Overlap *or = *((Overlap **) y);
+  int      c;
+
+  c = ORDER_OVL(ol,or);
+  if (c != 0)
+    return (c);
+  if (ol < or)
+    return (-1);
+  else if (ol > or)
+    return (1);
+  else
+    return (0);
+}
+
+static int ORDER_MAP(Overlap *ol, Overlap *or)
+{ int al, ar;
+  int bl, br;
+  int cl, cr;
+  int pl, pr;
+
+  al = ol->aread;
+  ar = or->aread;
+  if (al != ar)
+    return (al-ar);
+
+  pl = ol->path.abpos;
+  pr = or->path.abpos;
+  if (pl != pr)
+    return (pl-pr);
+
+  bl = ol->bread;
+  br = or->bread;
+  if (bl != br)
+    return (bl-br);
+
+  cl = COMP(ol->flags);
+  cr = COMP(or->flags);
+  if (cl != cr)
+    return (cl-cr);
+
+  pl = ol->path.aepos;
+  pr = or->path.aepos;
+  if (pl != pr)
+    return (pl-pr);
+
+  pl = ol->path.bbpos;
+  pr = or->path.bbpos;
+  if (pl != pr)
+    return (pl-pr);
+
+  pl = ol->path.bepos;
+  pr = or->path.bepos;
+  if (pl != pr)
+    return (pl-pr);
+
+  pl = ol->path.diffs;
+  pr = or->path.diffs;
+  if (pl != pr)
+    return (pl-pr);
+
+  return (0);
+}
+
+static int SORT_MAP(const void *x, const void *y)
+{ Overlap *ol = *((Overlap **) x);
+  Overlap *or = *((Overlap **) y);
+  int      c;
+
+  c = ORDER_MAP(ol,or);
+  if (c != 0)
+    return (c);
+  if (ol < or)
+    return (-1);
+  else if (ol > or)
+    return (1);
+  else
+    return (0);
+}
+
+  //  Sort_Las_Set radix sorts (with LSD_Sort_R) a key of three 32-bit words for each sort
+  //    unit: (aread,bread,COMP<<31|abpos), or (aread,abpos,bread<<1|COMP) in map order.  As
+  //    the radix sort is stable, units with equal keys remain in input order, and each such
+  //    run is then finished with qsort on the remaining fields.  Only the bytes of each word
+  //    that are non-zero in some key are sorted on.  LSD_Sort_R keeps its state per call,
+  //    so sets may be sorted in several threads at once.
+
+static void pack_key(Sort_Key *k, Overlap *o, int map_order)
+{ uint32 w[3];
+  int    i, b;
+
+  w[0] = o->aread;
+  if (map_order)
+    { w[1] = o->path.abpos;
+      w[2] = (((uint32) o->bread) << 1) | COMP(o->flags);
+    }
+  else
+    { w[1] = o->bread;
+      w[2] = (((uint32) COMP(o->flags)) << 31) | o->path.abpos;
+    }
+  for (i = 0; i < 3; i++)
+    for (b = 0; b < 4; b++)
+      k->key[4*i+b] = (uint8) (w[i] >> (8*b));
+  k->ovl = o;
+}
+
+int Sort_Las_Set(Las_Set *set, int map_order, int nthreads)
+{ int     (*compare)(const void *, const void *);
+  Sort_Key *src, *trg, *srt;
+  Overlap **perm;
+  uint8     used[KEY_BYTES];
+  int       bytes[KEY_BYTES+1];
+  int64     n = set->nsort;
+  int64     i, j;
+  int       w, b, nb;
+
+  compare = (map_order ? SORT_MAP : SORT_OVL);
+  if (n <= 1)
+    return (0);
+
+  src = (Sort_Key *) Malloc(sizeof(Sort_Key)*n,"Allocating sort keys");
+  trg = (Sort_Key *) Malloc(sizeof(Sort_Key)*n,"Allocating sort keys");
+  if (src == NULL || trg == NULL)
+    EXIT(1);
+
+  for (b = 0; b < KEY_BYTES; b++)
+    used[b] = 0;
+  for (i = 0; i < n; i++)
+    { pack_key(src+i,set->perm[i],map_order);
+      for (b = 0; b < KEY_BYTES; b++)
+        used[b] |= src[i].key[b];
+    }
+
+  nb = 0;
+  for (w = 2; w >= 0; w--)
+    for (b = 0; b < 4; b++)
+      if (used[4*w+b])
+        bytes[nb++] = 4*w+b;
+  bytes[nb] = -1;
+
+  srt = (Sort_Key *) LSD_Sort_R(n,src,trg,sizeof(Sort_Key),sizeof(Sort_Key),bytes,
+                                nthreads,0);
+
+  perm = set->perm;
+  for (i = 0; i < n; i = j)
+    { perm[i] = srt[i].ovl;
+      for (j = i+1; j < n && memcmp(srt[j].key,srt[i].key,KEY_BYTES) == 0; j++)
+        perm[j] = srt[j].ovl;
+      if (j-i > 1)
+        qsort(perm+i,j-i,sizeof(Overlap *),compare);
+    }
+
+  free(trg);
+  free(src);
+  return (0);
+}
+
+static int EQUAL(Overlap *ol, Overlap *or)
+{ return (ol->aread == or->aread && ol->bread == or->bread
+       && COMP(ol->flags) == COMP(or->flags)
+       && ol->path.abpos == or->path.abpos && ol->path.aepos == or->path.aepos
+       && ol->path.bbpos == or->path.bbpos && ol->path.bepos == or->path.bepos);
+}
+
+int64 Write_Las_Set(Las_Set *set, Las_Writer *out)
+{ Overlap *w, *x;
+  char    *end;
+  int64    j, nout;
+
+  end  = set->block + (set->size - LAS_PTR);
+  x    = NULL;
+  nout = 0;
+  for (j = 0; j < set->nsort; j++)
+    { w = set->perm[j];
+      do
+        { if (x == NULL || ! EQUAL(w,x))
+            { if (Las_Write(out,w))
+                EXIT(-1);
+              nout += 1;
+            }
+          x = w;
+          w = (Overlap *) (((char *) w) + LAS_SPAN(w,set->tbytes));
+        }
+      while ((char *) w < end && CHAIN_NEXT(w->flags));
+    }
+  return (nout);
+}
+
+  //  Return the LA after w in the sorted order of the set of s, or NULL if w is the last
+
+static Overlap *set_after(Set_Reader *s, Overlap *w)
+{ w = (Overlap *) (((char *) w) + LAS_SPAN(w,s->set->tbytes));
+  if ((char *) w < s->end && CHAIN_NEXT(w->flags))
+    return (w);
+  s->unit += 1;
+  if (s->unit >= s->set->nsort)
+    return (NULL);
+  return (s->set->perm[s->unit]);
+}
+
+  //  Step s past its current LA and any following it that Write_Las_Set would drop
+
+static void set_advance(Set_Reader *s)
+{ Overlap *w, *x;
+
+  x = s->cur;
+  w = set_after(s,x);
+  while (w != NULL && EQUAL(w,x))
+    { x = w;
+      w = set_after(s,x);
+    }
+  s->cur = w;
+}
+
+Las_Reader *Open_Las_Set_Reader(Las_Set *set)
+{ Las_Reader *in;
+  Set_Reader *s, t;
+  int64       novl;
+
+  in = new_reader(0,set->tspace);
+  s  = (Set_Reader *) Malloc(sizeof(Set_Reader),"Allocating .las set reader");
+  if (in == NULL || s == NULL)
+    EXIT(NULL);
+  s->set  = set;
+  s->end  = set->block + (set->size - LAS_PTR);
+  s->unit = 0;
+  if (set->nsort > 0)
+    s->cur = set->perm[0];
+  else
+    s->cur = NULL;
+
+  novl = 0;
+  for (t = *s; t.cur != NULL; set_advance(&t))
+    novl += 1;
+
+  in->input = NULL;
+  in->bsize = 0;
+  in->block = NULL;
+  in->ptr   = NULL;
+  in->top   = NULL;
+  in->novl  = novl;
+  in->sort  = s;
+  return (in);
+}
+
+void Free_Las_Set(Las_Set *set)
+{ free(set->perm);
+  free(set->block-LAS_PTR);
+  free(set);
+}
+
+
+/*******************************************************************************************
+ *
+ *  MERGING, CONCATENATING, AND SPLITTING
+ *
+ ********************************************************************************************/
+
+  //  The current LAs of the inputs are ordered by a loser tree.  Each input's current LA is
+  //    summarized by a two word key prefix: (aread|bread,COMP ; abpos) or (aread|abpos ; 0) in
+  //    map order, as in LAmerge, and ties on the prefix go to the earlier input.  If MERGE_FULL
+  //    is set, the second word of a map order key is bread,COMP, and ties on the prefix are
+  //    broken by the full order of Sort_Las_Set before going to the earlier input.  An
+  //    exhausted input has a key greater than that of any LA.
+
+#define MERGE_MAP   0x1
+#define MERGE_FULL  0x2
+
+#define MERGE_DONE  0xffffffffffffffffllu
+
+typedef struct
+  { int        nin;
+    int        order;
+    int       *tree;   //  tree[0] is the input with the least LA, tree[1..nin-1] the losers
+    Overlap  **cur;    //  cur[i] is the current LA of input i (NULL if none) ...
+    uint64    *key;    //    and key[2*i..2*i+1] is its key prefix
+  } Merger;
+
+static void merge_key(Merger *m, int i)
+{ Overlap *o   = m->cur[i];
+  uint64  *key = m->key + 2*i;
+
+  if (o == NULL)
+    key[0] = key[1] = MERGE_DONE;
+  else if (m->order & MERGE_MAP)
+    { key[0] = (((uint64) o->aread) << 32) | ((uint32) o->path.abpos);
+      if (m->order & MERGE_FULL)
+        key[1] = (((uint32) o->bread) << 1) | COMP(o->flags);
+      else
+        key[1] = 0;
+    }
+  else
+    { key[0] = (((uint64) o->aread) << 32) | (((uint32) o->bread) << 1) | COMP(o->flags);
+      key[1] = (uint32) o->path.abpos;
+    }
+}
+
+  //  Is the current LA of input l before that of input r?
+
+static inline int merge_less(Merger *m, int l, int r)
+{ uint64 *kl = m->key + 2*l;
+  uint64 *kr = m->key + 2*r;
+
+  if (kl[0] != kr[0])
+    return (kl[0] < kr[0]);
+  if (kl[1] != kr[1])
+    return (kl[1] < kr[1]);
+  if ((m->order & MERGE_FULL) && kl[0] != MERGE_DONE)
+    { int c;
+
+      if (m->order & MERGE_MAP)
+        c = ORDER_MAP(m->cur[l],m->cur[r]);
+      else
+        c = ORDER_OVL(m->cur[l],m->cur[r]);
+      if (c != 0)
+        return (c < 0);
+    }
+  return (l < r);
+}
+
+  //  Play the matches of the subtree at node (leaves are nodes nin..2*nin-1), returning its winner
+
+static int merge_play(Merger *m, int node)
+{ int l, r;
+
+  if (node >= m->nin)
+    return (node - m->nin);
+  l = merge_play(m,2*node);
+  r = merge_play(m,2*node+1);
+  if (merge_less(m,l,r))
+    { m->tree[node] = r;
+      return (l);
+    }
+  else
+    { m->tree[node] = l;
+      return (r);
+    }
+}
+
+static Merger *merge_start(Las_Reader **in, int nin, int order)
+{ Merger *m;
+  int     i;
+
+  m = (Merger *) Malloc(sizeof(Merger),"Allocating merge tree");
+  if (m == NULL)
+    EXIT(NULL);
+  m->tree = (int *) Malloc(sizeof(int)*(nin+1),"Allocating merge tree");
+  m->cur  = (Overlap **) Malloc(sizeof(Overlap *)*(nin+1),"Allocating merge tree");
+  m->key  = (uint64 *) Malloc(sizeof(uint64)*2*(nin+1),"Allocating merge tree");
+  if (m->tree == NULL || m->cur == NULL || m->key == NULL)
+    EXIT(NULL);
+
+  m->nin   = nin;
+  m->order = order;
+  for (i = 0; i < nin; i++)
+    { m->cur[i] = Las_Peek(in[i]);
+      merge_key(m,i);
+    }
+  m->tree[0] = merge_play(m,1);
+  return (m);
+}
+
+  //  The key of the winner w has changed: replay its matches up to the root
+
+static void merge_replay(Merger *m, int w)
+{ int node, t;
+
+  merge_key(m,w);
+  for (node = (w + m->nin) >> 1; node >= 1; node >>= 1)
+    { t = m->tree[node];
+      if (merge_less(m,t,w))
+        { m->tree[node] = w;
+          w = t;
+        }
+    }
+  m->tree[0] = w;
+}
+
+static void merge_free(Merger *m)
+{ free(m->key);
+  free(m->cur);
+  free(m->tree);
+  free(m);
+}
+
+int64 Merge_Las(Las_Reader **in, int nin, Las_Writer *out, int map_order)
+{ Merger *m;
+  int64   nout;
+  int     i;
+
+  if (nin <= 0)
+    return (0);
+  m = merge_start(in,nin,map_order ? MERGE_MAP : 0);
+  if (m == NULL)
+    EXIT(-1);
+
+  nout = 0;
+  while (m->cur[i = m->tree[0]] != NULL)
+    { do
+        { if (Las_Write(out,m->cur[i]))
+            EXIT(-1);
+          nout += 1;
+          Las_Advance(in[i]);
+          m->cur[i] = Las_Peek(in[i]);
+        }
+      while (m->cur[i] != NULL && CHAIN_NEXT(m->cur[i]->flags));
+      merge_replay(m,i);
+    }
+
+  merge_free(m);
+  return (nout);
+}
+
+int64 Merge_Las_Runs(Las_Reader **in, int nin, Las_Writer *out, int map_order)
+{ Merger  *m;
+  Overlap  last;
+  int64    nout;
+  int      i;
+
+  if (nin <= 0)
+    return (0);
+  m = merge_start(in,nin,MERGE_FULL | (map_order ? MERGE_MAP : 0));
+  if (m == NULL)
+    EXIT(-1);
+
+  memset(&last,0,sizeof(Overlap));
+  last.aread = -1;                    //  Equal to no LA
+
+  nout = 0;
+  while (m->cur[i = m->tree[0]] != NULL)
+    { do
+        { if ( ! EQUAL(m->cur[i],&last))
+            { if (Las_Write(out,m->cur[i]))
+                EXIT(-1);
+              nout += 1;
+            }
+          last = *m->cur[i];
+          Las_Advance(in[i]);
+          m->cur[i] = Las_Peek(in[i]);
+        }
+      while (m->cur[i] != NULL && CHAIN_NEXT(m->cur[i]->flags));
+      merge_replay(m,i);
+    }
+
+  merge_free(m);
+  return (nout);
+}
+
+int64 Cat_Las(Las_Reader *in, Las_Writer *out)
+{ Overlap *ovl;
+  int64    nout;
+
+  nout = 0;
+  while ((ovl = Las_Next(in)) != NULL)
+    { if (Las_Write(out,ovl))
+        EXIT(-1);
+      nout += 1;
+    }
+  return (nout);
+}
+
+int64 Split_Las(Las_Reader *in, Las_Writer *out, int64 nmin, int alimit)
+{ Overlap *ovl;
+  int64    nout;
+  int      last;
+
+  nout = 0;
+  last = 0;
+  while ((ovl = Las_Peek(in)) != NULL)
+    { if (alimit >= 0)
+        { if (ovl->aread >= alimit)
+            break;
+        }
+      else
+        { if (nout >= nmin && ovl->aread > last)
+            break;
+          last = ovl->aread;
+        }
+      if (Las_Write(out,ovl))
+        EXIT(-1);
+      Las_Advance(in);
+      nout += 1;
+    }
+  return (nout);
+}
+
+
+/*******************************************************************************************
+ *
+ *  INDEXES
+ *
+ ********************************************************************************************/
+
+  //  State of an index being built of the LAs passing through a writer or reader
+
+typedef struct
+  { Las_Index *idx;
+    int64      emax;    //  Entries allocated in idx
+    int64      base;    //  # of LAs before the first noted
+    int        last;    //  A-read of the last LA noted
+    int        valid;   //  LAs noted so far are sorted on a-read
+  } Index_Build;
+
+static Index_Build *index_start(int stride, int64 offset, int64 count)
+{ Index_Build *b;
+  Las_Index   *idx;
+
+  b   = (Index_Build *) Malloc(sizeof(Index_Build),"Allocating .las index");
+  idx = (Las_Index *) Malloc(sizeof(Las_Index),"Allocating .las index");
+  if (b == NULL || idx == NULL)
+    EXIT(NULL);
+  if (stride <= 0)
+    stride = LAS_STRIDE;
+  idx->novl   = count;
+  idx->fsize  = offset;
+  idx->stride = stride;
+  idx->nent   = 0;
+  idx->offset = NULL;
+  idx->count  = NULL;
+  b->idx   = idx;
+  b->emax  = 0;
+  b->base  = count;
+  b->last  = 0;
+  b->valid = 1;
+  return (b);
+}
+
+  //  Note the next LA, ovl of span bytes, that is preceded by count LAs of those noted
+
+static void index_note(void *index, Overlap *ovl, int64 span, int64 count)
+{ Index_Build *b   = (Index_Build *) index;
+  Las_Index   *idx = b->idx;
+  int64        k;
+
+  if (ovl->aread < b->last)
+    b->valid = 0;
+  b->last = ovl->aread;
+
+  k = ovl->aread / idx->stride;
+  if (k >= idx->nent && b->valid)
+    { if (k >= b->emax)
+        { b->emax = 1.2*k + 1000;
+          idx->offset = (int64 *) Realloc(idx->offset,sizeof(int64)*b->emax,
+                                          "Allocating .las index");
+          idx->count  = (int64 *) Realloc(idx->count,sizeof(int64)*b->emax,
+                                          "Allocating .las index");
+          if (idx->offset == NULL || idx->count == NULL)
+            { b->valid = 0;
+              return;
+            }
+        }
+      while (idx->nent <= k)
+        { idx->offset[idx->nent] = idx->fsize;
+          idx->count[idx->nent]  = b->base + count;
+          idx->nent += 1;
+        }
+    }
+  idx->fsize += span;
+  idx->novl   = b->base + count + 1;
+}
+
+  //  Finish the index being built, returning it, or NULL if the LAs were not sorted
+
+static Las_Index *index_finish(Index_Build *b)
+{ Las_Index *idx = b->idx;
+  int        valid = b->valid;
+
+  free(b);
+  if ( ! valid)
+    { Free_Las_Index(idx);
+      return (NULL);
+    }
+  return (idx);
+}
+
+int Set_Las_Index(Las_Writer *out, int stride, int64 offset, int64 count)
+{ if (out->index != NULL || out->pack != NULL)
+    return (0);
+  out->index = index_start(stride,offset,count);
+  if (out->index == NULL)
+    EXIT(1);
+  return (0);
+}
+
+Las_Index *Las_Writer_Index(Las_Writer *out)
+{ Las_Index *idx;
+
+  if (out->index == NULL)
+    return (NULL);
+  idx = index_finish((Index_Build *) out->index);
+  out->index = NULL;
+  return (idx);
+}
+
+Las_Index *Build_Las_Index(Las_Reader *in, int stride)
+{ Index_Build *b;
+  Overlap     *ovl;
+
+  b = index_start(stride,LAS_HEADER,0);
+  if (b == NULL)
+    EXIT(NULL);
+  while ((ovl = Las_Peek(in)) != NULL)
+    { index_note(b,ovl,LAS_SPAN(ovl,in->tbytes),in->nread);
+      if ( ! b->valid)
+        break;
+      Las_Advance(in);
+    }
+  return (index_finish(b));
+}
+
+Las_Index *Join_Las_Index(Las_Index **part, int npart)
+{ Las_Index *idx;
+  int64      nent, k;
+  int        p;
+
+  nent = 0;
+  for (p = 0; p < npart; p++)
+    { if (part[p] == NULL || part[p]->stride != part[0]->stride)
+        return (NULL);
+      if (part[p]->nent > nent)
+        nent = part[p]->nent;
+    }
+
+  idx = (Las_Index *) Malloc(sizeof(Las_Index),"Allocating .las index");
+  if (idx == NULL)
+    EXIT(NULL);
+  idx->offset = (int64 *) Malloc(sizeof(int64)*(nent+1),"Allocating .las index");
+  idx->count  = (int64 *) Malloc(sizeof(int64)*(nent+1),"Allocating .las index");
+  if (idx->offset == NULL || idx->count == NULL)
+    EXIT(NULL);
+  idx->stride = part[0]->stride;
+  idx->novl   = part[npart-1]->novl;
+  idx->fsize  = part[npart-1]->fsize;
+
+  //  An entry is taken from the first part that has it
+
+  idx->nent = 0;
+  for (p = 0; p < npart; p++)
+    for (k = idx->nent; k < part[p]->nent; k++)
+      { idx->offset[k] = part[p]->offset[k];
+        idx->count[k]  = part[p]->count[k];
+        idx->nent = k+1;
+      }
+  return (idx);
+}
+
+  //  Modification time of the file of 'info' in nanoseconds
+
+static int64 las_mtime(struct stat *info)
+{
+#ifdef __APPLE__
+  return (info->st_mtimespec.tv_sec*1000000000ll + info->st_mtimespec.tv_nsec);
+#else
+  return (info->st_mtim.tv_sec*1000000000ll + info->st_mtim.tv_nsec);
+#endif
+}
+
+int Write_Las_Index(Las_Index *idx, char *name, struct stat *las)
+{ FILE *output;
+
+  idx->mtime = las_mtime(las);
+
+  output = Fopen(name,"w");
+  if (output == NULL)
+    EXIT(1);
+  if (fwrite(&idx->novl,sizeof(int64),1,output) != 1)
+    goto error;
+  if (fwrite(&idx->fsize,sizeof(int64),1,output) != 1)
+    goto error;
+  if (fwrite(&idx->mtime,sizeof(int64),1,output) != 1)
+    goto error;
+  if (fwrite(&idx->stride,sizeof(int),1,output) != 1)
+    goto error;
+  if (fwrite(&idx->nent,sizeof(int64),1,output) != 1)
+    goto error;
+  if (fwrite(idx->offset,sizeof(int64),idx->nent,output) != (size_t) idx->nent)
+    goto error;
+  if (fwrite(idx->count,sizeof(int64),idx->nent,output) != (size_t) idx->nent)
+    goto error;
+  if (fclose(output) != 0)
+    WRITE_ERROR(1)
+  return (0);
+
+error:
+  fclose(output);
+  WRITE_ERROR(1)
+}
+
+Las_Index *Read_Las_Index(char *name, int64 novl, struct stat *las)
+{ FILE      *input;
+  Las_Index *idx;
+
+  input = fopen(name,"r");
+  if (input == NULL)
+    return (NULL);
+
+  idx = (Las_Index *) Malloc(sizeof(Las_Index),"Allocating .las index");
+  if (idx == NULL)
+    { fclose(input);
+      EXIT(NULL);
+    }
+  idx->offset = NULL;
+  idx->count  = NULL;
+  if (fread(&idx->novl,sizeof(int64),1,input) != 1)
+    goto stale;
+  if (fread(&idx->fsize,sizeof(int64),1,input) != 1)
+    goto stale;
+  if (fread(&idx->mtime,sizeof(int64),1,input) != 1)
+    goto stale;
+  if (fread(&idx->stride,sizeof(int),1,input) != 1)
+    goto stale;
+  if (fread(&idx->nent,sizeof(int64),1,input) != 1)
+    goto stale;
+  if (idx->novl != novl || idx->fsize != las->st_size || idx->mtime != las_mtime(las))
+    goto stale;
+  if (idx->stride <= 0 || idx->nent < 0)
+    goto stale;
+
+  idx->offset = (int64 *) Malloc(sizeof(int64)*(idx->nent+1),"Allocating .las index");
+  idx->count  = (int64 *) Malloc(sizeof(int64)*(idx->nent+1),"Allocating .las index");
+  if (idx->offset == NULL || idx->count == NULL)
+    goto stale;
+  if (fread(idx->offset,sizeof(int64),idx->nent,input) != (size_t) idx->nent)
+    goto stale;
+  if (fread(idx->count,sizeof(int64),idx->nent,input) != (size_t) idx->nent)
+    goto stale;
+
+  fclose(input);
+  return (idx);
+
+stale:
+  fclose(input);
+  Free_Las_Index(idx);
+  return (NULL);
+}
+
+void Las_Index_Seek(Las_Index *idx, int aread, int64 *offset, int64 *count)
+{ int64 k;
+
+  k = aread / idx->stride;
+  if (aread < 0)
+    k = 0;
+  if (k >= idx->nent)
+    { *offset = idx->fsize;
+      *count  = idx->novl;
+    }
+  else
+    { *offset = idx->offset[k];
+      *count  = idx->count[k];
+    }
+}
+
+  //  Read len bytes at offset off of the packed .las of reader 'in' into data, returning
+  //    non-zero if they are not all there
+
+static int pack_pread(Las_Reader *in, void *data, int64 len, int64 off)
+{ Pack_Reader *p = (Pack_Reader *) in->pack;
+
+  if (p->image != NULL)
+    { if (off < 0 || off + len > p->size)
+        return (1);
+      memcpy(data,p->image + off,len);
+      return (0);
+    }
+  return (pread(fileno(in->input),data,len,off) != len);
+}
+
+Las_Index *Las_Block_Index(Las_Reader *in, int stride)
+{ Pack_Reader *p = (Pack_Reader *) in->pack;
+  Pack_Trailer t;
+  Pack_Block  *blk;
+  Las_Index   *idx;
+  struct stat  info;
+  int64        fsize, k, b;
+
+  if (p == NULL)
+    return (NULL);
+  if (p->image != NULL)
+    fsize = p->size;
+  else if (fstat(fileno(in->input),&info) == 0 && S_ISREG(info.st_mode))
+    fsize = info.st_size;
+  else
+    return (NULL);
+
+  if (pack_pread(in,&t,sizeof(Pack_Trailer),fsize - (int64) sizeof(Pack_Trailer)))
+    return (NULL);
+  if ( ! t.sorted || t.nblock < 0 ||
+      t.footer + t.nblock * (int64) sizeof(Pack_Block) + (int64) sizeof(Pack_Trailer) != fsize)
+    return (NULL);
+
+  blk = (Pack_Block *) Malloc(sizeof(Pack_Block)*(t.nblock+1),"Allocating .las index");
+  idx = (Las_Index *) Malloc(sizeof(Las_Index),"Allocating .las index");
+  if (blk == NULL || idx == NULL)
+    EXIT(NULL);
+  if (pack_pread(in,blk,t.nblock*sizeof(Pack_Block),t.footer))
+    { free(idx);
+      free(blk);
+      return (NULL);
+    }
+
+  if (stride <= 0)
+    stride = LAS_STRIDE;
+  idx->novl   = in->novl;
+  idx->fsize  = fsize;
+  idx->stride = stride;
+  idx->nent   = (t.nblock > 0 ? t.alast/stride + 1 : 0);
+  idx->offset = (int64 *) Malloc(sizeof(int64)*(idx->nent+1),"Allocating .las index");
+  idx->count  = (int64 *) Malloc(sizeof(int64)*(idx->nent+1),"Allocating .las index");
+  if (idx->offset == NULL || idx->count == NULL)
+    EXIT(NULL);
+
+  //  Entry k is the last block whose first a-read is less than k*stride (or the first block),
+  //    as its LAs may include some of a-read k*stride
+
+  b = 0;
+  for (k = 0; k < idx->nent; k++)
+    { while (b+1 < t.nblock && blk[b+1].aread < k*stride)
+        b += 1;
+      idx->offset[k] = blk[b].offset;
+      idx->count[k]  = blk[b].count;
+    }
+
+  free(blk);
+  return (idx);
+}
+
+char *Las_Index_Name(char *path, char *root)
+{ return (Catenate(path,"/.",root,".las.idx")); }
+
+void Free_Las_Index(Las_Index *idx)
+{ free(idx->count);
+  free(idx->offset);
+  free(idx);
+}
@@ -0,0 +1,322 @@
+/*******************************************************************************************
+ *
+ *  .las file library (libdazzlas).  Buffered readers and writers of .las files, and the
+ *    sort, merge, concatenate, and split operations behind LAsort, LAmerge, LAcat, and
+ *    LAsplit, in a form that lets a pipeline chain them together within one process,
+ *    on files or on .las images held in memory.
+ *
+ *  Date  :  October 2026
+ *
+ ********************************************************************************************/
+
+#ifndef _LAS_MODULE
+
+#define _LAS_MODULE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "DB.h"
+#include "align.h"
+
+/*** INTERACTIVE vs BATCH version
+
+     As for the DB and align modules, routines either print an error message to stderr and
+       exit (batch), or place the message in EPLACE and return an error value, NULL for a
+       pointer or a negative number otherwise (INTERACTIVE).
+
+***/
+
+/*** RECORD VIEWS
+
+     A .las file is an int64 count of LAs and an int trace spacing, followed by the LAs.  Each
+       LA is an Overlap record minus its leading trace pointer, followed by its trace where
+       each value takes 'tbytes' bytes (1 if the spacing is not more than TRACE_XOVR, and 2
+       otherwise).  In memory a record is handled as an Overlap "view" whose trace pointer
+       lies in the LAS_PTR bytes before the record (and so is garbage), and whose trace
+       values immediately follow it.  Every buffer of records below is preceded by at least
+       LAS_PTR bytes so that the view of its first record is valid.
+
+     A packed .las starts instead with the int64 LAS_PACKED, followed by the count and spacing,
+       and its LAs are in blocks, each compressed on its own, followed by a footer locating
+       the blocks (see Open_Las_Packed_Writer).  The readers below unpack a packed .las as
+       they go, so that to their users the two kinds of file are the same.
+
+     Las_Trace_Bytes returns tbytes for trace spacing tspace.  Las_Header reads the header of
+       the .las open on 'input', returning 1 for a plain .las, 2 for a packed one, or a
+       negative number on error.
+
+***/
+
+#define LAS_PTR          ((int64) sizeof(void *))
+#define LAS_OVL          ((int64) (sizeof(Overlap) - sizeof(void *)))
+#define LAS_HEADER       ((int64) (sizeof(int64) + sizeof(int)))
+#define LAS_PACKED       (-2ll)
+#define LAS_PACK_HEADER  ((int64) (2*sizeof(int64) + sizeof(int)))
+
+#define LAS_RECORD(o)   (((char *) (o)) + LAS_PTR)                  //  First byte of record
+#define LAS_TRACE(o)    ((void *) ((o)+1))                          //  Trace of record
+#define LAS_SPAN(o,tb)  (LAS_OVL + ((int64) (o)->path.tlen)*(tb))   //  Bytes in record
+
+int Las_Trace_Bytes(int tspace);
+int Las_Header(FILE *input, int64 *novl, int *tspace);
+
+/*** READERS
+
+     Open_Las_Reader reads the header of the .las file open on 'input' and returns a reader
+       that buffers the file in blocks of 'bsize' bytes (a buffer is enlarged should a single
+       LA not fit).  Open_Las_Memory returns a reader of the complete .las image at 'data'
+       of 'size' bytes.  The image must remain in place while the reader is in use.
+       Open_Las_Segment_Reader returns a reader of 'novl' LAs of spacing 'tspace' that
+       start at the current position of 'input', i.e. of a segment of a .las file.
+
+     Open_Las_Map maps all of the .las file open on 'input' into memory and returns a reader
+       of the mapping, advised to the kernel as read sequentially (and if 'huge' is set, as
+       best backed by huge pages).  The views it returns point into the mapping, so records
+       and their traces are never copied, and they must not be modified.  It returns NULL,
+       having done nothing, if the file cannot be mapped (e.g. it is a pipe), in which case
+       a caller would use Open_Las_Reader instead.  For a memory image or mapping, the
+       remaining LAs are exactly block[ptr..top-1] of the reader, unless it is packed.
+
+     Las_Peek returns a view of the next LA or NULL if all the LAs given in the header have
+       been read.  The view remains valid until the next call to any of these routines for
+       the reader.  Las_Advance steps past the LA returned by the last Las_Peek, and Las_Next
+       is a Las_Peek followed by a Las_Advance.  Close_Las_Reader frees the reader but does
+       not close its file.
+
+     Las_Goto positions a reader at the LA at 'offset' in its file, preceded by 'count' LAs,
+       e.g. as given by an index (see INDEXES below), where for a packed .las the offset is
+       that of a block.  An offset of 0 positions the reader at the first LA.  Set_Las_Offsets
+       builds a table of the offset of every LA of an unpacked memory image or mapping,
+       after which Las_Record returns the view of the j'th LA, so that the LAs may be visited
+       in any order.  Las_Available returns how many of the next 'need' bytes of LAs are in
+       the reader's buffer once it has read (or unpacked) as far as it can to get them.
+
+     Set_Las_Read_Ahead gives a reader of a file a second buffer of the same size that is
+       filled by a background thread while the first is consumed, so that reading overlaps
+       the reader's use.  The reader takes the file over: it will have been read beyond the
+       LAs consumed when the reader is closed.  A reader of a packed .las has no read-ahead.
+
+***/
+
+typedef struct
+  { FILE  *input;   //  NULL for a reader of a memory image
+    char  *block;   //  Buffer: block[ptr..top-1] are the next bytes of the input
+    char  *ptr;
+    char  *top;
+    int64  bsize;   //  Size of block (0 for a memory image)
+    int64  novl;    //  # of LAs according to the header
+    int64  nread;   //  # of LAs stepped past so far
+    int    tspace;  //  Trace spacing and bytes per trace value
+    int    tbytes;
+    void  *ahead;   //  Read-ahead state (NULL if none)
+    int64  msize;   //  Size of the mapping of a mapped reader (0 otherwise)
+    int64 *offset;  //  offset[j] is that of the j'th LA from block (NULL if not built)
+    void  *pack;    //  Unpacking state of a reader of a packed .las (NULL if not packed)
+    void  *sort;    //  State of a reader of a sorted set (NULL if not one, see SORTING)
+  } Las_Reader;
+
+Las_Reader *Open_Las_Reader(FILE *input, int64 bsize);
+Las_Reader *Open_Las_Memory(void *data, int64 size);
+Las_Reader *Open_Las_Segment_Reader(FILE *input, int64 novl, int tspace, int64 bsize);
+Las_Reader *Open_Las_Map(FILE *input, int huge);
+
+int Set_Las_Read_Ahead(Las_Reader *in);
+
+Overlap *Las_Peek(Las_Reader *in);
+void     Las_Advance(Las_Reader *in);
+Overlap *Las_Next(Las_Reader *in);
+
+int      Las_Goto(Las_Reader *in, int64 offset, int64 count);
+int      Set_Las_Offsets(Las_Reader *in);
+Overlap *Las_Record(Las_Reader *in, int64 j);
+int64    Las_Available(Las_Reader *in, int64 need);
+
+void Close_Las_Reader(Las_Reader *in);
+
+/*** WRITERS
+
+     Open_Las_Writer writes a header claiming 'novl' LAs of spacing 'tspace' to 'output' and
+       returns a writer that buffers in blocks of 'bsize' bytes.  Las_Write appends the LA
+       viewed by 'ovl' (e.g. as returned by a reader) and returns non-zero on error.
+       Close_Las_Writer flushes the buffer and, if the number of LAs written differs from
+       that claimed, rewinds 'output' to correct the header (an error if it is not
+       seekable).  It frees the writer but does not close its file, and returns the number
+       of LAs written.  Open_Las_Segment_Writer returns a writer that writes no header, so
+       that LAs can be written to a segment of a .las file.
+
+     Open_Las_Packed_Writer is as Open_Las_Writer, but writes a packed .las, whose LAs are
+       packed in blocks of about 'bsize' bytes (at most 1MB), the a-reads, b-reads, and the
+       lengths of intervals as differences, and all of these and the trace values as
+       variable-length integers.  Each block can be unpacked on its own, and the footer
+       gives the offset, first a-read, and LA count of every block, so that a reader can go
+       straight to a block.  Such a writer cannot write behind or build an index (the footer
+       serves as one).
+
+     Set_Las_Write_Behind gives a writer a second buffer, so that while one is written by a
+       background thread the writer fills the other.
+
+***/
+
+typedef struct
+  { FILE  *output;
+    char  *block;   //  Buffer: block[0..ptr-1] are yet to be written
+    char  *ptr;
+    char  *top;
+    int64  novl;    //  # of LAs claimed in the header
+    int64  count;   //  # of LAs written
+    int    header;  //  A header was written (and so may need correcting)
+    int    tspace;
+    int    tbytes;
+    void  *behind;  //  Write-behind state (NULL if none)
+    void  *index;   //  Index being built (NULL if none)
+    void  *pack;    //  Packing state of a writer of a packed .las (NULL if not packed)
+  } Las_Writer;
+
+Las_Writer *Open_Las_Writer(FILE *output, int64 novl, int tspace, int64 bsize);
+Las_Writer *Open_Las_Segment_Writer(FILE *output, int tspace, int64 bsize);
+Las_Writer *Open_Las_Packed_Writer(FILE *output, int64 novl, int tspace, int64 bsize);
+
+int Set_Las_Write_Behind(Las_Writer *out);
+
+int   Las_Write(Las_Writer *out, Overlap *ovl);
+int64 Close_Las_Writer(Las_Writer *out);
+
+/*** SORTING
+
+     Read_Las_Set reads all of the .las file open on 'input' into memory, unpacking the blocks
+       of a packed .las in parallel.  If the LAs take more than 'budget' bytes (and budget > 0)
+       it is an error.  Sort_Las_Set sorts the LAs by
+       (aread,bread,COMP,abpos,aepos,bbpos,bepos,diffs), or if 'map_order' is set by
+       (aread,abpos,bread,COMP,aepos,bbpos,bepos,diffs), keeping LAs in their input order
+       when equal.  The sort is split over 'nthreads' threads.  A chain of LAs (see
+       CHAIN_START in align.h) is sorted as a unit on its first LA.  Write_Las_Set writes
+       the sorted LAs to 'out', dropping any LA identical in its read pair, orientation and
+       intervals to the one preceding it, and returns the number of LAs written.
+
+     Read_Las_Chunk reads the next LAs of reader 'in' into a set, stopping before the first
+       sort unit that would take the LAs, plus the working storage Sort_Las_Set needs for
+       them, over 'budget' bytes (it always reads at least one unit).  If 'chains' is set the
+       LAs are in chains (i.e. the first LA of the file is a CHAIN_START), and the chunk
+       always ends at the end of a chain.  Successive chunks, sorted and written, are the
+       runs of an external sort that Merge_Las_Runs below completes.
+
+     A caller may also fill a set itself, e.g. with LAs as they are produced: block (allocated
+       with LAS_PTR bytes before it so that Free_Las_Set can free it), size, novl, tspace, and
+       tbytes, with perm NULL.  Find_Las_Units then finds its sort units as Read_Las_Chunk
+       does, and may be called again once more LAs have been added.
+
+     Open_Las_Set_Reader returns a reader of the LAs of a sorted set in their sorted order,
+       less those Write_Las_Set would drop, so that a set can be merged with other runs or
+       files (see Merge_Las and Merge_Las_Runs) without first being written out.  Its views
+       point into the set, which must remain as it is while the reader is in use.  Such a
+       reader cannot Las_Goto, Set_Las_Offsets, or read ahead.
+
+***/
+
+typedef struct
+  { char     *block;  //  The LAs in .las format, preceded by LAS_PTR bytes
+    int64     size;   //  # of bytes in block
+    int64     novl;   //  # of LAs in block
+    int       tspace;
+    int       tbytes;
+    int64     nsort;  //  # of sort units (LAs or chains) ...
+    Overlap **perm;   //    and their views, in sorted order after Sort_Las_Set
+  } Las_Set;
+
+Las_Set *Read_Las_Set(FILE *input, int64 budget);
+Las_Set *Read_Las_Chunk(Las_Reader *in, int64 budget, int chains);
+int      Find_Las_Units(Las_Set *set, int chains);
+
+int   Sort_Las_Set(Las_Set *set, int map_order, int nthreads);
+int64 Write_Las_Set(Las_Set *set, Las_Writer *out);
+
+Las_Reader *Open_Las_Set_Reader(Las_Set *set);
+
+void Free_Las_Set(Las_Set *set);
+
+/*** MERGING, CONCATENATING, AND SPLITTING
+
+     Merge_Las merges the sorted LAs of the 'nin' readers in[0..nin-1] into 'out', where
+       'map_order' is as for Sort_Las_Set.  As LAmerge always has, it orders LAs only on their
+       leading fields up to and including abpos, taking LAs from the earlier reader first,
+       and keeps chains together.  It returns the number of LAs written.
+
+     Merge_Las_Runs merges runs written by Write_Las_Set, where in[i] holds LAs that came
+       before those of in[i+1] in the unsorted input.  LAs are ordered on all of the fields
+       Sort_Las_Set uses, and duplicates are dropped as by Write_Las_Set, so that the result
+       is exactly that of sorting the concatenated input in memory.
+
+     Cat_Las copies the remaining LAs of 'in' to 'out' and returns the number copied.
+
+     Split_Las copies LAs from 'in' to 'out' until the next LA's a-read is 'alimit' or more if
+       alimit >= 0, or otherwise until at least 'nmin' LAs have been copied and the next LA's
+       a-read is greater than that of the last LA copied (or than 0 if none were).  It
+       returns the number of LAs copied.
+
+***/
+
+int64 Merge_Las(Las_Reader **in, int nin, Las_Writer *out, int map_order);
+int64 Merge_Las_Runs(Las_Reader **in, int nin, Las_Writer *out, int map_order);
+
+int64 Cat_Las(Las_Reader *in, Las_Writer *out);
+
+int64 Split_Las(Las_Reader *in, Las_Writer *out, int64 nmin, int alimit);
+
+/*** INDEXES
+
+     A .las file sorted on a-read may have a sidecar index, .<root>.las.idx in the same
+       directory, of the file offset and number of LAs before the first LA whose a-read is
+       k*stride or more, for every k up to the last a-read.  A reader wanting the LAs of a
+       range of a-reads seeks straight to its entry, rather than reading through the file.
+       The index records the LA count, size, and modification time of the .las it was built
+       for, and Read_Las_Index returns NULL should it be missing or not match 'novl' and the
+       stat 'las' of the .las, so a .las rewritten since its index was built (e.g. by dumpLA
+       or LAcat) is simply read from the start.  Write_Las_Index records these from 'las',
+       which must therefore be taken once the .las is complete and flushed.
+
+     Set_Las_Index has writer 'out' build an index of the LAs it writes from here on, given
+       that 'count' LAs taking 'offset' bytes, header included, precede them in the file.
+       Las_Writer_Index returns it and must be called before the writer is closed; it is
+       NULL if the LAs written were not sorted on a-read.  Join_Las_Index joins the indices
+       of 'npart' consecutive segments of a file, each built by a segment writer told of the
+       segments before it.  Build_Las_Index indexes the remaining LAs of reader 'in', which
+       must be at the start of its file, returning NULL if they are not sorted.
+
+     Las_Block_Index returns an index of a packed .las built from its footer, or NULL if 'in'
+       is not packed or the LAs are not sorted.  Its entries are the blocks that can hold
+       the first LA of each stride.
+
+     Las_Index_Seek gives the offset and count of LAs before the first LA of the file that
+       can have an a-read of 'aread' or more.  Las_Index_Name returns the name of the index
+       of <path>/<root>.las in a Catenate buffer.
+
+***/
+
+#define LAS_STRIDE  16    //  Default stride of an index
+
+typedef struct
+  { int64  novl;     //  # of LAs in the .las indexed
+    int64  fsize;    //  # of bytes in the .las indexed
+    int64  mtime;    //  Modification time of the .las indexed (in ns, set on writing)
+    int    stride;   //  Entry k is for a-read k*stride
+    int64  nent;     //  # of entries
+    int64 *offset;   //  File offset of the first LA of entry k ...
+    int64 *count;    //    and the number of LAs before it
+  } Las_Index;
+
+int        Set_Las_Index(Las_Writer *out, int stride, int64 offset, int64 count);
+Las_Index *Las_Writer_Index(Las_Writer *out);
+Las_Index *Join_Las_Index(Las_Index **part, int npart);
+Las_Index *Build_Las_Index(Las_Reader *in, int stride);
+Las_Index *Las_Block_Index(Las_Reader *in, int stride);
+
+int        Write_Las_Index(Las_Index *idx, char *name, struct stat *las);
+Las_Index *Read_Las_Index(char *name, int64 novl, struct stat *las);
+
+void  Las_Index_Seek(Las_Index *idx, int aread, int64 *offset, int64 *count);
+char *Las_Index_Name(char *path, char *root);
+
+void Free_Las_Index(Las_Index *idx);
+
+#endif // _LAS_MODULE
@@ -26,9 +26,6 @@ typedef long long     int64;
 
 #undef TEST_LSORT
 
-static int    RSIZE;    //  Span between records
-static int    DSIZE;    //  Size of record
-
 static int    NTHREADS;       //  # of threads to use
 static int    VERBOSE;        //  Print each byte as it is sorted
 
@@ -37,22 +34,28 @@ void Set_LSD_Params(int nthread, int verbose)
   VERBOSE  = verbose;
 }
 
-//  Global variables for every "lex_thread"
+//  State of a sort shared by each of its "lex_thread"s (kept per call so that sorts may
+//    proceed in several threads at once)
 
-static int      LEX_byte;   //  Current byte to sort on
-static int      LEX_next;   //  Next byte to sort on (if >= 0)
-static int64    LEX_zdiv;   //  Size of thread segments (in bytes)
-static uint8   *LEX_src;    //  Source data goes to ...
-static uint8   *LEX_trg;    //  Target data
+typedef struct
+  { int      rsize;   //  Span between records
+    int      dsize;   //  Size of record
+    int      byte;    //  Current byte to sort on
+    int      next;    //  Next byte to sort on (if >= 0)
+    int64    zdiv;    //  Size of thread segments (in bytes)
+    uint8   *src;     //  Source data goes to ...
+    uint8   *trg;     //  Target data
+  } Lex_Sort;
 
 //  Thread control record
 
 typedef struct
-  { int64  beg;           //  Sort [beg,end) of LEX_src
+  { Lex_Sort *lex;        //  Sort the pass is a part of
+    int64  beg;           //  Sort [beg,end) of lex->src
     int64  end;
     int    check[256];    //  Not all of bucket will go to the same thread in the next cycle?
     int    next[256];     //  Thread assignment for next cycle (updated if check true)
-    int64  thresh[256];   //  If check then multiple of LEX_zdiv to check for thread assignment
+    int64  thresh[256];   //  If check then multiple of lex->zdiv to check for thread assignment
     int64  tptr[256];     //  Finger for each 8-bit value
     int64 *sptr;          //  Conceptually [256][NTHREADS].  At end of sorting pass
   } Lex_Arg;              //    sprtr[b][n] = # of occurences of value b in rangd of
@@ -61,35 +64,38 @@ typedef struct
 //  Threaded sorting pass
 
 static void *lex_thread(void *arg)
-{ Lex_Arg *data   = (Lex_Arg *) arg;
-  int64   *sptr   = data->sptr;
-  int64   *tptr   = data->tptr;
-  uint8   *src    = LEX_src;
-  uint8   *dig    = LEX_src + LEX_byte;
-  uint8   *nig    = LEX_src + LEX_next;
-  uint8   *trg    = LEX_trg;
-  int64    zdiv   = LEX_zdiv;
-  int     *check  = data->check;
-  int     *next   = data->next;
-  int64   *thresh = data->thresh;
+{ Lex_Arg  *data   = (Lex_Arg *) arg;
+  Lex_Sort *lex    = data->lex;
+  int64    *sptr   = data->sptr;
+  int64    *tptr   = data->tptr;
+  uint8    *src    = lex->src;
+  uint8    *dig    = lex->src + lex->byte;
+  uint8    *nig    = lex->src + lex->next;
+  uint8    *trg    = lex->trg;
+  int64     zdiv   = lex->zdiv;
+  int       rsize  = lex->rsize;
+  int       dsize  = lex->dsize;
+  int      *check  = data->check;
+  int      *next   = data->next;
+  int64    *thresh = data->thresh;
 
   int64       i, n, x;
   uint8       d;
 
   n = data->end;
-  if (LEX_next < 0)
-    for (i = data->beg; i < n; i += RSIZE)
+  if (lex->next < 0)
+    for (i = data->beg; i < n; i += rsize)
       { d = dig[i];
         x = tptr[d];
-        tptr[d] += RSIZE;
-        memcpy(trg+x,src+i,DSIZE);
+        tptr[d] += rsize;
+        memcpy(trg+x,src+i,dsize);
       }
   else
-    for (i = data->beg; i < n; i += RSIZE)
+    for (i = data->beg; i < n; i += rsize)
       { d = dig[i];
         x = tptr[d];
-        tptr[d] += RSIZE;
-        memcpy(trg+x,src+i,DSIZE);
+        tptr[d] += rsize;
+        memcpy(trg+x,src+i,dsize);
         if (check[d])
           { if (x >= thresh[d])
               { next[d]   += 0x100;
@@ -106,12 +112,13 @@ static void *lex_thread(void *arg)
 static void *lexbeg_thread(void *arg)
 { Lex_Arg    *data  = (Lex_Arg *) arg;
   int64      *tptr  = data->tptr;
-  uint8      *dig   = LEX_src + LEX_byte;
+  uint8      *dig   = data->lex->src + data->lex->byte;
+  int         rsize = data->lex->rsize;
 
   int64       i, n;
 
   n = data->end;
-  for (i = data->beg; i < n; i += RSIZE)
+  for (i = data->beg; i < n; i += rsize)
     tptr[dig[i]] += 1;
   return (NULL);
 }
@@ -119,67 +126,77 @@ static void *lexbeg_thread(void *arg)
 //  Radix sort the indicated "bytes" of src, using array trg as the secondary array
 //    The arrays contains len elements each of "size" bytes.
 //    Return a pointer to the array containing the final result.
+//    LSD_Sort_R sorts with 'nthreads' threads, printing each byte as it is sorted if
+//    'verbose' is set, and is safe to call from several threads at once.  LSD_Sort is
+//    LSD_Sort_R with the parameters last given to Set_LSD_Params.
 
 void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *bytes)
-{ pthread_t threads[NTHREADS];
-  Lex_Arg   parmx[NTHREADS];   //  Thread control record for sorting
+{ return (LSD_Sort_R(nelem,src,trg,rsize,dsize,bytes,NTHREADS,VERBOSE)); }
+
+void *LSD_Sort_R(int64 nelem, void *src, void *trg, int rsize, int dsize, int *bytes,
+                 int nthreads, int verbose)
+{ pthread_t threads[nthreads];
+  Lex_Arg   parmx[nthreads];   //  Thread control record for sorting
+  Lex_Sort  lex;
 
   uint8   *xch;
   int64    x, y, asize;
   int      i, j, z, b;
 
   asize = nelem*rsize;
-  RSIZE = rsize;
-  DSIZE = dsize;
+  lex.rsize = rsize;
+  lex.dsize = dsize;
 
-  LEX_zdiv = ((nelem-1)/NTHREADS + 1)*RSIZE;
-  LEX_src  = (uint8 *) src;
-  LEX_trg  = (uint8 *) trg;
+  lex.zdiv = ((nelem-1)/nthreads + 1)*rsize;
+  lex.src  = (uint8 *) src;
+  lex.trg  = (uint8 *) trg;
 
-  for (i = 0; i < NTHREADS; i++)
-    parmx[i].sptr = (int64 *) alloca(NTHREADS*256*sizeof(int64));
+  for (i = 0; i < nthreads; i++)
+    { parmx[i].lex  = &lex;
+      parmx[i].sptr = (int64 *) alloca(nthreads*256*sizeof(int64));
+    }
 
   //  For each requested byte b in order, radix sort
 
   for (b = 0; bytes[b] >= 0; b++)
-    { LEX_byte  = bytes[b];
-      LEX_next  = bytes[b+1];
+    { lex.byte  = bytes[b];
+      lex.next  = bytes[b+1];
 
-      if (VERBOSE)
-        { printf("     Sorting byte %d\n",LEX_byte);
+      if (verbose)
+        { printf("     Sorting byte %d\n",lex.byte);
           fflush(stdout);
         }
 
       //  Setup beg, end, and zero tptr counters
 
       x = 0;
-      for (i = 0; i < NTHREADS; i++)
+      for (i = 0; i < nthreads; i++)
         { parmx[i].beg = x;
-          x = LEX_zdiv*(i+1);
+          x = lex.zdiv*(i+1);
           if (x > asize)
             x = asize;
           parmx[i].end = x;
           for (j = 0; j < 256; j++)
             parmx[i].tptr[j] = 0;
         }
-      parmx[NTHREADS-1].end = asize;
+      parmx[nthreads-1].end = asize;
 
       //  If first pass, then explicitly sweep to get tptr counts
       //    otherwise accumulate from sptr counts of last sweep
 
       if (b == 0)
-        { for (i = 1; i < NTHREADS; i++)
+        { for (i = 1; i < nthreads; i++)
             pthread_create(threads+i,NULL,lexbeg_thread,parmx+i);
           lexbeg_thread(parmx);
-          for (i = 1; i < NTHREADS; i++)
+          for (i = 1; i < nthreads; i++)
             pthread_join(threads[i],NULL);
         }
       else
         { int64 *pxt, *pxs;
 
-          for (i = 0; i < NTHREADS; i++)
+          for (i = 0; i < nthreads; i++)
             { pxt = parmx[i].tptr;
-              for (z = 0; z < NTHREADS; z++)
+              for (z = 0; z < nthreads; z++)
                 { pxs = parmx[z].sptr + (i<<8);
                   for (j = 0; j < 256; j++)
                     pxt[j] += pxs[j];
@@ -189,8 +206,8 @@ void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *byt
 
       //   Zero sptr array counters in preparation of pass
 
-      for (i = 0; i < NTHREADS; i++)
-        for (z = (NTHREADS<<8)-1; z >= 0; z--)
+      for (i = 0; i < nthreads; i++)
+        for (z = (nthreads<<8)-1; z >= 0; z--)
           parmx[i].sptr[z] = 0;
 
       //  Convert tptr from counts to fingers, and determine thead assignment arrays
@@ -199,12 +216,12 @@ void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *byt
       { int64 thr;
         int   nxt;
 
-        thr = LEX_zdiv;
+        thr = lex.zdiv;
         nxt = 0;
         x = 0;
         for (j = 0; j < 256; j++)
-          for (i = 0; i < NTHREADS; i++)
-            { y = parmx[i].tptr[j]*RSIZE;
+          for (i = 0; i < nthreads; i++)
+            { y = parmx[i].tptr[j]*rsize;
               parmx[i].tptr[j] = x;
               x += y;
               parmx[i].next[j] = nxt;
@@ -214,7 +231,7 @@ void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *byt
                 { parmx[i].check[j]  = 1;
                   parmx[i].thresh[j] = thr;
                   while (x >= thr)
-                    { thr += LEX_zdiv;
+                    { thr += lex.zdiv;
                       nxt += 0x100;
                     }
                 }
@@ -223,39 +240,39 @@ void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *byt
 
       //  Threaded pass
 
-      for (i = 1; i < NTHREADS; i++)
+      for (i = 1; i < nthreads; i++)
         pthread_create(threads+i,NULL,lex_thread,parmx+i);
       lex_thread(parmx);
-      for (i = 1; i < NTHREADS; i++)
+      for (i = 1; i < nthreads; i++)
         pthread_join(threads[i],NULL);
 
-      xch     = LEX_src;
-      LEX_src = LEX_trg;
-      LEX_trg = xch;
+      xch     = lex.src;
+      lex.src = lex.trg;
+      lex.trg = xch;
 
 #ifdef TEST_LSORT
       { int64  c;
-        uint8 *psort = LEX_src-RSIZE;
+        uint8 *psort = lex.src-rsize;
 
-        printf("\nLSORT %d\n",LEX_byte);
-        for (c = 0; c < 1000*RSIZE; c += RSIZE)
-          { printf(" %4lld: ",c/RSIZE);
-            for (j = 0; j < DSIZE; j++)
-              printf(" %02x",LEX_src[c+j]);
+        printf("\nLSORT %d\n",lex.byte);
+        for (c = 0; c < 1000*rsize; c += rsize)
+          { printf(" %4lld: ",c/rsize);
+            for (j = 0; j < dsize; j++)
+              printf(" %02x",lex.src[c+j]);
             printf("\n");
           }
 
-        for (c = RSIZE; c < asize; c += RSIZE)
-          { for (j = LEX_byte; j >= 2; j--)
-              if (LEX_src[c+j] > psort[c+j])
+        for (c = rsize; c < asize; c += rsize)
+          { for (j = lex.byte; j >= 2; j--)
+              if (lex.src[c+j] > psort[c+j])
                 break;
-              else if (LEX_src[c+j] < psort[c+j])
-                { printf("  Order: %lld",c/RSIZE);
-                  for (x = 2; x <= LEX_byte; x++)
+              else if (lex.src[c+j] < psort[c+j])
+                { printf("  Order: %lld",c/rsize);
+                  for (x = 2; x <= lex.byte; x++)
                     printf(" %02x",psort[c+x]);
                   printf(" vs");
-                  for (x = 2; x <= LEX_byte; x++)
-                    printf(" %02x",LEX_src[c+x]);
+                  for (x = 2; x <= lex.byte; x++)
+                    printf(" %02x",lex.src[c+x]);
                   printf("\n");
                   break;
                 }
@@ -264,5 +281,5 @@ void *LSD_Sort(int64 nelem, void *src, void *trg, int rsize, int dsize, int *byt
 #endif
     }
 
-  return ((void *) LEX_src);
+  return ((void *) lex.src);
 }
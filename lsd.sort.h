@@ -5,4 +5,7 @@ void Set_LSD_Params(int nthread, int verbose);
 
 void *LSD_Sort(long long len, void *src, void *trg, int rsize, int dsize, int *bytes);
 
+void *LSD_Sort_R(long long len, void *src, void *trg, int rsize, int dsize, int *bytes,
+                 int nthreads, int verbose);
+
 #endif // LSD_SORT